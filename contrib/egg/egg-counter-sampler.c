@@ -0,0 +1,346 @@
+/* egg-counter-sampler.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "egg-counter-sampler.h"
+
+/**
+ * SECTION:egg-counter-sampler
+ * @title: EggCounterSampler
+ * @short_description: Records the counters of an arena over time
+ *
+ * #EggCounterSampler reads every counter of an #EggCounterArena, either
+ * when egg_counter_sampler_sample() is called or at a fixed interval with
+ * egg_counter_sampler_start(). Samples are kept in a fixed size ring, so
+ * only the most recent samples are retained.
+ *
+ * The set of counters is captured when the sampler is created. Counters
+ * registered afterwards are not sampled.
+ */
+
+struct _EggCounterSampler
+{
+  volatile gint    ref_count;
+  EggCounterArena *arena;
+  GPtrArray       *counters;
+  /* times[max_samples], values[max_samples * counters->len] */
+  gint64          *times;
+  gint64          *values;
+  guint            max_samples;
+  guint            head;
+  guint            n_samples;
+  GSource         *source;
+};
+
+G_DEFINE_BOXED_TYPE (EggCounterSampler, egg_counter_sampler,
+                     egg_counter_sampler_ref, egg_counter_sampler_unref)
+
+static void
+add_counter_cb (EggCounter *counter,
+                gpointer    user_data)
+{
+  GPtrArray *counters = user_data;
+
+  g_ptr_array_add (counters, counter);
+}
+
+/**
+ * egg_counter_sampler_new:
+ * @arena: an #EggCounterArena
+ * @max_samples: the number of samples to retain
+ *
+ * Returns: (transfer full): a new #EggCounterSampler.
+ */
+EggCounterSampler *
+egg_counter_sampler_new (EggCounterArena *arena,
+                         guint            max_samples)
+{
+  EggCounterSampler *self;
+
+  g_return_val_if_fail (arena != NULL, NULL);
+  g_return_val_if_fail (max_samples > 0, NULL);
+
+  self = g_slice_new0 (EggCounterSampler);
+  self->ref_count = 1;
+  self->arena = egg_counter_arena_ref (arena);
+  self->counters = g_ptr_array_new ();
+  self->max_samples = max_samples;
+
+  egg_counter_arena_foreach (arena, add_counter_cb, self->counters);
+
+  self->times = g_new0 (gint64, max_samples);
+  self->values = g_new0 (gint64, (gsize)max_samples * MAX (1, self->counters->len));
+
+  return self;
+}
+
+EggCounterSampler *
+egg_counter_sampler_ref (EggCounterSampler *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+egg_counter_sampler_unref (EggCounterSampler *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      egg_counter_sampler_stop (self);
+      g_clear_pointer (&self->counters, g_ptr_array_unref);
+      g_clear_pointer (&self->arena, egg_counter_arena_unref);
+      g_free (self->times);
+      g_free (self->values);
+      g_slice_free (EggCounterSampler, self);
+    }
+}
+
+static inline guint
+egg_counter_sampler_get_index (EggCounterSampler *self,
+                               guint              sample)
+{
+  return (self->head + self->max_samples - self->n_samples + sample) % self->max_samples;
+}
+
+/**
+ * egg_counter_sampler_sample:
+ * @self: an #EggCounterSampler
+ *
+ * Reads every counter now and appends the values as a new sample,
+ * discarding the oldest sample if the ring is full.
+ */
+void
+egg_counter_sampler_sample (EggCounterSampler *self)
+{
+  gint64 *row;
+
+  g_return_if_fail (self != NULL);
+
+  self->times[self->head] = g_get_monotonic_time ();
+
+  row = &self->values[(gsize)self->head * self->counters->len];
+  for (guint i = 0; i < self->counters->len; i++)
+    row[i] = egg_counter_get (g_ptr_array_index (self->counters, i));
+
+  self->head = (self->head + 1) % self->max_samples;
+  self->n_samples = MIN (self->n_samples + 1, self->max_samples);
+}
+
+static gboolean
+egg_counter_sampler_timeout (gpointer data)
+{
+  egg_counter_sampler_sample (data);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * egg_counter_sampler_start:
+ * @self: an #EggCounterSampler
+ * @interval_msec: the number of milliseconds between samples
+ *
+ * Takes a sample immediately, and then every @interval_msec from the
+ * thread-default main context.
+ */
+void
+egg_counter_sampler_start (EggCounterSampler *self,
+                           guint              interval_msec)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (interval_msec > 0);
+
+  egg_counter_sampler_stop (self);
+  egg_counter_sampler_sample (self);
+
+  self->source = g_timeout_source_new (interval_msec);
+  g_source_set_name (self->source, "[egg] EggCounterSampler");
+  g_source_set_callback (self->source, egg_counter_sampler_timeout, self, NULL);
+  g_source_attach (self->source, g_main_context_get_thread_default ());
+}
+
+void
+egg_counter_sampler_stop (EggCounterSampler *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->source != NULL)
+    {
+      g_source_destroy (self->source);
+      g_clear_pointer (&self->source, g_source_unref);
+    }
+}
+
+guint
+egg_counter_sampler_get_n_counters (EggCounterSampler *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->counters->len;
+}
+
+guint
+egg_counter_sampler_get_n_samples (EggCounterSampler *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->n_samples;
+}
+
+/**
+ * egg_counter_sampler_get_counter:
+ *
+ * Returns: (transfer none): the counter at index @counter.
+ */
+EggCounter *
+egg_counter_sampler_get_counter (EggCounterSampler *self,
+                                 guint              counter)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (counter < self->counters->len, NULL);
+
+  return g_ptr_array_index (self->counters, counter);
+}
+
+/**
+ * egg_counter_sampler_get_time:
+ * @self: an #EggCounterSampler
+ * @sample: the sample index, 0 being the oldest retained sample
+ *
+ * Returns: the monotonic time, in microseconds, at which @sample was taken.
+ */
+gint64
+egg_counter_sampler_get_time (EggCounterSampler *self,
+                              guint              sample)
+{
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (sample < self->n_samples, 0);
+
+  return self->times[egg_counter_sampler_get_index (self, sample)];
+}
+
+gint64
+egg_counter_sampler_get_value (EggCounterSampler *self,
+                               guint              counter,
+                               guint              sample)
+{
+  guint index;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (counter < self->counters->len, 0);
+  g_return_val_if_fail (sample < self->n_samples, 0);
+
+  index = egg_counter_sampler_get_index (self, sample);
+
+  return self->values[(gsize)index * self->counters->len + counter];
+}
+
+/**
+ * egg_counter_sampler_get_delta:
+ *
+ * Returns: how much @counter changed since the previous sample. The oldest
+ *   retained sample always has a delta of 0.
+ */
+gint64
+egg_counter_sampler_get_delta (EggCounterSampler *self,
+                               guint              counter,
+                               guint              sample)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  if (sample == 0 || sample >= self->n_samples)
+    return 0;
+
+  return egg_counter_sampler_get_value (self, counter, sample) -
+         egg_counter_sampler_get_value (self, counter, sample - 1);
+}
+
+/**
+ * egg_counter_sampler_get_rate:
+ *
+ * Returns: the change of @counter per second between the previous sample
+ *   and @sample.
+ */
+gdouble
+egg_counter_sampler_get_rate (EggCounterSampler *self,
+                              guint              counter,
+                              guint              sample)
+{
+  gint64 elapsed;
+
+  g_return_val_if_fail (self != NULL, 0.0);
+
+  if (sample == 0 || sample >= self->n_samples)
+    return 0.0;
+
+  elapsed = egg_counter_sampler_get_time (self, sample) -
+            egg_counter_sampler_get_time (self, sample - 1);
+
+  if (elapsed <= 0)
+    return 0.0;
+
+  return egg_counter_sampler_get_delta (self, counter, sample) * (gdouble)G_USEC_PER_SEC / elapsed;
+}
+
+/**
+ * egg_counter_sampler_to_csv:
+ * @self: an #EggCounterSampler
+ *
+ * Formats the retained samples as CSV, with one row per counter and sample.
+ * The columns are the monotonic time in microseconds, the counter category
+ * and name, its value, and its delta and rate since the previous sample.
+ *
+ * Returns: (transfer full): a newly allocated string.
+ */
+gchar *
+egg_counter_sampler_to_csv (EggCounterSampler *self)
+{
+  GString *str;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  str = g_string_new ("time_usec,category,name,value,delta,rate\n");
+
+  for (guint i = 0; i < self->n_samples; i++)
+    {
+      gint64 time = egg_counter_sampler_get_time (self, i);
+
+      for (guint j = 0; j < self->counters->len; j++)
+        {
+          EggCounter *counter = g_ptr_array_index (self->counters, j);
+          gchar rate[G_ASCII_DTOSTR_BUF_SIZE];
+
+          g_ascii_formatd (rate, sizeof rate, "%.3f", egg_counter_sampler_get_rate (self, j, i));
+          g_string_append_printf (str,
+                                  "%"G_GINT64_FORMAT",\"%s\",\"%s\",%"G_GINT64_FORMAT",%"G_GINT64_FORMAT",%s\n",
+                                  time,
+                                  counter->category,
+                                  counter->name,
+                                  egg_counter_sampler_get_value (self, j, i),
+                                  egg_counter_sampler_get_delta (self, j, i),
+                                  rate);
+        }
+    }
+
+  return g_string_free (str, FALSE);
+}
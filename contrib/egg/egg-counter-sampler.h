@@ -0,0 +1,60 @@
+/* egg-counter-sampler.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EGG_COUNTER_SAMPLER_H
+#define EGG_COUNTER_SAMPLER_H
+
+#include "egg-counter.h"
+
+G_BEGIN_DECLS
+
+#define EGG_TYPE_COUNTER_SAMPLER (egg_counter_sampler_get_type())
+
+typedef struct _EggCounterSampler EggCounterSampler;
+
+GType              egg_counter_sampler_get_type       (void);
+EggCounterSampler *egg_counter_sampler_new            (EggCounterArena   *arena,
+                                                       guint              max_samples);
+EggCounterSampler *egg_counter_sampler_ref            (EggCounterSampler *self);
+void               egg_counter_sampler_unref          (EggCounterSampler *self);
+void               egg_counter_sampler_sample         (EggCounterSampler *self);
+void               egg_counter_sampler_start          (EggCounterSampler *self,
+                                                       guint              interval_msec);
+void               egg_counter_sampler_stop           (EggCounterSampler *self);
+guint              egg_counter_sampler_get_n_counters (EggCounterSampler *self);
+guint              egg_counter_sampler_get_n_samples  (EggCounterSampler *self);
+EggCounter        *egg_counter_sampler_get_counter    (EggCounterSampler *self,
+                                                       guint              counter);
+gint64             egg_counter_sampler_get_time       (EggCounterSampler *self,
+                                                       guint              sample);
+gint64             egg_counter_sampler_get_value      (EggCounterSampler *self,
+                                                       guint              counter,
+                                                       guint              sample);
+gint64             egg_counter_sampler_get_delta      (EggCounterSampler *self,
+                                                       guint              counter,
+                                                       guint              sample);
+gdouble            egg_counter_sampler_get_rate       (EggCounterSampler *self,
+                                                       guint              counter,
+                                                       guint              sample);
+gchar             *egg_counter_sampler_to_csv         (EggCounterSampler *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EggCounterSampler, egg_counter_sampler_unref)
+
+G_END_DECLS
+
+#endif /* EGG_COUNTER_SAMPLER_H */
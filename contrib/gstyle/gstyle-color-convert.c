@@ -663,6 +663,361 @@ gstyle_color_convert_cielab_to_rgb (GstyleCielab *lab,
   gstyle_color_convert_srgb_to_rgb (srgb_red, srgb_green, srgb_blue, rgba);
 }
 
+/**
+ * gstyle_color_convert_hsv_to_rgb_batch: (skip)
+ * @hue: the hue components, in range [0.0-1.0]
+ * @saturation: the saturation components, in range [0.0-1.0]
+ * @value: the value components, in range [0.0-1.0]
+ * @red: (out): the red components
+ * @green: (out): the green components
+ * @blue: (out): the blue components
+ * @n_values: the number of colors to convert
+ *
+ * Convert @n_values HSV colors to RGB ones, like gstyle_color_convert_hsv_to_rgb()
+ * but in single precision and without branches, so that the compiler can
+ * vectorize the loop.
+ *
+ */
+void
+gstyle_color_convert_hsv_to_rgb_batch (const gfloat *hue,
+                                       const gfloat *saturation,
+                                       const gfloat *value,
+                                       gfloat       *red,
+                                       gfloat       *green,
+                                       gfloat       *blue,
+                                       guint         n_values)
+{
+  for (guint i = 0; i < n_values; ++i)
+    {
+      gfloat h = hue[i] * 6.0f;
+      gfloat vs = value[i] * saturation[i];
+      gfloat kr = h + 5.0f;
+      gfloat kg = h + 3.0f;
+      gfloat kb = h + 1.0f;
+
+      /* c = v - v * s * clamp (min (k, 4 - k), 0, 1) with k = (n + h) mod 6 */
+      kr = (kr >= 6.0f) ? kr - 6.0f : kr;
+      kg = (kg >= 6.0f) ? kg - 6.0f : kg;
+      kb = (kb >= 6.0f) ? kb - 6.0f : kb;
+
+      kr = CLAMP (MIN (kr, 4.0f - kr), 0.0f, 1.0f);
+      kg = CLAMP (MIN (kg, 4.0f - kg), 0.0f, 1.0f);
+      kb = CLAMP (MIN (kb, 4.0f - kb), 0.0f, 1.0f);
+
+      red[i] = value[i] - vs * kr;
+      green[i] = value[i] - vs * kg;
+      blue[i] = value[i] - vs * kb;
+    }
+}
+
+/*
+ * Lookup tables used by the batch conversions.
+ *
+ * The sRGB companding curves and the CIELAB f(t) function are sampled at
+ * regular intervals and linearly interpolated. Compared to the exact
+ * functions, the maximum errors are:
+ *
+ *   - linear to sRGB (4096 intervals): 2e-5
+ *   - sRGB to linear (1024 intervals): 5e-7
+ *   - f(t) for t in [0, 1.25] (4096 intervals): 1e-5
+ *
+ * Including the single precision arithmetic, RGB results are within 5e-5
+ * of the scalar functions, and CIELAB results within 5e-3 (the a* and b*
+ * components amplify the error of f(t) 500 and 200 times). These are well
+ * below the 1/255 step of an 8 bits channel and the 1.0 delta E a change
+ * becomes visible at. Out of range inputs of f(t) use the exact function.
+ */
+
+#define SRGB_ENCODE_LUT_SIZE 4096
+#define SRGB_DECODE_LUT_SIZE 1024
+#define LAB_F_LUT_SIZE       4096
+#define LAB_F_LUT_MAX        1.25f
+
+static gfloat srgb_encode_lut [SRGB_ENCODE_LUT_SIZE + 1];
+static gfloat srgb_decode_lut [SRGB_DECODE_LUT_SIZE + 1];
+static gfloat lab_f_lut [LAB_F_LUT_SIZE + 1];
+
+static void
+init_luts (void)
+{
+  static gsize initialized;
+
+  if (g_once_init_enter (&initialized))
+    {
+      for (guint i = 0; i <= SRGB_ENCODE_LUT_SIZE; ++i)
+        {
+          gdouble c = i / (gdouble)SRGB_ENCODE_LUT_SIZE;
+
+          srgb_encode_lut [i] = (c > 0.0031308) ? pow (c, 1.0 / 2.4) * 1.055 - 0.055 : c * 12.92;
+        }
+
+      for (guint i = 0; i <= SRGB_DECODE_LUT_SIZE; ++i)
+        {
+          gdouble c = i / (gdouble)SRGB_DECODE_LUT_SIZE;
+
+          srgb_decode_lut [i] = (c > 0.04045) ? pow ((c + 0.055) / 1.055, 2.4) : c / 12.92;
+        }
+
+      for (guint i = 0; i <= LAB_F_LUT_SIZE; ++i)
+        {
+          gdouble t = i * LAB_F_LUT_MAX / LAB_F_LUT_SIZE;
+
+          lab_f_lut [i] = (t > 0.008856) ? cbrt (t) : (t * 7.787) + _16_d_116;
+        }
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+/* @pos must be in [0, size] */
+static inline gfloat
+lut_lookup (const gfloat *lut,
+            guint         size,
+            gfloat        pos)
+{
+  guint i = MIN ((guint)pos, size - 1);
+  gfloat frac = pos - i;
+
+  return lut [i] + frac * (lut [i + 1] - lut [i]);
+}
+
+static inline gfloat
+lut_linear_to_srgb (gfloat c)
+{
+  /* Out of range values are clamped anyway */
+  c = CLAMP (c, 0.0f, 1.0f);
+
+  return lut_lookup (srgb_encode_lut, SRGB_ENCODE_LUT_SIZE, c * SRGB_ENCODE_LUT_SIZE);
+}
+
+static inline gfloat
+lut_srgb_to_linear (gfloat c)
+{
+  c = CLAMP (c, 0.0f, 1.0f);
+
+  return lut_lookup (srgb_decode_lut, SRGB_DECODE_LUT_SIZE, c * SRGB_DECODE_LUT_SIZE);
+}
+
+static inline gfloat
+lut_lab_f (gfloat t)
+{
+  if (t >= 0.0f && t < LAB_F_LUT_MAX)
+    return lut_lookup (lab_f_lut, LAB_F_LUT_SIZE, t * (LAB_F_LUT_SIZE / LAB_F_LUT_MAX));
+
+  return (t > 0.008856f) ? cbrtf (t) : (t * 7.787f) + (gfloat)_16_d_116;
+}
+
+static inline gfloat
+lab_f_inv (gfloat t)
+{
+  gfloat t3 = t * t * t;
+
+  return (t3 > 0.008856f) ? t3 : (t - (gfloat)_16_d_116) / 7.787f;
+}
+
+static inline void
+linear_to_xyz_batch (gfloat *red,
+                     gfloat *green,
+                     gfloat *blue,
+                     gfloat *x,
+                     gfloat *y,
+                     gfloat *z,
+                     guint   n_values)
+{
+  for (guint i = 0; i < n_values; ++i)
+    {
+      gfloat r = red[i];
+      gfloat g = green[i];
+      gfloat b = blue[i];
+
+      x[i] = r * 0.4124564f + g * 0.3575761f + b * 0.1804375f;
+      y[i] = r * 0.2126729f + g * 0.7151522f + b * 0.0721750f;
+      z[i] = r * 0.0193339f + g * 0.1191920f + b * 0.9503041f;
+    }
+}
+
+static inline void
+xyz_to_linear_batch (const gfloat *x,
+                     const gfloat *y,
+                     const gfloat *z,
+                     gfloat       *red,
+                     gfloat       *green,
+                     gfloat       *blue,
+                     guint         n_values)
+{
+  for (guint i = 0; i < n_values; ++i)
+    {
+      gfloat xi = x[i];
+      gfloat yi = y[i];
+      gfloat zi = z[i];
+
+      red[i]   = xi *  3.2404542f + yi * -1.5371385f + zi * -0.4985314f;
+      green[i] = xi * -0.9692660f + yi *  1.8760108f + zi *  0.0415560f;
+      blue[i]  = xi *  0.0556434f + yi * -0.2040259f + zi *  1.0572252f;
+    }
+}
+
+static inline void
+linear_to_srgb_batch (gfloat *red,
+                      gfloat *green,
+                      gfloat *blue,
+                      guint   n_values)
+{
+  for (guint i = 0; i < n_values; ++i)
+    {
+      red[i] = lut_linear_to_srgb (red[i]);
+      green[i] = lut_linear_to_srgb (green[i]);
+      blue[i] = lut_linear_to_srgb (blue[i]);
+    }
+}
+
+/**
+ * gstyle_color_convert_rgb_to_xyz_batch: (skip)
+ * @red: the red components, in range [0.0-1.0]
+ * @green: the green components, in range [0.0-1.0]
+ * @blue: the blue components, in range [0.0-1.0]
+ * @x: (out): the x components
+ * @y: (out): the y components
+ * @z: (out): the z components
+ * @n_values: the number of colors to convert
+ *
+ * Convert @n_values RGB colors to XYZ ones, like gstyle_color_convert_rgb_to_xyz()
+ * but in single precision and using lookup tables.
+ *
+ */
+void
+gstyle_color_convert_rgb_to_xyz_batch (const gfloat *red,
+                                       const gfloat *green,
+                                       const gfloat *blue,
+                                       gfloat       *x,
+                                       gfloat       *y,
+                                       gfloat       *z,
+                                       guint         n_values)
+{
+  init_luts ();
+
+  /* The outputs hold the linear values until the matrix is applied */
+  for (guint i = 0; i < n_values; ++i)
+    {
+      x[i] = lut_srgb_to_linear (red[i]);
+      y[i] = lut_srgb_to_linear (green[i]);
+      z[i] = lut_srgb_to_linear (blue[i]);
+    }
+
+  linear_to_xyz_batch (x, y, z, x, y, z, n_values);
+}
+
+/**
+ * gstyle_color_convert_xyz_to_rgb_batch: (skip)
+ * @x: the x components
+ * @y: the y components
+ * @z: the z components
+ * @red: (out): the red components
+ * @green: (out): the green components
+ * @blue: (out): the blue components
+ * @n_values: the number of colors to convert
+ *
+ * Convert @n_values XYZ colors to RGB ones, like gstyle_color_convert_xyz_to_rgb()
+ * but in single precision and using lookup tables. The RGB components are
+ * clamped to [0.0-1.0].
+ *
+ */
+void
+gstyle_color_convert_xyz_to_rgb_batch (const gfloat *x,
+                                       const gfloat *y,
+                                       const gfloat *z,
+                                       gfloat       *red,
+                                       gfloat       *green,
+                                       gfloat       *blue,
+                                       guint         n_values)
+{
+  init_luts ();
+
+  xyz_to_linear_batch (x, y, z, red, green, blue, n_values);
+  linear_to_srgb_batch (red, green, blue, n_values);
+}
+
+/**
+ * gstyle_color_convert_rgb_to_cielab_batch: (skip)
+ * @red: the red components, in range [0.0-1.0]
+ * @green: the green components, in range [0.0-1.0]
+ * @blue: the blue components, in range [0.0-1.0]
+ * @l: (out): the lightness components
+ * @a: (out): the a components
+ * @b: (out): the b components
+ * @n_values: the number of colors to convert
+ *
+ * Convert @n_values RGB colors to CIELAB ones, like gstyle_color_convert_rgb_to_cielab()
+ * but in single precision and using lookup tables.
+ *
+ */
+void
+gstyle_color_convert_rgb_to_cielab_batch (const gfloat *red,
+                                          const gfloat *green,
+                                          const gfloat *blue,
+                                          gfloat       *l,
+                                          gfloat       *a,
+                                          gfloat       *b,
+                                          guint         n_values)
+{
+  gstyle_color_convert_rgb_to_xyz_batch (red, green, blue, l, a, b, n_values);
+
+  for (guint i = 0; i < n_values; ++i)
+    {
+      gfloat fx = lut_lab_f (l[i] / (gfloat)D65_xref);
+      gfloat fy = lut_lab_f (a[i] / (gfloat)D65_yref);
+      gfloat fz = lut_lab_f (b[i] / (gfloat)D65_zref);
+
+      l[i] = fy * 116.0f - 16.0f;
+      a[i] = (fx - fy) * 500.0f;
+      b[i] = (fy - fz) * 200.0f;
+    }
+}
+
+/**
+ * gstyle_color_convert_cielab_to_rgb_batch: (skip)
+ * @l: the lightness components
+ * @a: the a components
+ * @b: the b components
+ * @red: (out): the red components
+ * @green: (out): the green components
+ * @blue: (out): the blue components
+ * @n_values: the number of colors to convert
+ *
+ * Convert @n_values CIELAB colors to RGB ones, like gstyle_color_convert_cielab_to_rgb()
+ * but in single precision and using lookup tables. The linear part of the
+ * conversion is done in a first pass the compiler can vectorize, the sRGB
+ * companding in a second one.
+ *
+ */
+void
+gstyle_color_convert_cielab_to_rgb_batch (const gfloat *l,
+                                          const gfloat *a,
+                                          const gfloat *b,
+                                          gfloat       *red,
+                                          gfloat       *green,
+                                          gfloat       *blue,
+                                          guint         n_values)
+{
+  init_luts ();
+
+  for (guint i = 0; i < n_values; ++i)
+    {
+      gfloat fy = (l[i] + 16.0f) / 116.0f;
+      gfloat fx = a[i] / 500.0f + fy;
+      gfloat fz = fy - b[i] / 200.0f;
+      gfloat x = lab_f_inv (fx) * (gfloat)D65_xref;
+      gfloat y = lab_f_inv (fy) * (gfloat)D65_yref;
+      gfloat z = lab_f_inv (fz) * (gfloat)D65_zref;
+
+      red[i]   = x *  3.2404542f + y * -1.5371385f + z * -0.4985314f;
+      green[i] = x * -0.9692660f + y *  1.8760108f + z *  0.0415560f;
+      blue[i]  = x *  0.0556434f + y * -0.2040259f + z *  1.0572252f;
+    }
+
+  linear_to_srgb_batch (red, green, blue, n_values);
+}
+
 inline void
 gstyle_color_convert_xyz_to_rgb (GstyleXYZ *xyz,
                                  GdkRGBA   *rgba)
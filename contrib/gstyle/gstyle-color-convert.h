@@ -51,6 +51,41 @@ void                  gstyle_color_convert_cielab_to_rgb    (GstyleCielab
                                                              GdkRGBA             *rgba);
 gdouble               gstyle_color_delta_e                  (GstyleCielab        *lab1,
                                                              GstyleCielab        *lab2);
+void                  gstyle_color_convert_hsv_to_rgb_batch    (const gfloat        *hue,
+                                                                const gfloat        *saturation,
+                                                                const gfloat        *value,
+                                                                gfloat              *red,
+                                                                gfloat              *green,
+                                                                gfloat              *blue,
+                                                                guint                n_values);
+void                  gstyle_color_convert_rgb_to_xyz_batch    (const gfloat        *red,
+                                                                const gfloat        *green,
+                                                                const gfloat        *blue,
+                                                                gfloat              *x,
+                                                                gfloat              *y,
+                                                                gfloat              *z,
+                                                                guint                n_values);
+void                  gstyle_color_convert_xyz_to_rgb_batch    (const gfloat        *x,
+                                                                const gfloat        *y,
+                                                                const gfloat        *z,
+                                                                gfloat              *red,
+                                                                gfloat              *green,
+                                                                gfloat              *blue,
+                                                                guint                n_values);
+void                  gstyle_color_convert_rgb_to_cielab_batch (const gfloat        *red,
+                                                                const gfloat        *green,
+                                                                const gfloat        *blue,
+                                                                gfloat              *l,
+                                                                gfloat              *a,
+                                                                gfloat              *b,
+                                                                guint                n_values);
+void                  gstyle_color_convert_cielab_to_rgb_batch (const gfloat        *l,
+                                                                const gfloat        *a,
+                                                                const gfloat        *b,
+                                                                gfloat              *red,
+                                                                gfloat              *green,
+                                                                gfloat              *blue,
+                                                                guint                n_values);
 
 void                  gstyle_color_convert_rgb_to_xyz       (GdkRGBA             *rgba,
                                                              GstyleXYZ           *xyz);
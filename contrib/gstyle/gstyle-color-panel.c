@@ -464,21 +464,24 @@ update_rgb_blue_color_ramp (GstyleColorPanel *self,
 }
 
 static void
-update_lab_l_color_ramp (GstyleColorPanel *self,
-                         GstyleColorScale *scale,
-                         GdkRGBA          *rgba)
+set_lab_color_ramp (GstyleColorScale *scale,
+                    const gfloat     *l,
+                    const gfloat     *a,
+                    const gfloat     *b)
 {
-  GstyleCielab lab;
-  GdkRGBA dst_rgba = {0};
+  gfloat red [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat green [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat blue [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
   guint32 *data;
 
+  gstyle_color_convert_cielab_to_rgb_batch (l, a, b, red, green, blue, GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE);
+
   /* TODO: malloc in init and keep data around */
-  gstyle_color_convert_rgb_to_cielab (rgba, &lab);
   data = g_malloc0 (GSTYLE_COLOR_SCALE_CUSTOM_DATA_BYTE_SIZE);
   for (gint x = 0; x < GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE; ++x)
     {
-      lab.l = x * CIELAB_L_TO_SCALE_FACTOR;
-      gstyle_color_convert_cielab_to_rgb (&lab, &dst_rgba);
+      GdkRGBA dst_rgba = { red [x], green [x], blue [x], 0.0 };
+
       data [x] = pack_rgba24 (&dst_rgba);
     }
 
@@ -486,27 +489,46 @@ update_lab_l_color_ramp (GstyleColorPanel *self,
   g_free (data);
 }
 
+static void
+update_lab_l_color_ramp (GstyleColorPanel *self,
+                         GstyleColorScale *scale,
+                         GdkRGBA          *rgba)
+{
+  gfloat l [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat a [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat b [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  GstyleCielab lab;
+
+  gstyle_color_convert_rgb_to_cielab (rgba, &lab);
+  for (gint x = 0; x < GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE; ++x)
+    {
+      l [x] = x * CIELAB_L_TO_SCALE_FACTOR;
+      a [x] = lab.a;
+      b [x] = lab.b;
+    }
+
+  set_lab_color_ramp (scale, l, a, b);
+}
+
 static void
 update_lab_a_color_ramp (GstyleColorPanel *self,
                          GstyleColorScale *scale,
                          GdkRGBA          *rgba)
 {
+  gfloat l [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat a [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat b [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
   GstyleCielab lab;
-  GdkRGBA dst_rgba = {0};
-  guint32 *data;
 
-  /* TODO: malloc in init and keep data around */
   gstyle_color_convert_rgb_to_cielab (rgba, &lab);
-  data = g_malloc0 (GSTYLE_COLOR_SCALE_CUSTOM_DATA_BYTE_SIZE);
   for (gint x = 0; x < GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE; ++x)
     {
-      lab.a = x - 128;
-      gstyle_color_convert_cielab_to_rgb (&lab, &dst_rgba);
-      data [x] = pack_rgba24 (&dst_rgba);
+      l [x] = lab.l;
+      a [x] = x - 128;
+      b [x] = lab.b;
     }
 
-  gstyle_color_scale_set_custom_data (scale, data);
-  g_free (data);
+  set_lab_color_ramp (scale, l, a, b);
 }
 
 static void
@@ -514,22 +536,20 @@ update_lab_b_color_ramp (GstyleColorPanel *self,
                          GstyleColorScale *scale,
                          GdkRGBA          *rgba)
 {
+  gfloat l [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat a [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
+  gfloat b [GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE];
   GstyleCielab lab;
-  GdkRGBA dst_rgba = {0};
-  guint32 *data;
 
-  /* TODO: malloc in init and keep data around */
   gstyle_color_convert_rgb_to_cielab (rgba, &lab);
-  data = g_malloc0 (GSTYLE_COLOR_SCALE_CUSTOM_DATA_BYTE_SIZE);
   for (gint x = 0; x < GSTYLE_COLOR_SCALE_CUSTOM_DATA_PIXEL_SIZE; ++x)
     {
-      lab.b = x - 128;
-      gstyle_color_convert_cielab_to_rgb (&lab, &dst_rgba);
-      data [x] = pack_rgba24 (&dst_rgba);
+      l [x] = lab.l;
+      a [x] = lab.a;
+      b [x] = x - 128;
     }
 
-  gstyle_color_scale_set_custom_data (scale, data);
-  g_free (data);
+  set_lab_color_ramp (scale, l, a, b);
 }
 
 static void
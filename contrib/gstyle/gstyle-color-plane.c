@@ -40,6 +40,8 @@ typedef struct _ComputeData
   gint     stride;
   guint32 *buffer;
 
+  gdouble  ref_val;
+
   gdouble  x_factor;
   gdouble  y_factor;
   gdouble  lab_x_factor;
@@ -93,6 +95,7 @@ typedef struct
   gdouble                 hue_backup;
 
   guint                   hue_backup_set : 1;
+  guint                   surface_dirty : 1;
 } GstyleColorPlanePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GstyleColorPlane, gstyle_color_plane, GTK_TYPE_DRAWING_AREA)
@@ -409,6 +412,8 @@ gstyle_color_plane_get_filter_func (GstyleColorPlane *self)
  * @user_data: (closure) (nullable): user data to pass when calling the filter function
  *
  * Set a filter to be used to change the drawing of the color plane.
+ * The plane is rendered by several threads, so @filter_cb can be called
+ * from a thread other than the main one.
  *
  */
 void
@@ -422,264 +427,253 @@ gstyle_color_plane_set_filter_func (GstyleColorPlane      *self,
 
   priv->filter = filter_cb;
   priv->filter_user_data = (filter_cb == NULL) ? NULL : user_data;
+  priv->surface_dirty = TRUE;
 
   gtk_widget_queue_draw (GTK_WIDGET (self));
 }
 
-static void
-compute_plane_hue_mode (GstyleColorPlane *self,
-                        ComputeData       data)
-{
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  gdouble hue, saturation, value;
-  GdkRGBA rgba = {0};
-  guint32 *p;
+/*
+ * The plane is rendered a row at a time: the inputs of the conversion are
+ * laid out in three float arrays (one constant, one depending on the row,
+ * one on the column) and converted in a batch, then packed into the buffer.
+ * Rows are grouped in tiles which are spread over a shared thread pool,
+ * the calling thread rendering the first one itself.
+ *
+ * Rendering is deferred to the next draw, so that several changes of the
+ * reference component during a frame only render the plane once.
+ */
 
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
+#define TILE_MIN_ROWS 32
 
-  hue = priv->comp [GSTYLE_COLOR_COMPONENT_HSV_H].val / priv->comp [GSTYLE_COLOR_COMPONENT_HSV_H].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      value = CLAMP ((data.height - y) * data.y_factor, 0.0, 1.0);
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          saturation = x * data.x_factor;
-          gstyle_color_convert_hsv_to_rgb (hue, saturation, value, &rgba);
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
-
-          p[x] = pack_rgba24 (&rgba);
-        }
-    }
-}
+typedef struct
+{
+  GMutex mutex;
+  GCond  cond;
+  gint   n_pending;
+} RenderJob;
 
-static void
-compute_plane_saturation_mode (GstyleColorPlane *self,
-                               ComputeData       data)
+typedef struct
 {
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  gdouble hue, saturation, value;
-  GdkRGBA rgba = {0};
-  guint32 *p;
+  GstyleColorPlane *self;
+  RenderJob        *job;
+  ComputeData       data;
+  gint              y_begin;
+  gint              y_end;
+} RenderTile;
+
+static GThreadPool *render_pool;
+
+static inline guint32
+pack_rgb24_float (gfloat red,
+                  gfloat green,
+                  gfloat blue)
+{
+  guint r = CLAMP (red * 255.0f, 0.0f, 255.0f);
+  guint g = CLAMP (green * 255.0f, 0.0f, 255.0f);
+  guint b = CLAMP (blue * 255.0f, 0.0f, 255.0f);
 
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
+  return (r << 16) | (g << 8) | b;
+}
 
-  saturation = priv->comp [GSTYLE_COLOR_COMPONENT_HSV_S].val / priv->comp [GSTYLE_COLOR_COMPONENT_HSV_S].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      value = CLAMP ((data.height - y) * data.y_factor, 0.0, 1.0);
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          hue = x * data.x_factor;
-          gstyle_color_convert_hsv_to_rgb (hue, saturation, value, &rgba);
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+static inline void
+fill_row (gfloat *dest,
+          gfloat  val,
+          gint    width)
+{
+  for (gint x = 0; x < width; ++x)
+    dest[x] = val;
+}
 
-          p[x] = pack_rgba24 (&rgba);
-        }
-    }
+static inline void
+fill_axis (gfloat *dest,
+           gdouble factor,
+           gdouble offset,
+           gint    width)
+{
+  for (gint x = 0; x < width; ++x)
+    dest[x] = x * factor + offset;
 }
 
 static void
-compute_plane_brightness_mode (GstyleColorPlane *self,
-                               ComputeData       data)
+compute_plane_rows (GstyleColorPlane  *self,
+                    const ComputeData *data,
+                    gint               y_begin,
+                    gint               y_end)
 {
   GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  gdouble hue, saturation, value;
-  GdkRGBA rgba = {0};
-  guint32 *p;
+  g_autofree gfloat *scratch = NULL;
+  GstyleColorFilterFunc filter = priv->filter;
+  gpointer filter_user_data = priv->filter_user_data;
+  gint width = data->width;
+  gfloat *in0, *in1, *in2;
+  gfloat *red, *green, *blue;
+  gfloat *fixed, *row, *column;
+  gfloat fixed_val = data->ref_val;
 
   g_assert (GSTYLE_IS_COLOR_PLANE (self));
 
-  value = priv->comp [GSTYLE_COLOR_COMPONENT_HSV_V].val / priv->comp [GSTYLE_COLOR_COMPONENT_HSV_V].factor;
-  for (gint y = 0; y < data.height - 1; ++y)
+  scratch = g_new (gfloat, width * 6);
+  in0 = scratch;
+  in1 = scratch + width;
+  in2 = scratch + width * 2;
+  red = scratch + width * 3;
+  green = scratch + width * 4;
+  blue = scratch + width * 5;
+
+  /* Map the plane axes to the inputs of the conversion */
+  switch (priv->mode)
     {
-      saturation = CLAMP ((data.height - y) * data.y_factor, 0.0, 1.0);
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          hue = x * data.x_factor;
-          gstyle_color_convert_hsv_to_rgb (hue, saturation, value, &rgba);
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+    case GSTYLE_COLOR_PLANE_MODE_HUE:          fixed = in0; column = in1; row = in2; break;
+    case GSTYLE_COLOR_PLANE_MODE_SATURATION:   fixed = in1; column = in0; row = in2; break;
+    case GSTYLE_COLOR_PLANE_MODE_BRIGHTNESS:   fixed = in2; column = in0; row = in1; break;
+    case GSTYLE_COLOR_PLANE_MODE_CIELAB_L:     fixed = in0; column = in1; row = in2; break;
+    case GSTYLE_COLOR_PLANE_MODE_CIELAB_A:     fixed = in1; column = in2; row = in0; break;
+    case GSTYLE_COLOR_PLANE_MODE_CIELAB_B:     fixed = in2; column = in1; row = in0; break;
+    case GSTYLE_COLOR_PLANE_MODE_RED:          fixed = red; column = blue; row = green; break;
+    case GSTYLE_COLOR_PLANE_MODE_GREEN:        fixed = green; column = blue; row = red; break;
+    case GSTYLE_COLOR_PLANE_MODE_BLUE:         fixed = blue; column = red; row = green; break;
 
-          p[x] = pack_rgba24 (&rgba);
-        }
+    case GSTYLE_COLOR_PLANE_MODE_NONE:
+    default:
+      g_assert_not_reached ();
     }
-}
 
-static void
-compute_plane_cielab_l_mode (GstyleColorPlane *self,
-                             ComputeData       data)
-{
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  GstyleCielab lab;
-  GdkRGBA rgba = {0};
-  guint32 *p;
+  /* Only the row input changes from one row to the next */
+  fill_row (fixed, fixed_val, width);
 
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
+  if (priv->mode == GSTYLE_COLOR_PLANE_MODE_CIELAB_L ||
+      priv->mode == GSTYLE_COLOR_PLANE_MODE_CIELAB_A ||
+      priv->mode == GSTYLE_COLOR_PLANE_MODE_CIELAB_B)
+    fill_axis (column, data->lab_x_factor, -128.0, width);
+  else
+    fill_axis (column, data->x_factor, 0.0, width);
 
-  lab.l = priv->comp [GSTYLE_COLOR_COMPONENT_LAB_L].val / priv->comp [GSTYLE_COLOR_COMPONENT_LAB_L].factor;
-  for (gint y = 0; y < data.height; ++y)
+  for (gint y = y_begin; y < y_end; ++y)
     {
-      lab.b = (data.height - y) * data.lab_y_factor - 128.0;
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          lab.a = x * data.lab_x_factor - 128.0;
-          gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+      guint32 *p = data->buffer + y * (data->stride / 4);
 
-          p[x] = pack_rgba24 (&rgba);
+      switch (priv->mode)
+        {
+        case GSTYLE_COLOR_PLANE_MODE_HUE:
+        case GSTYLE_COLOR_PLANE_MODE_SATURATION:
+        case GSTYLE_COLOR_PLANE_MODE_BRIGHTNESS:
+          fill_row (row, CLAMP ((data->height - y) * data->y_factor, 0.0, 1.0), width);
+          gstyle_color_convert_hsv_to_rgb_batch (in0, in1, in2, red, green, blue, width);
+          break;
+
+        case GSTYLE_COLOR_PLANE_MODE_CIELAB_L:
+          fill_row (row, (data->height - y) * data->lab_y_factor - 128.0, width);
+          gstyle_color_convert_cielab_to_rgb_batch (in0, in1, in2, red, green, blue, width);
+          break;
+
+        case GSTYLE_COLOR_PLANE_MODE_CIELAB_A:
+        case GSTYLE_COLOR_PLANE_MODE_CIELAB_B:
+          fill_row (row, (data->height - y) * data->lab_l_factor, width);
+          gstyle_color_convert_cielab_to_rgb_batch (in0, in1, in2, red, green, blue, width);
+          break;
+
+        case GSTYLE_COLOR_PLANE_MODE_RED:
+        case GSTYLE_COLOR_PLANE_MODE_GREEN:
+        case GSTYLE_COLOR_PLANE_MODE_BLUE:
+          fill_row (row, (data->height - y) * data->y_factor, width);
+          break;
+
+        case GSTYLE_COLOR_PLANE_MODE_NONE:
+        default:
+          g_assert_not_reached ();
         }
-    }
-}
-
-static void
-compute_plane_cielab_a_mode (GstyleColorPlane *self,
-                             ComputeData       data)
-{
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  GstyleCielab lab;
-  GdkRGBA rgba = {0};
-  guint32 *p;
-
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
 
-  lab.a = priv->comp [GSTYLE_COLOR_COMPONENT_LAB_A].val / priv->comp [GSTYLE_COLOR_COMPONENT_LAB_A].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      lab.l = (data.height - y) * data.lab_l_factor;
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
+      if (filter != NULL)
         {
-          lab.b = x * data.lab_x_factor - 128.0;
-          gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+          for (gint x = 0; x < width; ++x)
+            {
+              GdkRGBA rgba = { red[x], green[x], blue[x], 0.0 };
 
-          p[x] = pack_rgba24 (&rgba);
+              filter (&rgba, &rgba, filter_user_data);
+              p[x] = pack_rgba24 (&rgba);
+            }
+        }
+      else
+        {
+          for (gint x = 0; x < width; ++x)
+            p[x] = pack_rgb24_float (red[x], green[x], blue[x]);
         }
     }
 }
 
 static void
-compute_plane_cielab_b_mode (GstyleColorPlane *self,
-                             ComputeData       data)
+render_tile_worker (gpointer data,
+                    gpointer user_data)
 {
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  GstyleCielab lab;
-  GdkRGBA rgba = {0};
-  guint32 *p;
+  RenderTile *tile = data;
+  RenderJob *job = tile->job;
 
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
+  compute_plane_rows (tile->self, &tile->data, tile->y_begin, tile->y_end);
 
-  lab.b = priv->comp [GSTYLE_COLOR_COMPONENT_LAB_B].val / priv->comp [GSTYLE_COLOR_COMPONENT_LAB_B].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      lab.l = (data.height - y) * data.lab_l_factor;
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          lab.a = x * data.lab_x_factor - 128.0;
-          gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
-
-          p[x] = pack_rgba24 (&rgba);
-        }
-    }
+  g_mutex_lock (&job->mutex);
+  if (--job->n_pending == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->mutex);
 }
 
 static void
-compute_plane_red_mode (GstyleColorPlane *self,
-                        ComputeData       data)
+compute_plane (GstyleColorPlane  *self,
+               const ComputeData *data)
 {
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  GdkRGBA rgba = {0};
-  guint32 *p;
+  g_autofree RenderTile *tiles = NULL;
+  RenderJob job;
+  gint n_tiles;
+  gint rows;
 
   g_assert (GSTYLE_IS_COLOR_PLANE (self));
 
-  rgba.red = priv->comp [GSTYLE_COLOR_COMPONENT_RGB_RED].val / priv->comp [GSTYLE_COLOR_COMPONENT_RGB_RED].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      rgba.green = (data.height - y) * data.y_factor;
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          rgba.blue = x * data.x_factor;
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+  n_tiles = CLAMP (data->height / TILE_MIN_ROWS, 1, (gint)g_get_num_processors ());
 
-          p[x] = pack_rgba24 (&rgba);
-        }
+  if (n_tiles == 1)
+    {
+      compute_plane_rows (self, data, 0, data->height);
+      return;
     }
-}
 
-static void
-compute_plane_green_mode (GstyleColorPlane *self,
-                          ComputeData       data)
-{
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  GdkRGBA rgba = {0};
-  guint32 *p;
+  if (render_pool == NULL)
+    render_pool = g_thread_pool_new (render_tile_worker, NULL, g_get_num_processors (), FALSE, NULL);
 
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
+  g_mutex_init (&job.mutex);
+  g_cond_init (&job.cond);
+  job.n_pending = n_tiles - 1;
 
-  rgba.green = priv->comp [GSTYLE_COLOR_COMPONENT_RGB_GREEN].val / priv->comp [GSTYLE_COLOR_COMPONENT_RGB_GREEN].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      rgba.red = (data.height - y) * data.y_factor;
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          rgba.blue = x * data.x_factor;
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+  tiles = g_new0 (RenderTile, n_tiles);
+  rows = (data->height + n_tiles - 1) / n_tiles;
 
-          p[x] = pack_rgba24 (&rgba);
-        }
+  for (gint i = 0; i < n_tiles; ++i)
+    {
+      tiles[i].self = self;
+      tiles[i].job = &job;
+      tiles[i].data = *data;
+      tiles[i].y_begin = i * rows;
+      tiles[i].y_end = MIN (data->height, (i + 1) * rows);
+
+      if (i > 0)
+        g_thread_pool_push (render_pool, &tiles[i], NULL);
     }
-}
 
-static void
-compute_plane_blue_mode (GstyleColorPlane *self,
-                         ComputeData       data)
-{
-  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
-  GdkRGBA rgba = {0};
-  guint32 *p;
-
-  g_assert (GSTYLE_IS_COLOR_PLANE (self));
+  compute_plane_rows (self, data, tiles[0].y_begin, tiles[0].y_end);
 
-  rgba.blue = priv->comp [GSTYLE_COLOR_COMPONENT_RGB_BLUE].val / priv->comp [GSTYLE_COLOR_COMPONENT_RGB_BLUE].factor;
-  for (gint y = 0; y < data.height; ++y)
-    {
-      rgba.green = (data.height - y) * data.y_factor;
-      p = data.buffer + y * (data.stride / 4);
-      for (gint x = 0; x < data.width; ++x)
-        {
-          rgba.red = x * data.x_factor;
-          if (priv->filter != NULL)
-            priv->filter (&rgba, &rgba, priv->filter_user_data);
+  g_mutex_lock (&job.mutex);
+  while (job.n_pending > 0)
+    g_cond_wait (&job.cond, &job.mutex);
+  g_mutex_unlock (&job.mutex);
 
-          p[x] = pack_rgba24 (&rgba);
-        }
-    }
+  g_mutex_clear (&job.mutex);
+  g_cond_clear (&job.cond);
 }
 
+/* Update the plane geometry, the plane content is rendered on the next draw */
 static gboolean
 create_surface (GstyleColorPlane *self)
 {
   GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
   GtkWidget *widget = (GtkWidget *)self;
-  cairo_surface_t *surface;
-  cairo_surface_t *tmp;
-  cairo_t *cr;
   gint adjusted_height;
   gint adjusted_width;
 
@@ -688,8 +682,15 @@ create_surface (GstyleColorPlane *self)
   if (!gtk_widget_get_realized (widget))
     return FALSE;
 
+  priv->surface_dirty = TRUE;
+
   /* TODO: keep only one of priv->data.width or priv->cached_border_box.width */
 
+  if (priv->surface != NULL &&
+      priv->data.width == priv->cached_border_box.width &&
+      priv->data.height == priv->cached_border_box.height)
+    return (priv->data.width > 1 && priv->data.height > 1);
+
   priv->data.width = priv->cached_border_box.width;
   priv->data.height = priv->cached_border_box.height;
   adjusted_height = priv->data.height - 1;
@@ -701,14 +702,14 @@ create_surface (GstyleColorPlane *self)
   priv->data.lab_x_factor = 255.0 / adjusted_width;
   priv->data.lab_l_factor = 100.0 / adjusted_height;
 
-  surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
-                                               CAIRO_CONTENT_COLOR,
-                                               priv->data.width, priv->data.height);
-
   if (priv->surface)
     cairo_surface_destroy (priv->surface);
 
-  priv->surface = surface;
+  priv->surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                                     CAIRO_CONTENT_COLOR,
+                                                     priv->data.width, priv->data.height);
+
+  g_clear_pointer (&priv->data.buffer, g_free);
 
   if (priv->data.width <= 1 || priv->data.height <= 1)
     return FALSE;
@@ -716,60 +717,35 @@ create_surface (GstyleColorPlane *self)
   priv->data.stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, priv->data.width);
   priv->data.buffer = g_malloc (priv->data.height * priv->data.stride);
 
-  switch (priv->mode)
-    {
-    case GSTYLE_COLOR_PLANE_MODE_HUE:
-      compute_plane_hue_mode (self, priv->data);
-      break;
-
-    case GSTYLE_COLOR_PLANE_MODE_SATURATION:
-      compute_plane_saturation_mode (self, priv->data);
-      break;
-
-    case GSTYLE_COLOR_PLANE_MODE_BRIGHTNESS:
-      compute_plane_brightness_mode (self, priv->data);
-      break;
-
-    case GSTYLE_COLOR_PLANE_MODE_CIELAB_L:
-      compute_plane_cielab_l_mode (self, priv->data);
-      break;
-
-    case GSTYLE_COLOR_PLANE_MODE_CIELAB_A:
-      compute_plane_cielab_a_mode (self, priv->data);
-      break;
-
-    case GSTYLE_COLOR_PLANE_MODE_CIELAB_B:
-      compute_plane_cielab_b_mode (self, priv->data);
-      break;
+  return TRUE;
+}
 
-    case GSTYLE_COLOR_PLANE_MODE_RED:
-      compute_plane_red_mode (self, priv->data);
-      break;
+static void
+render_surface (GstyleColorPlane *self)
+{
+  GstyleColorPlanePrivate *priv = gstyle_color_plane_get_instance_private (self);
+  cairo_surface_t *tmp;
+  cairo_t *cr;
 
-    case GSTYLE_COLOR_PLANE_MODE_GREEN:
-      compute_plane_green_mode (self, priv->data);
-      break;
+  g_assert (GSTYLE_IS_COLOR_PLANE (self));
 
-    case GSTYLE_COLOR_PLANE_MODE_BLUE:
-      compute_plane_blue_mode (self, priv->data);
-      break;
+  if (priv->data.buffer == NULL)
+    return;
 
-    case GSTYLE_COLOR_PLANE_MODE_NONE:
-    default:
-      g_assert_not_reached ();
-    }
+  priv->data.ref_val = priv->comp [priv->ref_comp].val / priv->comp [priv->ref_comp].factor;
+  compute_plane (self, &priv->data);
 
   tmp = cairo_image_surface_create_for_data ((guchar *)priv->data.buffer, CAIRO_FORMAT_RGB24,
                                              priv->data.width, priv->data.height, priv->data.stride);
-  cr = cairo_create (surface);
+  cr = cairo_create (priv->surface);
   cairo_set_source_surface (cr, tmp, 0, 0);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
   cairo_paint (cr);
 
   cairo_destroy (cr);
   cairo_surface_destroy (tmp);
-  g_free (priv->data.buffer);
 
-  return TRUE;
+  priv->surface_dirty = FALSE;
 }
 
 static gboolean
@@ -791,6 +767,9 @@ gstyle_color_plane_draw (GtkWidget *widget,
   if (update_css_boxes (self) || priv->surface == NULL)
     create_surface (self);
 
+  if (priv->surface_dirty)
+    render_surface (self);
+
   left_spacing = priv->cached_margin.left + priv->cached_border.left;
   top_spacing = priv->cached_margin.top + priv->cached_border.top;
   x = round (priv->cursor_x) + left_spacing;
@@ -1353,6 +1332,7 @@ gstyle_color_plane_finalize (GObject *object)
   if (priv->surface)
     cairo_surface_destroy (priv->surface);
 
+  g_clear_pointer (&priv->data.buffer, g_free);
   g_clear_object (&priv->drag_gesture);
   g_clear_object (&priv->long_press_gesture);
   g_clear_object (&priv->default_provider);
@@ -685,25 +685,34 @@ _parse_hsla_string (const gchar      *string,
 }
 
 /* TODO: add a public func to init so we can control the initial starting time ? */
+
+/*
+ * Colors are parsed from worker threads (see the color-picker plugin), so
+ * the table must be built exactly once. It is read-only afterwards.
+ */
 static Fuzzy *
 _init_predefined_table (void)
 {
   static Fuzzy *predefined_table;
-  NamedColor *item;
 
-  if (predefined_table == NULL)
+  if (g_once_init_enter (&predefined_table))
     {
-      predefined_table = fuzzy_new (TRUE);
+      Fuzzy *table;
+      NamedColor *item;
 
-      fuzzy_begin_bulk_insert (predefined_table);
+      table = fuzzy_new (TRUE);
+
+      fuzzy_begin_bulk_insert (table);
       for (guint i = 0; i < G_N_ELEMENTS (predefined_colors_table); ++i)
         {
           item = &predefined_colors_table [i];
           item->index = i;
-          fuzzy_insert (predefined_table, item->name, (gpointer)item);
+          fuzzy_insert (table, item->name, (gpointer)item);
         }
 
-      fuzzy_end_bulk_insert (predefined_table);
+      fuzzy_end_bulk_insert (table);
+
+      g_once_init_leave (&predefined_table, table);
     }
 
   return predefined_table;
@@ -0,0 +1,355 @@
+/* test-gstyle-color-convert.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <math.h>
+
+#include "gstyle-color-convert.h"
+
+/* Documented in gstyle-color-convert.c */
+#define RGB_MAX_ERROR    5e-5
+#define XYZ_MAX_ERROR    5e-5
+#define CIELAB_MAX_ERROR 5e-3
+
+#define N_COLORS 100000
+
+typedef struct
+{
+  gfloat *in0;
+  gfloat *in1;
+  gfloat *in2;
+  gfloat *out0;
+  gfloat *out1;
+  gfloat *out2;
+} Colors;
+
+static void
+colors_init (Colors *colors)
+{
+  GRand *rand = g_rand_new_with_seed (0x5eed);
+
+  colors->in0 = g_new (gfloat, N_COLORS);
+  colors->in1 = g_new (gfloat, N_COLORS);
+  colors->in2 = g_new (gfloat, N_COLORS);
+  colors->out0 = g_new (gfloat, N_COLORS);
+  colors->out1 = g_new (gfloat, N_COLORS);
+  colors->out2 = g_new (gfloat, N_COLORS);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      colors->in0 [i] = g_rand_double (rand);
+      colors->in1 [i] = g_rand_double (rand);
+      colors->in2 [i] = g_rand_double (rand);
+    }
+
+  /* Make sure the bounds are covered */
+  colors->in0 [0] = colors->in1 [0] = colors->in2 [0] = 0.0;
+  colors->in0 [1] = colors->in1 [1] = colors->in2 [1] = 1.0;
+
+  g_rand_free (rand);
+}
+
+static void
+colors_clear (Colors *colors)
+{
+  g_free (colors->in0);
+  g_free (colors->in1);
+  g_free (colors->in2);
+  g_free (colors->out0);
+  g_free (colors->out1);
+  g_free (colors->out2);
+}
+
+static inline gdouble
+max_error (gdouble error,
+           gdouble v0,
+           gdouble v1,
+           gdouble v2,
+           gfloat  f0,
+           gfloat  f1,
+           gfloat  f2)
+{
+  error = MAX (error, fabs (v0 - f0));
+  error = MAX (error, fabs (v1 - f1));
+  error = MAX (error, fabs (v2 - f2));
+
+  return error;
+}
+
+static void
+test_hsv_to_rgb (void)
+{
+  Colors colors;
+  gdouble error = 0.0;
+
+  colors_init (&colors);
+  gstyle_color_convert_hsv_to_rgb_batch (colors.in0, colors.in1, colors.in2,
+                                         colors.out0, colors.out1, colors.out2,
+                                         N_COLORS);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GdkRGBA rgba;
+
+      gstyle_color_convert_hsv_to_rgb (colors.in0 [i], colors.in1 [i], colors.in2 [i], &rgba);
+      error = max_error (error, rgba.red, rgba.green, rgba.blue, colors.out0 [i], colors.out1 [i], colors.out2 [i]);
+    }
+
+  g_assert_cmpfloat (error, <, RGB_MAX_ERROR);
+  colors_clear (&colors);
+}
+
+static void
+test_rgb_to_xyz (void)
+{
+  Colors colors;
+  gdouble error = 0.0;
+
+  colors_init (&colors);
+  gstyle_color_convert_rgb_to_xyz_batch (colors.in0, colors.in1, colors.in2,
+                                         colors.out0, colors.out1, colors.out2,
+                                         N_COLORS);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GdkRGBA rgba = { colors.in0 [i], colors.in1 [i], colors.in2 [i], 1.0 };
+      GstyleXYZ xyz;
+
+      gstyle_color_convert_rgb_to_xyz (&rgba, &xyz);
+      error = max_error (error, xyz.x, xyz.y, xyz.z, colors.out0 [i], colors.out1 [i], colors.out2 [i]);
+    }
+
+  g_assert_cmpfloat (error, <, XYZ_MAX_ERROR);
+  colors_clear (&colors);
+}
+
+static void
+test_xyz_to_rgb (void)
+{
+  Colors colors;
+  gdouble error = 0.0;
+
+  colors_init (&colors);
+
+  /* Use XYZ colors in the sRGB gamut, and some outside of it */
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      colors.in0 [i] *= 0.95047;
+      colors.in2 [i] *= 1.08883;
+    }
+
+  gstyle_color_convert_xyz_to_rgb_batch (colors.in0, colors.in1, colors.in2,
+                                         colors.out0, colors.out1, colors.out2,
+                                         N_COLORS);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GstyleXYZ xyz = { colors.in0 [i], colors.in1 [i], colors.in2 [i], 1.0 };
+      GdkRGBA rgba;
+
+      gstyle_color_convert_xyz_to_rgb (&xyz, &rgba);
+      error = max_error (error, rgba.red, rgba.green, rgba.blue, colors.out0 [i], colors.out1 [i], colors.out2 [i]);
+    }
+
+  g_assert_cmpfloat (error, <, RGB_MAX_ERROR);
+  colors_clear (&colors);
+}
+
+static void
+test_rgb_to_cielab (void)
+{
+  Colors colors;
+  gdouble error = 0.0;
+
+  colors_init (&colors);
+  gstyle_color_convert_rgb_to_cielab_batch (colors.in0, colors.in1, colors.in2,
+                                            colors.out0, colors.out1, colors.out2,
+                                            N_COLORS);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GdkRGBA rgba = { colors.in0 [i], colors.in1 [i], colors.in2 [i], 1.0 };
+      GstyleCielab lab;
+
+      gstyle_color_convert_rgb_to_cielab (&rgba, &lab);
+      error = max_error (error, lab.l, lab.a, lab.b, colors.out0 [i], colors.out1 [i], colors.out2 [i]);
+    }
+
+  g_assert_cmpfloat (error, <, CIELAB_MAX_ERROR);
+  colors_clear (&colors);
+}
+
+static void
+test_cielab_to_rgb (void)
+{
+  Colors colors;
+  gdouble error = 0.0;
+
+  colors_init (&colors);
+
+  /* Cover the whole range used by the color plane and scales */
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      colors.in0 [i] *= 100.0;
+      colors.in1 [i] = colors.in1 [i] * 255.0 - 128.0;
+      colors.in2 [i] = colors.in2 [i] * 255.0 - 128.0;
+    }
+
+  gstyle_color_convert_cielab_to_rgb_batch (colors.in0, colors.in1, colors.in2,
+                                            colors.out0, colors.out1, colors.out2,
+                                            N_COLORS);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GstyleCielab lab = { colors.in0 [i], colors.in1 [i], colors.in2 [i], 1.0 };
+      GdkRGBA rgba;
+
+      gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
+      error = max_error (error, rgba.red, rgba.green, rgba.blue, colors.out0 [i], colors.out1 [i], colors.out2 [i]);
+    }
+
+  g_assert_cmpfloat (error, <, RGB_MAX_ERROR);
+  colors_clear (&colors);
+}
+
+/*
+ * Throughput, only run with -m perf
+ */
+
+static void
+report_throughput (const gchar *name,
+                   gdouble      scalar,
+                   gdouble      batch)
+{
+  g_test_minimized_result (batch, "%s: scalar %.1lf Mcolors/s, batch %.1lf Mcolors/s",
+                           name, N_COLORS / scalar / 1e6, N_COLORS / batch / 1e6);
+  g_printerr ("%-14s scalar %7.1lf Mcolors/s, batch %7.1lf Mcolors/s\n",
+              name, N_COLORS / scalar / 1e6, N_COLORS / batch / 1e6);
+}
+
+static void
+test_perf_cielab_to_rgb (void)
+{
+  Colors colors;
+  gdouble scalar;
+
+  colors_init (&colors);
+
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      colors.in0 [i] *= 100.0;
+      colors.in1 [i] = colors.in1 [i] * 255.0 - 128.0;
+      colors.in2 [i] = colors.in2 [i] * 255.0 - 128.0;
+    }
+
+  g_test_timer_start ();
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GstyleCielab lab = { colors.in0 [i], colors.in1 [i], colors.in2 [i], 1.0 };
+      GdkRGBA rgba;
+
+      gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
+      colors.out0 [i] = rgba.red;
+    }
+  scalar = g_test_timer_elapsed ();
+
+  g_test_timer_start ();
+  gstyle_color_convert_cielab_to_rgb_batch (colors.in0, colors.in1, colors.in2,
+                                            colors.out0, colors.out1, colors.out2,
+                                            N_COLORS);
+  report_throughput ("cielab-to-rgb", scalar, g_test_timer_elapsed ());
+
+  colors_clear (&colors);
+}
+
+static void
+test_perf_rgb_to_cielab (void)
+{
+  Colors colors;
+  gdouble scalar;
+
+  colors_init (&colors);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GdkRGBA rgba = { colors.in0 [i], colors.in1 [i], colors.in2 [i], 1.0 };
+      GstyleCielab lab;
+
+      gstyle_color_convert_rgb_to_cielab (&rgba, &lab);
+      colors.out0 [i] = lab.l;
+    }
+  scalar = g_test_timer_elapsed ();
+
+  g_test_timer_start ();
+  gstyle_color_convert_rgb_to_cielab_batch (colors.in0, colors.in1, colors.in2,
+                                            colors.out0, colors.out1, colors.out2,
+                                            N_COLORS);
+  report_throughput ("rgb-to-cielab", scalar, g_test_timer_elapsed ());
+
+  colors_clear (&colors);
+}
+
+static void
+test_perf_hsv_to_rgb (void)
+{
+  Colors colors;
+  gdouble scalar;
+
+  colors_init (&colors);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < N_COLORS; ++i)
+    {
+      GdkRGBA rgba;
+
+      gstyle_color_convert_hsv_to_rgb (colors.in0 [i], colors.in1 [i], colors.in2 [i], &rgba);
+      colors.out0 [i] = rgba.red;
+    }
+  scalar = g_test_timer_elapsed ();
+
+  g_test_timer_start ();
+  gstyle_color_convert_hsv_to_rgb_batch (colors.in0, colors.in1, colors.in2,
+                                         colors.out0, colors.out1, colors.out2,
+                                         N_COLORS);
+  report_throughput ("hsv-to-rgb", scalar, g_test_timer_elapsed ());
+
+  colors_clear (&colors);
+}
+
+int
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Gstyle/convert/hsv-to-rgb", test_hsv_to_rgb);
+  g_test_add_func ("/Gstyle/convert/rgb-to-xyz", test_rgb_to_xyz);
+  g_test_add_func ("/Gstyle/convert/xyz-to-rgb", test_xyz_to_rgb);
+  g_test_add_func ("/Gstyle/convert/rgb-to-cielab", test_rgb_to_cielab);
+  g_test_add_func ("/Gstyle/convert/cielab-to-rgb", test_cielab_to_rgb);
+
+  if (g_test_perf ())
+    {
+      g_test_add_func ("/Gstyle/convert/perf/hsv-to-rgb", test_perf_hsv_to_rgb);
+      g_test_add_func ("/Gstyle/convert/perf/rgb-to-cielab", test_perf_rgb_to_cielab);
+      g_test_add_func ("/Gstyle/convert/perf/cielab-to-rgb", test_perf_cielab_to_rgb);
+    }
+
+  return g_test_run ();
+}
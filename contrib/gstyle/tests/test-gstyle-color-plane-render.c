@@ -0,0 +1,255 @@
+/* test-gstyle-color-plane-render.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the time needed to draw a frame of a GstyleColorPlane while its
+ * reference component changes, as when dragging a slider, and compares it
+ * to rendering the same plane one pixel at a time with the double precision
+ * conversion functions.
+ */
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <stdlib.h>
+
+#include "gstyle-color-plane.h"
+#include "gstyle-utils.h"
+
+static gint     width = 1200;
+static gint     height = 1200;
+static gint     n_frames = 50;
+static gboolean use_filter;
+
+static const struct {
+  GstyleColorPlaneMode  mode;
+  const gchar          *name;
+} modes[] = {
+  { GSTYLE_COLOR_PLANE_MODE_HUE, "hsv-hue" },
+  { GSTYLE_COLOR_PLANE_MODE_BRIGHTNESS, "hsv-value" },
+  { GSTYLE_COLOR_PLANE_MODE_CIELAB_L, "cielab-l" },
+  { GSTYLE_COLOR_PLANE_MODE_CIELAB_A, "cielab-a" },
+  { GSTYLE_COLOR_PLANE_MODE_RED, "rgb-red" },
+};
+
+static gint
+compare_gint64 (gconstpointer a,
+                gconstpointer b)
+{
+  const gint64 *ia = a;
+  const gint64 *ib = b;
+
+  return (*ia > *ib) - (*ia < *ib);
+}
+
+static void
+print_samples (const gchar *mode,
+               const gchar *name,
+               gint64      *samples)
+{
+  gint64 total = 0;
+
+  qsort (samples, n_frames, sizeof (gint64), compare_gint64);
+
+  for (gint i = 0; i < n_frames; i++)
+    total += samples[i];
+
+  g_print ("%-10s %-8s mean %7.2lf msec, p50 %7.2lf msec, max %7.2lf msec\n",
+           mode, name,
+           total / (gdouble)n_frames / 1000.0,
+           samples[n_frames / 2] / 1000.0,
+           samples[n_frames - 1] / 1000.0);
+}
+
+/* Reference: the per pixel rendering used before tiled rendering */
+static void
+render_scalar (GstyleColorPlaneMode  mode,
+               gdouble               ref,
+               cairo_surface_t      *target)
+{
+  cairo_surface_t *tmp;
+  cairo_t *cr;
+  guint32 *buffer;
+  gint stride;
+
+  stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, width);
+  buffer = g_malloc (height * stride);
+
+  for (gint y = 0; y < height; ++y)
+    {
+      guint32 *p = buffer + y * (stride / 4);
+
+      for (gint x = 0; x < width; ++x)
+        {
+          gdouble fx = x / (gdouble)(width - 1);
+          gdouble fy = CLAMP ((height - y) / (gdouble)(height - 1), 0.0, 1.0);
+          GdkRGBA rgba = {0};
+          GstyleCielab lab;
+
+          switch ((gint)mode)
+            {
+            case GSTYLE_COLOR_PLANE_MODE_HUE:
+              gstyle_color_convert_hsv_to_rgb (ref, fx, fy, &rgba);
+              break;
+
+            case GSTYLE_COLOR_PLANE_MODE_BRIGHTNESS:
+              gstyle_color_convert_hsv_to_rgb (fx, fy, ref, &rgba);
+              break;
+
+            case GSTYLE_COLOR_PLANE_MODE_CIELAB_L:
+              lab.l = ref * 100.0;
+              lab.a = fx * 255.0 - 128.0;
+              lab.b = fy * 255.0 - 128.0;
+              gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
+              break;
+
+            case GSTYLE_COLOR_PLANE_MODE_CIELAB_A:
+              lab.l = fy * 100.0;
+              lab.a = ref * 255.0 - 128.0;
+              lab.b = fx * 255.0 - 128.0;
+              gstyle_color_convert_cielab_to_rgb (&lab, &rgba);
+              break;
+
+            case GSTYLE_COLOR_PLANE_MODE_RED:
+              rgba.red = ref;
+              rgba.green = fy;
+              rgba.blue = fx;
+              break;
+
+            default:
+              g_assert_not_reached ();
+            }
+
+          if (use_filter)
+            gstyle_color_filter_deuteranopia (&rgba, &rgba, NULL);
+
+          p[x] = pack_rgba24 (&rgba);
+        }
+    }
+
+  tmp = cairo_image_surface_create_for_data ((guchar *)buffer, CAIRO_FORMAT_RGB24, width, height, stride);
+  cr = cairo_create (target);
+  cairo_set_source_surface (cr, tmp, 0, 0);
+  cairo_paint (cr);
+
+  cairo_destroy (cr);
+  cairo_surface_destroy (tmp);
+  g_free (buffer);
+}
+
+static void
+run (GstyleColorPlane *plane,
+     guint             index)
+{
+  GstyleColorPlaneMode mode = modes[index].mode;
+  g_autofree gint64 *samples = g_new (gint64, n_frames);
+  cairo_surface_t *target;
+  GtkAdjustment *adj;
+  gdouble lower;
+  gdouble upper;
+
+  target = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+
+  for (gint i = 0; i < n_frames; i++)
+    {
+      gint64 begin = g_get_monotonic_time ();
+
+      render_scalar (mode, (i + 1) / (gdouble)(n_frames + 1), target);
+      samples[i] = g_get_monotonic_time () - begin;
+    }
+
+  print_samples (modes[index].name, "scalar", samples);
+
+  gstyle_color_plane_set_mode (plane, mode);
+
+  /* Plane modes and their reference components are in the same order */
+  adj = gstyle_color_plane_get_component_adjustment (plane, (GstyleColorComponent)mode);
+  lower = gtk_adjustment_get_lower (adj);
+  upper = gtk_adjustment_get_upper (adj);
+
+  for (gint i = 0; i < n_frames; i++)
+    {
+      gint64 begin = g_get_monotonic_time ();
+      cairo_t *cr;
+
+      gtk_adjustment_set_value (adj, lower + (upper - lower) * (i + 1) / (gdouble)(n_frames + 1));
+
+      cr = cairo_create (target);
+      gtk_widget_draw (GTK_WIDGET (plane), cr);
+      cairo_destroy (cr);
+
+      samples[i] = g_get_monotonic_time () - begin;
+    }
+
+  print_samples (modes[index].name, "tiled", samples);
+
+  cairo_surface_destroy (target);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  GstyleColorPlane *plane;
+  GtkWidget *window;
+  const GOptionEntry entries[] = {
+    { "width", 0, 0, G_OPTION_ARG_INT, &width, "Width of the plane", "1200" },
+    { "height", 0, 0, G_OPTION_ARG_INT, &height, "Height of the plane", "1200" },
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames, "Number of frames per mode", "50" },
+    { "filter", 'f', 0, G_OPTION_ARG_NONE, &use_filter, "Apply a color filter" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark GstyleColorPlane rendering");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gtk_get_option_group (TRUE));
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  width = MAX (width, 2);
+  height = MAX (height, 2);
+  n_frames = MAX (n_frames, 1);
+
+  plane = gstyle_color_plane_new ();
+  if (use_filter)
+    gstyle_color_plane_set_filter_func (plane, gstyle_color_filter_deuteranopia, NULL);
+
+  gtk_widget_set_size_request (GTK_WIDGET (plane), width, height);
+
+  window = gtk_offscreen_window_new ();
+  gtk_container_add (GTK_CONTAINER (window), GTK_WIDGET (plane));
+  gtk_widget_show_all (window);
+
+  while (gtk_events_pending ())
+    gtk_main_iteration ();
+
+  g_print ("%dx%d plane, %d frames per mode%s\n",
+           width, height, n_frames, use_filter ? ", with a filter" : "");
+
+  for (guint i = 0; i < G_N_ELEMENTS (modes); i++)
+    run (plane, i);
+
+  gtk_widget_destroy (window);
+
+  return EXIT_SUCCESS;
+}
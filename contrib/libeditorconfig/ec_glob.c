@@ -46,20 +46,24 @@ static const UT_icd ut_int_pair_icd = {sizeof(int_pair),NULL,NULL,NULL};
 #define STRING_CAT(p, string, end)  do {    \
     size_t string_len = strlen(string); \
     if (p + string_len >= end) \
-        return -1; \
+        goto fail; \
     strcat(p, string); \
     p += string_len; \
 } while(0)
 
+struct ec_glob
+{
+    pcre *      re;
+    UT_array *  nums;   /* number ranges */
+};
+
 #define PATTERN_MAX  300
 /*
- * Whether the string matches the given glob pattern
+ * Compile the given glob pattern, to be matched with ec_glob_match()
  */
 EDITORCONFIG_LOCAL
-int ec_glob(const char *pattern, const char *string)
+ec_glob_t *ec_glob_compile(const char *pattern)
 {
-    size_t                    i;
-    int_pair *                p;
     char *                    c;
     char                      pcre_str[2 * PATTERN_MAX] = "^";
     char *                    p_pcre;
@@ -70,15 +74,13 @@ int ec_glob(const char *pattern, const char *string)
     int                       erroffset;
     pcre *                    re;
     int                       rc;
-    int *                     pcre_result;
-    size_t                    pcre_result_len;
     char                      l_pattern[2 * PATTERN_MAX];
     _Bool                     are_brace_paired;
     UT_array *                nums;     /* number ranges */
-    int                       ret = 0;
+    ec_glob_t *               glob;
 
-    if (pattern == NULL || string == NULL || (strlen (pattern) > PATTERN_MAX))
-      return -1;
+    if (pattern == NULL || (strlen (pattern) > PATTERN_MAX))
+      return NULL;
 
     strcpy(l_pattern, pattern);
     p_pcre = pcre_str + 1;
@@ -108,7 +110,7 @@ int ec_glob(const char *pattern, const char *string)
     re = pcre_compile("^\\{[\\+\\-]?\\d+\\.\\.[\\+\\-]?\\d+\\}$", 0,
             &error_msg, &erroffset, NULL);
     if (!re)        /* failed to compile */
-        return -1;
+        return NULL;
 
     utarray_new(nums, &ut_int_pair_icd);
 
@@ -317,12 +319,47 @@ int ec_glob(const char *pattern, const char *string)
     if (!re)        /* failed to compile */
     {
       utarray_free(nums);
-      return -1;
+      return NULL;
+    }
+
+    glob = (ec_glob_t *) malloc(sizeof(ec_glob_t));
+    if (!glob)
+    {
+      pcre_free(re);
+      utarray_free(nums);
+      return NULL;
     }
 
-    pcre_result_len = 3 * (utarray_len(nums) + 1);
+    glob->re = re;
+    glob->nums = nums;
+
+    return glob;
+
+fail:
+    pcre_free(re);
+    utarray_free(nums);
+    return NULL;
+}
+
+/*
+ * Whether the string matches the given compiled glob pattern
+ */
+EDITORCONFIG_LOCAL
+int ec_glob_match(const ec_glob_t *glob, const char *string)
+{
+    size_t                    i;
+    int_pair *                p;
+    int                       rc;
+    int *                     pcre_result;
+    size_t                    pcre_result_len;
+    int                       ret = 0;
+
+    if (glob == NULL || string == NULL)
+      return -1;
+
+    pcre_result_len = 3 * (utarray_len(glob->nums) + 1);
     pcre_result = (int *) calloc(pcre_result_len, sizeof(int_pair));
-    rc = pcre_exec(re, NULL, string, (int) strlen(string), 0, 0,
+    rc = pcre_exec(glob->re, NULL, string, (int) strlen(string), 0, 0,
             pcre_result, pcre_result_len);
 
     if (rc < 0)     /* failed to match */
@@ -332,16 +369,14 @@ int ec_glob(const char *pattern, const char *string)
         else
             ret = rc;
 
-        pcre_free(re);
         free(pcre_result);
-        utarray_free(nums);
 
         return ret;
     }
 
     /* Whether the numbers are in the desired range? */
-    for(p = (int_pair *) utarray_front(nums), i = 1; p;
-            ++ i, p = (int_pair *) utarray_next(nums, p))
+    for(p = (int_pair *) utarray_front(glob->nums), i = 1; p;
+            ++ i, p = (int_pair *) utarray_next(glob->nums, p))
     {
         const char * substring_start = string + pcre_result[2 * i];
         size_t  substring_length = pcre_result[2 * i + 1] - pcre_result[2 * i];
@@ -363,9 +398,36 @@ int ec_glob(const char *pattern, const char *string)
     if (p != NULL)      /* numbers not matched */
         ret = EC_GLOB_NOMATCH;
 
-    pcre_free(re);
     free(pcre_result);
-    utarray_free(nums);
+
+    return ret;
+}
+
+EDITORCONFIG_LOCAL
+void ec_glob_free(ec_glob_t *glob)
+{
+    if (glob == NULL)
+        return;
+
+    pcre_free(glob->re);
+    utarray_free(glob->nums);
+    free(glob);
+}
+
+/*
+ * Whether the string matches the given glob pattern
+ */
+EDITORCONFIG_LOCAL
+int ec_glob(const char *pattern, const char *string)
+{
+    ec_glob_t *               glob;
+    int                       ret;
+
+    if (string == NULL || (glob = ec_glob_compile(pattern)) == NULL)
+        return -1;
+
+    ret = ec_glob_match(glob, string);
+    ec_glob_free(glob);
 
     return ret;
 }
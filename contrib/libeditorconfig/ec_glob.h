@@ -31,11 +31,19 @@
 
 #define EC_GLOB_NOMATCH  1   /* Match failed. */
 
+typedef struct ec_glob ec_glob_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 EDITORCONFIG_LOCAL
 int ec_glob(const char * pattern, const char * string);
+EDITORCONFIG_LOCAL
+ec_glob_t * ec_glob_compile(const char * pattern);
+EDITORCONFIG_LOCAL
+int ec_glob_match(const ec_glob_t * glob, const char * string);
+EDITORCONFIG_LOCAL
+void ec_glob_free(ec_glob_t * glob);
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@ G_BEGIN_DECLS
 #include "rg-graph.h"
 #include "rg-line-renderer.h"
 #include "rg-renderer.h"
+#include "rg-sampler.h"
 #include "rg-table.h"
 
 G_END_DECLS
@@ -0,0 +1,627 @@
+/* rg-sampler.c
+ *
+ * Copyright (C) 2016 Christian Hergert <christian@hergert.me>
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "rg-sampler"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__FreeBSD__)
+# include <sys/resource.h>
+# include <sys/sysctl.h>
+# include <sys/types.h>
+#endif
+
+#include "egg-counter.h"
+
+#include "rg-sampler.h"
+
+/*
+ * RgSampler is shared by every table that displays system statistics. The
+ * files in /proc are opened once and reread with pread() from a worker
+ * thread, so a tick costs a couple of syscalls regardless of how many tables
+ * are listening. The scanner works in place on preallocated buffers and the
+ * results are pushed into every table that is due from a single callback on
+ * the main thread.
+ *
+ * While a sample is in flight, the worker owns the file descriptors, the
+ * buffers and the value arrays. The main thread only touches them again from
+ * the completion callback, so no locking is needed.
+ */
+
+#define STAT_BYTES_PER_CPU 256
+#define MEMINFO_BUF_SIZE   4096
+
+EGG_DEFINE_COUNTER (skipped_ticks, "RgSampler", "Skipped Ticks", "Ticks skipped because the previous sample was still in flight")
+
+typedef struct
+{
+  guint64 total;
+  guint64 idle;
+} CpuTimes;
+
+typedef struct
+{
+  RgTable         *table;
+  RgSamplerSource  source;
+  guint            interval_msec;
+  gint64           next_push;
+} Subscription;
+
+struct _RgSampler
+{
+  GObject    parent_instance;
+
+  gint       stat_fd;
+  gint       meminfo_fd;
+  gchar     *stat_buf;
+  gsize      stat_buf_len;
+  gchar     *meminfo_buf;
+#ifdef __FreeBSD__
+  glong     *cp_times;
+#endif
+
+  CpuTimes  *last_cpu;
+  gdouble   *cpu;
+  gdouble    memory;
+  guint      n_cpu;
+
+  GArray    *subscriptions;
+  guint      tick_source;
+  guint      tick_interval_msec;
+  guint      in_flight : 1;
+};
+
+G_DEFINE_TYPE (RgSampler, rg_sampler, G_TYPE_OBJECT)
+
+enum {
+  SAMPLED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static void rg_sampler_table_finalized (gpointer  data,
+                                        GObject  *where_the_object_was);
+
+static inline const gchar *
+scan_u64 (const gchar *p,
+          const gchar *end,
+          guint64     *value)
+{
+  guint64 v = 0;
+
+  while (p < end && *p == ' ')
+    p++;
+
+  while (p < end && *p >= '0' && *p <= '9')
+    v = (v * 10) + (*p++ - '0');
+
+  *value = v;
+
+  return p;
+}
+
+static inline gdouble
+rg_sampler_update_cpu (RgSampler *self,
+                       guint      id,
+                       guint64    total,
+                       guint64    idle)
+{
+  CpuTimes *last = &self->last_cpu [id];
+  guint64 total_calc = total - last->total;
+  guint64 idle_calc = idle - last->idle;
+
+  last->total = total;
+  last->idle = idle;
+
+  if (total_calc == 0)
+    return 0.0;
+
+  return ((total_calc - idle_calc) / (gdouble)total_calc) * 100.0;
+}
+
+#ifdef __linux__
+static gsize
+pread_all (gint   fd,
+           gchar *buf,
+           gsize  len)
+{
+  gsize pos = 0;
+
+  while (pos < len)
+    {
+      gssize r;
+
+      r = pread (fd, buf + pos, len - pos, pos);
+
+      if (r < 0 && errno == EINTR)
+        continue;
+
+      if (r <= 0)
+        break;
+
+      pos += r;
+    }
+
+  return pos;
+}
+
+static void
+rg_sampler_scan_stat (RgSampler   *self,
+                      const gchar *buf,
+                      gsize        len)
+{
+  const gchar *end = buf + len;
+  const gchar *p = buf;
+  const gchar *eol;
+
+  /* Only complete lines are used, a truncated tail is ignored. */
+  while (p < end && NULL != (eol = memchr (p, '\n', end - p)))
+    {
+      guint64 total = 0;
+      guint64 idle = 0;
+      guint64 id;
+      guint i;
+
+      /* CPU info comes first. Skip further lines. */
+      if (eol - p < 4 || memcmp (p, "cpu", 3) != 0)
+        break;
+
+      if (p[3] >= '0' && p[3] <= '9')
+        {
+          const gchar *q = scan_u64 (p + 3, eol, &id);
+
+          /* user nice system idle iowait irq softirq steal guest guest_nice */
+          for (i = 0; i < 10 && q < eol; i++)
+            {
+              guint64 v;
+
+              q = scan_u64 (q, eol, &v);
+              total += v;
+
+              if (i == 3)
+                idle = v;
+            }
+
+          if (id < self->n_cpu)
+            self->cpu [id] = rg_sampler_update_cpu (self, id, total, idle);
+        }
+
+      p = eol + 1;
+    }
+}
+
+static void
+rg_sampler_scan_meminfo (RgSampler   *self,
+                         const gchar *buf,
+                         gsize        len)
+{
+  const gchar *end = buf + len;
+  const gchar *p = buf;
+  const gchar *eol;
+  guint64 total = 0;
+  guint64 available = 0;
+
+  while (p < end && NULL != (eol = memchr (p, '\n', end - p)))
+    {
+      if (eol - p > 9 && memcmp (p, "MemTotal:", 9) == 0)
+        scan_u64 (p + 9, eol, &total);
+      else if (eol - p > 13 && memcmp (p, "MemAvailable:", 13) == 0)
+        scan_u64 (p + 13, eol, &available);
+
+      if (total != 0 && available != 0)
+        break;
+
+      p = eol + 1;
+    }
+
+  if (total != 0 && available <= total)
+    self->memory = ((total - available) / (gdouble)total) * 100.0;
+  else
+    self->memory = 0.0;
+}
+
+static void
+rg_sampler_sample (RgSampler *self)
+{
+  gsize len;
+
+  if (self->stat_fd != -1)
+    {
+      len = pread_all (self->stat_fd, self->stat_buf, self->stat_buf_len);
+      rg_sampler_scan_stat (self, self->stat_buf, len);
+    }
+
+  if (self->meminfo_fd != -1)
+    {
+      len = pread_all (self->meminfo_fd, self->meminfo_buf, MEMINFO_BUF_SIZE);
+      rg_sampler_scan_meminfo (self, self->meminfo_buf, len);
+    }
+}
+#elif defined(__FreeBSD__)
+static void
+rg_sampler_sample (RgSampler *self)
+{
+  static gint mib_cp_times[2];
+  static gsize len_cp_times = 2;
+  gsize cp_times_size = sizeof (glong) * CPUSTATES * self->n_cpu;
+
+  if (mib_cp_times[0] == 0 || mib_cp_times[1] == 0)
+    {
+      if (sysctlnametomib ("kern.cp_times", mib_cp_times, &len_cp_times) == -1)
+        {
+          g_critical ("Cannot convert sysctl name kern.cp_times to a mib array: %s",
+                      g_strerror (errno));
+          return;
+        }
+    }
+
+  if (sysctl (mib_cp_times, 2, self->cp_times, &cp_times_size, NULL, 0) == -1)
+    {
+      g_critical ("Cannot get CPU usage by sysctl kern.cp_times: %s",
+                  g_strerror (errno));
+      return;
+    }
+
+  for (guint i = 0, j = 0; i < self->n_cpu; i++, j += CPUSTATES)
+    {
+      const glong *cp = &self->cp_times [j];
+      guint64 total;
+
+      total = cp[CP_USER] + cp[CP_NICE] + cp[CP_SYS] + cp[CP_INTR] + cp[CP_IDLE];
+      self->cpu [i] = rg_sampler_update_cpu (self, i, total, cp[CP_IDLE]);
+    }
+}
+#else
+static void
+rg_sampler_sample (RgSampler *self)
+{
+  /*
+   * TODO: calculate cpu info for OpenBSD/etc.
+   */
+}
+#endif
+
+static const gdouble *
+rg_sampler_get_values (RgSampler       *self,
+                       RgSamplerSource  source,
+                       guint           *n_values)
+{
+  switch (source)
+    {
+    case RG_SAMPLER_CPU:
+      *n_values = self->n_cpu;
+      return self->cpu;
+
+    case RG_SAMPLER_MEMORY:
+      *n_values = 1;
+      return &self->memory;
+
+    default:
+      *n_values = 0;
+      return NULL;
+    }
+}
+
+static void
+rg_sampler_sample_worker (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+  rg_sampler_sample (source_object);
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+rg_sampler_sample_cb (GObject      *object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  RgSampler *self = (RgSampler *)object;
+  gint64 now;
+  gint64 slack;
+  guint i;
+
+  g_assert (RG_IS_SAMPLER (self));
+  g_assert (G_IS_TASK (result));
+
+  self->in_flight = FALSE;
+
+  now = g_get_monotonic_time ();
+
+  /* Allow a little jitter so tables on the tick interval never skip a beat. */
+  slack = self->tick_interval_msec * 1000L / 2;
+
+  for (i = 0; i < self->subscriptions->len; i++)
+    {
+      Subscription *sub = &g_array_index (self->subscriptions, Subscription, i);
+      const gdouble *values;
+      RgTableIter iter;
+      guint n_values;
+      guint j;
+
+      if (now + slack < sub->next_push)
+        continue;
+
+      values = rg_sampler_get_values (self, sub->source, &n_values);
+
+      rg_table_push (sub->table, &iter, now);
+
+      for (j = 0; j < n_values; j++)
+        rg_table_iter_set (&iter, j, values [j], -1);
+
+      sub->next_push = now + sub->interval_msec * 1000L;
+    }
+
+  g_signal_emit (self, signals [SAMPLED], 0);
+}
+
+static gboolean
+rg_sampler_tick (gpointer user_data)
+{
+  RgSampler *self = user_data;
+  g_autoptr(GTask) task = NULL;
+
+  g_assert (RG_IS_SAMPLER (self));
+
+  if (self->in_flight)
+    {
+      EGG_COUNTER_INC (skipped_ticks);
+      return G_SOURCE_CONTINUE;
+    }
+
+  self->in_flight = TRUE;
+
+  task = g_task_new (self, NULL, rg_sampler_sample_cb, NULL);
+  g_task_set_source_tag (task, rg_sampler_tick);
+  g_task_run_in_thread (task, rg_sampler_sample_worker);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+rg_sampler_update_tick (RgSampler *self)
+{
+  guint interval_msec = 0;
+  guint i;
+
+  g_assert (RG_IS_SAMPLER (self));
+
+  for (i = 0; i < self->subscriptions->len; i++)
+    {
+      const Subscription *sub = &g_array_index (self->subscriptions, Subscription, i);
+
+      if (interval_msec == 0 || sub->interval_msec < interval_msec)
+        interval_msec = sub->interval_msec;
+    }
+
+  if (interval_msec == self->tick_interval_msec)
+    return;
+
+  if (self->tick_source != 0)
+    {
+      g_source_remove (self->tick_source);
+      self->tick_source = 0;
+    }
+
+  self->tick_interval_msec = interval_msec;
+
+  if (interval_msec != 0)
+    self->tick_source = g_timeout_add (interval_msec, rg_sampler_tick, self);
+}
+
+static gboolean
+rg_sampler_remove_subscription (RgSampler *self,
+                                GObject   *table)
+{
+  guint i;
+
+  for (i = 0; i < self->subscriptions->len; i++)
+    {
+      const Subscription *sub = &g_array_index (self->subscriptions, Subscription, i);
+
+      if ((GObject *)sub->table == table)
+        {
+          g_array_remove_index_fast (self->subscriptions, i);
+          rg_sampler_update_tick (self);
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+rg_sampler_table_finalized (gpointer  data,
+                            GObject  *where_the_object_was)
+{
+  rg_sampler_remove_subscription (data, where_the_object_was);
+}
+
+static void
+rg_sampler_finalize (GObject *object)
+{
+  RgSampler *self = (RgSampler *)object;
+  guint i;
+
+  for (i = 0; i < self->subscriptions->len; i++)
+    {
+      const Subscription *sub = &g_array_index (self->subscriptions, Subscription, i);
+
+      g_object_weak_unref (G_OBJECT (sub->table), rg_sampler_table_finalized, self);
+    }
+
+  if (self->tick_source != 0)
+    {
+      g_source_remove (self->tick_source);
+      self->tick_source = 0;
+    }
+
+  if (self->stat_fd != -1)
+    close (self->stat_fd);
+
+  if (self->meminfo_fd != -1)
+    close (self->meminfo_fd);
+
+  g_clear_pointer (&self->subscriptions, g_array_unref);
+  g_clear_pointer (&self->stat_buf, g_free);
+  g_clear_pointer (&self->meminfo_buf, g_free);
+  g_clear_pointer (&self->last_cpu, g_free);
+  g_clear_pointer (&self->cpu, g_free);
+#ifdef __FreeBSD__
+  g_clear_pointer (&self->cp_times, g_free);
+#endif
+
+  G_OBJECT_CLASS (rg_sampler_parent_class)->finalize (object);
+}
+
+static void
+rg_sampler_class_init (RgSamplerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = rg_sampler_finalize;
+
+  /**
+   * RgSampler::sampled:
+   *
+   * This signal is emitted on the main thread after a sample has been
+   * pushed into every table that was due.
+   */
+  signals [SAMPLED] =
+    g_signal_new ("sampled",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+rg_sampler_init (RgSampler *self)
+{
+  self->stat_fd = -1;
+  self->meminfo_fd = -1;
+
+  self->n_cpu = g_get_num_processors ();
+  self->last_cpu = g_new0 (CpuTimes, self->n_cpu);
+  self->cpu = g_new0 (gdouble, self->n_cpu);
+  self->subscriptions = g_array_new (FALSE, FALSE, sizeof (Subscription));
+
+#ifdef __linux__
+  self->stat_fd = open ("/proc/stat", O_RDONLY | O_CLOEXEC);
+  self->meminfo_fd = open ("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+
+  /* The aggregate "cpu" line plus one line per CPU, the rest is ignored. */
+  self->stat_buf_len = (self->n_cpu + 1) * STAT_BYTES_PER_CPU;
+  self->stat_buf = g_malloc (self->stat_buf_len);
+  self->meminfo_buf = g_malloc (MEMINFO_BUF_SIZE);
+#elif defined(__FreeBSD__)
+  self->cp_times = g_new0 (glong, CPUSTATES * self->n_cpu);
+#endif
+
+  /* Prime the counters so the first tick covers a single interval. */
+  rg_sampler_sample (self);
+}
+
+/**
+ * rg_sampler_get_default:
+ *
+ * Gets the sampler shared by all system statistic tables.
+ *
+ * Returns: (transfer none): An #RgSampler.
+ */
+RgSampler *
+rg_sampler_get_default (void)
+{
+  static RgSampler *instance;
+
+  if (g_once_init_enter (&instance))
+    g_once_init_leave (&instance, g_object_new (RG_TYPE_SAMPLER, NULL));
+
+  return instance;
+}
+
+/**
+ * rg_sampler_get_n_values:
+ * @self: An #RgSampler
+ * @source: An #RgSamplerSource
+ *
+ * Gets the number of values that are pushed for @source. Tables added with
+ * rg_sampler_add_table() must have this many #G_TYPE_DOUBLE columns.
+ */
+guint
+rg_sampler_get_n_values (RgSampler       *self,
+                         RgSamplerSource  source)
+{
+  guint n_values = 0;
+
+  g_return_val_if_fail (RG_IS_SAMPLER (self), 0);
+
+  rg_sampler_get_values (self, source, &n_values);
+
+  return n_values;
+}
+
+/**
+ * rg_sampler_add_table:
+ * @self: An #RgSampler
+ * @table: An #RgTable
+ * @source: The #RgSamplerSource to record into @table
+ * @interval_msec: How often a row should be pushed into @table
+ *
+ * Pushes a row of @source values into @table every @interval_msec until the
+ * table is removed or finalized.
+ */
+void
+rg_sampler_add_table (RgSampler       *self,
+                      RgTable         *table,
+                      RgSamplerSource  source,
+                      guint            interval_msec)
+{
+  Subscription sub = { 0 };
+
+  g_return_if_fail (RG_IS_SAMPLER (self));
+  g_return_if_fail (RG_IS_TABLE (table));
+  g_return_if_fail (interval_msec > 0);
+
+  sub.table = table;
+  sub.source = source;
+  sub.interval_msec = interval_msec;
+  sub.next_push = g_get_monotonic_time () + interval_msec * 1000L;
+
+  g_array_append_val (self->subscriptions, sub);
+  g_object_weak_ref (G_OBJECT (table), rg_sampler_table_finalized, self);
+
+  rg_sampler_update_tick (self);
+}
+
+void
+rg_sampler_remove_table (RgSampler *self,
+                         RgTable   *table)
+{
+  g_return_if_fail (RG_IS_SAMPLER (self));
+  g_return_if_fail (RG_IS_TABLE (table));
+
+  if (rg_sampler_remove_subscription (self, G_OBJECT (table)))
+    g_object_weak_unref (G_OBJECT (table), rg_sampler_table_finalized, self);
+}
@@ -0,0 +1,48 @@
+/* rg-sampler.h
+ *
+ * Copyright (C) 2016 Christian Hergert <christian@hergert.me>
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RG_SAMPLER_H
+#define RG_SAMPLER_H
+
+#include "rg-table.h"
+
+G_BEGIN_DECLS
+
+#define RG_TYPE_SAMPLER (rg_sampler_get_type())
+
+G_DECLARE_FINAL_TYPE (RgSampler, rg_sampler, RG, SAMPLER, GObject)
+
+typedef enum
+{
+  RG_SAMPLER_CPU,
+  RG_SAMPLER_MEMORY,
+} RgSamplerSource;
+
+RgSampler *rg_sampler_get_default  (void);
+guint      rg_sampler_get_n_values (RgSampler       *self,
+                                    RgSamplerSource  source);
+void       rg_sampler_add_table    (RgSampler       *self,
+                                    RgTable         *table,
+                                    RgSamplerSource  source,
+                                    guint            interval_msec);
+void       rg_sampler_remove_table (RgSampler       *self,
+                                    RgTable         *table);
+
+G_END_DECLS
+
+#endif /* RG_SAMPLER_H */
@@ -55,7 +55,7 @@ def DBusMethod(dbus_interface, in_signature=None, out_signature=None, async=Fals
         arg_names = inspect.getargspec(func).args
         arg_names.pop(0) # eat "self" argument
         if async: arg_names.pop(0) # eat "invocation"
-        if len(in_signature) != len(arg_names):
+        if len(in_signature_list) != len(arg_names):
             raise TypeError('specified signature %s for method %s does not match length of arguments' % (str(in_signature_list), func.func_name))
         for pair in zip(in_signature_list, arg_names):
             func._dbus_method.in_args.append(pair)
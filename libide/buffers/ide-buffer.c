@@ -65,6 +65,9 @@
 #define NOTE_COLOR       "#708090"
 #define WARNING_COLOR    "#fcaf3e"
 
+/* Extra lines captured around the requested range of a line flags snapshot */
+#define LINE_FLAGS_SNAPSHOT_MARGIN 100
+
 typedef struct
 {
   IdeContext             *context;
@@ -74,6 +77,7 @@ typedef struct
   IdeFile                *file;
   GBytes                 *content;
   IdeBufferChangeMonitor *change_monitor;
+  IdeBufferLineFlagsSnapshot *line_flags_snapshot;
   IdeHighlightEngine     *highlight_engine;
   IdeExtensionAdapter    *rename_provider_adapter;
   IdeExtensionAdapter    *symbol_resolver_adapter;
@@ -103,7 +107,29 @@ typedef struct
   guint                   read_only : 1;
 } IdeBufferPrivate;
 
+typedef struct
+{
+  guint              line;
+  IdeBufferLineFlags flags;
+} LineFlagsRun;
+
+struct _IdeBufferLineFlagsSnapshot
+{
+  volatile gint  ref_count;
+
+  /* Lines the snapshot was created for, and the buffer line count at the time */
+  guint          begin_line;
+  guint          end_line;
+  guint          line_count;
+
+  /* Runs of equal flags, sorted by their first line */
+  guint          n_runs;
+  LineFlagsRun  *runs;
+};
+
 G_DEFINE_TYPE_WITH_PRIVATE (IdeBuffer, ide_buffer, GTK_SOURCE_TYPE_BUFFER)
+G_DEFINE_BOXED_TYPE (IdeBufferLineFlagsSnapshot, ide_buffer_line_flags_snapshot,
+                     ide_buffer_line_flags_snapshot_ref, ide_buffer_line_flags_snapshot_unref)
 
 EGG_DEFINE_COUNTER (instances, "IdeBuffer", "Instances", "Number of IdeBuffer instances.")
 
@@ -263,6 +289,17 @@ ide_buffer_sync_to_unsaved_files (IdeBuffer *self)
     g_bytes_unref (content);
 }
 
+static void
+ide_buffer_emit_line_flags_changed (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  g_clear_pointer (&priv->line_flags_snapshot, ide_buffer_line_flags_snapshot_unref);
+  g_signal_emit (self, signals [LINE_FLAGS_CHANGED], 0);
+}
+
 static void
 ide_buffer_clear_diagnostics (IdeBuffer *self)
 {
@@ -455,9 +492,9 @@ ide_buffer_update_diagnostics (IdeBuffer      *self,
     }
 }
 
-static void
-ide_buffer_set_diagnostics (IdeBuffer      *self,
-                            IdeDiagnostics *diagnostics)
+void
+_ide_buffer_set_diagnostics (IdeBuffer      *self,
+                             IdeDiagnostics *diagnostics)
 {
   IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
 
@@ -478,7 +515,7 @@ ide_buffer_set_diagnostics (IdeBuffer      *self,
           ide_buffer_update_diagnostics (self, diagnostics);
         }
 
-      g_signal_emit (self, signals [LINE_FLAGS_CHANGED], 0);
+      ide_buffer_emit_line_flags_changed (self);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_HAS_DIAGNOSTICS]);
     }
 
@@ -511,7 +548,7 @@ ide_buffer__diagnostics_manager__changed (IdeBuffer             *self,
   if (sequence != priv->diagnostics_sequence)
     {
       diagnostics = ide_diagnostics_manager_get_diagnostics_for_file (diagnostics_manager, file);
-      ide_buffer_set_diagnostics (self, diagnostics);
+      _ide_buffer_set_diagnostics (self, diagnostics);
       priv->diagnostics_sequence = sequence;
     }
 
@@ -551,7 +588,7 @@ ide_buffer__change_monitor_changed_cb (IdeBuffer              *self,
   g_assert (IDE_IS_BUFFER (self));
   g_assert (IDE_IS_BUFFER_CHANGE_MONITOR (monitor));
 
-  g_signal_emit (self, signals [LINE_FLAGS_CHANGED], 0);
+  ide_buffer_emit_line_flags_changed (self);
 
   IDE_EXIT;
 }
@@ -563,6 +600,8 @@ ide_buffer_reload_change_monitor (IdeBuffer *self)
 
   g_assert (IDE_IS_BUFFER (self));
 
+  g_clear_pointer (&priv->line_flags_snapshot, ide_buffer_line_flags_snapshot_unref);
+
   if (priv->change_monitor)
     {
       ide_clear_signal_handler (priv->change_monitor, &priv->change_monitor_changed_handler);
@@ -1219,6 +1258,7 @@ ide_buffer_dispose (GObject *object)
 
   egg_signal_group_set_target (priv->diagnostics_manager_signals, NULL);
 
+  g_clear_pointer (&priv->line_flags_snapshot, ide_buffer_line_flags_snapshot_unref);
   g_clear_pointer (&priv->diagnostics_line_cache, g_hash_table_unref);
   g_clear_pointer (&priv->diagnostics, ide_diagnostics_unref);
   g_clear_pointer (&priv->content, g_bytes_unref);
@@ -1640,24 +1680,18 @@ ide_buffer_get_context (IdeBuffer *self)
   return priv->context;
 }
 
-/**
- * ide_buffer_get_line_flags:
- * @self: A #IdeBuffer.
- * @line: a buffer line number.
- *
- * Return the flags set for the #IdeBuffer @line number.
- * (diagnostics and errors messages, line changed or added, notes)
- *
- * Returns: (transfer full): An #IdeBufferLineFlags struct.
- */
-IdeBufferLineFlags
-ide_buffer_get_line_flags (IdeBuffer *self,
-                           guint      line)
+static IdeBufferLineFlags
+ide_buffer_get_line_flags_at_iter (IdeBuffer         *self,
+                                   guint              line,
+                                   const GtkTextIter *iter)
 {
   IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
   IdeBufferLineFlags flags = 0;
   IdeBufferLineChange change = 0;
 
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (iter != NULL);
+
   if (priv->diagnostics_line_cache)
     {
       gpointer key = GINT_TO_POINTER (line);
@@ -1688,10 +1722,7 @@ ide_buffer_get_line_flags (IdeBuffer *self,
 
   if (priv->change_monitor)
     {
-      GtkTextIter iter;
-
-      gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), &iter, line);
-      change = ide_buffer_change_monitor_get_change (priv->change_monitor, &iter);
+      change = ide_buffer_change_monitor_get_change (priv->change_monitor, iter);
 
       switch (change)
         {
@@ -1716,6 +1747,188 @@ ide_buffer_get_line_flags (IdeBuffer *self,
   return flags;
 }
 
+/**
+ * ide_buffer_get_line_flags:
+ * @self: A #IdeBuffer.
+ * @line: a buffer line number.
+ *
+ * Return the flags set for the #IdeBuffer @line number.
+ * (diagnostics and errors messages, line changed or added, notes)
+ *
+ * When looking up many lines, such as while drawing, prefer
+ * ide_buffer_get_line_flags_snapshot().
+ *
+ * Returns: (transfer full): An #IdeBufferLineFlags struct.
+ */
+IdeBufferLineFlags
+ide_buffer_get_line_flags (IdeBuffer *self,
+                           guint      line)
+{
+  GtkTextIter iter;
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), 0);
+
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), &iter, line);
+
+  return ide_buffer_get_line_flags_at_iter (self, line, &iter);
+}
+
+static IdeBufferLineFlagsSnapshot *
+ide_buffer_line_flags_snapshot_new (IdeBuffer *self,
+                                    guint      begin_line,
+                                    guint      end_line)
+{
+  IdeBufferLineFlagsSnapshot *snapshot;
+  GArray *runs;
+  GtkTextIter iter;
+  guint line_count;
+  guint line;
+
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (begin_line <= end_line);
+
+  runs = g_array_new (FALSE, FALSE, sizeof (LineFlagsRun));
+  line_count = gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (self));
+
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), &iter, begin_line);
+
+  for (line = begin_line; line <= end_line && line < line_count; line++)
+    {
+      LineFlagsRun run = { line, ide_buffer_get_line_flags_at_iter (self, line, &iter) };
+
+      if (runs->len == 0 || g_array_index (runs, LineFlagsRun, runs->len - 1).flags != run.flags)
+        g_array_append_val (runs, run);
+
+      gtk_text_iter_forward_line (&iter);
+    }
+
+  /* Lines past the end of the buffer have no flags */
+  if (line <= end_line &&
+      (runs->len == 0 || g_array_index (runs, LineFlagsRun, runs->len - 1).flags != 0))
+    {
+      LineFlagsRun run = { line, 0 };
+
+      g_array_append_val (runs, run);
+    }
+
+  snapshot = g_new0 (IdeBufferLineFlagsSnapshot, 1);
+  snapshot->ref_count = 1;
+  snapshot->begin_line = begin_line;
+  snapshot->end_line = end_line;
+  snapshot->line_count = line_count;
+  snapshot->n_runs = runs->len;
+  snapshot->runs = (LineFlagsRun *)(gpointer)g_array_free (runs, FALSE);
+
+  return snapshot;
+}
+
+/**
+ * ide_buffer_get_line_flags_snapshot:
+ * @self: A #IdeBuffer.
+ * @begin_line: the first line of the range.
+ * @end_line: the last line of the range.
+ *
+ * Gets an immutable snapshot of the line flags for the lines from
+ * @begin_line to @end_line, stored as runs of equal flags.
+ *
+ * The snapshot is shared and only regenerated when the line flags change,
+ * as signaled by #IdeBuffer::line-flags-changed, when the number of lines
+ * in the buffer changes, or when a range outside of it is requested. This
+ * makes it cheap to request for every frame drawn.
+ *
+ * Returns: (transfer full): An #IdeBufferLineFlagsSnapshot.
+ */
+IdeBufferLineFlagsSnapshot *
+ide_buffer_get_line_flags_snapshot (IdeBuffer *self,
+                                    guint      begin_line,
+                                    guint      end_line)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+  IdeBufferLineFlagsSnapshot *snapshot;
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
+  g_return_val_if_fail (begin_line <= end_line, NULL);
+
+  snapshot = priv->line_flags_snapshot;
+
+  if (snapshot == NULL ||
+      begin_line < snapshot->begin_line ||
+      end_line > snapshot->end_line ||
+      snapshot->line_count != gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (self)))
+    {
+      begin_line -= MIN (begin_line, LINE_FLAGS_SNAPSHOT_MARGIN);
+      end_line += MIN (G_MAXUINT - end_line, LINE_FLAGS_SNAPSHOT_MARGIN);
+
+      g_clear_pointer (&priv->line_flags_snapshot, ide_buffer_line_flags_snapshot_unref);
+      priv->line_flags_snapshot = ide_buffer_line_flags_snapshot_new (self, begin_line, end_line);
+    }
+
+  return ide_buffer_line_flags_snapshot_ref (priv->line_flags_snapshot);
+}
+
+/**
+ * ide_buffer_line_flags_snapshot_get:
+ * @self: An #IdeBufferLineFlagsSnapshot.
+ * @line: a buffer line number.
+ *
+ * Gets the flags of @line at the time the snapshot was created. Lines outside
+ * of the range of the snapshot have no flags.
+ *
+ * Returns: An #IdeBufferLineFlags.
+ */
+IdeBufferLineFlags
+ide_buffer_line_flags_snapshot_get (IdeBufferLineFlagsSnapshot *self,
+                                    guint                       line)
+{
+  guint lo;
+  guint hi;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  if (line < self->begin_line || line > self->end_line || self->n_runs == 0)
+    return 0;
+
+  /* Find the last run starting at or before @line */
+  lo = 0;
+  hi = self->n_runs;
+
+  while (hi - lo > 1)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (self->runs [mid].line <= line)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return self->runs [lo].flags;
+}
+
+IdeBufferLineFlagsSnapshot *
+ide_buffer_line_flags_snapshot_ref (IdeBufferLineFlagsSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_buffer_line_flags_snapshot_unref (IdeBufferLineFlagsSnapshot *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_free (self->runs);
+      g_free (self);
+    }
+}
+
 /**
  * ide_buffer_get_highlight_diagnostics:
  * @self: A #IdeBuffer.
@@ -2085,6 +2298,20 @@ ide_buffer_set_style_scheme_name (IdeBuffer   *self,
     gtk_source_buffer_set_style_scheme (GTK_SOURCE_BUFFER (self), scheme);
 }
 
+/*
+ * Returns %TRUE if the buffer is held by at least one view, which is the
+ * closest approximation we have to the buffer being visible.
+ */
+gboolean
+_ide_buffer_get_held (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), FALSE);
+
+  return priv->hold_count > 0;
+}
+
 gboolean
 _ide_buffer_get_loading (IdeBuffer *self)
 {
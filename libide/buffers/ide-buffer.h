@@ -43,6 +43,10 @@ typedef enum
   IDE_BUFFER_LINE_FLAGS_NOTE     = 1 << 5,
 } IdeBufferLineFlags;
 
+#define IDE_TYPE_BUFFER_LINE_FLAGS_SNAPSHOT (ide_buffer_line_flags_snapshot_get_type ())
+
+typedef struct _IdeBufferLineFlagsSnapshot IdeBufferLineFlagsSnapshot;
+
 struct _IdeBufferClass
 {
   GtkSourceBufferClass parent_class;
@@ -109,6 +113,17 @@ gchar              *ide_buffer_get_word_at_iter              (IdeBuffer
                                                               const GtkTextIter    *iter);
 void                ide_buffer_sync_to_unsaved_files         (IdeBuffer            *self);
 
+IdeBufferLineFlagsSnapshot *ide_buffer_get_line_flags_snapshot      (IdeBuffer                  *self,
+                                                                     guint                       begin_line,
+                                                                     guint                       end_line);
+GType                       ide_buffer_line_flags_snapshot_get_type (void);
+IdeBufferLineFlagsSnapshot *ide_buffer_line_flags_snapshot_ref      (IdeBufferLineFlagsSnapshot *self);
+void                        ide_buffer_line_flags_snapshot_unref    (IdeBufferLineFlagsSnapshot *self);
+IdeBufferLineFlags          ide_buffer_line_flags_snapshot_get      (IdeBufferLineFlagsSnapshot *self,
+                                                                     guint                       line);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeBufferLineFlagsSnapshot, ide_buffer_line_flags_snapshot_unref)
+
 G_END_DECLS
 
 #endif /* IDE_BUFFER_H */
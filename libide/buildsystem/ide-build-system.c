@@ -23,9 +23,11 @@
 
 #include "buildsystem/ide-build-system.h"
 #include "buildsystem/ide-builder.h"
+#include "buildsystem/ide-compile-commands.h"
 #include "buildsystem/ide-configuration.h"
 #include "buildsystem/ide-configuration-manager.h"
 #include "files/ide-file.h"
+#include "vcs/ide-vcs.h"
 
 G_DEFINE_INTERFACE (IdeBuildSystem, ide_build_system, IDE_TYPE_OBJECT)
 
@@ -218,6 +220,62 @@ get_default_builder (IdeBuildSystem  *self,
   return ide_build_system_get_builder (IDE_BUILD_SYSTEM (self), config, error);
 }
 
+static void
+ide_build_system_load_compile_commands_cb (GObject      *object,
+                                           GAsyncResult *result,
+                                           gpointer      user_data)
+{
+  IdeCompileCommands *commands = (IdeCompileCommands *)object;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (commands));
+
+  /* A missing file just means there is no database (yet) */
+  if (!ide_compile_commands_load_finish (commands, result, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    g_debug ("Failed to load compile commands: %s", error->message);
+}
+
+/*
+ * Projects may provide a compile_commands.json in the root of the source
+ * tree (such as generated by bear or cmake). If found, we load it once and
+ * use it to answer build flags requests before falling back to the builder.
+ * The file is monitored, so one created later is loaded when it appears.
+ */
+static IdeCompileCommands *
+get_compile_commands (IdeBuildSystem *self)
+{
+  IdeCompileCommands *commands;
+
+  g_assert (IDE_IS_BUILD_SYSTEM (self));
+
+  commands = g_object_get_data (G_OBJECT (self), "IDE_COMPILE_COMMANDS");
+
+  if (commands == NULL)
+    {
+      g_autoptr(GFile) file = NULL;
+      IdeContext *context;
+      IdeVcs *vcs;
+      GFile *workdir;
+
+      context = ide_object_get_context (IDE_OBJECT (self));
+      vcs = ide_context_get_vcs (context);
+      workdir = ide_vcs_get_working_directory (vcs);
+      file = g_file_get_child (workdir, "compile_commands.json");
+
+      commands = ide_compile_commands_new ();
+      g_object_set_data_full (G_OBJECT (self), "IDE_COMPILE_COMMANDS", commands, g_object_unref);
+
+      ide_compile_commands_load_async (commands,
+                                       file,
+                                       NULL,
+                                       ide_build_system_load_compile_commands_cb,
+                                       NULL);
+    }
+
+  return commands;
+}
+
 static void
 ide_build_system_get_build_flags_cb (GObject      *object,
                                      GAsyncResult *result,
@@ -246,6 +304,7 @@ ide_build_system_get_build_flags_async (IdeBuildSystem      *self,
   g_autoptr(GTask) task = NULL;
   g_autoptr(IdeBuilder) builder = NULL;
   g_autoptr(GError) error = NULL;
+  IdeCompileCommands *commands;
 
   g_return_if_fail (IDE_IS_BUILD_SYSTEM (self));
   g_return_if_fail (IDE_IS_FILE (file));
@@ -254,6 +313,21 @@ ide_build_system_get_build_flags_async (IdeBuildSystem      *self,
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, ide_build_system_get_build_flags_async);
 
+  commands = get_compile_commands (self);
+
+  if (ide_compile_commands_get_loaded (commands))
+    {
+      g_auto(GStrv) flags = NULL;
+
+      flags = ide_compile_commands_lookup (commands, ide_file_get_file (file), NULL, NULL);
+
+      if (flags != NULL)
+        {
+          g_task_return_pointer (task, g_steal_pointer (&flags), (GDestroyNotify)g_strfreev);
+          return;
+        }
+    }
+
   if (NULL == (builder = get_default_builder (self, &error)))
     {
       g_task_return_error (task, g_steal_pointer (&error));
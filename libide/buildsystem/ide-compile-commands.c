@@ -0,0 +1,843 @@
+/* ide-compile-commands.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-compile-commands"
+
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "ide-debug.h"
+
+#include "buildsystem/ide-compile-commands.h"
+
+/**
+ * SECTION:ide-compile-commands
+ * @title: IdeCompileCommands
+ * @short_description: Build flags lookup from compile_commands.json
+ *
+ * #IdeCompileCommands parses a compile_commands.json (as generated by
+ * meson, cmake, or bear) once into a table indexed by the absolute path
+ * of each translation unit. The command line for a file is only tokenized
+ * the first time it is requested, after which the resulting flags are
+ * cached until the database is reloaded.
+ *
+ * The underlying file is monitored, and the database is reloaded in a
+ * worker thread when it changes on disk. Concurrent requests to load the
+ * same file share a single parse.
+ */
+
+struct _IdeCompileCommands
+{
+  GObject       parent_instance;
+
+  /* Absolute path of translation unit → CompileInfo */
+  GHashTable   *info_by_path;
+
+  GFile        *file;
+  GFileMonitor *monitor;
+
+  /*
+   * The load currently being parsed in a worker thread, if any. Callers
+   * of ide_compile_commands_load_async() for the same file are queued on
+   * it rather than starting another parse.
+   */
+  GTask        *in_flight;
+};
+
+typedef struct
+{
+  gchar  *directory;
+  gchar  *command;
+  gchar **argv;
+  gchar **flags;
+} CompileInfo;
+
+typedef struct
+{
+  GFile        *file;
+  GCancellable *cancellable;
+  GPtrArray    *waiting;
+} LoadState;
+
+G_DEFINE_TYPE (IdeCompileCommands, ide_compile_commands, G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_FILE,
+  N_PROPS
+};
+
+enum {
+  CHANGED,
+  N_SIGNALS
+};
+
+static GParamSpec *properties [N_PROPS];
+static guint signals [N_SIGNALS];
+
+static void
+compile_info_free (gpointer data)
+{
+  CompileInfo *info = data;
+
+  g_clear_pointer (&info->directory, g_free);
+  g_clear_pointer (&info->command, g_free);
+  g_clear_pointer (&info->argv, g_strfreev);
+  g_clear_pointer (&info->flags, g_strfreev);
+  g_slice_free (CompileInfo, info);
+}
+
+static void
+load_state_free (gpointer data)
+{
+  LoadState *state = data;
+
+  g_clear_object (&state->file);
+  g_clear_object (&state->cancellable);
+  g_clear_pointer (&state->waiting, g_ptr_array_unref);
+  g_slice_free (LoadState, state);
+}
+
+/*
+ * Like json_object_get_string_member(), but returns %NULL instead of
+ * logging a critical when the member is missing or not a string.
+ */
+static const gchar *
+get_string_member (JsonObject  *obj,
+                   const gchar *name)
+{
+  JsonNode *node;
+
+  if (!json_object_has_member (obj, name) ||
+      NULL == (node = json_object_get_member (obj, name)) ||
+      !JSON_NODE_HOLDS_VALUE (node) ||
+      json_node_get_value_type (node) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string (node);
+}
+
+static gchar **
+get_arguments_member (JsonObject *obj)
+{
+  JsonArray *args;
+  JsonNode *node;
+  GPtrArray *ar;
+  guint n_args;
+
+  if (!json_object_has_member (obj, "arguments") ||
+      NULL == (node = json_object_get_member (obj, "arguments")) ||
+      !JSON_NODE_HOLDS_ARRAY (node) ||
+      NULL == (args = json_node_get_array (node)))
+    return NULL;
+
+  n_args = json_array_get_length (args);
+  ar = g_ptr_array_sized_new (n_args + 1);
+
+  for (guint i = 0; i < n_args; i++)
+    {
+      JsonNode *element = json_array_get_element (args, i);
+
+      if (!JSON_NODE_HOLDS_VALUE (element) ||
+          json_node_get_value_type (element) != G_TYPE_STRING)
+        {
+          g_ptr_array_set_free_func (ar, g_free);
+          g_ptr_array_unref (ar);
+          return NULL;
+        }
+
+      g_ptr_array_add (ar, g_strdup (json_node_get_string (element)));
+    }
+
+  g_ptr_array_add (ar, NULL);
+
+  return (gchar **)g_ptr_array_free (ar, FALSE);
+}
+
+static GHashTable *
+ide_compile_commands_parse (GFile         *file,
+                            GCancellable  *cancellable,
+                            GError       **error)
+{
+  g_autoptr(GHashTable) info_by_path = NULL;
+  g_autoptr(JsonParser) parser = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autofree gchar *path = NULL;
+  g_autoptr(GError) local_error = NULL;
+  JsonArray *ar;
+  JsonNode *root;
+  guint n_items;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_FILE (file));
+
+  if (!(path = g_file_get_path (file)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "compile_commands.json must be on a local filesystem");
+      IDE_RETURN (NULL);
+    }
+
+  /*
+   * These files can be tens of megabytes, so avoid copying the contents
+   * into the heap before handing them to the parser.
+   */
+  if (!(mapped = g_mapped_file_new (path, FALSE, &local_error)))
+    {
+      /* Callers treat a missing file as "no database yet" */
+      if (g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_set_error_literal (error,
+                             G_IO_ERROR,
+                             G_IO_ERROR_NOT_FOUND,
+                             local_error->message);
+      else
+        g_propagate_error (error, g_steal_pointer (&local_error));
+      IDE_RETURN (NULL);
+    }
+
+  parser = json_parser_new ();
+
+  if (!json_parser_load_from_data (parser,
+                                   g_mapped_file_get_contents (mapped),
+                                   g_mapped_file_get_length (mapped),
+                                   error))
+    IDE_RETURN (NULL);
+
+  if (NULL == (root = json_parser_get_root (parser)) ||
+      !JSON_NODE_HOLDS_ARRAY (root) ||
+      NULL == (ar = json_node_get_array (root)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Failed to extract commands, invalid json");
+      IDE_RETURN (NULL);
+    }
+
+  info_by_path = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, compile_info_free);
+
+  n_items = json_array_get_length (ar);
+
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr(GFile) dir = NULL;
+      g_autoptr(GFile) child = NULL;
+      g_autofree gchar *full_path = NULL;
+      g_auto(GStrv) argv = NULL;
+      CompileInfo *info;
+      JsonObject *obj;
+      JsonNode *node;
+      const gchar *directory;
+      const gchar *filename;
+      const gchar *command = NULL;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        IDE_RETURN (NULL);
+
+      if (NULL == (node = json_array_get_element (ar, i)) ||
+          !JSON_NODE_HOLDS_OBJECT (node) ||
+          NULL == (obj = json_node_get_object (node)) ||
+          NULL == (directory = get_string_member (obj, "directory")) ||
+          NULL == (filename = get_string_member (obj, "file")))
+        continue;
+
+      /*
+       * Entries may contain either a "command" string, which we tokenize
+       * lazily, or an already split "arguments" array. Entries with
+       * neither cannot provide flags, so drop them.
+       */
+      if (NULL == (argv = get_arguments_member (obj)) &&
+          NULL == (command = get_string_member (obj, "command")))
+        continue;
+
+      /* GFile normalizes "." and ".." components for us */
+      dir = g_file_new_for_path (directory);
+      child = g_file_resolve_relative_path (dir, filename);
+
+      if (NULL == (full_path = g_file_get_path (child)))
+        continue;
+
+      info = g_slice_new0 (CompileInfo);
+      info->directory = g_strdup (directory);
+      info->argv = g_steal_pointer (&argv);
+      info->command = g_strdup (command);
+
+      g_hash_table_insert (info_by_path, g_steal_pointer (&full_path), info);
+    }
+
+  IDE_TRACE_MSG ("Indexed %u compile commands", g_hash_table_size (info_by_path));
+
+  IDE_RETURN (g_steal_pointer (&info_by_path));
+}
+
+static void
+ide_compile_commands_load_worker (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  LoadState *state = task_data;
+  GHashTable *info_by_path;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_COMPILE_COMMANDS (source_object));
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->file));
+
+  if (!(info_by_path = ide_compile_commands_parse (state->file, cancellable, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, info_by_path, (GDestroyNotify)g_hash_table_unref);
+}
+
+static void ide_compile_commands_monitor_changed (IdeCompileCommands *self,
+                                                  GFile              *file,
+                                                  GFile              *other_file,
+                                                  GFileMonitorEvent   event,
+                                                  GFileMonitor       *monitor);
+
+static void
+ide_compile_commands_set_file (IdeCompileCommands *self,
+                               GFile              *file)
+{
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (G_IS_FILE (file));
+
+  if (self->file != NULL && g_file_equal (self->file, file))
+    return;
+
+  if (self->monitor != NULL)
+    {
+      g_file_monitor_cancel (self->monitor);
+      g_clear_object (&self->monitor);
+    }
+
+  g_set_object (&self->file, file);
+
+  self->monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+
+  if (self->monitor != NULL)
+    g_signal_connect_object (self->monitor,
+                             "changed",
+                             G_CALLBACK (ide_compile_commands_monitor_changed),
+                             self,
+                             G_CONNECT_SWAPPED);
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_FILE]);
+}
+
+static void
+ide_compile_commands_load_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  IdeCompileCommands *self = (IdeCompileCommands *)object;
+  g_autoptr(GHashTable) info_by_path = NULL;
+  g_autoptr(GError) error = NULL;
+  GTask *task = (GTask *)result;
+  LoadState *state;
+  gboolean current;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (G_IS_TASK (task));
+
+  state = g_task_get_task_data (task);
+  info_by_path = g_task_propagate_pointer (task, &error);
+
+  /*
+   * If this load was superseded (the file changed underneath us, or a
+   * different file was requested), its waiters have already been moved
+   * or cancelled and the result must not replace the newer database.
+   */
+  current = (self->in_flight == task);
+
+  if (current)
+    {
+      g_clear_object (&self->in_flight);
+
+      if (info_by_path != NULL)
+        {
+          g_clear_pointer (&self->info_by_path, g_hash_table_unref);
+          self->info_by_path = g_steal_pointer (&info_by_path);
+        }
+
+      /*
+       * Monitor the file even if it could not be loaded, so that a
+       * compile_commands.json which is generated later is picked up.
+       */
+      ide_compile_commands_set_file (self, state->file);
+
+      if (error == NULL)
+        g_signal_emit (self, signals [CHANGED], 0);
+    }
+  else if (error == NULL)
+    {
+      error = g_error_new_literal (G_IO_ERROR,
+                                   G_IO_ERROR_CANCELLED,
+                                   "The load was superseded");
+    }
+
+  if (state->waiting != NULL)
+    {
+      for (guint i = 0; i < state->waiting->len; i++)
+        {
+          GTask *waiter = g_ptr_array_index (state->waiting, i);
+
+          if (error != NULL)
+            g_task_return_error (waiter, g_error_copy (error));
+          else
+            g_task_return_boolean (waiter, TRUE);
+        }
+
+      g_ptr_array_set_size (state->waiting, 0);
+    }
+
+  IDE_EXIT;
+}
+
+static void
+ide_compile_commands_start_load (IdeCompileCommands *self,
+                                 GFile              *file,
+                                 GPtrArray          *waiting)
+{
+  LoadState *state;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (self->in_flight == NULL);
+
+  state = g_slice_new0 (LoadState);
+  state->file = g_object_ref (file);
+  state->cancellable = g_cancellable_new ();
+  state->waiting = waiting ? waiting : g_ptr_array_new_with_free_func (g_object_unref);
+
+  self->in_flight = g_task_new (self, state->cancellable, ide_compile_commands_load_cb, NULL);
+  g_task_set_source_tag (self->in_flight, ide_compile_commands_start_load);
+  g_task_set_priority (self->in_flight, G_PRIORITY_LOW);
+  g_task_set_task_data (self->in_flight, state, load_state_free);
+  g_task_run_in_thread (self->in_flight, ide_compile_commands_load_worker);
+}
+
+/*
+ * Cancels the load in flight, if any, returning the tasks that were
+ * waiting on it so they may be attached to a replacement load.
+ */
+static GPtrArray *
+ide_compile_commands_cancel_load (IdeCompileCommands *self)
+{
+  LoadState *state;
+  GPtrArray *waiting;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+
+  if (self->in_flight == NULL)
+    return NULL;
+
+  state = g_task_get_task_data (self->in_flight);
+  waiting = g_steal_pointer (&state->waiting);
+  g_cancellable_cancel (state->cancellable);
+  g_clear_object (&self->in_flight);
+
+  return waiting;
+}
+
+static void
+ide_compile_commands_monitor_changed (IdeCompileCommands *self,
+                                      GFile              *file,
+                                      GFile              *other_file,
+                                      GFileMonitorEvent   event,
+                                      GFileMonitor       *monitor)
+{
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (G_IS_FILE_MONITOR (monitor));
+
+  if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+      event != G_FILE_MONITOR_EVENT_CREATED &&
+      event != G_FILE_MONITOR_EVENT_DELETED)
+    return;
+
+  if (event == G_FILE_MONITOR_EVENT_DELETED)
+    {
+      g_clear_pointer (&self->info_by_path, g_hash_table_unref);
+      g_signal_emit (self, signals [CHANGED], 0);
+      return;
+    }
+
+  /* Anyone waiting on a stale parse gets the result of the new one */
+  ide_compile_commands_start_load (self,
+                                   self->file,
+                                   ide_compile_commands_cancel_load (self));
+}
+
+static void
+ide_compile_commands_finalize (GObject *object)
+{
+  IdeCompileCommands *self = (IdeCompileCommands *)object;
+
+  /* Loads hold a reference to @self, so none can be in flight */
+  g_assert (self->in_flight == NULL);
+
+  if (self->monitor != NULL)
+    g_file_monitor_cancel (self->monitor);
+
+  g_clear_object (&self->monitor);
+  g_clear_object (&self->file);
+  g_clear_pointer (&self->info_by_path, g_hash_table_unref);
+
+  G_OBJECT_CLASS (ide_compile_commands_parent_class)->finalize (object);
+}
+
+static void
+ide_compile_commands_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+  IdeCompileCommands *self = IDE_COMPILE_COMMANDS (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_compile_commands_class_init (IdeCompileCommandsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_compile_commands_finalize;
+  object_class->get_property = ide_compile_commands_get_property;
+
+  properties [PROP_FILE] =
+    g_param_spec_object ("file",
+                         "File",
+                         "The compile_commands.json file being tracked",
+                         G_TYPE_FILE,
+                         (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+
+  /**
+   * IdeCompileCommands::changed:
+   *
+   * This signal is emitted when the database has been reloaded, or the
+   * underlying file was removed. Any cached flags should be discarded.
+   */
+  signals [CHANGED] =
+    g_signal_new ("changed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+ide_compile_commands_init (IdeCompileCommands *self)
+{
+}
+
+IdeCompileCommands *
+ide_compile_commands_new (void)
+{
+  return g_object_new (IDE_TYPE_COMPILE_COMMANDS, NULL);
+}
+
+/**
+ * ide_compile_commands_get_file:
+ *
+ * Returns: (transfer none) (nullable): A #GFile or %NULL.
+ */
+GFile *
+ide_compile_commands_get_file (IdeCompileCommands *self)
+{
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), NULL);
+
+  return self->file;
+}
+
+gboolean
+ide_compile_commands_get_loaded (IdeCompileCommands *self)
+{
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), FALSE);
+
+  return self->info_by_path != NULL;
+}
+
+/**
+ * ide_compile_commands_load_async:
+ * @self: An #IdeCompileCommands
+ * @file: a #GFile containing the compile_commands.json
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: the callback for the operation
+ * @user_data: closure data for @callback
+ *
+ * Asynchronously parses @file in a worker thread. Upon completion, the
+ * database is swapped in on the main thread and @file is monitored for
+ * changes.
+ *
+ * If @file is already being loaded, this request waits for that load to
+ * complete rather than parsing the file again.
+ *
+ * If @file does not exist, the operation fails with
+ * %G_IO_ERROR_NOT_FOUND, but @file is still monitored so that the
+ * database is loaded once it is created.
+ */
+void
+ide_compile_commands_load_async (IdeCompileCommands  *self,
+                                 GFile               *file,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  LoadState *state;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_COMPILE_COMMANDS (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_compile_commands_load_async);
+
+  if (self->in_flight != NULL)
+    {
+      state = g_task_get_task_data (self->in_flight);
+
+      if (!g_file_equal (state->file, file))
+        {
+          g_autoptr(GPtrArray) superseded = ide_compile_commands_cancel_load (self);
+
+          for (guint i = 0; superseded != NULL && i < superseded->len; i++)
+            g_task_return_new_error (g_ptr_array_index (superseded, i),
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_CANCELLED,
+                                     "The load was superseded");
+        }
+    }
+
+  if (self->in_flight == NULL)
+    ide_compile_commands_start_load (self, file, NULL);
+
+  state = g_task_get_task_data (self->in_flight);
+  g_ptr_array_add (state->waiting, g_steal_pointer (&task));
+
+  IDE_EXIT;
+}
+
+gboolean
+ide_compile_commands_load_finish (IdeCompileCommands  *self,
+                                  GAsyncResult        *result,
+                                  GError             **error)
+{
+  gboolean ret;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (result), FALSE);
+
+  ret = g_task_propagate_boolean (G_TASK (result), error);
+
+  IDE_RETURN (ret);
+}
+
+static gboolean
+flag_takes_argument (const gchar *flag)
+{
+  return (g_strcmp0 (flag, "-I") == 0 ||
+          g_strcmp0 (flag, "-D") == 0 ||
+          g_strcmp0 (flag, "-U") == 0 ||
+          g_strcmp0 (flag, "-isystem") == 0 ||
+          g_strcmp0 (flag, "-iquote") == 0 ||
+          g_strcmp0 (flag, "-idirafter") == 0 ||
+          g_strcmp0 (flag, "-include") == 0);
+}
+
+static gboolean
+flag_is_path (const gchar *flag)
+{
+  return (g_str_has_prefix (flag, "-I") ||
+          g_strcmp0 (flag, "-isystem") == 0 ||
+          g_strcmp0 (flag, "-iquote") == 0 ||
+          g_strcmp0 (flag, "-idirafter") == 0 ||
+          g_strcmp0 (flag, "-include") == 0);
+}
+
+static gboolean
+flag_is_interesting (const gchar *flag)
+{
+  return (g_str_has_prefix (flag, "-I") ||
+          g_str_has_prefix (flag, "-D") ||
+          g_str_has_prefix (flag, "-U") ||
+          g_str_has_prefix (flag, "-W") ||
+          g_str_has_prefix (flag, "-std=") ||
+          g_str_has_prefix (flag, "-f") ||
+          g_str_has_prefix (flag, "-m") ||
+          flag_takes_argument (flag));
+}
+
+/*
+ * Extracts the flags that are relevant to parsing the translation unit,
+ * translating include paths which are relative to the build directory.
+ */
+static gchar **
+filter_flags (const gchar * const *argv,
+              const gchar         *directory)
+{
+  GPtrArray *ar;
+
+  g_assert (argv != NULL);
+  g_assert (directory != NULL);
+
+  ar = g_ptr_array_new ();
+
+  /* Skip argv[0], the compiler */
+  for (guint i = argv [0] ? 1 : 0; argv [i] != NULL; i++)
+    {
+      const gchar *flag = argv [i];
+
+      if (!flag_is_interesting (flag))
+        continue;
+
+      if (flag_takes_argument (flag))
+        {
+          const gchar *param = argv [i + 1];
+
+          if (param == NULL)
+            break;
+
+          i++;
+
+          g_ptr_array_add (ar, g_strdup (flag));
+
+          if (flag_is_path (flag) && !g_path_is_absolute (param))
+            g_ptr_array_add (ar, g_build_filename (directory, param, NULL));
+          else
+            g_ptr_array_add (ar, g_strdup (param));
+
+          continue;
+        }
+
+      if (g_str_has_prefix (flag, "-I") && !g_path_is_absolute (flag + 2))
+        {
+          g_autofree gchar *abspath = g_build_filename (directory, flag + 2, NULL);
+
+          g_ptr_array_add (ar, g_strdup_printf ("-I%s", abspath));
+          continue;
+        }
+
+      g_ptr_array_add (ar, g_strdup (flag));
+    }
+
+  g_ptr_array_add (ar, NULL);
+
+  return (gchar **)g_ptr_array_free (ar, FALSE);
+}
+
+/**
+ * ide_compile_commands_lookup:
+ * @self: An #IdeCompileCommands
+ * @file: a #GFile representing the file to lookup
+ * @directory: (out) (optional) (transfer full): A location for a #GFile, or %NULL
+ * @error: A location for a #GError, or %NULL
+ *
+ * Locates the flags used to compile @file. The command line is tokenized
+ * on first use and the result cached for subsequent lookups.
+ *
+ * If @directory is non-%NULL, it is set to the directory the command
+ * should be run from.
+ *
+ * Returns: (transfer full): A #GStrv of flags or %NULL and @error is set.
+ */
+gchar **
+ide_compile_commands_lookup (IdeCompileCommands  *self,
+                             GFile               *file,
+                             GFile              **directory,
+                             GError             **error)
+{
+  g_autofree gchar *path = NULL;
+  CompileInfo *info;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  if (directory != NULL)
+    *directory = NULL;
+
+  if (self->info_by_path == NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_INITIALIZED,
+                   "Compile commands have not been loaded");
+      IDE_RETURN (NULL);
+    }
+
+  if (NULL == (path = g_file_get_path (file)) ||
+      NULL == (info = g_hash_table_lookup (self->info_by_path, path)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_FOUND,
+                   "File is not included in compile commands");
+      IDE_RETURN (NULL);
+    }
+
+  if (info->flags == NULL)
+    {
+      if (info->argv == NULL)
+        {
+          if (info->command == NULL)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "No command found for file");
+              IDE_RETURN (NULL);
+            }
+
+          if (!g_shell_parse_argv (info->command, NULL, &info->argv, error))
+            IDE_RETURN (NULL);
+
+          g_clear_pointer (&info->command, g_free);
+        }
+
+      info->flags = filter_flags ((const gchar * const *)info->argv, info->directory);
+    }
+
+  if (directory != NULL)
+    *directory = g_file_new_for_path (info->directory);
+
+  IDE_RETURN (g_strdupv (info->flags));
+}
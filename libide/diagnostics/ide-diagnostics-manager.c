@@ -18,10 +18,12 @@
 
 #define G_LOG_DOMAIN "ide-diagnostics-manager"
 
+#include <egg-counter.h>
 #include <gtksourceview/gtksource.h>
 
 #include "ide-context.h"
 #include "ide-debug.h"
+#include "ide-internal.h"
 #include "ide-macros.h"
 
 #include "buffers/ide-buffer.h"
@@ -32,6 +34,30 @@
 #include "diagnostics/ide-diagnostics-manager.h"
 #include "plugins/ide-extension-set-adapter.h"
 
+/*
+ * Edits to a buffer are coalesced for this long before we dispatch a new
+ * diagnosis so that we do not re-diagnose on every keystroke.
+ */
+#define DIAGNOSE_DEBOUNCE_MSEC 333
+
+/*
+ * The maximum number of diagnoses we allow in flight for a single provider
+ * type. Providers such as clang are expensive, and many buffers changing at
+ * once (such as after a branch switch) would otherwise thrash the machine.
+ */
+#define MAX_IN_FLIGHT_PER_PROVIDER 2
+
+typedef struct
+{
+  /* Number of diagnoses currently in flight for this provider type */
+  guint  in_flight;
+
+  /* Latency accounting for completed diagnoses, in microseconds */
+  guint  n_completed;
+  gint64 total_usec;
+  gint64 max_usec;
+} IdeDiagnosticsProviderStats;
+
 typedef struct
 {
   /*
@@ -75,6 +101,25 @@ typedef struct
    */
   IdeExtensionSetAdapter *adapter;
 
+  /*
+   * The set of providers which need to be diagnosed but have not yet been
+   * dispatched, either because we are waiting for the edits to settle or
+   * because too many diagnoses are in flight for that provider type.
+   */
+  GHashTable *pending;
+
+  /*
+   * Providers which are currently diagnosing, mapped to the monotonic time
+   * at which the diagnosis was dispatched so we can track latency.
+   */
+  GHashTable *in_flight;
+
+  /*
+   * The monotonic time at which the group may be diagnosed. This is pushed
+   * into the future as the user types so that we coalesce the changes.
+   */
+  gint64 ready_at;
+
   /*
    * This is our sequence number for diagnostics. It is monotonically
    * increasing with every diagnostic discovered.
@@ -123,11 +168,23 @@ struct _IdeDiagnosticsManager
    */
   GHashTable *groups_by_file;
 
+  /*
+   * Latency and concurrency accounting, keyed by the GType of the
+   * diagnostic provider. The value is an IdeDiagnosticsProviderStats.
+   */
+  GHashTable *stats_by_type;
+
   /*
    * If any group has a queued diagnose in process, this will be set so
    * we can coalesce the dispatch of everything at the same time.
    */
   guint queued_diagnose_source;
+
+  /*
+   * The monotonic time at which queued_diagnose_source will fire, so that
+   * we know if an earlier dispatch is necessary.
+   */
+  gint64 queued_diagnose_at;
 };
 
 enum {
@@ -150,6 +207,8 @@ static void     ide_diagnostics_manager_add_diagnostic    (IdeDiagnosticsManager
                                                            IdeDiagnostic         *diagnostic);
 static void     ide_diagnostics_group_queue_diagnose      (IdeDiagnosticsGroup   *group,
                                                            IdeDiagnosticsManager *self);
+static void     ide_diagnostics_manager_queue_dispatch    (IdeDiagnosticsManager *self,
+                                                           gint64                 ready_at);
 
 
 static GParamSpec *properties [N_PROPS];
@@ -159,6 +218,9 @@ static guint signals [N_SIGNALS];
 G_DEFINE_TYPE_WITH_CODE (IdeDiagnosticsManager, ide_diagnostics_manager, IDE_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init))
 
+EGG_DEFINE_COUNTER (dispatched, "IdeDiagnosticsManager", "Dispatched", "Number of diagnoses dispatched to providers")
+EGG_DEFINE_COUNTER (deferred, "IdeDiagnosticsManager", "Deferred", "Number of diagnoses deferred due to concurrency limits")
+
 
 static void
 free_diagnostics (gpointer data)
@@ -178,6 +240,8 @@ ide_diagnostics_group_free (gpointer data)
   g_assert (group->ref_count == 0);
 
   g_clear_pointer (&group->diagnostics_by_provider, g_hash_table_unref);
+  g_clear_pointer (&group->pending, g_hash_table_unref);
+  g_clear_pointer (&group->in_flight, g_hash_table_unref);
   g_weak_ref_clear (&group->buffer_wr);
   g_clear_object (&group->adapter);
   g_clear_object (&group->file);
@@ -194,6 +258,8 @@ ide_diagnostics_group_new (GFile *file)
   group = g_slice_new0 (IdeDiagnosticsGroup);
   group->ref_count = 1;
   group->file = g_object_ref (file);
+  group->pending = g_hash_table_new (NULL, NULL);
+  group->in_flight = g_hash_table_new_full (NULL, NULL, NULL, g_free);
 
   g_weak_ref_init (&group->buffer_wr, NULL);
 
@@ -295,6 +361,25 @@ ide_diagnostics_group_add (IdeDiagnosticsGroup   *group,
   group->sequence++;
 }
 
+static IdeDiagnosticsProviderStats *
+ide_diagnostics_manager_get_stats (IdeDiagnosticsManager *self,
+                                   GType                  provider_type)
+{
+  IdeDiagnosticsProviderStats *stats;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  stats = g_hash_table_lookup (self->stats_by_type, GSIZE_TO_POINTER (provider_type));
+
+  if (stats == NULL)
+    {
+      stats = g_new0 (IdeDiagnosticsProviderStats, 1);
+      g_hash_table_insert (self->stats_by_type, GSIZE_TO_POINTER (provider_type), stats);
+    }
+
+  return stats;
+}
+
 static void
 ide_diagnostics_group_diagnose_cb (GObject      *object,
                                    GAsyncResult *result,
@@ -304,7 +389,9 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
   g_autoptr(IdeDiagnosticsManager) self = user_data;
   g_autoptr(IdeDiagnostics) diagnostics = NULL;
   g_autoptr(GError) error = NULL;
+  IdeDiagnosticsProviderStats *stats;
   IdeDiagnosticsGroup *group;
+  gint64 *begin_time;
   gboolean changed;
 
   IDE_ENTRY;
@@ -317,6 +404,9 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
 
   diagnostics = ide_diagnostic_provider_diagnose_finish (provider, result, &error);
 
+  stats = ide_diagnostics_manager_get_stats (self, G_OBJECT_TYPE (provider));
+  stats->in_flight--;
+
   if (error != NULL)
     g_warning ("%s", error->message);
 
@@ -328,6 +418,23 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
   group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
   g_assert (group != NULL);
 
+  if (NULL != (begin_time = g_hash_table_lookup (group->in_flight, provider)))
+    {
+      gint64 elapsed = g_get_monotonic_time () - *begin_time;
+
+      stats->n_completed++;
+      stats->total_usec += elapsed;
+      stats->max_usec = MAX (stats->max_usec, elapsed);
+
+      g_debug ("%s diagnosed in %.3lf msec (avg %.3lf msec, max %.3lf msec)",
+               G_OBJECT_TYPE_NAME (provider),
+               elapsed / 1000.0,
+               stats->total_usec / (gdouble)stats->n_completed / 1000.0,
+               stats->max_usec / 1000.0);
+
+      g_hash_table_remove (group->in_flight, provider);
+    }
+
   /*
    * Clear all of our old diagnostics no matter where they ended up.
    */
@@ -381,27 +488,38 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
     g_signal_emit (self, signals [CHANGED], 0);
 
   /*
-   * If there are no more diagnostics providers active and the group needs
-   * another diagnosis, then we can start the next one now.
+   * We just released a slot for this provider type, so give the scheduler
+   * a chance to dispatch anything that was waiting on it (including
+   * another diagnosis of this group if it changed while we were busy).
    *
    * If we are completing this diagnosis and the buffer was already released
    * (and other diagnose providers have unloaded), we might be able to clean
    * up the group and be done with things.
    */
-  if (group->was_removed == FALSE && group->in_diagnose == 0 && group->needs_diagnose)
-    {
-      ide_diagnostics_group_queue_diagnose (group, self);
-    }
-  else if (ide_diagnostics_group_can_dispose (group))
+  if (group->was_removed == FALSE &&
+      group->in_diagnose == 0 &&
+      group->needs_diagnose == FALSE &&
+      ide_diagnostics_group_can_dispose (group))
     {
       group->was_removed = TRUE;
       g_hash_table_remove (self->groups_by_file, group->file);
-      IDE_EXIT;
     }
 
+  ide_diagnostics_manager_queue_dispatch (self, 0);
+
+  if (group->in_diagnose == 0)
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+
   IDE_EXIT;
 }
 
+typedef struct
+{
+  IdeDiagnosticsManager *self;
+  IdeDiagnosticsGroup   *group;
+  IdeFile               *file;
+} DiagnoseForeach;
+
 static void
 ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
                                         PeasPluginInfo         *plugin_info,
@@ -409,27 +527,67 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
                                         gpointer                user_data)
 {
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
-  IdeDiagnosticsManager *self = user_data;
-  IdeDiagnosticsGroup *group;
-  IdeContext *context;
-  g_autoptr(IdeFile) file = NULL;
+  DiagnoseForeach *state = user_data;
+  IdeDiagnosticsProviderStats *stats;
+  IdeDiagnosticsGroup *group = state->group;
+  gint64 *begin_time;
 
   IDE_ENTRY;
 
-  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (state->self));
   g_assert (IDE_IS_EXTENSION_SET_ADAPTER (adapter));
   g_assert (plugin_info != NULL);
   g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (group == g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP"));
 
-  group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
-  group->in_diagnose++;
+  /*
+   * Skip providers which do not need a diagnosis, or are still working
+   * on a previous one. The latter stay pending and will be dispatched
+   * again once the in-flight request completes.
+   */
+  if (!g_hash_table_contains (group->pending, provider) ||
+      g_hash_table_contains (group->in_flight, provider))
+    IDE_EXIT;
 
-  context = ide_object_get_context (IDE_OBJECT (self));
+  stats = ide_diagnostics_manager_get_stats (state->self, G_OBJECT_TYPE (provider));
 
-  file = g_object_new (IDE_TYPE_FILE,
-                       "context", context,
-                       "file", group->file,
-                       NULL);
+  if (stats->in_flight >= MAX_IN_FLIGHT_PER_PROVIDER)
+    {
+      EGG_COUNTER_INC (deferred);
+      IDE_EXIT;
+    }
+
+  /*
+   * We need to ensure that all the diagnostic providers have access to the
+   * proper data within the unsaved files. So sync the content once to avoid
+   * all providers from having to do this manually.
+   */
+  if (state->file == NULL)
+    {
+      g_autoptr(IdeBuffer) buffer = NULL;
+      IdeContext *context;
+
+      if (NULL != (buffer = g_weak_ref_get (&group->buffer_wr)))
+        ide_buffer_sync_to_unsaved_files (buffer);
+
+      context = ide_object_get_context (IDE_OBJECT (state->self));
+
+      state->file = g_object_new (IDE_TYPE_FILE,
+                                  "context", context,
+                                  "file", group->file,
+                                  NULL);
+    }
+
+  begin_time = g_new (gint64, 1);
+  *begin_time = g_get_monotonic_time ();
+
+  g_hash_table_remove (group->pending, provider);
+  g_hash_table_insert (group->in_flight, provider, begin_time);
+
+  stats->in_flight++;
+  group->in_diagnose++;
+
+  EGG_COUNTER_INC (dispatched);
 
 #ifdef IDE_ENABLE_TRACE
   {
@@ -440,57 +598,105 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
 #endif
 
   ide_diagnostic_provider_diagnose_async (provider,
-                                          file,
+                                          state->file,
                                           NULL,
                                           ide_diagnostics_group_diagnose_cb,
-                                          g_object_ref (self));
+                                          g_object_ref (state->self));
+
+  IDE_EXIT;
 }
 
 static void
 ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
                                 IdeDiagnosticsManager *self)
 {
-  g_autoptr(IdeBuffer) buffer = NULL;
+  DiagnoseForeach state = { self, group, NULL };
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
   g_assert (group != NULL);
-  g_assert (group->in_diagnose == FALSE);
   g_assert (IDE_IS_EXTENSION_SET_ADAPTER (group->adapter));
 
-  group->needs_diagnose = FALSE;
-  group->has_diagnostics = FALSE;
-
-  /*
-   * We need to ensure that all the diagnostic providers have access to the
-   * proper data within the unsaved files. So sync the content once to avoid
-   * all providers from having to do this manually.
-   */
-  if (NULL != (buffer = g_weak_ref_get (&group->buffer_wr)))
-    ide_buffer_sync_to_unsaved_files (buffer);
+  if (group->in_diagnose == 0)
+    group->has_diagnostics = FALSE;
 
   ide_extension_set_adapter_foreach (group->adapter,
                                      ide_diagnostics_group_diagnose_foreach,
-                                     self);
+                                     &state);
+
+  /* Anything still pending is waiting on a concurrency slot */
+  group->needs_diagnose = g_hash_table_size (group->pending) > 0;
 
-  g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+  if (state.file != NULL)
+    {
+      g_clear_object (&state.file);
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+    }
 
   IDE_EXIT;
 }
 
+/*
+ * Lower values are dispatched first. The focused buffer is most important,
+ * followed by buffers that are visible in a view, then buffers which are
+ * loaded but not displayed.
+ */
+static gint
+ide_diagnostics_group_get_priority (IdeDiagnosticsGroup *group,
+                                    IdeBuffer           *focus_buffer)
+{
+  g_autoptr(IdeBuffer) buffer = NULL;
+
+  g_assert (group != NULL);
+
+  if (NULL == (buffer = g_weak_ref_get (&group->buffer_wr)))
+    return 3;
+
+  if (buffer == focus_buffer)
+    return 0;
+
+  if (_ide_buffer_get_held (buffer))
+    return 1;
+
+  return 2;
+}
+
+static gint
+compare_by_priority (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  IdeDiagnosticsGroup *group_a = *(IdeDiagnosticsGroup **)a;
+  IdeDiagnosticsGroup *group_b = *(IdeDiagnosticsGroup **)b;
+  IdeBuffer *focus_buffer = user_data;
+
+  return ide_diagnostics_group_get_priority (group_a, focus_buffer) -
+         ide_diagnostics_group_get_priority (group_b, focus_buffer);
+}
+
 static gboolean
 ide_diagnostics_manager_begin_diagnose (gpointer data)
 {
   IdeDiagnosticsManager *self = data;
+  g_autoptr(GPtrArray) ready = NULL;
+  IdeBufferManager *buffer_manager;
+  IdeBuffer *focus_buffer;
+  IdeContext *context;
   GHashTableIter iter;
   gpointer value;
+  gint64 next_ready_at = G_MAXINT64;
+  gint64 now;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
 
   self->queued_diagnose_source = 0;
+  self->queued_diagnose_at = 0;
+
+  now = g_get_monotonic_time ();
+  ready = g_ptr_array_new ();
 
   g_hash_table_iter_init (&iter, self->groups_by_file);
 
@@ -498,13 +704,84 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
     {
       IdeDiagnosticsGroup *group = value;
 
-      if (group->needs_diagnose && group->adapter != NULL)
-        ide_diagnostics_group_diagnose (group, self);
+      if (!group->needs_diagnose || group->adapter == NULL)
+        continue;
+
+      if (group->ready_at > now)
+        {
+          next_ready_at = MIN (next_ready_at, group->ready_at);
+          continue;
+        }
+
+      g_ptr_array_add (ready, group);
     }
 
+  context = ide_object_get_context (IDE_OBJECT (self));
+  buffer_manager = ide_context_get_buffer_manager (context);
+  focus_buffer = ide_buffer_manager_get_focus_buffer (buffer_manager);
+
+  g_ptr_array_sort_with_data (ready, compare_by_priority, focus_buffer);
+
+  for (guint i = 0; i < ready->len; i++)
+    ide_diagnostics_group_diagnose (g_ptr_array_index (ready, i), self);
+
+  /*
+   * Groups blocked on concurrency limits will be retried as providers
+   * complete. Groups still settling need a timeout to wake us up.
+   */
+  if (next_ready_at != G_MAXINT64)
+    ide_diagnostics_manager_queue_dispatch (self, next_ready_at);
+
   IDE_RETURN (G_SOURCE_REMOVE);
 }
 
+static void
+ide_diagnostics_manager_queue_dispatch (IdeDiagnosticsManager *self,
+                                        gint64                 ready_at)
+{
+  gint64 now;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  /* Nothing to do if we'll already be dispatching by then */
+  if (self->queued_diagnose_source != 0 && self->queued_diagnose_at <= ready_at)
+    return;
+
+  ide_clear_source (&self->queued_diagnose_source);
+
+  now = g_get_monotonic_time ();
+
+  self->queued_diagnose_at = ready_at;
+
+  if (ready_at <= now)
+    self->queued_diagnose_source =
+      gdk_threads_add_idle_full (G_PRIORITY_DEFAULT,
+                                 ide_diagnostics_manager_begin_diagnose,
+                                 g_object_ref (self),
+                                 g_object_unref);
+  else
+    self->queued_diagnose_source =
+      gdk_threads_add_timeout_full (G_PRIORITY_DEFAULT,
+                                    (ready_at - now) / 1000L + 1,
+                                    ide_diagnostics_manager_begin_diagnose,
+                                    g_object_ref (self),
+                                    g_object_unref);
+}
+
+static void
+ide_diagnostics_group_mark_pending (IdeExtensionSetAdapter *adapter,
+                                    PeasPluginInfo         *plugin_info,
+                                    PeasExtension          *exten,
+                                    gpointer                user_data)
+{
+  IdeDiagnosticsGroup *group = user_data;
+
+  g_assert (group != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (exten));
+
+  g_hash_table_add (group->pending, exten);
+}
+
 static void
 ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
                                       IdeDiagnosticsManager *self)
@@ -512,20 +789,22 @@ ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
   g_assert (group != NULL);
 
   /*
-   * This checks to see if we are diagnosing and if not queues a diagnose.
-   * If a diagnosis is already running, we don't need to do anything now
-   * because the completion of the diagnose will tick off the next diagnose
-   * upon seening group->needs_diagnose==TRUE.
+   * This marks every provider of the group as needing a diagnosis and
+   * schedules the dispatcher for when the group is ready. Providers that
+   * are already diagnosing stay pending and are dispatched again by the
+   * scheduler once their current request completes.
    */
 
+  if (group->adapter == NULL)
+    return;
+
+  ide_extension_set_adapter_foreach (group->adapter,
+                                     ide_diagnostics_group_mark_pending,
+                                     group);
+
   group->needs_diagnose = TRUE;
 
-  if (group->in_diagnose == 0 && self->queued_diagnose_source == 0)
-    self->queued_diagnose_source =
-      gdk_threads_add_idle_full (G_PRIORITY_DEFAULT,
-                                 ide_diagnostics_manager_begin_diagnose,
-                                 g_object_ref (self),
-                                 g_object_unref);
+  ide_diagnostics_manager_queue_dispatch (self, group->ready_at);
 }
 
 static void
@@ -535,6 +814,7 @@ ide_diagnostics_manager_finalize (GObject *object)
 
   ide_clear_source (&self->queued_diagnose_source);
   g_clear_pointer (&self->groups_by_file, g_hash_table_unref);
+  g_clear_pointer (&self->stats_by_type, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_diagnostics_manager_parent_class)->finalize (object);
 }
@@ -596,6 +876,7 @@ ide_diagnostics_manager_init (IdeDiagnosticsManager *self)
                                                 (GEqualFunc)g_file_equal,
                                                 NULL,
                                                 (GDestroyNotify)ide_diagnostics_group_unref);
+  self->stats_by_type = g_hash_table_new_full (NULL, NULL, NULL, g_free);
 }
 
 static void
@@ -801,6 +1082,7 @@ ide_diagnostics_manager_extension_removed (IdeExtensionSetAdapter *adapter,
 {
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
   IdeDiagnosticsManager *self = user_data;
+  IdeDiagnosticsGroup *group;
 
   IDE_ENTRY;
 
@@ -813,6 +1095,13 @@ ide_diagnostics_manager_extension_removed (IdeExtensionSetAdapter *adapter,
                                         G_CALLBACK (ide_diagnostics_manager_provider_invalidated),
                                         self);
 
+  /*
+   * Drop any queued diagnosis for the provider. If it is in flight, the
+   * completion callback will release the concurrency slot.
+   */
+  if (NULL != (group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP")))
+    g_hash_table_remove (group->pending, provider);
+
   /*
    * The goal of the following is to reomve our diagnostics from any file
    * that has been loaded. It is possible for diagnostic providers to effect
@@ -836,6 +1125,10 @@ ide_diagnostics_manager_buffer_changed (IdeDiagnosticsManager *self,
   g_assert (IDE_IS_BUFFER (buffer));
 
   group = ide_diagnostics_manager_find_group_from_buffer (self, buffer);
+
+  /* Push the dispatch back while the user is still typing */
+  group->ready_at = g_get_monotonic_time () + (DIAGNOSE_DEBOUNCE_MSEC * 1000L);
+
   ide_diagnostics_group_queue_diagnose (group, self);
 
   IDE_EXIT;
@@ -17,9 +17,59 @@
  */
 
 #include <editorconfig/editorconfig.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "ec_glob.h"
+#include "ini.h"
 
 #include "editorconfig-glib.h"
 
+#define ROOT_SECTION G_MAXUINT
+
+/*
+ * EditorconfigGlibCache resolves settings like editorconfig_parse() does,
+ * but keeps every .editorconfig it reads, keyed by directory, with the
+ * globs of its sections compiled. Files are read with the ini parser of
+ * libeditorconfig, so lookups give the same results.
+ *
+ * A file monitor marks a directory as stale when its .editorconfig
+ * changes. It is read again on the next lookup, unless its modification
+ * time and size did not change.
+ */
+
+typedef struct
+{
+  ec_glob_t *glob;
+} Section;
+
+typedef struct
+{
+  guint  section;
+  gchar *name;
+  gchar *value;
+} Entry;
+
+typedef struct
+{
+  gchar        *dir;
+  GPtrArray    *sections;
+  GArray       *entries;
+  GFileMonitor *monitor;
+  gint64        mtime;
+  gint64        size;
+  gint          error;
+  guint         exists : 1;
+  guint         stale : 1;
+} ConfigFile;
+
+struct _EditorconfigGlibCache
+{
+  volatile gint  ref_count;
+  GMutex         mutex;
+  GHashTable    *files;
+};
+
 static void
 _g_value_free (gpointer data)
 {
@@ -29,6 +79,43 @@ _g_value_free (gpointer data)
   g_free (value);
 }
 
+static GHashTable *
+create_table (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, _g_value_free);
+}
+
+static void
+add_value (GHashTable  *ret,
+           const gchar *key,
+           const gchar *valuestr)
+{
+  GValue *value;
+
+  value = g_new0 (GValue, 1);
+
+  if ((g_strcmp0 (key, "tab_width") == 0) ||
+      (g_strcmp0 (key, "max_line_length") == 0) ||
+      (g_strcmp0 (key, "indent_size") == 0))
+    {
+      g_value_init (value, G_TYPE_INT);
+      g_value_set_int (value, g_ascii_strtoll (valuestr, NULL, 10));
+    }
+  else if ((g_strcmp0 (key, "insert_final_newline") == 0) ||
+           (g_strcmp0 (key, "trim_trailing_whitespace") == 0))
+    {
+      g_value_init (value, G_TYPE_BOOLEAN);
+      g_value_set_boolean (value, g_str_equal (valuestr, "true"));
+    }
+  else
+    {
+      g_value_init (value, G_TYPE_STRING);
+      g_value_set_string (value, valuestr);
+    }
+
+  g_hash_table_replace (ret, g_strdup (key), value);
+}
+
 GHashTable *
 editorconfig_glib_read (GFile         *file,
                         GCancellable  *cancellable,
@@ -77,43 +164,463 @@ editorconfig_glib_read (GFile         *file,
 
   count = editorconfig_handle_get_name_value_count (handle);
 
-  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, _g_value_free);
+  ret = create_table ();
 
   for (i = 0; i < count; i++)
     {
-      GValue *value;
       const gchar *key = NULL;
       const gchar *valuestr = NULL;
 
-      value = g_new0 (GValue, 1);
-
       editorconfig_handle_get_name_value (handle, i, &key, &valuestr);
+      add_value (ret, key, valuestr);
+    }
+
+cleanup:
+  editorconfig_handle_destroy (handle);
+  g_free (filename);
+
+  return ret;
+}
+
+static void
+entry_clear (gpointer data)
+{
+  Entry *entry = data;
+
+  g_clear_pointer (&entry->name, g_free);
+  g_clear_pointer (&entry->value, g_free);
+}
+
+static void
+section_free (gpointer data)
+{
+  Section *section = data;
+
+  g_clear_pointer (&section->glob, ec_glob_free);
+  g_slice_free (Section, section);
+}
+
+static void
+config_file_changed (GFileMonitor          *monitor,
+                     GFile                 *file,
+                     GFile                 *other_file,
+                     GFileMonitorEvent      event,
+                     EditorconfigGlibCache *cache)
+{
+  const gchar *dir;
+  ConfigFile *cf;
+
+  g_assert (G_IS_FILE_MONITOR (monitor));
+  g_assert (cache != NULL);
 
-      if ((g_strcmp0 (key, "tab_width") == 0) ||
-          (g_strcmp0 (key, "max_line_length") == 0) ||
-          (g_strcmp0 (key, "indent_size") == 0))
+  dir = g_object_get_data (G_OBJECT (monitor), "EDITORCONFIG_DIR");
+
+  g_mutex_lock (&cache->mutex);
+  if ((cf = g_hash_table_lookup (cache->files, dir)) && cf->monitor == monitor)
+    cf->stale = TRUE;
+  g_mutex_unlock (&cache->mutex);
+}
+
+static void
+config_file_free (gpointer data)
+{
+  ConfigFile *cf = data;
+
+  if (cf->monitor != NULL)
+    {
+      g_file_monitor_cancel (cf->monitor);
+      g_signal_handlers_disconnect_matched (cf->monitor, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, config_file_changed, NULL);
+      g_clear_object (&cf->monitor);
+    }
+
+  g_clear_pointer (&cf->dir, g_free);
+  g_clear_pointer (&cf->sections, g_ptr_array_unref);
+  g_clear_pointer (&cf->entries, g_array_unref);
+  g_slice_free (ConfigFile, cf);
+}
+
+typedef struct
+{
+  ConfigFile *cf;
+  gchar      *section;
+} ParseState;
+
+/* Same as ini_handler() in libeditorconfig, but matching is deferred */
+static int
+config_file_ini_handler (void       *user_data,
+                         const char *section,
+                         const char *name,
+                         const char *value)
+{
+  ParseState *state = user_data;
+  ConfigFile *cf = state->cf;
+  Entry entry = { 0 };
+
+  if (*section == '\0' &&
+      g_ascii_strcasecmp (name, "root") == 0 &&
+      g_ascii_strcasecmp (value, "true") == 0)
+    {
+      entry.section = ROOT_SECTION;
+      g_array_append_val (cf->entries, entry);
+      return 1;
+    }
+
+  if (state->section == NULL || !g_str_equal (state->section, section))
+    {
+      Section *s;
+      gchar *pattern;
+
+      /*
+       * The directory of the .editorconfig, followed by double star and a
+       * slash if the section has no slash, or by a slash if the section
+       * does not start with one.
+       */
+      if (strchr (section, '/') == NULL)
+        pattern = g_strconcat (cf->dir, "**/", section, NULL);
+      else if (*section != '/')
+        pattern = g_strconcat (cf->dir, "/", section, NULL);
+      else
+        pattern = g_strconcat (cf->dir, section, NULL);
+
+      s = g_slice_new0 (Section);
+      s->glob = ec_glob_compile (pattern);
+      g_ptr_array_add (cf->sections, s);
+
+      g_free (state->section);
+      state->section = g_strdup (section);
+      g_free (pattern);
+    }
+
+  entry.section = cf->sections->len - 1;
+  entry.name = g_strdup (name);
+  entry.value = g_strdup (value);
+  g_array_append_val (cf->entries, entry);
+
+  return 1;
+}
+
+static gboolean
+stat_config_file (const gchar *path,
+                  gint64      *mtime,
+                  gint64      *size)
+{
+  GStatBuf st;
+
+  *mtime = 0;
+  *size = 0;
+
+  if (g_stat (path, &st) != 0)
+    return FALSE;
+
+  *mtime = st.st_mtime;
+  *size = st.st_size;
+
+  return TRUE;
+}
+
+/*
+ * Gets the parsed .editorconfig of @dir, reading it if needed. Must be
+ * called with the mutex held.
+ */
+static ConfigFile *
+editorconfig_glib_cache_ensure (EditorconfigGlibCache *cache,
+                                const gchar           *dir)
+{
+  g_autofree gchar *path = NULL;
+  g_autoptr(GFile) file = NULL;
+  ParseState state = { 0 };
+  ConfigFile *cf;
+  gboolean exists;
+  gint64 mtime;
+  gint64 size;
+
+  if ((cf = g_hash_table_lookup (cache->files, dir)) && !cf->stale)
+    return cf;
+
+  path = g_strconcat (dir, "/.editorconfig", NULL);
+  exists = stat_config_file (path, &mtime, &size);
+
+  if (cf != NULL)
+    {
+      if (cf->exists == exists && cf->mtime == mtime && cf->size == size)
         {
-          g_value_init (value, G_TYPE_INT);
-          g_value_set_int (value, g_ascii_strtoll (valuestr, NULL, 10));
+          cf->stale = FALSE;
+          return cf;
         }
-      else if ((g_strcmp0 (key, "insert_final_newline") == 0) ||
-               (g_strcmp0 (key, "trim_trailing_whitespace") == 0))
+
+      g_hash_table_remove (cache->files, dir);
+    }
+
+  cf = g_slice_new0 (ConfigFile);
+  cf->dir = g_strdup (dir);
+  cf->sections = g_ptr_array_new_with_free_func (section_free);
+  cf->entries = g_array_new (FALSE, FALSE, sizeof (Entry));
+  g_array_set_clear_func (cf->entries, entry_clear);
+  cf->exists = exists;
+  cf->mtime = mtime;
+  cf->size = size;
+
+  /* Like editorconfig_parse(), I/O errors mean there is no file */
+  state.cf = cf;
+  if (exists && (cf->error = ini_parse (path, config_file_ini_handler, &state)) < 0)
+    cf->error = 0;
+  g_free (state.section);
+
+  file = g_file_new_for_path (path);
+  cf->monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+
+  if (cf->monitor != NULL)
+    {
+      g_object_set_data_full (G_OBJECT (cf->monitor), "EDITORCONFIG_DIR", g_strdup (dir), g_free);
+      g_signal_connect (cf->monitor, "changed", G_CALLBACK (config_file_changed), cache);
+    }
+
+  g_hash_table_insert (cache->files, g_strdup (dir), cf);
+
+  return cf;
+}
+
+static gint
+name_values_find (GPtrArray   *names,
+                  const gchar *name)
+{
+  for (guint i = 0; i < names->len; i++)
+    {
+      if (g_str_equal (g_ptr_array_index (names, i), name))
+        return i;
+    }
+
+  return -1;
+}
+
+static const gchar *
+name_values_lookup (GPtrArray   *names,
+                    GPtrArray   *values,
+                    const gchar *name)
+{
+  gint pos = name_values_find (names, name);
+
+  return pos < 0 ? NULL : g_ptr_array_index (values, pos);
+}
+
+/* Same as array_editorconfig_name_value_add() in libeditorconfig */
+static void
+name_values_add (GPtrArray   *names,
+                 GPtrArray   *values,
+                 const gchar *name,
+                 const gchar *value)
+{
+  gchar *name_lwr;
+  gchar *value_copy;
+  gint pos;
+
+  name_lwr = g_ascii_strdown (name, -1);
+  value_copy = g_strdup (value);
+
+  if (g_str_equal (name_lwr, "end_of_line") ||
+      g_str_equal (name_lwr, "indent_style") ||
+      g_str_equal (name_lwr, "indent_size") ||
+      g_str_equal (name_lwr, "insert_final_newline") ||
+      g_str_equal (name_lwr, "trim_trailing_whitespace") ||
+      g_str_equal (name_lwr, "charset"))
+    {
+      for (gchar *c = value_copy; *c; c++)
+        *c = g_ascii_tolower (*c);
+    }
+
+  if ((pos = name_values_find (names, name_lwr)) >= 0)
+    {
+      g_free (name_lwr);
+      g_free (g_ptr_array_index (values, pos));
+      g_ptr_array_index (values, pos) = value_copy;
+      return;
+    }
+
+  g_ptr_array_add (names, name_lwr);
+  g_ptr_array_add (values, value_copy);
+}
+
+/* Same post-processing as editorconfig_parse() */
+static void
+name_values_finish (GPtrArray *names,
+                    GPtrArray *values)
+{
+  const gchar *indent_style;
+  const gchar *indent_size;
+  const gchar *tab_width;
+  gboolean v0_9 = FALSE;
+  gint major = 0;
+  gint minor = 0;
+  gint patch = 0;
+
+  editorconfig_get_version (&major, &minor, &patch);
+  v0_9 = (major > 0 || (major == 0 && minor >= 9));
+
+  if (v0_9)
+    {
+      indent_style = name_values_lookup (names, values, "indent_style");
+      indent_size = name_values_lookup (names, values, "indent_size");
+
+      if (indent_style && !indent_size && g_str_equal (indent_style, "tab"))
+        name_values_add (names, values, "indent_size", "tab");
+
+      indent_size = name_values_lookup (names, values, "indent_size");
+      tab_width = name_values_lookup (names, values, "tab_width");
+
+      if (indent_size && tab_width && g_str_equal (indent_size, "tab"))
         {
-          g_value_init (value, G_TYPE_BOOLEAN);
-          g_value_set_boolean (value, g_str_equal (valuestr, "true"));
+          g_autofree gchar *copy = g_strdup (tab_width);
+
+          name_values_add (names, values, "indent_size", copy);
         }
-      else
+    }
+
+  indent_size = name_values_lookup (names, values, "indent_size");
+  tab_width = name_values_lookup (names, values, "tab_width");
+
+  if (indent_size && !tab_width && (!v0_9 || !g_str_equal (indent_size, "tab")))
+    {
+      g_autofree gchar *copy = g_strdup (indent_size);
+
+      name_values_add (names, values, "tab_width", copy);
+    }
+}
+
+EditorconfigGlibCache *
+editorconfig_glib_cache_new (void)
+{
+  EditorconfigGlibCache *cache;
+
+  cache = g_slice_new0 (EditorconfigGlibCache);
+  cache->ref_count = 1;
+  g_mutex_init (&cache->mutex);
+  cache->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, config_file_free);
+
+  return cache;
+}
+
+EditorconfigGlibCache *
+editorconfig_glib_cache_ref (EditorconfigGlibCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (cache->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&cache->ref_count);
+
+  return cache;
+}
+
+void
+editorconfig_glib_cache_unref (EditorconfigGlibCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (cache->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&cache->ref_count))
+    {
+      g_clear_pointer (&cache->files, g_hash_table_unref);
+      g_mutex_clear (&cache->mutex);
+      g_slice_free (EditorconfigGlibCache, cache);
+    }
+}
+
+/**
+ * editorconfig_glib_cache_read:
+ *
+ * Like editorconfig_glib_read(), but reuses the .editorconfig files
+ * already read by @cache.
+ */
+GHashTable *
+editorconfig_glib_cache_read (EditorconfigGlibCache  *cache,
+                              GFile                  *file,
+                              GCancellable           *cancellable,
+                              GError                **error)
+{
+  g_autoptr(GPtrArray) names = NULL;
+  g_autoptr(GPtrArray) values = NULL;
+  g_autofree gchar *filename = NULL;
+  GHashTable *ret;
+  gboolean failed = FALSE;
+
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  filename = g_file_get_path (file);
+
+  if (!filename)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "only local files are currently supported");
+      return NULL;
+    }
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  values = g_ptr_array_new_with_free_func (g_free);
+
+  g_mutex_lock (&cache->mutex);
+
+  /* From the root down to the directory of @file, like get_filenames() */
+  for (const gchar *slash = strchr (filename, '/'); slash; slash = strchr (slash + 1, '/'))
+    {
+      g_autofree gchar *dir = g_strndup (filename, slash - filename);
+      g_autofree gint8 *matched = NULL;
+      ConfigFile *cf;
+
+      cf = editorconfig_glib_cache_ensure (cache, dir);
+
+      if (cf->error != 0)
         {
-          g_value_init (value, G_TYPE_STRING);
-          g_value_set_string (value, valuestr);
+          failed = TRUE;
+          break;
         }
 
-      g_hash_table_replace (ret, g_strdup (key), value);
+      /* -1 until a section is matched against @filename */
+      matched = g_malloc (cf->sections->len + 1);
+      memset (matched, -1, cf->sections->len + 1);
+
+      for (guint i = 0; i < cf->entries->len; i++)
+        {
+          const Entry *entry = &g_array_index (cf->entries, Entry, i);
+          const Section *section;
+
+          if (entry->section == ROOT_SECTION)
+            {
+              g_ptr_array_set_size (names, 0);
+              g_ptr_array_set_size (values, 0);
+              continue;
+            }
+
+          if (matched [entry->section] == -1)
+            {
+              section = g_ptr_array_index (cf->sections, entry->section);
+              matched [entry->section] = section->glob != NULL &&
+                                         ec_glob_match (section->glob, filename) == 0;
+            }
+
+          if (matched [entry->section])
+            name_values_add (names, values, entry->name, entry->value);
+        }
     }
 
-cleanup:
-  editorconfig_handle_destroy (handle);
-  g_free (filename);
+  g_mutex_unlock (&cache->mutex);
+
+  if (failed)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "Failed to parse editorconfig.");
+      return NULL;
+    }
+
+  name_values_finish (names, values);
+
+  ret = create_table ();
+
+  for (guint i = 0; i < names->len; i++)
+    add_value (ret, g_ptr_array_index (names, i), g_ptr_array_index (values, i));
 
   return ret;
 }
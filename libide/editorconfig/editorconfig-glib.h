@@ -13,8 +13,17 @@
 
 #include <gio/gio.h>
 
-GHashTable *editorconfig_glib_read (GFile         *file,
-                                    GCancellable  *cancellable,
-                                    GError       **error);
+typedef struct _EditorconfigGlibCache EditorconfigGlibCache;
+
+GHashTable            *editorconfig_glib_read        (GFile                  *file,
+                                                      GCancellable           *cancellable,
+                                                      GError                **error);
+EditorconfigGlibCache *editorconfig_glib_cache_new   (void);
+EditorconfigGlibCache *editorconfig_glib_cache_ref   (EditorconfigGlibCache  *cache);
+void                   editorconfig_glib_cache_unref (EditorconfigGlibCache  *cache);
+GHashTable            *editorconfig_glib_cache_read  (EditorconfigGlibCache  *cache,
+                                                      GFile                  *file,
+                                                      GCancellable           *cancellable,
+                                                      GError                **error);
 
 #endif /* EDITORCONFIG_GLIB_H */
@@ -21,6 +21,7 @@
 #include <editorconfig-glib.h>
 #include <glib/gi18n.h>
 
+#include "ide-context.h"
 #include "ide-debug.h"
 
 #include "editorconfig/ide-editorconfig-file-settings.h"
@@ -50,13 +51,57 @@ ide_editorconfig_file_settings_init (IdeEditorconfigFileSettings *self)
 {
 }
 
+typedef struct
+{
+  GFile                 *file;
+  EditorconfigGlibCache *cache;
+} InitState;
+
+static void
+init_state_free (gpointer data)
+{
+  InitState *state = data;
+
+  g_clear_object (&state->file);
+  g_clear_pointer (&state->cache, editorconfig_glib_cache_unref);
+  g_slice_free (InitState, state);
+}
+
+/*
+ * The .editorconfig files are shared by every file of a context, so they are
+ * kept in a cache attached to the context.
+ */
+static EditorconfigGlibCache *
+get_cache (IdeEditorconfigFileSettings *self)
+{
+  EditorconfigGlibCache *cache;
+  IdeContext *context;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  if (context == NULL)
+    return NULL;
+
+  cache = g_object_get_data (G_OBJECT (context), "EDITORCONFIG_CACHE");
+
+  if (cache == NULL)
+    {
+      cache = editorconfig_glib_cache_new ();
+      g_object_set_data_full (G_OBJECT (context),
+                              "EDITORCONFIG_CACHE",
+                              cache,
+                              (GDestroyNotify)editorconfig_glib_cache_unref);
+    }
+
+  return editorconfig_glib_cache_ref (cache);
+}
+
 static void
 ide_editorconfig_file_settings_init_worker (GTask        *task,
                                             gpointer      source_object,
                                             gpointer      task_data,
                                             GCancellable *cancellable)
 {
-  GFile *file = task_data;
+  InitState *state = task_data;
   GHashTableIter iter;
   GHashTable *ht;
   gpointer k, v;
@@ -64,10 +109,14 @@ ide_editorconfig_file_settings_init_worker (GTask        *task,
 
   g_assert (G_IS_TASK (task));
   g_assert (IDE_IS_EDITORCONFIG_FILE_SETTINGS (source_object));
-  g_assert (G_IS_FILE (file));
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->file));
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  ht = editorconfig_glib_read (file, cancellable, &error);
+  if (state->cache != NULL)
+    ht = editorconfig_glib_cache_read (state->cache, state->file, cancellable, &error);
+  else
+    ht = editorconfig_glib_read (state->file, cancellable, &error);
 
   if (!ht)
     {
@@ -137,6 +186,7 @@ ide_editorconfig_file_settings_init_async (GAsyncInitable      *initable,
 {
   IdeEditorconfigFileSettings *self = (IdeEditorconfigFileSettings *)initable;
   g_autoptr(GTask) task = NULL;
+  InitState *state;
   IdeFile *file;
   GFile *gfile = NULL;
 
@@ -160,7 +210,11 @@ ide_editorconfig_file_settings_init_async (GAsyncInitable      *initable,
       IDE_EXIT;
     }
 
-  g_task_set_task_data (task, g_object_ref (gfile), g_object_unref);
+  state = g_slice_new0 (InitState);
+  state->file = g_object_ref (gfile);
+  state->cache = get_cache (self);
+
+  g_task_set_task_data (task, state, init_state_free);
   g_task_run_in_thread (task, ide_editorconfig_file_settings_init_worker);
 
   IDE_EXIT;
@@ -0,0 +1,737 @@
+/* ide-back-forward-journal.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-back-forward-journal"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ide-debug.h"
+#include "ide-macros.h"
+
+#include "history/ide-back-forward-journal.h"
+
+/*
+ * The journal is an append-only log of back/forward items, oldest first.
+ *
+ * It starts with an 8 byte header (JOURNAL_MAGIC followed by a version byte)
+ * and is followed by records that each start with a tag byte. Integers are
+ * stored as unsigned LEB128 varints.
+ *
+ *   RECORD_URI       len, bytes            Interns a URI (without fragment).
+ *                                          Ids are assigned in order from 0.
+ *   RECORD_POSITION  id, line, line_offset An item at "uri#L<line>_<offset>".
+ *                                          The line is zigzag encoded as the
+ *                                          delta from the previous position
+ *                                          recorded for the same URI.
+ *   RECORD_FRAGMENT  id, len, bytes        An item with any other fragment,
+ *                                          or none when len is zero.
+ *
+ * Saving only appends the items that are not yet in the journal. Once the
+ * journal holds too many stale records, or does not match what we read, it
+ * is rewritten from scratch. A torn record at the end of the file is ignored
+ * when loading and dropped by the next rewrite.
+ *
+ * The journal may be used from a worker thread, but only one thread at a
+ * time.
+ */
+
+#define JOURNAL_MAGIC        "IDEBFJ\0"
+#define JOURNAL_VERSION      1
+#define JOURNAL_HEADER_SIZE  8
+#define MAX_JOURNAL_SIZE     (10 * 1024 * 1024)
+#define COMPACT_SLACK        256
+
+enum {
+  RECORD_URI      = 1,
+  RECORD_POSITION = 2,
+  RECORD_FRAGMENT = 3,
+};
+
+struct _IdeBackForwardJournal
+{
+  volatile gint  ref_count;
+
+  /* Interned URIs, indexed by id */
+  GPtrArray     *uris;
+  GHashTable    *uri_ids;
+
+  /* The last line recorded for each URI id, for delta encoding */
+  GArray        *last_line;
+
+  /* The items that were read by _ide_back_forward_journal_load() */
+  GPtrArray     *entries;
+
+  /* Number of valid bytes in the journal on disk, zero if unknown */
+  gsize          length;
+  guint          n_records;
+
+  guint          legacy : 1;
+};
+
+IdeBackForwardJournal *
+_ide_back_forward_journal_new (void)
+{
+  IdeBackForwardJournal *ret;
+
+  ret = g_slice_new0 (IdeBackForwardJournal);
+  ret->ref_count = 1;
+  ret->uris = g_ptr_array_new_with_free_func (g_free);
+  ret->uri_ids = g_hash_table_new (g_str_hash, g_str_equal);
+  ret->last_line = g_array_new (FALSE, TRUE, sizeof (guint));
+  ret->entries = g_ptr_array_new_with_free_func (g_free);
+
+  return ret;
+}
+
+IdeBackForwardJournal *
+_ide_back_forward_journal_ref (IdeBackForwardJournal *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+_ide_back_forward_journal_unref (IdeBackForwardJournal *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_clear_pointer (&self->uri_ids, g_hash_table_unref);
+      g_clear_pointer (&self->uris, g_ptr_array_unref);
+      g_clear_pointer (&self->last_line, g_array_unref);
+      g_clear_pointer (&self->entries, g_ptr_array_unref);
+      g_slice_free (IdeBackForwardJournal, self);
+    }
+}
+
+static void
+ide_back_forward_journal_reset (IdeBackForwardJournal *self)
+{
+  g_assert (self != NULL);
+
+  g_hash_table_remove_all (self->uri_ids);
+  g_ptr_array_set_size (self->uris, 0);
+  g_array_set_size (self->last_line, 0);
+
+  self->length = 0;
+  self->n_records = 0;
+  self->legacy = FALSE;
+}
+
+static guint
+ide_back_forward_journal_intern (IdeBackForwardJournal *self,
+                                 gchar                 *uri)
+{
+  guint zero = 0;
+  guint id;
+
+  g_assert (self != NULL);
+  g_assert (uri != NULL);
+
+  id = self->uris->len;
+
+  g_ptr_array_add (self->uris, uri);
+  g_hash_table_insert (self->uri_ids, uri, GUINT_TO_POINTER (id + 1));
+  g_array_append_val (self->last_line, zero);
+
+  return id;
+}
+
+static inline void
+put_uint (GByteArray *buf,
+          guint64     value)
+{
+  guint8 byte;
+
+  while (value >= 0x80)
+    {
+      byte = (value & 0x7F) | 0x80;
+      g_byte_array_append (buf, &byte, 1);
+      value >>= 7;
+    }
+
+  byte = value;
+  g_byte_array_append (buf, &byte, 1);
+}
+
+static inline gboolean
+get_uint (const guint8 **ptr,
+          const guint8  *end,
+          guint64       *value)
+{
+  const guint8 *p = *ptr;
+  guint64 v = 0;
+  guint shift = 0;
+
+  while (p < end && shift < 64)
+    {
+      guint8 byte = *p++;
+
+      v |= (guint64)(byte & 0x7F) << shift;
+
+      if ((byte & 0x80) == 0)
+        {
+          *ptr = p;
+          *value = v;
+          return TRUE;
+        }
+
+      shift += 7;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+parse_position (const gchar *fragment,
+                guint       *line,
+                guint       *line_offset)
+{
+  gchar str[32];
+
+  /* Only take the compact form if it survives the round trip exactly. */
+  if (2 != sscanf (fragment, "L%u_%u", line, line_offset))
+    return FALSE;
+
+  g_snprintf (str, sizeof str, "L%u_%u", *line, *line_offset);
+
+  return g_str_equal (str, fragment);
+}
+
+static void
+ide_back_forward_journal_encode (IdeBackForwardJournal *self,
+                                 GByteArray            *buf,
+                                 const gchar           *uri)
+{
+  g_autofree gchar *base = NULL;
+  const gchar *fragment;
+  gpointer id_ptr;
+  guint line_offset;
+  guint line;
+  guint8 tag;
+  guint id;
+
+  g_assert (self != NULL);
+  g_assert (buf != NULL);
+  g_assert (uri != NULL);
+
+  if (NULL != (fragment = strchr (uri, '#')))
+    {
+      base = g_strndup (uri, fragment - uri);
+      fragment++;
+    }
+  else
+    base = g_strdup (uri);
+
+  if (NULL != (id_ptr = g_hash_table_lookup (self->uri_ids, base)))
+    {
+      id = GPOINTER_TO_UINT (id_ptr) - 1;
+    }
+  else
+    {
+      gsize len = strlen (base);
+
+      tag = RECORD_URI;
+      g_byte_array_append (buf, &tag, 1);
+      put_uint (buf, len);
+      g_byte_array_append (buf, (const guint8 *)base, len);
+
+      id = ide_back_forward_journal_intern (self, g_steal_pointer (&base));
+    }
+
+  if (fragment != NULL && parse_position (fragment, &line, &line_offset))
+    {
+      guint *last_line = &g_array_index (self->last_line, guint, id);
+      gint64 delta = (gint64)line - (gint64)*last_line;
+
+      tag = RECORD_POSITION;
+      g_byte_array_append (buf, &tag, 1);
+      put_uint (buf, id);
+      put_uint (buf, ((guint64)delta << 1) ^ (guint64)(delta >> 63));
+      put_uint (buf, line_offset);
+
+      *last_line = line;
+    }
+  else
+    {
+      gsize len = fragment ? strlen (fragment) : 0;
+
+      tag = RECORD_FRAGMENT;
+      g_byte_array_append (buf, &tag, 1);
+      put_uint (buf, id);
+      put_uint (buf, len);
+      g_byte_array_append (buf, (const guint8 *)fragment, len);
+    }
+
+  self->n_records++;
+}
+
+static void
+ide_back_forward_journal_decode (IdeBackForwardJournal *self,
+                                 const guint8          *data,
+                                 gsize                  len)
+{
+  const guint8 *end = data + len;
+  const guint8 *p = data + JOURNAL_HEADER_SIZE;
+  const guint8 *last_good = p;
+
+  g_assert (self != NULL);
+  g_assert (len >= JOURNAL_HEADER_SIZE);
+
+  while (p < end)
+    {
+      guint64 id;
+      guint64 a;
+      guint64 b;
+      guint8 tag = *p++;
+
+      switch (tag)
+        {
+        case RECORD_URI:
+          if (!get_uint (&p, end, &a) || a > (guint64)(end - p))
+            goto truncated;
+          if (!g_utf8_validate ((const gchar *)p, a, NULL))
+            goto truncated;
+          ide_back_forward_journal_intern (self, g_strndup ((const gchar *)p, a));
+          p += a;
+          break;
+
+        case RECORD_POSITION:
+          {
+            guint *last_line;
+            gint64 line;
+
+            if (!get_uint (&p, end, &id) || id >= self->uris->len ||
+                !get_uint (&p, end, &a) ||
+                !get_uint (&p, end, &b) || b > G_MAXUINT)
+              goto truncated;
+
+            last_line = &g_array_index (self->last_line, guint, id);
+            line = (gint64)*last_line + (gint64)((a >> 1) ^ -(a & 1));
+
+            if (line < 0 || line > G_MAXUINT)
+              goto truncated;
+
+            g_ptr_array_add (self->entries,
+                             g_strdup_printf ("%s#L%u_%u",
+                                              (const gchar *)g_ptr_array_index (self->uris, id),
+                                              (guint)line, (guint)b));
+            *last_line = line;
+            self->n_records++;
+          }
+          break;
+
+        case RECORD_FRAGMENT:
+          {
+            const gchar *uri;
+
+            if (!get_uint (&p, end, &id) || id >= self->uris->len ||
+                !get_uint (&p, end, &a) || a > (guint64)(end - p) ||
+                !g_utf8_validate ((const gchar *)p, a, NULL))
+              goto truncated;
+
+            uri = g_ptr_array_index (self->uris, id);
+
+            if (a == 0)
+              g_ptr_array_add (self->entries, g_strdup (uri));
+            else
+              g_ptr_array_add (self->entries,
+                               g_strdup_printf ("%s#%.*s", uri, (gint)a, (const gchar *)p));
+
+            p += a;
+            self->n_records++;
+          }
+          break;
+
+        default:
+          goto truncated;
+        }
+
+      last_good = p;
+    }
+
+truncated:
+  if (last_good != end)
+    g_debug ("Ignoring %"G_GSIZE_FORMAT" trailing bytes of back/forward journal",
+             (gsize)(end - last_good));
+
+  self->length = last_good - data;
+}
+
+static gboolean
+ide_back_forward_journal_decode_legacy (IdeBackForwardJournal  *self,
+                                        const gchar            *data,
+                                        gsize                   len,
+                                        GError                **error)
+{
+  g_autofree gchar *contents = NULL;
+  g_auto(GStrv) lines = NULL;
+  guint i;
+
+  g_assert (self != NULL);
+
+  if (!g_utf8_validate (data, len, NULL))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "The content was not UTF-8 formatted");
+      return FALSE;
+    }
+
+  contents = g_strndup (data, len);
+  lines = g_strsplit (contents, "\n", 0);
+
+  /* The text format was written newest first. */
+  for (i = g_strv_length (lines); i > 0; i--)
+    {
+      const gchar *line = lines [i - 1];
+      char *old_style_uri = NULL;
+      guint lineno = 0;
+      guint line_offset = 0;
+
+      if (ide_str_empty0 (line))
+        continue;
+
+      /* Convert from old style "LINE OFFSET URI" to new-style "URI". */
+      if (3 == sscanf (line, "%u %u %ms", &lineno, &line_offset, &old_style_uri))
+        {
+          g_ptr_array_add (self->entries,
+                           g_strdup_printf ("%s#L%u_%u", old_style_uri, lineno, line_offset));
+          free (old_style_uri);
+          continue;
+        }
+
+      g_ptr_array_add (self->entries, g_strdup (line));
+    }
+
+  self->legacy = TRUE;
+
+  return TRUE;
+}
+
+/**
+ * _ide_back_forward_journal_load:
+ * @self: An #IdeBackForwardJournal
+ * @file: The journal to load
+ * @error: A location for a #GError, or %NULL
+ *
+ * Maps @file and decodes its items, which are then available from
+ * _ide_back_forward_journal_get_entries(). Files written in the previous
+ * text format are also accepted, and will be converted by the next save.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+_ide_back_forward_journal_load (IdeBackForwardJournal  *self,
+                                GFile                  *file,
+                                GError                **error)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autofree gchar *path = NULL;
+  GError *local_error = NULL;
+  const gchar *data;
+  gsize len;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+
+  ide_back_forward_journal_reset (self);
+  g_ptr_array_set_size (self->entries, 0);
+
+  if (NULL == (path = g_file_get_path (file)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "Only local back/forward journals are supported");
+      IDE_RETURN (FALSE);
+    }
+
+  if (NULL == (mapped = g_mapped_file_new (path, FALSE, &local_error)))
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)
+                             ? G_IO_ERROR_NOT_FOUND : G_IO_ERROR_FAILED,
+                           local_error->message);
+      g_clear_error (&local_error);
+      IDE_RETURN (FALSE);
+    }
+
+  data = g_mapped_file_get_contents (mapped);
+  len = g_mapped_file_get_length (mapped);
+
+  if (len > MAX_JOURNAL_SIZE)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Implausible file size discovered");
+      IDE_RETURN (FALSE);
+    }
+
+  if (len < JOURNAL_HEADER_SIZE || memcmp (data, JOURNAL_MAGIC, JOURNAL_HEADER_SIZE - 1) != 0)
+    IDE_RETURN (ide_back_forward_journal_decode_legacy (self, data, len, error));
+
+  if (data [JOURNAL_HEADER_SIZE - 1] != JOURNAL_VERSION)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Unsupported back/forward journal version %u",
+                   (guint)(guint8)data [JOURNAL_HEADER_SIZE - 1]);
+      IDE_RETURN (FALSE);
+    }
+
+  ide_back_forward_journal_decode (self, (const guint8 *)data, len);
+
+  IDE_RETURN (TRUE);
+}
+
+/**
+ * _ide_back_forward_journal_get_entries:
+ *
+ * Returns: (transfer none) (element-type utf8): The URIs of the items read
+ *   by _ide_back_forward_journal_load(), oldest first.
+ */
+GPtrArray *
+_ide_back_forward_journal_get_entries (IdeBackForwardJournal *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return self->entries;
+}
+
+gboolean
+_ide_back_forward_journal_is_legacy (IdeBackForwardJournal *self)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  return self->legacy;
+}
+
+static gboolean
+ide_back_forward_journal_compact (IdeBackForwardJournal  *self,
+                                  GFile                  *file,
+                                  GPtrArray              *uris,
+                                  GCancellable           *cancellable,
+                                  GError                **error)
+{
+  g_autoptr(GByteArray) buf = NULL;
+  guint8 version = JOURNAL_VERSION;
+  guint i;
+
+  IDE_ENTRY;
+
+  g_assert (self != NULL);
+  g_assert (G_IS_FILE (file));
+  g_assert (uris != NULL);
+
+  ide_back_forward_journal_reset (self);
+
+  buf = g_byte_array_new ();
+  g_byte_array_append (buf, (const guint8 *)JOURNAL_MAGIC, JOURNAL_HEADER_SIZE - 1);
+  g_byte_array_append (buf, &version, 1);
+
+  for (i = 0; i < uris->len; i++)
+    ide_back_forward_journal_encode (self, buf, g_ptr_array_index (uris, i));
+
+  if (!g_file_replace_contents (file,
+                                (const gchar *)buf->data,
+                                buf->len,
+                                NULL,
+                                FALSE,
+                                G_FILE_CREATE_NONE,
+                                NULL,
+                                cancellable,
+                                error))
+    {
+      ide_back_forward_journal_reset (self);
+      IDE_RETURN (FALSE);
+    }
+
+  self->length = buf->len;
+
+  IDE_TRACE_MSG ("Compacted back/forward journal to %u records", self->n_records);
+
+  IDE_RETURN (TRUE);
+}
+
+static gboolean
+ide_back_forward_journal_append (IdeBackForwardJournal  *self,
+                                 GFile                  *file,
+                                 GPtrArray              *uris,
+                                 guint                   n_journaled,
+                                 GCancellable           *cancellable,
+                                 GError                **error)
+{
+  g_autoptr(GByteArray) buf = NULL;
+  g_autofree gchar *path = NULL;
+  struct stat st;
+  gsize pos = 0;
+  gint fd;
+  guint i;
+
+  IDE_ENTRY;
+
+  g_assert (self != NULL);
+  g_assert (G_IS_FILE (file));
+  g_assert (uris != NULL);
+  g_assert (n_journaled < uris->len);
+
+  path = g_file_get_path (file);
+  fd = path ? open (path, O_WRONLY | O_APPEND | O_CLOEXEC) : -1;
+
+  /* If the journal is not what we read, start over. */
+  if (fd == -1 || fstat (fd, &st) != 0 || (gsize)st.st_size != self->length)
+    {
+      if (fd != -1)
+        close (fd);
+      IDE_RETURN (ide_back_forward_journal_compact (self, file, uris, cancellable, error));
+    }
+
+  buf = g_byte_array_new ();
+
+  for (i = n_journaled; i < uris->len; i++)
+    ide_back_forward_journal_encode (self, buf, g_ptr_array_index (uris, i));
+
+  while (pos < buf->len)
+    {
+      gssize r = write (fd, buf->data + pos, buf->len - pos);
+
+      if (r < 0 && errno == EINTR)
+        continue;
+
+      if (r <= 0)
+        {
+          gint errsv = errno;
+
+          close (fd);
+
+          /* Our view of the file is stale now, rewrite it next time. */
+          ide_back_forward_journal_reset (self);
+
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errsv),
+                       "Failed to append to back/forward journal: %s",
+                       g_strerror (errsv));
+          IDE_RETURN (FALSE);
+        }
+
+      pos += r;
+    }
+
+  close (fd);
+
+  self->length += buf->len;
+
+  IDE_TRACE_MSG ("Appended %u records to back/forward journal", uris->len - n_journaled);
+
+  IDE_RETURN (TRUE);
+}
+
+/**
+ * _ide_back_forward_journal_save:
+ * @self: An #IdeBackForwardJournal
+ * @file: The journal to write
+ * @uris: (element-type utf8): The URIs of every item to keep, oldest first
+ * @n_journaled: The number of leading @uris that are already recorded in
+ *   @file, or -1 if unknown
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @error: A location for a #GError, or %NULL
+ *
+ * Appends the items after @n_journaled to @file. The journal is rewritten
+ * with exactly @uris instead when it was never written, was in the previous
+ * text format, changed on disk, or has grown to hold too many stale records.
+ *
+ * This performs blocking I/O and should be called from a worker thread.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+_ide_back_forward_journal_save (IdeBackForwardJournal  *self,
+                                GFile                  *file,
+                                GPtrArray              *uris,
+                                gint                    n_journaled,
+                                GCancellable           *cancellable,
+                                GError                **error)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (uris != NULL, FALSE);
+  g_return_val_if_fail (n_journaled <= (gint)uris->len, FALSE);
+
+  if (n_journaled < 0 ||
+      self->legacy ||
+      self->length < JOURNAL_HEADER_SIZE ||
+      self->n_records + (uris->len - n_journaled) > (uris->len * 2) + COMPACT_SLACK)
+    return ide_back_forward_journal_compact (self, file, uris, cancellable, error);
+
+  if (n_journaled == (gint)uris->len)
+    return TRUE;
+
+  return ide_back_forward_journal_append (self, file, uris, n_journaled, cancellable, error);
+}
+
+/**
+ * _ide_back_forward_journal_convert:
+ * @file: A back/forward list in the previous text format
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @error: A location for a #GError, or %NULL
+ *
+ * Rewrites @file as a journal, keeping every item. Files that are already
+ * journals are left untouched.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+_ide_back_forward_journal_convert (GFile         *file,
+                                   GCancellable  *cancellable,
+                                   GError       **error)
+{
+  g_autoptr(IdeBackForwardJournal) self = NULL;
+
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  self = _ide_back_forward_journal_new ();
+
+  if (!_ide_back_forward_journal_load (self, file, error))
+    return FALSE;
+
+  if (!self->legacy)
+    return TRUE;
+
+  return ide_back_forward_journal_compact (self, file, self->entries, cancellable, error);
+}
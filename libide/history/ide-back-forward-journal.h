@@ -0,0 +1,50 @@
+/* ide-back-forward-journal.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_BACK_FORWARD_JOURNAL_H
+#define IDE_BACK_FORWARD_JOURNAL_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeBackForwardJournal IdeBackForwardJournal;
+
+IdeBackForwardJournal *_ide_back_forward_journal_new         (void);
+IdeBackForwardJournal *_ide_back_forward_journal_ref         (IdeBackForwardJournal  *self);
+void                   _ide_back_forward_journal_unref       (IdeBackForwardJournal  *self);
+gboolean               _ide_back_forward_journal_load        (IdeBackForwardJournal  *self,
+                                                              GFile                  *file,
+                                                              GError                **error);
+GPtrArray             *_ide_back_forward_journal_get_entries (IdeBackForwardJournal  *self);
+gboolean               _ide_back_forward_journal_is_legacy   (IdeBackForwardJournal  *self);
+gboolean               _ide_back_forward_journal_save        (IdeBackForwardJournal  *self,
+                                                              GFile                  *file,
+                                                              GPtrArray              *uris,
+                                                              gint                    n_journaled,
+                                                              GCancellable           *cancellable,
+                                                              GError                **error);
+gboolean               _ide_back_forward_journal_convert     (GFile                  *file,
+                                                              GCancellable           *cancellable,
+                                                              GError                **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeBackForwardJournal, _ide_back_forward_journal_unref)
+
+G_END_DECLS
+
+#endif /* IDE_BACK_FORWARD_JOURNAL_H */
@@ -18,98 +18,147 @@
 
 #define G_LOG_DOMAIN "ide-back-forward-list"
 
-#include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
 
 #include "ide-context.h"
 #include "ide-debug.h"
 
 #include "history/ide-back-forward-item.h"
+#include "history/ide-back-forward-journal.h"
 #include "history/ide-back-forward-list.h"
 #include "history/ide-back-forward-list-private.h"
 
-static void
-ide_back_forward_list_load_cb (GObject      *object,
-                               GAsyncResult *result,
-                               gpointer      user_data)
+typedef struct
 {
-  g_autoptr(GTask) task = user_data;
-  g_autofree gchar *contents = NULL;
-  g_auto(GStrv) lines = NULL;
-  IdeBackForwardList *self;
-  IdeContext *context;
-  GError *error = NULL;
-  GFile *file = (GFile *)object;
-  gsize length = 0;
-  gsize n_lines;
-  gint i;
-
-  g_assert (G_IS_FILE (file));
-  g_assert (G_IS_TASK (task));
-
-  self = g_task_get_source_object (task);
-  g_assert (IDE_IS_BACK_FORWARD_LIST (self));
+  IdeBackForwardJournal *journal;
+  GFile                 *file;
+  GPtrArray             *uris;
+} IdeBackForwardListLoad;
 
-  context = ide_object_get_context (IDE_OBJECT (self));
-  g_assert (IDE_IS_CONTEXT (context));
+static void
+ide_back_forward_list_load_free (gpointer data)
+{
+  IdeBackForwardListLoad *state = data;
 
-  if (!g_file_load_contents_finish (file, result, &contents, &length, NULL, &error))
+  if (state != NULL)
     {
-      g_task_return_error (task, error);
-      return;
+      g_clear_pointer (&state->journal, _ide_back_forward_journal_unref);
+      g_clear_object (&state->file);
+      g_clear_pointer (&state->uris, g_ptr_array_unref);
+      g_slice_free (IdeBackForwardListLoad, state);
     }
+}
 
-  if (length > (10 * 1024 * 1024))
-    {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_INVALID_DATA,
-                               "Implausible file size discovered");
-      return;
-    }
+static void
+ide_back_forward_list_load_worker (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data,
+                                   GCancellable *cancellable)
+{
+  IdeBackForwardListLoad *state = task_data;
+  g_autoptr(GHashTable) counter = NULL;
+  GPtrArray *entries;
+  GError *error = NULL;
+  guint i;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_BACK_FORWARD_LIST (source_object));
+  g_assert (G_IS_TASK (task));
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->file));
 
-  if (!g_utf8_validate (contents, length, NULL))
+  if (!_ide_back_forward_journal_load (state->journal, state->file, &error))
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_INVALID_DATA,
-                               "The content was not UTF-8 formatted");
-      return;
+      g_task_return_error (task, error);
+      IDE_EXIT;
     }
 
-  lines = g_strsplit (contents, "\n", 0);
-  n_lines = g_strv_length (lines);
+  entries = _ide_back_forward_journal_get_entries (state->journal);
+  counter = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-  for (i = n_lines; i > 0; i--)
+  /*
+   * The journal keeps every item that was ever appended, so only restore
+   * the most recent items for each file. They are collected newest first.
+   */
+  for (i = entries->len; i > 0; i--)
     {
-      const gchar *line = lines [i - 1];
-      g_autoptr(IdeUri) uri = NULL;
-      g_autoptr(IdeBackForwardItem) item = NULL;
-      g_autofree gchar *new_style_uri = NULL;
-      char *old_style_uri = NULL;
-      guint lineno = 0;
-      guint line_offset = 0;
+      const gchar *line = g_ptr_array_index (entries, i - 1);
+      const gchar *fragment = strchr (line, '#');
+      gchar *hash_key;
+      IdeUri *uri;
+      gsize count;
 
-      if (ide_str_empty0 (line))
-        continue;
+      hash_key = fragment ? g_strndup (line, fragment - line) : g_strdup (line);
+      count = GPOINTER_TO_SIZE (g_hash_table_lookup (counter, hash_key));
 
-      /* Convert from old style "LINE OFFSET URI" to new-style "URI". */
-      if (3 == sscanf (line, "%u %u %ms", &lineno, &line_offset, &old_style_uri))
+      if (count == MAX_ITEMS_PER_FILE)
         {
-          line = new_style_uri = g_strdup_printf ("%s#L%u_%u", old_style_uri, lineno, line_offset);
-          free (old_style_uri);
+          g_free (hash_key);
+          continue;
         }
 
-      uri = ide_uri_new (line, 0, &error);
+      g_hash_table_insert (counter, hash_key, GSIZE_TO_POINTER (count + 1));
 
-      if (uri == NULL)
+      if (NULL == (uri = ide_uri_new (line, 0, &error)))
         {
           g_task_return_error (task, error);
-          return;
+          IDE_EXIT;
         }
 
+      g_ptr_array_add (state->uris, uri);
+    }
+
+  g_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+static void
+ide_back_forward_list_load_cb (GObject      *object,
+                               GAsyncResult *result,
+                               gpointer      user_data)
+{
+  IdeBackForwardList *self = (IdeBackForwardList *)object;
+  IdeBackForwardListLoad *state;
+  g_autoptr(GTask) task = user_data;
+  IdeContext *context;
+  GError *error = NULL;
+  guint i;
+
+  g_assert (IDE_IS_BACK_FORWARD_LIST (self));
+  g_assert (G_IS_TASK (result));
+  g_assert (G_IS_TASK (task));
+
+  state = g_task_get_task_data (G_TASK (result));
+  g_assert (state != NULL);
+
+  /*
+   * Keep the journal even if it failed to load, so the next save knows it
+   * has to rewrite the file rather than append to it.
+   */
+  _ide_back_forward_list_set_journal (self, state->journal);
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  g_assert (IDE_IS_CONTEXT (context));
+
+  for (i = state->uris->len; i > 0; i--)
+    {
+      g_autoptr(IdeBackForwardItem) item = NULL;
+      IdeUri *uri = g_ptr_array_index (state->uris, i - 1);
+
       item = ide_back_forward_item_new (context, uri);
       ide_back_forward_list_push (self, item);
+
+      /* @item is dropped if it was chained onto the previous item */
+      if (ide_back_forward_list_get_current_item (self) == item)
+        _ide_back_forward_list_set_journaled (self, item, 1);
     }
 
   g_task_return_boolean (task, TRUE);
@@ -122,7 +171,9 @@ _ide_back_forward_list_load_async (IdeBackForwardList  *self,
                                    GAsyncReadyCallback  callback,
                                    gpointer             user_data)
 {
+  IdeBackForwardListLoad *state;
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GTask) worker = NULL;
 
   g_assert (IDE_IS_BACK_FORWARD_LIST (self));
   g_assert (G_IS_FILE (file));
@@ -139,10 +190,18 @@ _ide_back_forward_list_load_async (IdeBackForwardList  *self,
 
   task = g_task_new (self, cancellable, callback, user_data);
 
-  g_file_load_contents_async (file,
-                              cancellable,
-                              ide_back_forward_list_load_cb,
-                              g_object_ref (task));
+  state = g_slice_new0 (IdeBackForwardListLoad);
+  state->journal = _ide_back_forward_journal_new ();
+  state->file = g_object_ref (file);
+  state->uris = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_uri_unref);
+
+  /* The journal is mapped and decoded in a thread, items are created here. */
+  worker = g_task_new (self,
+                       cancellable,
+                       ide_back_forward_list_load_cb,
+                       g_object_ref (task));
+  g_task_set_task_data (worker, state, ide_back_forward_list_load_free);
+  g_task_run_in_thread (worker, ide_back_forward_list_load_worker);
 }
 
 gboolean
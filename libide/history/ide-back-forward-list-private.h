@@ -22,30 +22,42 @@
 #include <gio/gio.h>
 
 #include "ide-back-forward-list.h"
+#include "ide-back-forward-journal.h"
 
 G_BEGIN_DECLS
 
-void                _ide_back_forward_list_foreach     (IdeBackForwardList    *self,
-                                                        GFunc                  callback,
-                                                        gpointer               user_data);
-void                _ide_back_forward_list_load_async  (IdeBackForwardList    *self,
-                                                        GFile                 *file,
-                                                        GCancellable          *cancellable,
-                                                        GAsyncReadyCallback    callback,
-                                                        gpointer               user_data);
-gboolean            _ide_back_forward_list_load_finish (IdeBackForwardList    *self,
-                                                        GAsyncResult          *result,
-                                                        GError               **error);
-void                _ide_back_forward_list_save_async  (IdeBackForwardList    *self,
-                                                        GFile                 *file,
-                                                        GCancellable          *cancellable,
-                                                        GAsyncReadyCallback    callback,
-                                                        gpointer               user_data);
-gboolean            _ide_back_forward_list_save_finish (IdeBackForwardList    *self,
-                                                        GAsyncResult          *result,
-                                                        GError               **error);
-IdeBackForwardItem *_ide_back_forward_list_find        (IdeBackForwardList    *self,
-                                                        IdeFile               *file);
+#define MAX_ITEMS_PER_FILE 5
+
+void                   _ide_back_forward_list_foreach        (IdeBackForwardList     *self,
+                                                              GFunc                   callback,
+                                                              gpointer                user_data);
+void                   _ide_back_forward_list_load_async     (IdeBackForwardList     *self,
+                                                              GFile                  *file,
+                                                              GCancellable           *cancellable,
+                                                              GAsyncReadyCallback     callback,
+                                                              gpointer                user_data);
+gboolean               _ide_back_forward_list_load_finish    (IdeBackForwardList     *self,
+                                                              GAsyncResult           *result,
+                                                              GError                **error);
+void                   _ide_back_forward_list_save_async     (IdeBackForwardList     *self,
+                                                              GFile                  *file,
+                                                              GCancellable           *cancellable,
+                                                              GAsyncReadyCallback     callback,
+                                                              gpointer                user_data);
+gboolean               _ide_back_forward_list_save_finish    (IdeBackForwardList     *self,
+                                                              GAsyncResult           *result,
+                                                              GError                **error);
+IdeBackForwardItem    *_ide_back_forward_list_find           (IdeBackForwardList     *self,
+                                                              IdeFile                *file);
+IdeBackForwardJournal *_ide_back_forward_list_get_journal    (IdeBackForwardList     *self);
+void                   _ide_back_forward_list_set_journal    (IdeBackForwardList     *self,
+                                                              IdeBackForwardJournal  *journal);
+guint                  _ide_back_forward_list_get_journaled  (IdeBackForwardList     *self,
+                                                              IdeBackForwardItem     *item);
+void                   _ide_back_forward_list_set_journaled  (IdeBackForwardList     *self,
+                                                              IdeBackForwardItem     *item,
+                                                              guint                   n_records);
+void                   _ide_back_forward_list_drop_journaled (IdeBackForwardList     *self);
 
 G_END_DECLS
 
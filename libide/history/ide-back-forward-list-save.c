@@ -21,16 +21,18 @@
 #include "ide-debug.h"
 
 #include "history/ide-back-forward-item.h"
+#include "history/ide-back-forward-journal.h"
 #include "history/ide-back-forward-list.h"
 #include "history/ide-back-forward-list-private.h"
 
-#define MAX_ITEMS_PER_FILE 5
-
 typedef struct
 {
-  GHashTable *counter;
-  GString    *content;
-  GFile      *file;
+  IdeBackForwardJournal *journal;
+  GHashTable            *counter;
+  GFile                 *file;
+  GPtrArray             *uris;
+  GPtrArray             *items;
+  gint                   n_journaled;
 } IdeBackForwardListSave;
 
 static void
@@ -40,11 +42,10 @@ ide_back_forward_list_save_free (gpointer data)
 
   if (state != NULL)
     {
+      g_clear_pointer (&state->journal, _ide_back_forward_journal_unref);
       g_clear_object (&state->file);
-
-      g_string_free (state->content, TRUE);
-      state->content = NULL;
-
+      g_clear_pointer (&state->uris, g_ptr_array_unref);
+      g_clear_pointer (&state->items, g_ptr_array_unref);
       g_clear_pointer (&state->counter, g_hash_table_unref);
 
       g_slice_free (IdeBackForwardListSave, state);
@@ -57,14 +58,14 @@ ide_back_forward_list_save_collect (gpointer data,
 {
   IdeBackForwardListSave *state = user_data;
   IdeBackForwardItem *item = data;
-  g_autofree gchar *str = NULL;
+  gchar *str = NULL;
   gchar *hash_key = NULL;
   IdeUri *uri;
   gsize count;
 
   g_assert (IDE_IS_BACK_FORWARD_ITEM (item));
   g_assert (state != NULL);
-  g_assert (state->content != NULL);
+  g_assert (state->uris != NULL);
   g_assert (state->counter != NULL);
 
   uri = ide_back_forward_item_get_uri (item);
@@ -86,7 +87,24 @@ ide_back_forward_list_save_collect (gpointer data,
 
   str = ide_uri_to_string (uri, 0);
   if (str != NULL)
-    g_string_append_printf (state->content, "%s\n", str);
+    {
+      g_ptr_array_add (state->uris, str);
+      g_ptr_array_add (state->items, g_object_ref (item));
+    }
+}
+
+static void
+reverse_array (GPtrArray *ar)
+{
+  guint i;
+
+  for (i = 0; i < ar->len / 2; i++)
+    {
+      gpointer tmp = ar->pdata [i];
+
+      ar->pdata [i] = ar->pdata [ar->len - i - 1];
+      ar->pdata [ar->len - i - 1] = tmp;
+    }
 }
 
 static void
@@ -98,7 +116,6 @@ ide_back_forward_list_save_worker (GTask        *task,
   IdeBackForwardListSave *state = task_data;
   g_autoptr(GFile) parent = NULL;
   GError *error = NULL;
-  gboolean ret;
 
   IDE_ENTRY;
 
@@ -106,7 +123,7 @@ ide_back_forward_list_save_worker (GTask        *task,
   g_assert (G_IS_TASK (task));
   g_assert (state != NULL);
   g_assert (G_IS_FILE (state->file));
-  g_assert (state->content != NULL);
+  g_assert (state->uris != NULL);
 
   parent = g_file_get_parent (state->file);
 
@@ -119,17 +136,12 @@ ide_back_forward_list_save_worker (GTask        *task,
         }
     }
 
-  ret = g_file_replace_contents (state->file,
-                                 state->content->str,
-                                 state->content->len,
-                                 NULL,
-                                 FALSE,
-                                 G_FILE_CREATE_NONE,
-                                 NULL,
-                                 cancellable,
-                                 &error);
-
-  if (ret == FALSE)
+  if (!_ide_back_forward_journal_save (state->journal,
+                                       state->file,
+                                       state->uris,
+                                       state->n_journaled,
+                                       cancellable,
+                                       &error))
     g_task_return_error (task, error);
   else
     g_task_return_boolean (task, TRUE);
@@ -137,6 +149,27 @@ ide_back_forward_list_save_worker (GTask        *task,
   IDE_EXIT;
 }
 
+/*
+ * Counts this occurrence of @item in @seen and checks whether the journal
+ * already has a record for it.
+ */
+static gboolean
+is_journaled_occurrence (IdeBackForwardList *self,
+                         GHashTable         *seen,
+                         IdeBackForwardItem *item)
+{
+  guint n_seen;
+
+  g_assert (IDE_IS_BACK_FORWARD_LIST (self));
+  g_assert (seen != NULL);
+  g_assert (IDE_IS_BACK_FORWARD_ITEM (item));
+
+  n_seen = GPOINTER_TO_UINT (g_hash_table_lookup (seen, item));
+  g_hash_table_insert (seen, item, GUINT_TO_POINTER (n_seen + 1));
+
+  return n_seen < _ide_back_forward_list_get_journaled (self, item);
+}
+
 void
 _ide_back_forward_list_save_async (IdeBackForwardList  *self,
                                    GFile               *file,
@@ -145,7 +178,10 @@ _ide_back_forward_list_save_async (IdeBackForwardList  *self,
                                    gpointer             user_data)
 {
   IdeBackForwardListSave *state;
+  IdeBackForwardJournal *journal;
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GHashTable) seen = NULL;
+  guint i;
 
   IDE_ENTRY;
 
@@ -162,16 +198,55 @@ _ide_back_forward_list_save_async (IdeBackForwardList  *self,
   }
 #endif
 
+  if (NULL == (journal = _ide_back_forward_list_get_journal (self)))
+    {
+      g_autoptr(IdeBackForwardJournal) new_journal = _ide_back_forward_journal_new ();
+
+      _ide_back_forward_list_set_journal (self, new_journal);
+      journal = new_journal;
+    }
+
   state = g_slice_new0 (IdeBackForwardListSave);
-  state->content = g_string_new (NULL);
+  state->journal = _ide_back_forward_journal_ref (journal);
+  state->uris = g_ptr_array_new_with_free_func (g_free);
+  state->items = g_ptr_array_new_with_free_func (g_object_unref);
   state->counter = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   state->file = g_object_ref (file);
   _ide_back_forward_list_foreach (self, ide_back_forward_list_save_collect, state);
 
+  /* The items are collected newest first, the journal is oldest first. */
+  reverse_array (state->uris);
+  reverse_array (state->items);
+
+  /*
+   * Records that are already in the journal must all come before the new
+   * ones for an append to reproduce this history. Otherwise the journal is
+   * rewritten. An item that occurs more than once only accounts for as
+   * many records as were written for it, later occurrences are new.
+   */
+  seen = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < state->items->len; i++)
+    {
+      if (!is_journaled_occurrence (self, seen, g_ptr_array_index (state->items, i)))
+        break;
+    }
+
+  state->n_journaled = i;
+
+  for (i++; i < state->items->len; i++)
+    {
+      if (is_journaled_occurrence (self, seen, g_ptr_array_index (state->items, i)))
+        {
+          state->n_journaled = -1;
+          break;
+        }
+    }
+
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_task_data (task, state, ide_back_forward_list_save_free);
 
-  if (state->content->len == 0)
+  if (state->uris->len == 0)
     g_task_return_boolean (task, TRUE);
   else
     g_task_run_in_thread (task, ide_back_forward_list_save_worker);
@@ -193,5 +268,31 @@ _ide_back_forward_list_save_finish (IdeBackForwardList  *self,
 
   ret = g_task_propagate_boolean (G_TASK (result), error);
 
+  if (ret)
+    {
+      IdeBackForwardListSave *state = g_task_get_task_data (G_TASK (result));
+      g_autoptr(GHashTable) counts = NULL;
+      GHashTableIter iter;
+      gpointer key, value;
+      guint i;
+
+      /* The journal now holds exactly one record per collected occurrence */
+      counts = g_hash_table_new (NULL, NULL);
+
+      for (i = 0; i < state->items->len; i++)
+        {
+          gpointer item = g_ptr_array_index (state->items, i);
+          guint count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, item));
+
+          g_hash_table_insert (counts, item, GUINT_TO_POINTER (count + 1));
+        }
+
+      _ide_back_forward_list_drop_journaled (self);
+
+      g_hash_table_iter_init (&iter, counts);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        _ide_back_forward_list_set_journaled (self, key, GPOINTER_TO_UINT (value));
+    }
+
   IDE_RETURN (ret);
 }
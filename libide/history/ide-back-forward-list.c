@@ -32,17 +32,27 @@
 #include "files/ide-file.h"
 #include "history/ide-back-forward-item.h"
 #include "history/ide-back-forward-list.h"
+#include "history/ide-back-forward-list-private.h"
 #include "projects/ide-project.h"
 
 #define MAX_ITEMS_TOTAL 100
 
 struct _IdeBackForwardList
 {
-  IdeObject           parent_instance;
+  IdeObject              parent_instance;
 
-  GQueue             *backward;
-  IdeBackForwardItem *current_item;
-  GQueue             *forward;
+  GQueue                *backward;
+  IdeBackForwardItem    *current_item;
+  GQueue                *forward;
+
+  /*
+   * The journal the history was loaded from, and how many records of it
+   * each item accounts for, so that saving only needs to append the rest.
+   * An item appears more than once when the current item is re-pushed
+   * after navigating backward.
+   */
+  IdeBackForwardJournal *journal;
+  GHashTable            *journaled;
 };
 
 
@@ -154,6 +164,31 @@ ide_back_forward_list_get_can_go_forward (IdeBackForwardList *self)
   return (self->forward->length > 0);
 }
 
+/*
+ * Pruning drops the oldest occurrence of @item, which is the first record
+ * of it in the journal. Release it once no occurrence is left so that the
+ * list does not keep pruned items alive.
+ */
+static void
+ide_back_forward_list_forget_journaled (IdeBackForwardList *self,
+                                        IdeBackForwardItem *item)
+{
+  guint count;
+
+  g_assert (IDE_IS_BACK_FORWARD_LIST (self));
+  g_assert (IDE_IS_BACK_FORWARD_ITEM (item));
+
+  if (self->journaled == NULL)
+    return;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (self->journaled, item));
+
+  if (count > 1)
+    g_hash_table_insert (self->journaled, g_object_ref (item), GUINT_TO_POINTER (count - 1));
+  else if (count == 1)
+    g_hash_table_remove (self->journaled, item);
+}
+
 static void
 ide_back_forward_list_prune (IdeBackForwardList *self)
 {
@@ -164,6 +199,7 @@ ide_back_forward_list_prune (IdeBackForwardList *self)
       IdeBackForwardList *item;
 
       item = g_queue_pop_tail (self->backward);
+      ide_back_forward_list_forget_journaled (self, (IdeBackForwardItem *)item);
       g_clear_object (&item);
     }
 }
@@ -383,6 +419,9 @@ ide_back_forward_list_dispose (GObject *object)
       g_clear_pointer (&self->forward, g_queue_free);
     }
 
+  g_clear_pointer (&self->journaled, g_hash_table_unref);
+  g_clear_pointer (&self->journal, _ide_back_forward_journal_unref);
+
   G_OBJECT_CLASS (ide_back_forward_list_parent_class)->dispose (object);
 }
 
@@ -460,6 +499,7 @@ ide_back_forward_list_init (IdeBackForwardList *self)
 {
   self->backward = g_queue_new ();
   self->forward = g_queue_new ();
+  self->journaled = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
 }
 
 void
@@ -540,3 +580,70 @@ _ide_back_forward_list_find (IdeBackForwardList *self,
 
   return lookup.result;
 }
+
+IdeBackForwardJournal *
+_ide_back_forward_list_get_journal (IdeBackForwardList *self)
+{
+  g_return_val_if_fail (IDE_IS_BACK_FORWARD_LIST (self), NULL);
+
+  return self->journal;
+}
+
+void
+_ide_back_forward_list_set_journal (IdeBackForwardList    *self,
+                                    IdeBackForwardJournal *journal)
+{
+  g_return_if_fail (IDE_IS_BACK_FORWARD_LIST (self));
+
+  if (journal != self->journal)
+    {
+      g_clear_pointer (&self->journal, _ide_back_forward_journal_unref);
+      if (journal != NULL)
+        self->journal = _ide_back_forward_journal_ref (journal);
+      if (self->journaled != NULL)
+        g_hash_table_remove_all (self->journaled);
+    }
+}
+
+guint
+_ide_back_forward_list_get_journaled (IdeBackForwardList *self,
+                                      IdeBackForwardItem *item)
+{
+  g_return_val_if_fail (IDE_IS_BACK_FORWARD_LIST (self), 0);
+  g_return_val_if_fail (IDE_IS_BACK_FORWARD_ITEM (item), 0);
+
+  if (self->journaled == NULL)
+    return 0;
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->journaled, item));
+}
+
+/*
+ * Records that @n_records records of the journal belong to @item, one per
+ * occurrence of @item in the list.
+ */
+void
+_ide_back_forward_list_set_journaled (IdeBackForwardList *self,
+                                      IdeBackForwardItem *item,
+                                      guint               n_records)
+{
+  g_return_if_fail (IDE_IS_BACK_FORWARD_LIST (self));
+  g_return_if_fail (IDE_IS_BACK_FORWARD_ITEM (item));
+
+  if (self->journaled == NULL)
+    return;
+
+  if (n_records == 0)
+    g_hash_table_remove (self->journaled, item);
+  else
+    g_hash_table_insert (self->journaled, g_object_ref (item), GUINT_TO_POINTER (n_records));
+}
+
+void
+_ide_back_forward_list_drop_journaled (IdeBackForwardList *self)
+{
+  g_return_if_fail (IDE_IS_BACK_FORWARD_LIST (self));
+
+  if (self->journaled != NULL)
+    g_hash_table_remove_all (self->journaled);
+}
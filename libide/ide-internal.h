@@ -37,6 +37,9 @@ void                _ide_battery_monitor_init               (void);
 void                _ide_battery_monitor_shutdown           (void);
 void                _ide_buffer_set_changed_on_volume       (IdeBuffer             *self,
                                                              gboolean               changed_on_volume);
+void                _ide_buffer_set_diagnostics             (IdeBuffer             *self,
+                                                             IdeDiagnostics        *diagnostics);
+gboolean            _ide_buffer_get_held                    (IdeBuffer             *self);
 gboolean            _ide_buffer_get_loading                 (IdeBuffer             *self);
 void                _ide_buffer_set_loading                 (IdeBuffer             *self,
                                                              gboolean               loading);
@@ -36,10 +36,44 @@
 
 typedef const gchar *(*IdeLogLevelStrFunc) (GLogLevelFlags log_level);
 
+/*
+ * In asynchronous mode, producers format their message into a single
+ * allocation and push it onto a lock-free stack. A writer thread swaps
+ * the whole stack out, restores FIFO order and writes the batch to each
+ * channel with one write and one flush.
+ *
+ * The writer also folds runs of identical messages (same domain, thread,
+ * level and text) into a single "repeated" line, so a hot loop logging the
+ * same warning cannot flood the channels.
+ */
+#define TIMESTAMP_LEN      15 /* "HH:MM:SS.mmmm  " */
+#define REPEAT_WINDOW_USEC G_USEC_PER_SEC
+
+typedef struct _IdeLogRecord
+{
+  struct _IdeLogRecord *next;
+  gint64                time;
+  gsize                 prefix_len;
+  gsize                 len;
+  gchar                 line[];
+} IdeLogRecord;
+
+typedef struct
+{
+  time_t sec;
+  gchar  ftime[32];
+} IdeLogTimeCache;
+
 static GPtrArray          *channels;
 static GLogFunc            last_handler;
 static int                 log_verbosity;
 static IdeLogLevelStrFunc  log_level_str_func;
+static IdeLogRecord       *pending;
+static GThread            *writer_thread;
+static gint                writer_running;
+static GMutex              writer_mutex;
+static GCond               writer_cond;
+static GPrivate            time_cache = G_PRIVATE_INIT (g_free);
 
 G_LOCK_DEFINE (channels_lock);
 
@@ -106,19 +140,249 @@ ide_log_level_str_with_color (GLogLevelFlags log_level)
     }
 }
 
-/**
- * ide_log_write_to_channel:
- * @channel: A #GIOChannel.
- * @message: A string log message.
- *
- * Writes @message to @channel and flushes the channel.
+static void
+ide_log_write_to_channels (const gchar *buffer,
+                           gsize        len)
+{
+  G_LOCK (channels_lock);
+  for (guint i = 0; i < channels->len; i++)
+    {
+      GIOChannel *channel = g_ptr_array_index (channels, i);
+
+      g_io_channel_write_chars (channel, buffer, len, NULL, NULL);
+      g_io_channel_flush (channel, NULL);
+    }
+  G_UNLOCK (channels_lock);
+}
+
+/*
+ * Formats the wall clock time of @tv, calling localtime_r() at most once a
+ * second per thread.
+ */
+static const gchar *
+ide_log_get_ftime (const GTimeVal *tv)
+{
+  IdeLogTimeCache *cache = g_private_get (&time_cache);
+
+  if G_UNLIKELY (cache == NULL)
+    {
+      cache = g_new0 (IdeLogTimeCache, 1);
+      cache->sec = -1;
+      g_private_set (&time_cache, cache);
+    }
+
+  if (cache->sec != (time_t)tv->tv_sec)
+    {
+      struct tm tt;
+
+      cache->sec = (time_t)tv->tv_sec;
+      localtime_r (&cache->sec, &tt);
+      strftime (cache->ftime, sizeof cache->ftime, "%H:%M:%S", &tt);
+    }
+
+  return cache->ftime;
+}
+
+static IdeLogRecord *
+ide_log_steal_pending (void)
+{
+  IdeLogRecord *head;
+  IdeLogRecord *reversed = NULL;
+
+  do
+    head = g_atomic_pointer_get (&pending);
+  while (!g_atomic_pointer_compare_and_exchange (&pending, head, NULL));
+
+  /* The stack is newest first, so flip it back into arrival order */
+  while (head != NULL)
+    {
+      IdeLogRecord *next = head->next;
+
+      head->next = reversed;
+      reversed = head;
+      head = next;
+    }
+
+  return reversed;
+}
+
+static gboolean
+ide_log_record_equal (const IdeLogRecord *a,
+                      const IdeLogRecord *b)
+{
+  return a->len == b->len &&
+         memcmp (a->line + TIMESTAMP_LEN, b->line + TIMESTAMP_LEN, a->len - TIMESTAMP_LEN) == 0;
+}
+
+static void
+ide_log_append_repeated (GString            *str,
+                         const IdeLogRecord *record,
+                         guint               n_repeated)
+{
+  g_string_append_len (str, record->line, record->prefix_len);
+  g_string_append_printf (str, "last message repeated %u times\n", n_repeated);
+}
+
+/*
+ * Writes everything that is pending. @last is the first record of the
+ * current run of identical messages and @n_repeated the number of copies
+ * suppressed since; they carry over between batches. A run is summarized
+ * at most once per REPEAT_WINDOW_USEC.
+ */
+static void
+ide_log_drain (GString       *str,
+               IdeLogRecord **last,
+               guint         *n_repeated)
+{
+  IdeLogRecord *records = ide_log_steal_pending ();
+
+  g_string_truncate (str, 0);
+
+  while (records != NULL)
+    {
+      IdeLogRecord *record = records;
+
+      records = record->next;
+
+      if (*last != NULL &&
+          record->time - (*last)->time < REPEAT_WINDOW_USEC &&
+          ide_log_record_equal (record, *last))
+        {
+          (*n_repeated)++;
+          g_free (record);
+          continue;
+        }
+
+      if (*n_repeated > 0)
+        ide_log_append_repeated (str, *last, *n_repeated);
+
+      g_string_append_len (str, record->line, record->len);
+
+      g_free (*last);
+      *last = record;
+      *n_repeated = 0;
+    }
+
+  if (str->len > 0)
+    ide_log_write_to_channels (str->str, str->len);
+}
+
+static void
+ide_log_flush_repeated (GString      *str,
+                        IdeLogRecord *last,
+                        guint        *n_repeated)
+{
+  if (*n_repeated > 0)
+    {
+      g_string_truncate (str, 0);
+      ide_log_append_repeated (str, last, *n_repeated);
+      ide_log_write_to_channels (str->str, str->len);
+      *n_repeated = 0;
+    }
+}
+
+static gpointer
+ide_log_writer_worker (gpointer data)
+{
+  g_autoptr(GString) str = g_string_new (NULL);
+  IdeLogRecord *last = NULL;
+  guint n_repeated = 0;
+
+  while (g_atomic_int_get (&writer_running))
+    {
+      g_mutex_lock (&writer_mutex);
+      /*
+       * Producers only signal on the empty to non-empty transition, so use
+       * a timeout as well to summarize a run of repeated messages once it
+       * has gone quiet.
+       */
+      if (g_atomic_pointer_get (&pending) == NULL && g_atomic_int_get (&writer_running))
+        g_cond_wait_until (&writer_cond, &writer_mutex,
+                           g_get_monotonic_time () + REPEAT_WINDOW_USEC);
+      g_mutex_unlock (&writer_mutex);
+
+      ide_log_drain (str, &last, &n_repeated);
+
+      if (last != NULL && g_get_monotonic_time () - last->time >= REPEAT_WINDOW_USEC)
+        ide_log_flush_repeated (str, last, &n_repeated);
+    }
+
+  ide_log_drain (str, &last, &n_repeated);
+  ide_log_flush_repeated (str, last, &n_repeated);
+
+  g_free (last);
+
+  return NULL;
+}
+
+/*
+ * Writes everything still pending from the calling thread. Used once the
+ * writer thread has gone away.
  */
 static void
-ide_log_write_to_channel (GIOChannel  *channel,
-                          const gchar *message)
+ide_log_drain_sync (void)
 {
-  g_io_channel_write_chars (channel, message, -1, NULL, NULL);
-  g_io_channel_flush (channel, NULL);
+  g_autoptr(GString) str = g_string_new (NULL);
+  IdeLogRecord *last = NULL;
+  guint n_repeated = 0;
+
+  ide_log_drain (str, &last, &n_repeated);
+  ide_log_flush_repeated (str, last, &n_repeated);
+  g_free (last);
+}
+
+static void
+ide_log_push (IdeLogRecord *record)
+{
+  IdeLogRecord *head;
+
+  do
+    {
+      head = g_atomic_pointer_get (&pending);
+      record->next = head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange (&pending, head, record));
+
+  if (head == NULL)
+    {
+      g_mutex_lock (&writer_mutex);
+      g_cond_signal (&writer_cond);
+      g_mutex_unlock (&writer_mutex);
+    }
+
+  /*
+   * The writer may have been stopped after our caller checked
+   * writer_running, and its final drain may have run before our push.
+   * Nobody would pick up the record then, so write it ourselves. Stealing
+   * the stack is atomic, so the record is written at most once.
+   */
+  if (!g_atomic_int_get (&writer_running))
+    ide_log_drain_sync ();
+}
+
+static void
+ide_log_stop_writer (void)
+{
+  GThread *thread;
+
+  g_mutex_lock (&writer_mutex);
+  thread = writer_thread;
+  writer_thread = NULL;
+  g_atomic_int_set (&writer_running, FALSE);
+  g_cond_signal (&writer_cond);
+  g_mutex_unlock (&writer_mutex);
+
+  /* The writer drains whatever is left before exiting */
+  if (thread != NULL)
+    {
+      g_thread_join (thread);
+
+      /*
+       * Pick up anything pushed by threads which raced with us. Producers
+       * that push after this re-check writer_running and drain themselves.
+       */
+      ide_log_drain_sync ();
+    }
 }
 
 /**
@@ -140,10 +404,7 @@ ide_log_handler (const gchar    *log_domain,
                  gpointer        user_data)
 {
   GTimeVal tv;
-  struct tm tt;
-  time_t t;
   const gchar *level;
-  gchar ftime[32];
   gchar *buffer;
 
   if (G_LIKELY (channels->len))
@@ -176,19 +437,55 @@ ide_log_handler (const gchar    *log_domain,
 
       level = log_level_str_func (log_level);
       g_get_current_time (&tv);
-      t = (time_t) tv.tv_sec;
-      tt = *localtime (&t);
-      strftime (ftime, sizeof (ftime), "%H:%M:%S", &tt);
+
+      if (g_atomic_int_get (&writer_running) &&
+          !(log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR)))
+        {
+          IdeLogRecord *record;
+          gchar prefix[128];
+          gsize prefix_len;
+          gsize message_len;
+
+          prefix_len = g_snprintf (prefix, sizeof prefix,
+                                   "%s.%04ld  %30s[%d]: %s: ",
+                                   ide_log_get_ftime (&tv),
+                                   tv.tv_usec / 1000,
+                                   log_domain,
+                                   ide_log_get_thread (),
+                                   level);
+          prefix_len = MIN (prefix_len, sizeof prefix - 1);
+          message_len = strlen (message);
+
+          record = g_malloc (sizeof *record + prefix_len + message_len + 2);
+          record->next = NULL;
+          record->time = g_get_monotonic_time ();
+          record->prefix_len = prefix_len;
+          record->len = prefix_len + message_len + 1;
+          memcpy (record->line, prefix, prefix_len);
+          memcpy (record->line + prefix_len, message, message_len);
+          record->line[record->len - 1] = '\n';
+          record->line[record->len] = '\0';
+
+          ide_log_push (record);
+
+          return;
+        }
+
+      /*
+       * Fatal messages are written synchronously, after anything still
+       * queued, so they are not lost when we abort right after.
+       */
+      if (g_atomic_int_get (&writer_running))
+        ide_log_stop_writer ();
+
       buffer = g_strdup_printf ("%s.%04ld  %30s[%d]: %s: %s\n",
-                                ftime,
+                                ide_log_get_ftime (&tv),
                                 tv.tv_usec / 1000,
                                 log_domain,
                                 ide_log_get_thread (),
                                 level,
                                 message);
-      G_LOCK (channels_lock);
-      g_ptr_array_foreach (channels, (GFunc) ide_log_write_to_channel, buffer);
-      G_UNLOCK (channels_lock);
+      ide_log_write_to_channels (buffer, strlen (buffer));
       g_free (buffer);
     }
 }
@@ -237,6 +534,8 @@ ide_log_init (gboolean     stdout_,
 void
 ide_log_shutdown (void)
 {
+  ide_log_set_async (FALSE);
+
   if (last_handler)
     {
       g_log_set_default_handler (last_handler, NULL);
@@ -244,6 +543,41 @@ ide_log_shutdown (void)
     }
 }
 
+/**
+ * ide_log_set_async:
+ * @async_: if messages should be written from a dedicated thread
+ *
+ * In asynchronous mode, the thread emitting a log message only formats it
+ * and queues it. A writer thread writes queued messages to the log channels
+ * in batches and folds runs of identical messages into a single line.
+ *
+ * Fatal messages are always written synchronously. Disabling asynchronous
+ * mode, or calling ide_log_shutdown(), flushes anything still queued.
+ */
+void
+ide_log_set_async (gboolean async_)
+{
+  async_ = !!async_;
+
+  if (async_ == g_atomic_int_get (&writer_running))
+    return;
+
+  if (async_)
+    {
+      g_mutex_lock (&writer_mutex);
+      if (writer_thread == NULL)
+        {
+          g_atomic_int_set (&writer_running, TRUE);
+          writer_thread = g_thread_new ("ide-log-writer", ide_log_writer_worker, NULL);
+        }
+      g_mutex_unlock (&writer_mutex);
+    }
+  else
+    {
+      ide_log_stop_writer ();
+    }
+}
+
 /**
  * ide_log_increase_verbosity:
  *
@@ -0,0 +1,318 @@
+/* ide-trace-ring.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#ifdef __linux__
+# include <sys/types.h>
+# include <sys/syscall.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ide-debug.h"
+
+#ifdef IDE_ENABLE_TRACE_RING
+
+/*
+ * Each thread that records a trace event gets its own ring of fixed size
+ * records. The owning thread is the only writer, so recording is a couple
+ * of stores followed by an atomic increment of the head. Readers take
+ * rings_lock (which serializes them against each other, never against the
+ * writers) and validate what they copied against the head afterwards, so
+ * records overwritten mid-copy are dropped instead of being reported torn.
+ *
+ * When a ring is full, the oldest records are overwritten. When a thread
+ * exits its ring is retired rather than freed, since its records may still
+ * need to be flushed. Once a retired ring has been drained it is kept for
+ * reuse by the next new thread, or freed if enough rings are spare already.
+ */
+
+#define RING_SIZE 8192
+#define RING_MASK (RING_SIZE - 1)
+#define MAX_SPARE_RINGS 4
+
+G_STATIC_ASSERT ((RING_SIZE & RING_MASK) == 0);
+
+typedef struct
+{
+  /* Only written by the owning thread */
+  volatile gint  head;
+  /* Only accessed with rings_lock held */
+  guint          tail;
+  guint          retired : 1;
+  guint32        thread_id;
+  IdeTraceRecord records[RING_SIZE];
+} IdeTraceRing;
+
+static void ide_trace_ring_retire (gpointer data);
+
+static GPrivate    current_ring = G_PRIVATE_INIT (ide_trace_ring_retire);
+static GMutex      rings_lock;
+static GPtrArray  *rings;
+static GPtrArray  *spare_rings;
+static GMutex      functions_lock;
+static GHashTable *function_ids;
+static GPtrArray  *function_names;
+
+static inline guint32
+ide_trace_ring_get_thread (void)
+{
+#ifdef __linux__
+  return (guint32) syscall (SYS_gettid);
+#else
+  return GPOINTER_TO_UINT (g_thread_self ());
+#endif
+}
+
+static inline gint64
+ide_trace_ring_get_time (void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  /* Use the same clock as sysprof so marks line up with samples */
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * G_GINT64_CONSTANT (1000000000)) + ts.tv_nsec;
+#else
+  return g_get_monotonic_time () * 1000;
+#endif
+}
+
+/* Must be called with rings_lock held, once the ring has been drained */
+static void
+ide_trace_ring_release_locked (IdeTraceRing *ring)
+{
+  g_ptr_array_remove_fast (rings, ring);
+
+  if (spare_rings == NULL)
+    spare_rings = g_ptr_array_new ();
+
+  if (spare_rings->len < MAX_SPARE_RINGS)
+    g_ptr_array_add (spare_rings, ring);
+  else
+    g_free (ring);
+}
+
+static void
+ide_trace_ring_retire (gpointer data)
+{
+  IdeTraceRing *ring = data;
+
+  g_mutex_lock (&rings_lock);
+
+  ring->retired = TRUE;
+
+  /* Nothing left to flush, so there is no need to wait for a reader */
+  if ((guint)g_atomic_int_get (&ring->head) == ring->tail)
+    ide_trace_ring_release_locked (ring);
+
+  g_mutex_unlock (&rings_lock);
+}
+
+static IdeTraceRing *
+ide_trace_ring_new (void)
+{
+  IdeTraceRing *ring;
+
+  g_mutex_lock (&rings_lock);
+
+  if (spare_rings != NULL && spare_rings->len > 0)
+    {
+      /* Records are not cleared, readers never look past head */
+      ring = g_ptr_array_remove_index_fast (spare_rings, spare_rings->len - 1);
+      ring->head = 0;
+      ring->tail = 0;
+      ring->retired = FALSE;
+    }
+  else
+    {
+      ring = g_malloc0 (sizeof *ring);
+    }
+
+  ring->thread_id = ide_trace_ring_get_thread ();
+
+  if (rings == NULL)
+    rings = g_ptr_array_new ();
+  g_ptr_array_add (rings, ring);
+
+  g_mutex_unlock (&rings_lock);
+
+  g_private_set (&current_ring, ring);
+
+  return ring;
+}
+
+/**
+ * ide_trace_ring_intern: (skip)
+ *
+ * Returns a stable, non-zero identifier for @function. This is called once
+ * per call site by the tracing macros, so it is fine for it to take a lock.
+ */
+guint
+ide_trace_ring_intern (const gchar *function)
+{
+  const gchar *interned = g_intern_string (function);
+  guint id;
+
+  g_mutex_lock (&functions_lock);
+
+  if (function_ids == NULL)
+    {
+      function_ids = g_hash_table_new (NULL, NULL);
+      function_names = g_ptr_array_new ();
+      /* Reserve 0 so callers can use it to mean "not yet interned" */
+      g_ptr_array_add (function_names, NULL);
+    }
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (function_ids, interned));
+
+  if (id == 0)
+    {
+      id = function_names->len;
+      g_ptr_array_add (function_names, (gpointer)interned);
+      g_hash_table_insert (function_ids, (gpointer)interned, GUINT_TO_POINTER (id));
+    }
+
+  g_mutex_unlock (&functions_lock);
+
+  return id;
+}
+
+/**
+ * ide_trace_ring_get_function_name: (skip)
+ *
+ * Returns: (nullable): the function name registered for @function_id.
+ */
+const gchar *
+ide_trace_ring_get_function_name (guint function_id)
+{
+  const gchar *ret = NULL;
+
+  g_mutex_lock (&functions_lock);
+  if (function_names != NULL && function_id < function_names->len)
+    ret = g_ptr_array_index (function_names, function_id);
+  g_mutex_unlock (&functions_lock);
+
+  return ret;
+}
+
+/**
+ * ide_trace_ring_record: (skip)
+ *
+ * Appends a record to the ring of the calling thread. This never blocks.
+ */
+void
+ide_trace_ring_record (guint         function_id,
+                       IdeTraceEvent event,
+                       guint         line)
+{
+  IdeTraceRing *ring = g_private_get (&current_ring);
+  IdeTraceRecord *record;
+  guint head;
+
+  if G_UNLIKELY (ring == NULL)
+    ring = ide_trace_ring_new ();
+
+  /* We are the only writer, so a plain read of head is fine */
+  head = (guint)ring->head;
+
+  record = &ring->records[head & RING_MASK];
+  record->time = ide_trace_ring_get_time ();
+  record->thread_id = ring->thread_id;
+  record->function_id = function_id;
+  record->event = event;
+  record->line = line;
+
+  /* Publish the record to readers */
+  g_atomic_int_set (&ring->head, (gint)(head + 1));
+}
+
+/**
+ * ide_trace_ring_foreach: (skip)
+ * @func: a function to call for the new records of each thread
+ * @user_data: closure data for @func
+ *
+ * Drains every ring, calling @func once per thread with the records that
+ * were added since the previous call, in the order they were recorded.
+ * Records that were overwritten before they could be drained are lost.
+ * Rings of threads that have exited are recycled once they are drained.
+ *
+ * @func is called with the ring list locked, so it must not be the first
+ * thing on a new thread to record a trace event.
+ */
+void
+ide_trace_ring_foreach (IdeTraceRingFunc func,
+                        gpointer         user_data)
+{
+  g_autofree IdeTraceRecord *copy = NULL;
+
+  g_return_if_fail (func != NULL);
+
+  g_mutex_lock (&rings_lock);
+
+  if (rings != NULL)
+    copy = g_new (IdeTraceRecord, RING_SIZE);
+
+  /* Walk backwards so that releasing a ring only moves one already visited */
+  for (guint i = rings != NULL ? rings->len : 0; i > 0; i--)
+    {
+      IdeTraceRing *ring = g_ptr_array_index (rings, i - 1);
+      gboolean retired = ring->retired;
+      guint head = (guint)g_atomic_int_get (&ring->head);
+      guint begin = ring->tail;
+      guint skip = 0;
+      guint valid;
+      guint n_records;
+
+      if (head - begin > RING_SIZE)
+        begin = head - RING_SIZE;
+
+      n_records = head - begin;
+
+      for (guint j = 0; j < n_records; j++)
+        copy[j] = ring->records[(begin + j) & RING_MASK];
+
+      /*
+       * Anything the writer lapped while we were copying, including the
+       * slot it may be filling right now, could be torn so skip past it.
+       */
+      valid = (guint)g_atomic_int_get (&ring->head);
+      if (valid - begin >= RING_SIZE)
+        skip = MIN (n_records, valid - begin - RING_SIZE + 1);
+
+      ring->tail = head;
+
+      if (n_records > skip)
+        func (copy + skip, n_records - skip, user_data);
+
+      /* The owning thread has exited, so head can no longer move */
+      if (retired)
+        ide_trace_ring_release_locked (ring);
+    }
+
+  g_mutex_unlock (&rings_lock);
+}
+
+#endif /* IDE_ENABLE_TRACE_RING */
@@ -24,54 +24,89 @@
 
 #include "buffers/ide-buffer-manager.h"
 #include "buffers/ide-buffer.h"
+#include "files/ide-file.h"
 #include "modelines/ide-modelines-file-settings.h"
 #include "modelines/modeline-parser.h"
 
 struct _IdeModelinesFileSettings
 {
-  IdeFileSettings parent_instance;
+  IdeFileSettings  parent_instance;
+
+  /* The options last applied, to skip unchanged modelines on reload */
+  ModelineOptions *options;
 };
 
-G_DEFINE_TYPE (IdeModelinesFileSettings, ide_modelines_file_settings, IDE_TYPE_FILE_SETTINGS)
+static void async_initable_iface_init (GAsyncInitableIface *iface);
+
+G_DEFINE_TYPE_EXTENDED (IdeModelinesFileSettings,
+                        ide_modelines_file_settings,
+                        IDE_TYPE_FILE_SETTINGS,
+                        0,
+                        G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
+                                               async_initable_iface_init))
 
 static void
-buffer_loaded_cb (IdeModelinesFileSettings *self,
-                  IdeBuffer                *buffer,
-                  IdeBufferManager         *buffer_manager)
+ide_modelines_file_settings_set_options (IdeModelinesFileSettings *self,
+                                         ModelineOptions          *options)
 {
+  g_assert (IDE_IS_MODELINES_FILE_SETTINGS (self));
+  g_assert (options != NULL);
+
+  if (modeline_options_equal (self->options, options))
+    {
+      modeline_options_free (options);
+      return;
+    }
+
+  modeline_parser_apply_settings (options, IDE_FILE_SETTINGS (self));
+
+  g_clear_pointer (&self->options, modeline_options_free);
+  self->options = options;
+}
+
+static void
+ide_modelines_file_settings_apply_buffer (IdeModelinesFileSettings *self,
+                                          IdeBuffer                *buffer)
+{
+  ModelineOptions *options;
   IdeFile *our_file;
   IdeFile *buffer_file;
 
   g_assert (IDE_IS_MODELINES_FILE_SETTINGS (self));
   g_assert (IDE_IS_BUFFER (buffer));
-  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
 
   if ((buffer_file = ide_buffer_get_file (buffer)) &&
       (our_file = ide_file_settings_get_file (IDE_FILE_SETTINGS (self))) &&
       ide_file_equal (buffer_file, our_file))
     {
-      modeline_parser_apply_modeline (GTK_TEXT_BUFFER (buffer), IDE_FILE_SETTINGS (self));
+      options = modeline_parser_scan_buffer (GTK_TEXT_BUFFER (buffer));
+      modeline_parser_apply_language (options, GTK_SOURCE_BUFFER (buffer));
+      ide_modelines_file_settings_set_options (self, options);
     }
 }
 
+static void
+buffer_loaded_cb (IdeModelinesFileSettings *self,
+                  IdeBuffer                *buffer,
+                  IdeBufferManager         *buffer_manager)
+{
+  g_assert (IDE_IS_MODELINES_FILE_SETTINGS (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
+
+  ide_modelines_file_settings_apply_buffer (self, buffer);
+}
+
 static void
 buffer_saved_cb (IdeModelinesFileSettings *self,
                  IdeBuffer                *buffer,
                  IdeBufferManager         *buffer_manager)
 {
-  IdeFile *our_file;
-  IdeFile *buffer_file;
-
   g_assert (IDE_IS_MODELINES_FILE_SETTINGS (self));
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
 
-  if ((buffer_file = ide_buffer_get_file (buffer)) &&
-      (our_file = ide_file_settings_get_file (IDE_FILE_SETTINGS (self))) &&
-      ide_file_equal (buffer_file, our_file))
-    {
-      modeline_parser_apply_modeline (GTK_TEXT_BUFFER (buffer), IDE_FILE_SETTINGS (self));
-    }
+  ide_modelines_file_settings_apply_buffer (self, buffer);
 }
 
 static void
@@ -99,15 +134,125 @@ ide_modelines_file_settings_constructed (GObject *object)
                            G_CONNECT_SWAPPED);
 }
 
+static void
+ide_modelines_file_settings_finalize (GObject *object)
+{
+  IdeModelinesFileSettings *self = (IdeModelinesFileSettings *)object;
+
+  g_clear_pointer (&self->options, modeline_options_free);
+
+  G_OBJECT_CLASS (ide_modelines_file_settings_parent_class)->finalize (object);
+}
+
 static void
 ide_modelines_file_settings_class_init (IdeModelinesFileSettingsClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->constructed = ide_modelines_file_settings_constructed;
+  object_class->finalize = ide_modelines_file_settings_finalize;
 }
 
 static void
 ide_modelines_file_settings_init (IdeModelinesFileSettings *self)
 {
 }
+
+static void
+ide_modelines_file_settings_init_worker (GTask        *task,
+                                         gpointer      source_object,
+                                         gpointer      task_data,
+                                         GCancellable *cancellable)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  const gchar *path = task_data;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_MODELINES_FILE_SETTINGS (source_object));
+  g_assert (path != NULL);
+
+  /*
+   * The file may not exist yet, in which case there are no modelines until
+   * a buffer is saved.
+   */
+  if (!(mapped = g_mapped_file_new (path, FALSE, NULL)))
+    {
+      g_task_return_pointer (task, NULL, NULL);
+      return;
+    }
+
+  g_task_return_pointer (task,
+                         modeline_parser_scan (g_mapped_file_get_contents (mapped),
+                                               g_mapped_file_get_length (mapped)),
+                         (GDestroyNotify)modeline_options_free);
+}
+
+static void
+ide_modelines_file_settings_init_async (GAsyncInitable      *initable,
+                                        gint                 io_priority,
+                                        GCancellable        *cancellable,
+                                        GAsyncReadyCallback  callback,
+                                        gpointer             user_data)
+{
+  IdeModelinesFileSettings *self = (IdeModelinesFileSettings *)initable;
+  g_autoptr(GTask) task = NULL;
+  IdeFile *file;
+  GFile *gfile = NULL;
+  gchar *path = NULL;
+
+  g_return_if_fail (IDE_IS_MODELINES_FILE_SETTINGS (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_priority (task, io_priority);
+
+  /* Modelines of files that are not local are read from their buffer */
+  if ((file = ide_file_settings_get_file (IDE_FILE_SETTINGS (self))) &&
+      (gfile = ide_file_get_file (file)))
+    path = g_file_get_path (gfile);
+
+  if (path == NULL)
+    {
+      g_task_return_pointer (task, NULL, NULL);
+      return;
+    }
+
+  g_task_set_task_data (task, path, g_free);
+  g_task_run_in_thread (task, ide_modelines_file_settings_init_worker);
+}
+
+static gboolean
+ide_modelines_file_settings_init_finish (GAsyncInitable  *initable,
+                                         GAsyncResult    *result,
+                                         GError         **error)
+{
+  IdeModelinesFileSettings *self = (IdeModelinesFileSettings *)initable;
+  ModelineOptions *options;
+  g_autoptr(GError) local_error = NULL;
+
+  g_return_val_if_fail (IDE_IS_MODELINES_FILE_SETTINGS (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (result), FALSE);
+
+  options = g_task_propagate_pointer (G_TASK (result), &local_error);
+
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+
+  /* A buffer may have been loaded in the mean time, it has precedence */
+  if (options != NULL && self->options == NULL)
+    ide_modelines_file_settings_set_options (self, options);
+  else
+    modeline_options_free (options);
+
+  return TRUE;
+}
+
+static void
+async_initable_iface_init (GAsyncInitableIface *iface)
+{
+  iface->init_async = ide_modelines_file_settings_init_async;
+  iface->init_finish = ide_modelines_file_settings_init_finish;
+}
@@ -35,40 +35,15 @@ static GHashTable *vim_languages = NULL;
 static GHashTable *emacs_languages = NULL;
 static GHashTable *kate_languages = NULL;
 
-typedef enum
-{
-	MODELINE_SET_NONE = 0,
-	MODELINE_SET_TAB_WIDTH = 1 << 0,
-	MODELINE_SET_INDENT_WIDTH = 1 << 1,
-	MODELINE_SET_WRAP_MODE = 1 << 2,
-	MODELINE_SET_SHOW_RIGHT_MARGIN = 1 << 3,
-	MODELINE_SET_RIGHT_MARGIN_POSITION = 1 << 4,
-	MODELINE_SET_LANGUAGE = 1 << 5,
-	MODELINE_SET_INSERT_SPACES = 1 << 6
-} ModelineSet;
-
-typedef struct _ModelineOptions
-{
-	gchar		*language_id;
-
-	/* these options are similar to the GtkSourceView properties of the
-	 * same names.
-	 */
-	gboolean	insert_spaces;
-	guint		tab_width;
-	guint		indent_width;
-	GtkWrapMode	wrap_mode;
-	gboolean	display_right_margin;
-	guint		right_margin_position;
+/* Modelines may be scanned from a thread, see modeline_parser_scan() */
+G_LOCK_DEFINE_STATIC (language_mappings);
 
-	ModelineSet	set;
-} ModelineOptions;
-
-#define MODELINE_OPTIONS_DATA_KEY "ModelineOptionsDataKey"
+/* Beyond the line count of any file, see modeline_parser_scan() */
+#define UNKNOWN_LINE_COUNT (G_MAXINT / 2)
 
 static gboolean
-has_option (ModelineOptions *options,
-            ModelineSet      set)
+has_option (const ModelineOptions *options,
+            ModelineSet            set)
 {
 	return options->set & set;
 }
@@ -81,6 +56,8 @@ modeline_parser_init (void)
 void
 modeline_parser_shutdown ()
 {
+	G_LOCK (language_mappings);
+
 	if (vim_languages != NULL)
 		g_hash_table_unref (vim_languages);
 
@@ -93,6 +70,8 @@ modeline_parser_shutdown ()
 	vim_languages = NULL;
 	emacs_languages = NULL;
 	kate_languages = NULL;
+
+	G_UNLOCK (language_mappings);
 }
 
 static GHashTable *
@@ -190,28 +169,52 @@ get_language_id (const gchar *language_name, GHashTable *mapping)
 static gchar *
 get_language_id_vim (const gchar *language_name)
 {
+	gchar *language_id;
+
+	G_LOCK (language_mappings);
+
 	if (vim_languages == NULL)
 		load_language_mappings ();
 
-	return get_language_id (language_name, vim_languages);
+	language_id = get_language_id (language_name, vim_languages);
+
+	G_UNLOCK (language_mappings);
+
+	return language_id;
 }
 
 static gchar *
 get_language_id_emacs (const gchar *language_name)
 {
+	gchar *language_id;
+
+	G_LOCK (language_mappings);
+
 	if (emacs_languages == NULL)
 		load_language_mappings ();
 
-	return get_language_id (language_name, emacs_languages);
+	language_id = get_language_id (language_name, emacs_languages);
+
+	G_UNLOCK (language_mappings);
+
+	return language_id;
 }
 
 static gchar *
 get_language_id_kate (const gchar *language_name)
 {
+	gchar *language_id;
+
+	G_LOCK (language_mappings);
+
 	if (kate_languages == NULL)
 		load_language_mappings ();
 
-	return get_language_id (language_name, kate_languages);
+	language_id = get_language_id (language_name, kate_languages);
+
+	G_UNLOCK (language_mappings);
+
+	return language_id;
 }
 
 static gboolean
@@ -614,202 +617,319 @@ parse_modeline (gchar           *line,
 	}
 }
 
-static void
-free_modeline_options (ModelineOptions *options)
+/* Vim and kate modelines need a colon, emacs ones start with "-*-".
+ * This rejects most lines without copying them.
+ */
+static gboolean
+line_may_have_modeline (const gchar *line,
+			gsize        len,
+			gint         line_number,
+			gint         line_count)
 {
-	g_free (options->language_id);
-	g_slice_free (ModelineOptions, options);
+	if ((line_number <= 10 || line_number > line_count - 10) &&
+	    memchr (line, ':', len) != NULL)
+		return TRUE;
+
+	return line_number <= 2 && memchr (line, '-', len) != NULL;
 }
 
-void
-modeline_parser_apply_modeline (GtkTextBuffer   *buffer,
-                                IdeFileSettings *file_settings)
+/* Scan the lines between begin and end, the first one being line_number */
+static void
+scan_lines (const gchar     *begin,
+	    const gchar     *end,
+	    gint             line_number,
+	    gint             line_count,
+	    ModelineOptions *options)
 {
-	ModelineOptions options;
-	GtkTextIter iter, liter;
-	gint line_count;
-	ModelineOptions *previous;
+	while (begin < end)
+	{
+		const gchar *eol;
+		gsize len;
 
-	options.language_id = NULL;
-	options.set = MODELINE_SET_NONE;
+		eol = memchr (begin, '\n', end - begin);
+		if (eol == NULL)
+			eol = end;
 
-	gtk_text_buffer_get_start_iter (buffer, &iter);
+		len = eol - begin;
+		if (len > 0 && begin[len - 1] == '\r')
+			len--;
 
-	line_count = gtk_text_buffer_get_line_count (buffer);
+		if (line_may_have_modeline (begin, len, line_number, line_count))
+		{
+			gchar *line;
 
-	/* Parse the modelines on the 10 first lines... */
-	while ((gtk_text_iter_get_line (&iter) < 10) &&
-	       !gtk_text_iter_is_end (&iter))
-	{
-		gchar *line;
+			line = g_strndup (begin, len);
+			parse_modeline (line, line_number, line_count, options);
+			g_free (line);
+		}
 
-		liter = iter;
-		gtk_text_iter_forward_to_line_end (&iter);
-		line = gtk_text_buffer_get_text (buffer, &liter, &iter, TRUE);
+		begin = eol + 1;
+		line_number++;
+	}
+}
 
-		parse_modeline (line,
-				1 + gtk_text_iter_get_line (&iter),
-				line_count,
-				&options);
+/**
+ * modeline_parser_scan:
+ * @data: the contents of a file
+ * @length: the length of @data
+ *
+ * Looks for modelines on the 10 first and the 10 last lines of @data,
+ * without needing a #GtkTextBuffer. It only reads the lines it scans, so
+ * @data can be a mapped file.
+ *
+ * Returns: (transfer full): the options found, free with
+ *   modeline_options_free().
+ */
+ModelineOptions *
+modeline_parser_scan (const gchar *data,
+		      gsize        length)
+{
+	ModelineOptions *options;
+	const gchar *end = data + length;
+	const gchar *head_end = data;
+	const gchar *tail_begin;
+	gint n_head = 0;
+	gint n_tail = 0;
 
-		gtk_text_iter_forward_line (&iter);
+	options = g_slice_new0 (ModelineOptions);
 
-		g_free (line);
-	}
+	if (length == 0)
+		return options;
 
-	/* ...and on the 10 last ones (modelines are not allowed in between) */
-	if (!gtk_text_iter_is_end (&iter))
+	/* Find the end of the 10 first lines... */
+	while (n_head < 10)
 	{
-		gint cur_line;
-		guint remaining_lines;
+		const gchar *eol = memchr (head_end, '\n', end - head_end);
 
-		/* we are on the 11th line (count from 0) */
-		cur_line = gtk_text_iter_get_line (&iter);
-		/* g_assert (10 == cur_line); */
+		n_head++;
 
-		remaining_lines = line_count - cur_line - 1;
-
-		if (remaining_lines > 10)
+		if (eol == NULL)
 		{
-			gtk_text_buffer_get_end_iter (buffer, &iter);
-			gtk_text_iter_backward_lines (&iter, 9);
+			scan_lines (data, end, 1, n_head, options);
+			return options;
 		}
+
+		head_end = eol + 1;
 	}
 
-	while (!gtk_text_iter_is_end (&iter))
+	/* ...and the beginning of the 10 last ones, if they are not the same */
+	tail_begin = end;
+	for (;;)
 	{
-		gchar *line;
+		while (tail_begin > head_end && tail_begin[-1] != '\n')
+			tail_begin--;
 
-		liter = iter;
-		gtk_text_iter_forward_to_line_end (&iter);
-		line = gtk_text_buffer_get_text (buffer, &liter, &iter, TRUE);
+		n_tail++;
 
-		parse_modeline (line,
-				1 + gtk_text_iter_get_line (&iter),
-				line_count,
-				&options);
+		if (tail_begin == head_end || n_tail == 10)
+			break;
 
-		gtk_text_iter_forward_line (&iter);
+		tail_begin--;
+	}
 
-		g_free (line);
+	if (tail_begin == head_end)
+	{
+		scan_lines (data, end, 1, n_head + n_tail, options);
+	}
+	else
+	{
+		/* Lines are not counted in between, the tail is numbered from
+		 * the end of an arbitrary long file instead.
+		 */
+		scan_lines (data, head_end, 1, UNKNOWN_LINE_COUNT, options);
+		scan_lines (tail_begin, end,
+			    UNKNOWN_LINE_COUNT - n_tail + 1,
+			    UNKNOWN_LINE_COUNT,
+			    options);
 	}
 
-	/* Try to set language */
-	if (has_option (&options, MODELINE_SET_LANGUAGE) && options.language_id)
+	return options;
+}
+
+static void
+scan_buffer_lines (GtkTextBuffer   *buffer,
+		   gint             first_line,
+		   gint             last_line,
+		   gint             line_count,
+		   ModelineOptions *options)
+{
+	GtkTextIter begin, end;
+	gchar *text;
+
+	gtk_text_buffer_get_iter_at_line (buffer, &begin, first_line);
+	gtk_text_buffer_get_iter_at_line (buffer, &end, last_line);
+	if (!gtk_text_iter_ends_line (&end))
+		gtk_text_iter_forward_to_line_end (&end);
+
+	text = gtk_text_buffer_get_text (buffer, &begin, &end, TRUE);
+	scan_lines (text, text + strlen (text), first_line + 1, line_count, options);
+	g_free (text);
+}
+
+/**
+ * modeline_parser_scan_buffer:
+ * @buffer: a #GtkTextBuffer
+ *
+ * Like modeline_parser_scan(), for the contents of @buffer.
+ *
+ * Returns: (transfer full): the options found, free with
+ *   modeline_options_free().
+ */
+ModelineOptions *
+modeline_parser_scan_buffer (GtkTextBuffer *buffer)
+{
+	ModelineOptions *options;
+	gint line_count;
+
+	g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+	options = g_slice_new0 (ModelineOptions);
+	line_count = gtk_text_buffer_get_line_count (buffer);
+
+	/* Parse the modelines on the 10 first lines and on the 10 last ones
+	 * (modelines are not allowed in between).
+	 */
+	if (line_count <= 20)
 	{
-		if (g_ascii_strcasecmp (options.language_id, "text") == 0)
-		{
-			gtk_source_buffer_set_language (GTK_SOURCE_BUFFER (buffer), NULL);
-		}
-		else
-		{
-		        GtkSourceLanguageManager *manager;
-		        GtkSourceLanguage *language;
+		scan_buffer_lines (buffer, 0, line_count - 1, line_count, options);
+	}
+	else
+	{
+		scan_buffer_lines (buffer, 0, 9, line_count, options);
+		scan_buffer_lines (buffer, line_count - 10, line_count - 1, line_count, options);
+	}
 
-		        manager = gtk_source_language_manager_get_default ();
+	return options;
+}
 
-			language = gtk_source_language_manager_get_language
-					(manager, options.language_id);
-			if (language != NULL)
-			{
-				gtk_source_buffer_set_language (GTK_SOURCE_BUFFER (buffer), language);
-			}
-			else
-			{
-				gedit_debug_message (DEBUG_PLUGINS,
-						     "Unknown language `%s'",
-						     options.language_id);
-			}
-		}
+/**
+ * modeline_parser_apply_language:
+ *
+ * Sets the language of @buffer if @options has one.
+ */
+void
+modeline_parser_apply_language (const ModelineOptions *options,
+				GtkSourceBuffer       *buffer)
+{
+	GtkSourceLanguageManager *manager;
+	GtkSourceLanguage *language;
+
+	g_return_if_fail (options != NULL);
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+
+	if (!has_option (options, MODELINE_SET_LANGUAGE) || options->language_id == NULL)
+		return;
+
+	if (g_ascii_strcasecmp (options->language_id, "text") == 0)
+	{
+		gtk_source_buffer_set_language (buffer, NULL);
+		return;
 	}
 
-	previous = g_object_get_data (G_OBJECT (buffer),
-	                              MODELINE_OPTIONS_DATA_KEY);
+	manager = gtk_source_language_manager_get_default ();
+	language = gtk_source_language_manager_get_language (manager, options->language_id);
 
-	/* Apply the options we got from modelines and restore defaults if
-	   we set them before */
-	if (has_option (&options, MODELINE_SET_INSERT_SPACES))
+	if (language != NULL)
+	{
+		gtk_source_buffer_set_language (buffer, language);
+	}
+	else
+	{
+		gedit_debug_message (DEBUG_PLUGINS,
+				     "Unknown language `%s'",
+				     options->language_id);
+	}
+}
+
+/**
+ * modeline_parser_apply_settings:
+ *
+ * Applies @options to @file_settings, and unsets the settings that
+ * @options does not have.
+ */
+void
+modeline_parser_apply_settings (const ModelineOptions *options,
+				IdeFileSettings       *file_settings)
+{
+	g_return_if_fail (options != NULL);
+	g_return_if_fail (IDE_IS_FILE_SETTINGS (file_settings));
+
+	if (has_option (options, MODELINE_SET_INSERT_SPACES))
 	{
 		IdeIndentStyle style;
-		style = options.insert_spaces ? IDE_INDENT_STYLE_SPACES : IDE_INDENT_STYLE_TABS;
+		style = options->insert_spaces ? IDE_INDENT_STYLE_SPACES : IDE_INDENT_STYLE_TABS;
 		ide_file_settings_set_indent_style (file_settings, style);
 	}
-        else
+	else
 	{
 		ide_file_settings_set_indent_style_set (file_settings, FALSE);
 	}
 
-	if (has_option (&options, MODELINE_SET_TAB_WIDTH))
+	if (has_option (options, MODELINE_SET_TAB_WIDTH))
 	{
-		ide_file_settings_set_tab_width (file_settings, options.tab_width);
+		ide_file_settings_set_tab_width (file_settings, options->tab_width);
 	}
-        else
+	else
 	{
 		ide_file_settings_set_tab_width_set (file_settings, FALSE);
 	}
 
-	if (has_option (&options, MODELINE_SET_INDENT_WIDTH))
+	if (has_option (options, MODELINE_SET_INDENT_WIDTH))
 	{
-		ide_file_settings_set_indent_width (file_settings, options.indent_width);
+		ide_file_settings_set_indent_width (file_settings, options->indent_width);
 	}
-        else
+	else
 	{
 		ide_file_settings_set_indent_width_set (file_settings, FALSE);
 	}
 
 	/* XXX: no wrap mode support in IdeFileSettings yet */
-#if 0
-	if (has_option (&options, MODELINE_SET_WRAP_MODE))
-	{
-		gtk_text_view_set_wrap_mode (GTK_TEXT_VIEW (view), options.wrap_mode);
-	}
-	else if (check_previous (view, previous, MODELINE_SET_WRAP_MODE))
-	{
-		GtkWrapMode mode;
 
-		mode = g_settings_get_enum (settings,
-					    GEDIT_SETTINGS_WRAP_MODE);
-		gtk_text_view_set_wrap_mode (GTK_TEXT_VIEW (view), mode);
-	}
-#endif
-
-	if (has_option (&options, MODELINE_SET_RIGHT_MARGIN_POSITION))
+	if (has_option (options, MODELINE_SET_RIGHT_MARGIN_POSITION))
 	{
-		ide_file_settings_set_right_margin_position (file_settings, options.right_margin_position);
+		ide_file_settings_set_right_margin_position (file_settings, options->right_margin_position);
 	}
-        else
+	else
 	{
 		ide_file_settings_set_right_margin_position_set (file_settings, FALSE);
 	}
 
-	if (has_option (&options, MODELINE_SET_SHOW_RIGHT_MARGIN))
+	if (has_option (options, MODELINE_SET_SHOW_RIGHT_MARGIN))
 	{
-		ide_file_settings_set_show_right_margin (file_settings, options.display_right_margin);
+		ide_file_settings_set_show_right_margin (file_settings, options->display_right_margin);
 	}
-        else
+	else
 	{
 		ide_file_settings_set_show_right_margin_set (file_settings, FALSE);
 	}
+}
 
-	if (previous)
-	{
-		g_free (previous->language_id);
-		*previous = options;
-		previous->language_id = g_strdup (options.language_id);
-	}
-	else
+gboolean
+modeline_options_equal (const ModelineOptions *a,
+			const ModelineOptions *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	/* Values are only compared when they are set */
+	return a->set == b->set &&
+	       (!has_option (a, MODELINE_SET_LANGUAGE) || g_strcmp0 (a->language_id, b->language_id) == 0) &&
+	       (!has_option (a, MODELINE_SET_INSERT_SPACES) || a->insert_spaces == b->insert_spaces) &&
+	       (!has_option (a, MODELINE_SET_TAB_WIDTH) || a->tab_width == b->tab_width) &&
+	       (!has_option (a, MODELINE_SET_INDENT_WIDTH) || a->indent_width == b->indent_width) &&
+	       (!has_option (a, MODELINE_SET_WRAP_MODE) || a->wrap_mode == b->wrap_mode) &&
+	       (!has_option (a, MODELINE_SET_SHOW_RIGHT_MARGIN) || a->display_right_margin == b->display_right_margin) &&
+	       (!has_option (a, MODELINE_SET_RIGHT_MARGIN_POSITION) || a->right_margin_position == b->right_margin_position);
+}
+
+void
+modeline_options_free (ModelineOptions *options)
+{
+	if (options != NULL)
 	{
-		previous = g_slice_new (ModelineOptions);
-		*previous = options;
-		previous->language_id = g_strdup (options.language_id);
-
-		g_object_set_data_full (G_OBJECT (buffer),
-		                        MODELINE_OPTIONS_DATA_KEY,
-		                        previous,
-		                        (GDestroyNotify)free_modeline_options);
+		g_free (options->language_id);
+		g_slice_free (ModelineOptions, options);
 	}
-
-	g_free (options.language_id);
 }
 
 /* vi:ts=8 */
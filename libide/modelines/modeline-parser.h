@@ -28,10 +28,47 @@
 
 G_BEGIN_DECLS
 
-void modeline_parser_init           (void);
-void modeline_parser_shutdown       (void);
-void modeline_parser_apply_modeline (GtkTextBuffer   *buffer,
-                                     IdeFileSettings *file_settings);
+typedef enum
+{
+	MODELINE_SET_NONE = 0,
+	MODELINE_SET_TAB_WIDTH = 1 << 0,
+	MODELINE_SET_INDENT_WIDTH = 1 << 1,
+	MODELINE_SET_WRAP_MODE = 1 << 2,
+	MODELINE_SET_SHOW_RIGHT_MARGIN = 1 << 3,
+	MODELINE_SET_RIGHT_MARGIN_POSITION = 1 << 4,
+	MODELINE_SET_LANGUAGE = 1 << 5,
+	MODELINE_SET_INSERT_SPACES = 1 << 6
+} ModelineSet;
+
+typedef struct _ModelineOptions
+{
+	gchar		*language_id;
+
+	/* these options are similar to the GtkSourceView properties of the
+	 * same names.
+	 */
+	gboolean	insert_spaces;
+	guint		tab_width;
+	guint		indent_width;
+	GtkWrapMode	wrap_mode;
+	gboolean	display_right_margin;
+	guint		right_margin_position;
+
+	ModelineSet	set;
+} ModelineOptions;
+
+void             modeline_parser_init           (void);
+void             modeline_parser_shutdown       (void);
+ModelineOptions *modeline_parser_scan           (const gchar           *data,
+                                                 gsize                  length);
+ModelineOptions *modeline_parser_scan_buffer    (GtkTextBuffer         *buffer);
+void             modeline_parser_apply_language (const ModelineOptions *options,
+                                                 GtkSourceBuffer       *buffer);
+void             modeline_parser_apply_settings (const ModelineOptions *options,
+                                                 IdeFileSettings       *file_settings);
+gboolean         modeline_options_equal         (const ModelineOptions *a,
+                                                 const ModelineOptions *b);
+void             modeline_options_free          (ModelineOptions       *options);
 
 G_END_DECLS
 
@@ -21,6 +21,38 @@
 #include "ide-search-reducer.h"
 #include "ide-search-result.h"
 
+/*
+ * The reducer keeps the best max_results results in a binary min-heap, the
+ * lowest score being at the root. Once the heap is full, a result is only
+ * accepted if it scores better than the root, which it then replaces.
+ *
+ * Accepted results are published to the search context in batches of
+ * FLUSH_BATCH_SIZE, so that results evicted before their batch is full
+ * never reach the UI, while the first results still show up before the
+ * provider is done. Results already published are removed from the
+ * context when evicted.
+ *
+ * The heap storage is private, so that the public structure keeps the
+ * layout it had with the GSequence based implementation.
+ */
+
+#define INITIAL_CAPACITY 32
+#define FLUSH_BATCH_SIZE 32
+
+typedef struct
+{
+  gfloat           score;
+  guint            published : 1;
+  IdeSearchResult *result;
+} IdeSearchReducerEntry;
+
+struct _IdeSearchReducerHeap
+{
+  gsize                 capacity;
+  gsize                 n_unpublished;
+  IdeSearchReducerEntry entries [];
+};
+
 void
 ide_search_reducer_init (IdeSearchReducer  *reducer,
                          IdeSearchContext  *context,
@@ -33,7 +65,7 @@ ide_search_reducer_init (IdeSearchReducer  *reducer,
 
   reducer->context = context;
   reducer->provider = provider;
-  reducer->sequence = g_sequence_new (g_object_unref);
+  reducer->heap = NULL;
   reducer->max_results = max_results ?: G_MAXSIZE;
   reducer->count = 0;
 }
@@ -43,57 +75,158 @@ ide_search_reducer_destroy (IdeSearchReducer *reducer)
 {
   g_return_if_fail (reducer);
 
-  if (reducer->sequence)
-    g_sequence_free (reducer->sequence);
+  if (reducer->heap != NULL)
+    {
+      ide_search_reducer_flush (reducer);
+
+      for (gsize i = 0; i < reducer->count; i++)
+        g_object_unref (reducer->heap->entries [i].result);
+
+      g_clear_pointer (&reducer->heap, g_free);
+      reducer->count = 0;
+    }
+}
+
+static void
+ide_search_reducer_sift_up (IdeSearchReducer *reducer,
+                            gsize             idx)
+{
+  IdeSearchReducerEntry *heap = reducer->heap->entries;
+  IdeSearchReducerEntry entry = heap [idx];
+
+  while (idx > 0)
+    {
+      gsize parent = (idx - 1) / 2;
+
+      if (heap [parent].score <= entry.score)
+        break;
+
+      heap [idx] = heap [parent];
+      idx = parent;
+    }
+
+  heap [idx] = entry;
+}
+
+static void
+ide_search_reducer_sift_down (IdeSearchReducer *reducer,
+                              gsize             idx)
+{
+  IdeSearchReducerEntry *heap = reducer->heap->entries;
+  IdeSearchReducerEntry entry = heap [idx];
+  gsize count = reducer->count;
+
+  for (;;)
+    {
+      gsize child = idx * 2 + 1;
+
+      if (child >= count)
+        break;
+
+      if (child + 1 < count && heap [child + 1].score < heap [child].score)
+        child++;
+
+      if (entry.score <= heap [child].score)
+        break;
+
+      heap [idx] = heap [child];
+      idx = child;
+    }
+
+  heap [idx] = entry;
 }
 
 void
 ide_search_reducer_push (IdeSearchReducer *reducer,
                          IdeSearchResult  *result)
 {
+  IdeSearchReducerEntry entry;
+
   g_return_if_fail (reducer);
   g_return_if_fail (IDE_IS_SEARCH_RESULT (result));
 
-  if (reducer->max_results <= g_sequence_get_length (reducer->sequence))
+  entry.score = ide_search_result_get_score (result);
+  entry.published = FALSE;
+  entry.result = result;
+
+  if (reducer->count < reducer->max_results)
+    {
+      gsize capacity = reducer->heap ? reducer->heap->capacity : 0;
+
+      if (reducer->count == capacity)
+        {
+          capacity = MIN (reducer->max_results, MAX (INITIAL_CAPACITY, capacity * 2));
+          reducer->heap = g_realloc (reducer->heap,
+                                     sizeof (IdeSearchReducerHeap) +
+                                     capacity * sizeof (IdeSearchReducerEntry));
+          if (reducer->count == 0)
+            reducer->heap->n_unpublished = 0;
+          reducer->heap->capacity = capacity;
+        }
+
+      g_object_ref (result);
+      reducer->heap->entries [reducer->count++] = entry;
+      ide_search_reducer_sift_up (reducer, reducer->count - 1);
+    }
+  else if (entry.score > reducer->heap->entries [0].score)
+    {
+      IdeSearchReducerEntry *lowest = &reducer->heap->entries [0];
+
+      /* Replace the lowest score */
+      if (lowest->published)
+        ide_search_context_remove_result (reducer->context, reducer->provider, lowest->result);
+      else
+        reducer->heap->n_unpublished--;
+      g_object_unref (lowest->result);
+
+      g_object_ref (result);
+      reducer->heap->entries [0] = entry;
+      ide_search_reducer_sift_down (reducer, 0);
+    }
+  else
     {
-      GSequenceIter *iter;
-      IdeSearchResult *lowest;
-
-      /* Remove lowest score */
-      iter = g_sequence_get_begin_iter (reducer->sequence);
-      lowest = g_sequence_get (iter);
-      ide_search_context_remove_result (reducer->context, reducer->provider, lowest);
-      g_sequence_remove (iter);
+      return;
     }
 
-  g_sequence_insert_sorted (reducer->sequence,
-                            g_object_ref (result),
-                            (GCompareDataFunc)ide_search_result_compare,
-                            NULL);
-  ide_search_context_add_result (reducer->context, reducer->provider, result);
+  if (++reducer->heap->n_unpublished >= FLUSH_BATCH_SIZE)
+    ide_search_reducer_flush (reducer);
 }
 
-gboolean
-ide_search_reducer_accepts (IdeSearchReducer *reducer,
-                            gfloat            score)
+/**
+ * ide_search_reducer_flush:
+ * @reducer: An #IdeSearchReducer
+ *
+ * Publishes the results accepted since the last flush to the search context.
+ * This is done automatically by ide_search_reducer_push() every few accepted
+ * results, and by ide_search_reducer_destroy().
+ */
+void
+ide_search_reducer_flush (IdeSearchReducer *reducer)
 {
-  GSequenceIter *iter;
-
-  g_return_val_if_fail (reducer, FALSE);
-
-  if (g_sequence_get_length (reducer->sequence) < reducer->max_results)
-    return TRUE;
+  g_return_if_fail (reducer);
 
-  iter = g_sequence_get_begin_iter (reducer->sequence);
+  if (reducer->heap == NULL || reducer->heap->n_unpublished == 0)
+    return;
 
-  if (iter)
+  for (gsize i = 0; i < reducer->count; i++)
     {
-      IdeSearchResult *result;
+      IdeSearchReducerEntry *entry = &reducer->heap->entries [i];
 
-      result = g_sequence_get (iter);
-      if (result)
-        return score > ide_search_result_get_score (result);
+      if (!entry->published)
+        {
+          entry->published = TRUE;
+          ide_search_context_add_result (reducer->context, reducer->provider, entry->result);
+        }
     }
 
-  return FALSE;
+  reducer->heap->n_unpublished = 0;
+}
+
+gboolean
+ide_search_reducer_accepts (IdeSearchReducer *reducer,
+                            gfloat            score)
+{
+  g_return_val_if_fail (reducer, FALSE);
+
+  return (reducer->count < reducer->max_results) || (score > reducer->heap->entries [0].score);
 }
@@ -23,13 +23,15 @@
 
 G_BEGIN_DECLS
 
+typedef struct _IdeSearchReducerHeap IdeSearchReducerHeap;
+
 typedef struct
 {
-  IdeSearchContext  *context;
-  IdeSearchProvider *provider;
-  GSequence         *sequence;
-  gsize              max_results;
-  gsize              count;
+  IdeSearchContext     *context;
+  IdeSearchProvider    *provider;
+  IdeSearchReducerHeap *heap;
+  gsize                 max_results;
+  gsize                 count;
 } IdeSearchReducer;
 
 void     ide_search_reducer_init    (IdeSearchReducer  *reducer,
@@ -40,6 +42,7 @@ gboolean ide_search_reducer_accepts (IdeSearchReducer  *reducer,
                                      gfloat             score);
 void     ide_search_reducer_push    (IdeSearchReducer  *reducer,
                                      IdeSearchResult   *result);
+void     ide_search_reducer_flush   (IdeSearchReducer  *reducer);
 void     ide_search_reducer_destroy (IdeSearchReducer  *reducer);
 
 G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (IdeSearchReducer, ide_search_reducer_destroy)
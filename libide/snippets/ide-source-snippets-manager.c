@@ -19,33 +19,101 @@
 #define G_LOG_DOMAIN "ide-source-snippets-manager"
 
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "ide-global.h"
 #include "ide-source-snippets-manager.h"
+#include "ide-source-snippet-chunk.h"
 #include "ide-source-snippet-parser.h"
 #include "ide-source-snippets.h"
 #include "ide-source-snippet.h"
 
+/*
+ * Bundled snippets are loaded lazily. At construction, the resources are
+ * only scanned for the languages they provide (the file basename and its
+ * "- scope" lines), and a language's files are parsed the first time its
+ * snippets are requested. User snippets are loaded before any language is
+ * requested, and are merged last so that they override bundled snippets.
+ *
+ * User snippets are compiled into a GVariant stored in the cache directory
+ * along with the modification time of the snippets file, so that later
+ * sessions map it instead of running the parser.
+ *
+ * The loading thread only builds fresh IdeSourceSnippets of its own. They
+ * are merged into the ones handed out to consumers from the main thread.
+ */
+
 struct _IdeSourceSnippetsManager
 {
   GObject     parent_instance;
+
+  /* language id -> IdeSourceSnippets, for languages requested so far */
   GHashTable *by_language_id;
+
+  /* language id -> GPtrArray of BundledFile, not yet requested */
+  GHashTable *pending;
+
+  /* language id -> IdeSourceSnippets, from the user snippets directory */
+  GHashTable *user_by_language_id;
+
+  /* BundledFile owned by the manager */
+  GPtrArray  *bundled;
 };
 
+typedef struct
+{
+  gchar *uri;
+  guint  loaded : 1;
+} BundledFile;
+
 G_DEFINE_TYPE (IdeSourceSnippetsManager, ide_source_snippets_manager, G_TYPE_OBJECT)
 
 #define SNIPPETS_DIRECTORY "/org/gnome/builder/snippets/"
+#define COMPILED_VERSION     1
+#define COMPILED_TYPE_STRING "(uta(ssmssa(si)))"
+
+static void
+bundled_file_free (gpointer data)
+{
+  BundledFile *bf = data;
+
+  g_free (bf->uri);
+  g_slice_free (BundledFile, bf);
+}
+
+static void
+add_snippets (GHashTable *by_language_id,
+              GList      *list)
+{
+  for (GList *iter = list; iter; iter = iter->next)
+    {
+      IdeSourceSnippet *snippet = iter->data;
+      IdeSourceSnippets *snippets;
+      const gchar *language;
+
+      language = ide_source_snippet_get_language (snippet);
+      snippets = g_hash_table_lookup (by_language_id, language);
+
+      if (!snippets)
+        {
+          snippets = ide_source_snippets_new ();
+          g_hash_table_insert (by_language_id, g_strdup (language), snippets);
+        }
+
+      ide_source_snippets_add (snippets, snippet);
+    }
+}
 
 static gboolean
-ide_source_snippets_manager_load_file (IdeSourceSnippetsManager  *self,
-                                       GFile                     *file,
-                                       GError                   **error)
+ide_source_snippets_manager_load_file (GHashTable  *by_language_id,
+                                       GFile       *file,
+                                       GList      **snippets,
+                                       GError     **error)
 {
   IdeSourceSnippetParser *parser;
-  GList *iter;
 
-  g_return_val_if_fail (IDE_IS_SOURCE_SNIPPETS_MANAGER (self), FALSE);
-  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_assert (by_language_id != NULL);
+  g_assert (G_IS_FILE (file));
 
   parser = ide_source_snippet_parser_new ();
 
@@ -55,38 +123,179 @@ ide_source_snippets_manager_load_file (IdeSourceSnippetsManager  *self,
       return FALSE;
     }
 
-  for (iter = ide_source_snippet_parser_get_snippets (parser); iter; iter = iter->next)
+  add_snippets (by_language_id, ide_source_snippet_parser_get_snippets (parser));
+
+  if (snippets != NULL)
+    {
+      *snippets = g_list_copy_deep (ide_source_snippet_parser_get_snippets (parser),
+                                    (GCopyFunc)g_object_ref, NULL);
+    }
+
+  g_object_unref (parser);
+
+  return TRUE;
+}
+
+static GVariant *
+compile_snippets (GList   *list,
+                  guint64  mtime)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssmssa(si))"));
+
+  for (GList *iter = list; iter; iter = iter->next)
+    {
+      IdeSourceSnippet *snippet = iter->data;
+      const gchar *text = ide_source_snippet_get_snippet_text (snippet);
+      guint n_chunks = ide_source_snippet_get_n_chunks (snippet);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("(ssmssa(si))"));
+      g_variant_builder_add (&builder, "s", ide_source_snippet_get_trigger (snippet));
+      g_variant_builder_add (&builder, "s", ide_source_snippet_get_language (snippet));
+      g_variant_builder_add (&builder, "ms", ide_source_snippet_get_description (snippet));
+      g_variant_builder_add (&builder, "s", text ? text : "");
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(si)"));
+
+      for (guint i = 0; i < n_chunks; i++)
+        {
+          IdeSourceSnippetChunk *chunk = ide_source_snippet_get_nth_chunk (snippet, i);
+          const gchar *spec = ide_source_snippet_chunk_get_spec (chunk);
+
+          g_variant_builder_add (&builder, "(si)",
+                                 spec ? spec : "",
+                                 ide_source_snippet_chunk_get_tab_stop (chunk));
+        }
+
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
+    }
+
+  return g_variant_ref_sink (g_variant_new ("(uta(ssmssa(si)))",
+                                            COMPILED_VERSION,
+                                            mtime,
+                                            &builder));
+}
+
+static gboolean
+load_compiled (GHashTable  *by_language_id,
+               const gchar *path,
+               guint64      mtime)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) snippetsv = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  GVariantIter iter;
+  GVariantIter *chunks;
+  const gchar *trigger;
+  const gchar *language;
+  const gchar *description;
+  const gchar *text;
+  guint64 compiled_mtime = 0;
+  guint version = 0;
+
+  if (NULL == (mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return FALSE;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (COMPILED_TYPE_STRING), bytes, FALSE));
+
+  g_variant_get (variant, "(ut@a(ssmssa(si)))", &version, &compiled_mtime, &snippetsv);
+  if (version != COMPILED_VERSION || compiled_mtime != mtime)
+    return FALSE;
+
+  g_variant_iter_init (&iter, snippetsv);
+
+  while (g_variant_iter_next (&iter, "(&s&sm&s&sa(si))", &trigger, &language, &description, &text, &chunks))
     {
+      g_autoptr(IdeSourceSnippet) snippet = NULL;
       IdeSourceSnippets *snippets;
-      IdeSourceSnippet *snippet;
-      const gchar *language;
+      const gchar *spec;
+      gint tab_stop;
 
-      snippet  = iter->data;
-      language = ide_source_snippet_get_language (snippet);
-      snippets = g_hash_table_lookup (self->by_language_id, language);
+      snippet = ide_source_snippet_new (trigger, language);
+      ide_source_snippet_set_description (snippet, description);
+      ide_source_snippet_set_snippet_text (snippet, text);
 
-      if (!snippets)
+      while (g_variant_iter_next (chunks, "(&si)", &spec, &tab_stop))
+        {
+          g_autoptr(IdeSourceSnippetChunk) chunk = ide_source_snippet_chunk_new ();
+
+          ide_source_snippet_chunk_set_spec (chunk, spec);
+          ide_source_snippet_chunk_set_tab_stop (chunk, tab_stop);
+          ide_source_snippet_add_chunk (snippet, chunk);
+        }
+
+      g_variant_iter_free (chunks);
+
+      if (!(snippets = g_hash_table_lookup (by_language_id, language)))
         {
           snippets = ide_source_snippets_new ();
-          g_hash_table_insert (self->by_language_id, g_strdup (language), snippets);
+          g_hash_table_insert (by_language_id, g_strdup (language), snippets);
         }
 
       ide_source_snippets_add (snippets, snippet);
     }
 
-  g_object_unref (parser);
-
   return TRUE;
 }
 
 static void
-ide_source_snippets_manager_load_directory (IdeSourceSnippetsManager *manager,
-                                           const gchar             *path)
+ide_source_snippets_manager_load_user_file (GHashTable  *by_language_id,
+                                            const gchar *filename,
+                                            const gchar *compiled_path)
+{
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GFileInfo) info = NULL;
+  g_autoptr(GVariant) compiled = NULL;
+  GError *error = NULL;
+  GList *list = NULL;
+  guint64 mtime;
+
+  file = g_file_new_for_path (filename);
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED","G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL,
+                            NULL);
+  if (info == NULL)
+    return;
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+          g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  if (load_compiled (by_language_id, compiled_path, mtime))
+    return;
+
+  if (!ide_source_snippets_manager_load_file (by_language_id, file, &list, &error))
+    {
+      g_warning (_("Failed to load file: %s: %s"), filename, error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  compiled = compile_snippets (list, mtime);
+
+  if (!g_file_set_contents (compiled_path,
+                            g_variant_get_data (compiled),
+                            g_variant_get_size (compiled),
+                            &error))
+    {
+      g_warning ("%s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_list_free_full (list, g_object_unref);
+}
+
+static void
+ide_source_snippets_manager_load_directory (GHashTable  *by_language_id,
+                                            const gchar *path,
+                                            const gchar *cache_path)
 {
   const gchar *name;
   GError *error = NULL;
-  gchar *filename;
-  GFile *file;
   GDir *dir;
 
   dir = g_dir_open (path, 0, &error);
@@ -102,36 +311,100 @@ ide_source_snippets_manager_load_directory (IdeSourceSnippetsManager *manager,
     {
       if (g_str_has_suffix (name, ".snippets"))
         {
+          g_autofree gchar *filename = NULL;
+          g_autofree gchar *compiled_name = NULL;
+          g_autofree gchar *compiled_path = NULL;
+
           filename = g_build_filename (path, name, NULL);
-          file = g_file_new_for_path (filename);
-          if (!ide_source_snippets_manager_load_file (manager, file, &error))
-            {
-              g_warning (_("Failed to load file: %s: %s"), filename, error->message);
-              g_clear_error (&error);
-            }
-          g_object_unref (file);
-          g_free (filename);
+          compiled_name = g_strconcat (name, ".compiled", NULL);
+          compiled_path = g_build_filename (cache_path, compiled_name, NULL);
+
+          ide_source_snippets_manager_load_user_file (by_language_id, filename, compiled_path);
         }
     }
 
   g_dir_close (dir);
 }
 
+static void
+ide_source_snippets_manager_merge_user (IdeSourceSnippetsManager *self,
+                                        const gchar              *language_id)
+{
+  IdeSourceSnippets *user;
+  IdeSourceSnippets *snippets;
+
+  g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
+
+  if (!(user = g_hash_table_lookup (self->user_by_language_id, language_id)))
+    return;
+
+  if (!(snippets = g_hash_table_lookup (self->by_language_id, language_id)))
+    {
+      snippets = ide_source_snippets_new ();
+      g_hash_table_insert (self->by_language_id, g_strdup (language_id), snippets);
+    }
+
+  ide_source_snippets_merge (snippets, user);
+}
+
 static void
 ide_source_snippets_manager_load_worker (GTask        *task,
                                          gpointer      source_object,
                                          gpointer      task_data,
                                          GCancellable *cancellable)
 {
+  GHashTable *user_by_language_id;
   g_autofree gchar *path = NULL;
+  g_autofree gchar *cache_path = NULL;
 
   g_assert (G_IS_TASK (task));
   g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (source_object));
 
-  /* Load internal snippets */
+  user_by_language_id = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  /* Load user snippets */
   path = g_build_filename (g_get_user_config_dir (), ide_get_program_name (), "snippets", NULL);
+  cache_path = g_build_filename (g_get_user_cache_dir (), ide_get_program_name (), "snippets", NULL);
   g_mkdir_with_parents (path, 0700);
-  ide_source_snippets_manager_load_directory (source_object, path);
+  g_mkdir_with_parents (cache_path, 0700);
+  ide_source_snippets_manager_load_directory (user_by_language_id, path, cache_path);
+
+  g_task_return_pointer (task, user_by_language_id, (GDestroyNotify)g_hash_table_unref);
+}
+
+static void
+ide_source_snippets_manager_load_cb (GObject      *object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data)
+{
+  IdeSourceSnippetsManager *self = (IdeSourceSnippetsManager *)object;
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GHashTable) user_by_language_id = NULL;
+  GError *error = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
+  g_assert (G_IS_TASK (result));
+  g_assert (G_IS_TASK (task));
+
+  if (!(user_by_language_id = g_task_propagate_pointer (G_TASK (result), &error)))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_hash_table_iter_init (&iter, user_by_language_id);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      g_hash_table_iter_steal (&iter);
+      g_hash_table_replace (self->user_by_language_id, key, value);
+
+      /* Languages requested before we finished loading */
+      if (!g_hash_table_contains (self->pending, key))
+        ide_source_snippets_manager_merge_user (self, key);
+    }
 
   g_task_return_boolean (task, TRUE);
 }
@@ -143,12 +416,19 @@ ide_source_snippets_manager_load_async (IdeSourceSnippetsManager *self,
                                         gpointer                  user_data)
 {
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GTask) load_task = NULL;
 
   g_return_if_fail (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   task = g_task_new (self, cancellable, callback, user_data);
-  g_task_run_in_thread (task, ide_source_snippets_manager_load_worker);
+
+  /* The results are merged from the main thread, in load_cb() */
+  load_task = g_task_new (self,
+                          cancellable,
+                          ide_source_snippets_manager_load_cb,
+                          g_object_ref (task));
+  g_task_run_in_thread (load_task, ide_source_snippets_manager_load_worker);
 }
 
 gboolean
@@ -163,6 +443,45 @@ ide_source_snippets_manager_load_finish (IdeSourceSnippetsManager  *self,
   return g_task_propagate_boolean (task, error);
 }
 
+/*
+ * Parses the bundled files providing @language_id, if not done yet.
+ */
+static void
+ide_source_snippets_manager_ensure_language (IdeSourceSnippetsManager *self,
+                                             const gchar              *language_id)
+{
+  GPtrArray *files;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
+  g_assert (language_id != NULL);
+
+  if (!(files = g_hash_table_lookup (self->pending, language_id)))
+    return;
+
+  for (guint i = 0; i < files->len; i++)
+    {
+      BundledFile *bf = g_ptr_array_index (files, i);
+      g_autoptr(GFile) file = NULL;
+
+      if (bf->loaded)
+        continue;
+
+      bf->loaded = TRUE;
+      file = g_file_new_for_uri (bf->uri);
+
+      if (!ide_source_snippets_manager_load_file (self->by_language_id, file, NULL, &error))
+        {
+          g_message ("%s", error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  g_hash_table_remove (self->pending, language_id);
+
+  ide_source_snippets_manager_merge_user (self, language_id);
+}
+
 /**
  * ide_source_snippets_manager_get_for_language_id:
  *
@@ -174,10 +493,15 @@ IdeSourceSnippets *
 ide_source_snippets_manager_get_for_language_id (IdeSourceSnippetsManager *self,
                                                  const gchar              *language_id)
 {
+  IdeSourceSnippets *snippets;
+
   g_return_val_if_fail (IDE_IS_SOURCE_SNIPPETS_MANAGER (self), NULL);
   g_return_val_if_fail (language_id != NULL, NULL);
 
-  return g_hash_table_lookup (self->by_language_id, language_id);
+  ide_source_snippets_manager_ensure_language (self, language_id);
+  snippets = g_hash_table_lookup (self->by_language_id, language_id);
+
+  return snippets;
 }
 
 /**
@@ -191,16 +515,89 @@ IdeSourceSnippets *
 ide_source_snippets_manager_get_for_language (IdeSourceSnippetsManager *self,
                                               GtkSourceLanguage        *language)
 {
-  IdeSourceSnippets *snippets;
-  const char *language_id;
-
   g_return_val_if_fail (IDE_IS_SOURCE_SNIPPETS_MANAGER (self), NULL);
   g_return_val_if_fail (GTK_SOURCE_IS_LANGUAGE (language), NULL);
 
-  language_id = gtk_source_language_get_id (language);
-  snippets = g_hash_table_lookup (self->by_language_id, language_id);
+  return ide_source_snippets_manager_get_for_language_id (self, gtk_source_language_get_id (language));
+}
 
-  return snippets;
+static void
+ide_source_snippets_manager_add_pending (IdeSourceSnippetsManager *self,
+                                         const gchar              *language_id,
+                                         BundledFile              *bf)
+{
+  GPtrArray *files;
+
+  g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
+  g_assert (bf != NULL);
+
+  if (!(files = g_hash_table_lookup (self->pending, language_id)))
+    {
+      files = g_ptr_array_new ();
+      g_hash_table_insert (self->pending, g_strdup (language_id), files);
+    }
+
+  for (guint i = 0; i < files->len; i++)
+    {
+      if (g_ptr_array_index (files, i) == bf)
+        return;
+    }
+
+  g_ptr_array_add (files, bf);
+}
+
+/*
+ * Finds the languages a snippets file provides without parsing it. Like
+ * the parser, every snippet gets the file basename as a scope, in
+ * addition to the ones from its "- scope" lines.
+ */
+static void
+ide_source_snippets_manager_index (IdeSourceSnippetsManager *self,
+                                   const gchar              *name,
+                                   BundledFile              *bf)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *basename = NULL;
+  const gchar *data;
+  const gchar *end;
+  const gchar *line;
+  gsize len = 0;
+
+  g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
+  g_assert (name != NULL);
+  g_assert (bf != NULL);
+
+  basename = g_strdup (name);
+  if (strchr (basename, '.'))
+    *strchr (basename, '.') = '\0';
+  ide_source_snippets_manager_add_pending (self, basename, bf);
+
+  path = g_strconcat (SNIPPETS_DIRECTORY, name, NULL);
+  if (!(bytes = g_resources_lookup_data (path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL)))
+    return;
+
+  data = g_bytes_get_data (bytes, &len);
+  end = data + len;
+
+  for (line = data; line < end; )
+    {
+      const gchar *eol = memchr (line, '\n', end - line);
+
+      if (eol == NULL)
+        eol = end;
+
+      if (eol - line > 7 && memcmp (line, "- scope", 7) == 0)
+        {
+          g_autofree gchar *scopes = g_strndup (line + 7, eol - line - 7);
+          g_auto(GStrv) parts = g_strsplit (scopes, ",", -1);
+
+          for (guint i = 0; parts[i]; i++)
+            ide_source_snippets_manager_add_pending (self, g_strstrip (parts[i]), bf);
+        }
+
+      line = eol + 1;
+    }
 }
 
 static void
@@ -213,6 +610,8 @@ ide_source_snippets_manager_constructed (GObject *object)
 
   g_assert (IDE_IS_SOURCE_SNIPPETS_MANAGER (self));
 
+  G_OBJECT_CLASS (ide_source_snippets_manager_parent_class)->constructed (object);
+
   names = g_resources_enumerate_children (SNIPPETS_DIRECTORY, G_RESOURCE_LOOKUP_FLAGS_NONE, &error);
 
   if (!names)
@@ -224,17 +623,13 @@ ide_source_snippets_manager_constructed (GObject *object)
 
   for (i = 0; names[i]; i++)
     {
-      g_autofree gchar *path = NULL;
-      g_autoptr(GFile) file = NULL;
+      BundledFile *bf;
 
-      path = g_strdup_printf ("resource://"SNIPPETS_DIRECTORY"%s", names[i]);
-      file = g_file_new_for_uri (path);
+      bf = g_slice_new0 (BundledFile);
+      bf->uri = g_strdup_printf ("resource://"SNIPPETS_DIRECTORY"%s", names[i]);
+      g_ptr_array_add (self->bundled, bf);
 
-      if (!ide_source_snippets_manager_load_file (self, file, &error))
-        {
-          g_message ("%s", error->message);
-          g_clear_error (&error);
-        }
+      ide_source_snippets_manager_index (self, names[i], bf);
     }
 
   g_strfreev (names);
@@ -246,6 +641,9 @@ ide_source_snippets_manager_finalize (GObject *object)
   IdeSourceSnippetsManager *self = (IdeSourceSnippetsManager *)object;
 
   g_clear_pointer (&self->by_language_id, g_hash_table_unref);
+  g_clear_pointer (&self->user_by_language_id, g_hash_table_unref);
+  g_clear_pointer (&self->pending, g_hash_table_unref);
+  g_clear_pointer (&self->bundled, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ide_source_snippets_manager_parent_class)->finalize (object);
 }
@@ -263,4 +661,7 @@ static void
 ide_source_snippets_manager_init (IdeSourceSnippetsManager *self)
 {
   self->by_language_id = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->user_by_language_id = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+  self->bundled = g_ptr_array_new_with_free_func (bundled_file_free);
 }
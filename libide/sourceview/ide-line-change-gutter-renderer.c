@@ -42,6 +42,9 @@ struct _IdeLineChangeGutterRenderer
   GtkTextBuffer          *buffer;
   gulong                  buffer_notify_style_scheme;
 
+  /* Line flags of the lines being drawn, between begin and end */
+  IdeBufferLineFlagsSnapshot *snapshot;
+
   GdkRGBA                 rgba_added;
   GdkRGBA                 rgba_changed;
   GdkRGBA                 rgba_removed;
@@ -234,6 +237,53 @@ ide_line_change_gutter_renderer_notify_view (IdeLineChangeGutterRenderer *self)
   connect_view (self);
 }
 
+static void
+ide_line_change_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
+                                       cairo_t                 *cr,
+                                       GdkRectangle            *bg_area,
+                                       GdkRectangle            *cell_area,
+                                       GtkTextIter             *begin,
+                                       GtkTextIter             *end)
+{
+  IdeLineChangeGutterRenderer *self = (IdeLineChangeGutterRenderer *)renderer;
+  GtkTextBuffer *buffer;
+  guint begin_line;
+  guint end_line;
+
+  g_assert (IDE_IS_LINE_CHANGE_GUTTER_RENDERER (self));
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_change_gutter_renderer_parent_class)->begin)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_change_gutter_renderer_parent_class)->begin (renderer, cr, bg_area, cell_area, begin, end);
+
+  g_clear_pointer (&self->snapshot, ide_buffer_line_flags_snapshot_unref);
+
+  buffer = gtk_text_iter_get_buffer (begin);
+
+  if (!IDE_IS_BUFFER (buffer))
+    return;
+
+  /* Include the surrounding lines for the deletion marks */
+  begin_line = gtk_text_iter_get_line (begin);
+  end_line = gtk_text_iter_get_line (end);
+
+  self->snapshot = ide_buffer_get_line_flags_snapshot (IDE_BUFFER (buffer),
+                                                       begin_line > 0 ? begin_line - 1 : 0,
+                                                       end_line + 1);
+}
+
+static void
+ide_line_change_gutter_renderer_end (GtkSourceGutterRenderer *renderer)
+{
+  IdeLineChangeGutterRenderer *self = (IdeLineChangeGutterRenderer *)renderer;
+
+  g_assert (IDE_IS_LINE_CHANGE_GUTTER_RENDERER (self));
+
+  g_clear_pointer (&self->snapshot, ide_buffer_line_flags_snapshot_unref);
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_change_gutter_renderer_parent_class)->end)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_change_gutter_renderer_parent_class)->end (renderer);
+}
+
 static void
 ide_line_change_gutter_renderer_draw (GtkSourceGutterRenderer      *renderer,
                                       cairo_t                      *cr,
@@ -245,7 +295,6 @@ ide_line_change_gutter_renderer_draw (GtkSourceGutterRenderer      *renderer,
 {
   IdeLineChangeGutterRenderer *self = (IdeLineChangeGutterRenderer *)renderer;
   GdkRectangle cell_area_copy;
-  GtkTextBuffer *buffer;
   GdkRGBA *rgba = NULL;
   IdeBufferLineFlags flags;
   IdeBufferLineFlags prev_flags = 0;
@@ -262,17 +311,15 @@ ide_line_change_gutter_renderer_draw (GtkSourceGutterRenderer      *renderer,
 
   GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_change_gutter_renderer_parent_class)->draw (renderer, cr, bg_area, cell_area, begin, end, state);
 
-  buffer = gtk_text_iter_get_buffer (begin);
-
-  if (!IDE_IS_BUFFER (buffer))
+  if (self->snapshot == NULL)
     return;
 
   lineno = gtk_text_iter_get_line (begin);
 
-  flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), lineno);
-  next_flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), lineno + 1);
+  flags = ide_buffer_line_flags_snapshot_get (self->snapshot, lineno);
+  next_flags = ide_buffer_line_flags_snapshot_get (self->snapshot, lineno + 1);
   if (lineno > 0)
-    prev_flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), lineno - 1);
+    prev_flags = ide_buffer_line_flags_snapshot_get (self->snapshot, lineno - 1);
 
   if ((flags & IDE_BUFFER_LINE_FLAGS_ADDED) != 0)
     rgba = self->rgba_added_set ? &self->rgba_added : &rgbaAdded;
@@ -386,7 +433,11 @@ ide_line_change_gutter_renderer_draw (GtkSourceGutterRenderer      *renderer,
 static void
 ide_line_change_gutter_renderer_dispose (GObject *object)
 {
-  disconnect_view (IDE_LINE_CHANGE_GUTTER_RENDERER (object));
+  IdeLineChangeGutterRenderer *self = (IdeLineChangeGutterRenderer *)object;
+
+  disconnect_view (self);
+
+  g_clear_pointer (&self->snapshot, ide_buffer_line_flags_snapshot_unref);
 
   G_OBJECT_CLASS (ide_line_change_gutter_renderer_parent_class)->dispose (object);
 }
@@ -440,7 +491,9 @@ ide_line_change_gutter_renderer_class_init (IdeLineChangeGutterRendererClass *kl
   object_class->get_property = ide_line_change_gutter_renderer_get_property;
   object_class->set_property = ide_line_change_gutter_renderer_set_property;
 
+  renderer_class->begin = ide_line_change_gutter_renderer_begin;
   renderer_class->draw = ide_line_change_gutter_renderer_draw;
+  renderer_class->end = ide_line_change_gutter_renderer_end;
 
   properties [PROP_SHOW_LINE_DELETIONS] =
     g_param_spec_boolean ("show-line-deletions",
@@ -23,21 +23,65 @@
 
 struct _IdeLineDiagnosticsGutterRenderer
 {
-  GtkSourceGutterRendererPixbuf parent_instance;
+  GtkSourceGutterRendererPixbuf  parent_instance;
+
+  /* Line flags of the lines being drawn, between begin and end */
+  IdeBufferLineFlagsSnapshot    *snapshot;
 };
 
 G_DEFINE_TYPE (IdeLineDiagnosticsGutterRenderer,
                ide_line_diagnostics_gutter_renderer,
                GTK_SOURCE_TYPE_GUTTER_RENDERER_PIXBUF)
 
+static void
+ide_line_diagnostics_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
+                                            cairo_t                 *cr,
+                                            GdkRectangle            *bg_area,
+                                            GdkRectangle            *cell_area,
+                                            GtkTextIter             *begin,
+                                            GtkTextIter             *end)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+  GtkTextBuffer *buffer;
+
+  g_assert (IDE_IS_LINE_DIAGNOSTICS_GUTTER_RENDERER (self));
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->begin)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->begin (renderer, cr, bg_area, cell_area, begin, end);
+
+  g_clear_pointer (&self->snapshot, ide_buffer_line_flags_snapshot_unref);
+
+  buffer = gtk_text_iter_get_buffer (begin);
+
+  if (!IDE_IS_BUFFER (buffer))
+    return;
+
+  self->snapshot = ide_buffer_get_line_flags_snapshot (IDE_BUFFER (buffer),
+                                                       gtk_text_iter_get_line (begin),
+                                                       gtk_text_iter_get_line (end));
+}
+
+static void
+ide_line_diagnostics_gutter_renderer_end (GtkSourceGutterRenderer *renderer)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+
+  g_assert (IDE_IS_LINE_DIAGNOSTICS_GUTTER_RENDERER (self));
+
+  g_clear_pointer (&self->snapshot, ide_buffer_line_flags_snapshot_unref);
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->end)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->end (renderer);
+}
+
 static void
 ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *renderer,
                                                  GtkTextIter                  *begin,
                                                  GtkTextIter                  *end,
                                                  GtkSourceGutterRendererState  state)
 {
-  GtkTextBuffer *buffer;
-  IdeBufferLineFlags flags;
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+  IdeBufferLineFlags flags = 0;
   const gchar *icon_name = NULL;
   guint line;
 
@@ -45,13 +89,11 @@ ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *r
   g_return_if_fail (begin);
   g_return_if_fail (end);
 
-  buffer = gtk_text_iter_get_buffer (begin);
-
-  if (!IDE_IS_BUFFER (buffer))
+  if (self->snapshot == NULL)
     return;
 
   line = gtk_text_iter_get_line (begin);
-  flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), line);
+  flags = ide_buffer_line_flags_snapshot_get (self->snapshot, line);
   flags &= IDE_BUFFER_LINE_FLAGS_DIAGNOSTICS_MASK;
 
   if (flags == 0)
@@ -71,12 +113,27 @@ ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *r
     g_object_set (renderer, "pixbuf", NULL, NULL);
 }
 
+static void
+ide_line_diagnostics_gutter_renderer_finalize (GObject *object)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)object;
+
+  g_clear_pointer (&self->snapshot, ide_buffer_line_flags_snapshot_unref);
+
+  G_OBJECT_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->finalize (object);
+}
+
 static void
 ide_line_diagnostics_gutter_renderer_class_init (IdeLineDiagnosticsGutterRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkSourceGutterRendererClass *renderer_class = GTK_SOURCE_GUTTER_RENDERER_CLASS (klass);
 
+  object_class->finalize = ide_line_diagnostics_gutter_renderer_finalize;
+
+  renderer_class->begin = ide_line_diagnostics_gutter_renderer_begin;
   renderer_class->query_data = ide_line_diagnostics_gutter_renderer_query_data;
+  renderer_class->end = ide_line_diagnostics_gutter_renderer_end;
 }
 
 static void
@@ -51,6 +51,7 @@ struct _IdeMakecache
   GFile        *makefile;
   GFile        *parent;
   GMappedFile  *mapped;
+  GHashTable   *file_targets_index;
   EggTaskCache *file_targets_cache;
   EggTaskCache *file_flags_cache;
   GPtrArray    *build_targets;
@@ -68,8 +69,8 @@ typedef struct
 
 typedef struct
 {
-  GMappedFile *mapped;
-  gchar       *path;
+  GHashTable *index;
+  gchar      *path;
 } FileTargetsLookup;
 
 G_DEFINE_TYPE (IdeMakecache, ide_makecache, IDE_TYPE_OBJECT)
@@ -102,7 +103,7 @@ file_targets_lookup_free (gpointer data)
   FileTargetsLookup *lookup = data;
 
   g_clear_pointer (&lookup->path, g_free);
-  g_clear_pointer (&lookup->mapped, g_mapped_file_unref);
+  g_clear_pointer (&lookup->index, g_hash_table_unref);
   g_slice_free (FileTargetsLookup, lookup);
 }
 
@@ -151,22 +152,80 @@ is_target_interesting (const gchar *target)
            g_str_has_suffix (target, ".o")));
 }
 
+/*
+ * The file targets index maps the basename of every prerequisite found in the
+ * makecache to the (subdir, target) pairs that depend upon it. It is built in
+ * a single pass over the makecache when it is created so that looking up the
+ * targets for a file does not require scanning the whole `make -p` database.
+ *
+ * The index is persisted next to the makecache (as a GVariant) along with a
+ * checksum of the makecache contents. If the next makecache generation
+ * produces identical output, we can load the index instead of rebuilding it.
+ */
+#define FILE_TARGETS_INDEX_TYPE    "(sa{sa(ss)})"
+#define FILE_TARGETS_INDEX_VERSION "1"
+
+static void
+file_targets_index_add (GHashTable  *index,
+                        GHashTable  *found,
+                        const gchar *name,
+                        const gchar *subdir,
+                        const gchar *targetstr)
+{
+  g_autoptr(IdeMakecacheTarget) target = NULL;
+  g_autofree gchar *key = NULL;
+  GPtrArray *targets;
+
+  g_assert (index != NULL);
+  g_assert (found != NULL);
+  g_assert (name != NULL);
+  g_assert (targetstr != NULL);
+
+  target = ide_makecache_target_new (subdir, targetstr);
+  key = g_strdup_printf ("%s\n%s\n%s",
+                         name,
+                         ide_makecache_target_get_subdir (target) ?: "",
+                         targetstr);
+
+  if (g_hash_table_contains (found, key))
+    return;
+
+  if (!(targets = g_hash_table_lookup (index, name)))
+    {
+      targets = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_makecache_target_unref);
+      g_hash_table_insert (index, g_strdup (name), targets);
+    }
+
+  g_ptr_array_add (targets, g_steal_pointer (&target));
+  g_hash_table_add (found, g_steal_pointer (&key));
+}
+
+static GHashTable *
+file_targets_index_new (void)
+{
+  return g_hash_table_new_full (g_str_hash,
+                                g_str_equal,
+                                g_free,
+                                (GDestroyNotify)g_ptr_array_unref);
+}
+
 /**
- * ide_makecache_get_file_targets_searched:
+ * ide_makecache_build_file_targets_index:
  *
- * Returns: (transfer container): A #GPtrArray of #IdeMakecacheTarget.
+ * Walks the makecache once, collecting every rule whose target is an
+ * interesting object file. Each whitespace separated prerequisite of the rule
+ * is indexed by its basename, which matches the lookup semantics of the
+ * previous per-file regex scan.
+ *
+ * Returns: (transfer full): A #GHashTable of basename to #GPtrArray of
+ *   #IdeMakecacheTarget.
  */
-static GPtrArray *
-ide_makecache_get_file_targets_searched (GMappedFile *mapped,
-                                         const gchar *path)
+static GHashTable *
+ide_makecache_build_file_targets_index (GMappedFile *mapped)
 {
-  g_autofree gchar *escaped = NULL;
-  g_autofree gchar *name = NULL;
-  g_autofree gchar *regexstr = NULL;
-  g_autofree gchar *subdir = NULL;
   g_autoptr(GHashTable) found = NULL;
-  g_autoptr(GPtrArray) targets = NULL;
-  g_autoptr(GRegex) regex = NULL;
+  g_autofree gchar *subdir = NULL;
+  GHashTable *index;
   const gchar *content;
   const gchar *line;
   IdeLineReader rl;
@@ -175,46 +234,22 @@ ide_makecache_get_file_targets_searched (GMappedFile *mapped,
 
   IDE_ENTRY;
 
-  g_assert (path);
-
-  /*
-   * TODO:
-   *
-   * We can end up with the same filename in multiple subdirectories. We should be careful about
-   * that later when we extract flags to choose the best match first.
-   */
-  name = g_path_get_basename (path);
-  escaped = g_regex_escape_string (name, -1);
-  regexstr = g_strdup_printf ("^([^:\n ]+):.*\\b(%s)\\b", escaped);
-
-  regex = g_regex_new (regexstr, 0, 0, NULL);
-  if (!regex)
-    IDE_RETURN (NULL);
+  g_assert (mapped != NULL);
 
   content = g_mapped_file_get_contents (mapped);
   len = g_mapped_file_get_length (mapped);
 
-  targets = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_makecache_target_unref);
-  found = g_hash_table_new (ide_makecache_target_hash, ide_makecache_target_equal);
-
-#ifdef IDE_ENABLE_TRACE
-  {
-    gchar *fmtsize;
-
-    fmtsize = g_format_size (len);
-    IDE_TRACE_MSG ("Beginning regex lookup across %s of UTF-8 text", fmtsize);
-    g_free (fmtsize);
-  }
-#endif
-
-  if (len > G_MAXSSIZE)
-    IDE_RETURN (NULL);
+  index = file_targets_index_new ();
+  found = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   ide_line_reader_init (&rl, (gchar *)content, len);
 
   while ((line = ide_line_reader_next (&rl, &line_len)))
     {
-      g_autoptr(GMatchInfo) match_info = NULL;
+      g_autofree gchar *targetstr = NULL;
+      const gchar *end = line + line_len;
+      const gchar *colon;
+      const gchar *iter;
 
       /*
        * Keep track of "subdir = <dir>" changes so we know what directory
@@ -227,72 +262,249 @@ ide_makecache_get_file_targets_searched (GMappedFile *mapped,
           continue;
         }
 
-      if (g_regex_match_full (regex, line, line_len, 0, 0, &match_info, NULL))
+      if (line_len == 0 || line [0] == '#' || line [0] == '.' || line [0] == '\t')
+        continue;
+
+      /* Rules look like "target: prereq1 prereq2 ...", without spaces in target */
+      for (colon = line; colon < end; colon++)
         {
-          while (g_match_info_matches (match_info))
-            {
-              g_autofree gchar *targetstr = NULL;
+          if (*colon == ':' || *colon == ' ' || *colon == '\t')
+            break;
+        }
 
-              targetstr = g_match_info_fetch (match_info, 1);
+      if (colon == line || colon >= end || *colon != ':')
+        continue;
 
-              if (is_target_interesting (targetstr))
-                {
-                  g_autoptr(IdeMakecacheTarget) target = NULL;
+      targetstr = g_strndup (line, colon - line);
 
-                  target = ide_makecache_target_new (subdir, targetstr);
+      if (!is_target_interesting (targetstr))
+        continue;
 
-                  if (!g_hash_table_contains (found, target))
-                    {
-                      g_hash_table_insert (found, target, NULL);
-                      g_ptr_array_add (targets, g_steal_pointer (&target));
-                    }
-                }
+      for (iter = colon + 1; iter < end;)
+        {
+          g_autofree gchar *name = NULL;
+          const gchar *begin;
+          const gchar *slash;
 
-              g_match_info_next (match_info, NULL);
-            }
+          while (iter < end && (*iter == ' ' || *iter == '\t' || *iter == ':' || *iter == '|'))
+            iter++;
+
+          if (iter >= end || *iter == ';')
+            break;
+
+          begin = iter;
+
+          while (iter < end && *iter != ' ' && *iter != '\t' && *iter != ';')
+            iter++;
+
+          /* The regex scan matched on basenames, so index the same way */
+          slash = iter;
+          while (slash > begin && *(slash - 1) != G_DIR_SEPARATOR)
+            slash--;
+
+          if (slash == iter)
+            continue;
+
+          name = g_strndup (slash, iter - slash);
+          file_targets_index_add (index, found, name, subdir, targetstr);
         }
     }
 
-  IDE_TRACE_MSG ("Regex scan complete");
+  IDE_TRACE_MSG ("Indexed %u prerequisites", g_hash_table_size (index));
+
+  IDE_RETURN (index);
+}
+
+static gchar *
+ide_makecache_get_index_checksum (GMappedFile *mapped)
+{
+  g_autofree gchar *checksum = NULL;
+
+  g_assert (mapped != NULL);
+
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+                                          (const guchar *)g_mapped_file_get_contents (mapped),
+                                          g_mapped_file_get_length (mapped));
+
+  return g_strdup_printf ("%s:%s", FILE_TARGETS_INDEX_VERSION, checksum);
+}
+
+static GHashTable *
+ide_makecache_load_file_targets_index (const gchar *index_path,
+                                       const gchar *checksum)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariantIter) entries = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  GHashTable *index;
+  const gchar *stored_checksum = NULL;
+  const gchar *name = NULL;
+  GVariantIter *pairs = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (index_path != NULL);
+  g_assert (checksum != NULL);
+
+  if (!(mapped = g_mapped_file_new (index_path, FALSE, NULL)))
+    IDE_RETURN (NULL);
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_new_from_bytes (G_VARIANT_TYPE (FILE_TARGETS_INDEX_TYPE), bytes, FALSE);
+
+  if (!g_variant_is_normal_form (variant))
+    IDE_RETURN (NULL);
 
-  if (targets->len > 0)
+  g_variant_get (variant, "(&sa{sa(ss)})", &stored_checksum, &entries);
+
+  if (g_strcmp0 (stored_checksum, checksum) != 0)
+    IDE_RETURN (NULL);
+
+  index = file_targets_index_new ();
+
+  while (g_variant_iter_next (entries, "{&sa(ss)}", &name, &pairs))
     {
-#ifdef IDE_ENABLE_TRACE
-      {
-        GString *str;
-        gsize i;
+      GPtrArray *targets;
+      const gchar *subdir;
+      const gchar *target;
 
-        str = g_string_new (NULL);
+      targets = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_makecache_target_unref);
 
-        for (i = 0; i < targets->len; i++)
-          {
-            const gchar *target_subdir;
-            const gchar *target;
-            IdeMakecacheTarget *cur;
+      while (g_variant_iter_next (pairs, "(&s&s)", &subdir, &target))
+        g_ptr_array_add (targets, ide_makecache_target_new (subdir, target));
 
-            cur = g_ptr_array_index (targets, i);
+      g_hash_table_insert (index, g_strdup (name), targets);
+      g_variant_iter_free (pairs);
+    }
 
-            target_subdir = ide_makecache_target_get_subdir (cur);
-            target = ide_makecache_target_get_target (cur);
+  IDE_RETURN (index);
+}
 
-            if (target_subdir != NULL)
-              g_string_append_printf (str, " (%s of subdir %s)", target, target_subdir);
-            else
-              g_string_append_printf (str, " %s", target);
-          }
+static gboolean
+ide_makecache_save_file_targets_index (GHashTable   *index,
+                                       const gchar  *index_path,
+                                       const gchar  *checksum,
+                                       GError      **error)
+{
+  g_autoptr(GVariant) variant = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
 
+  g_assert (index != NULL);
+  g_assert (index_path != NULL);
+  g_assert (checksum != NULL);
 
-        IDE_TRACE_MSG ("File \"%s\" found in targets: %s", path, str->str);
-        g_string_free (str, TRUE);
-      }
-#endif
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa(ss)}"));
+
+  g_hash_table_iter_init (&iter, index);
 
-      g_ptr_array_ref (targets);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GPtrArray *targets = value;
+      guint i;
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa(ss)}"));
+      g_variant_builder_add (&builder, "s", key);
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(ss)"));
+
+      for (i = 0; i < targets->len; i++)
+        {
+          IdeMakecacheTarget *target = g_ptr_array_index (targets, i);
 
-      IDE_RETURN (targets);
+          g_variant_builder_add (&builder, "(ss)",
+                                 ide_makecache_target_get_subdir (target) ?: "",
+                                 ide_makecache_target_get_target (target));
+        }
+
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
     }
 
-  IDE_RETURN (NULL);
+  variant = g_variant_ref_sink (g_variant_new ("(sa{sa(ss)})", checksum, &builder));
+
+  return g_file_set_contents (index_path,
+                              g_variant_get_data (variant),
+                              g_variant_get_size (variant),
+                              error);
+}
+
+/**
+ * ide_makecache_get_file_targets_searched:
+ *
+ * Returns: (transfer container): A #GPtrArray of #IdeMakecacheTarget.
+ */
+static GPtrArray *
+ide_makecache_get_file_targets_searched (GHashTable  *index,
+                                         const gchar *path)
+{
+  g_autofree gchar *name = NULL;
+  g_autoptr(GPtrArray) targets = NULL;
+  GPtrArray *indexed;
+  guint i;
+
+  IDE_ENTRY;
+
+  g_assert (index != NULL);
+  g_assert (path);
+
+  /*
+   * TODO:
+   *
+   * We can end up with the same filename in multiple subdirectories. We should be careful about
+   * that later when we extract flags to choose the best match first.
+   */
+  name = g_path_get_basename (path);
+
+  if (!(indexed = g_hash_table_lookup (index, name)) || indexed->len == 0)
+    IDE_RETURN (NULL);
+
+  /*
+   * The index is shared between lookups, and callers may mutate the targets
+   * (such as translating vala targets), so hand out copies.
+   */
+  targets = g_ptr_array_new_full (indexed->len, (GDestroyNotify)ide_makecache_target_unref);
+
+  for (i = 0; i < indexed->len; i++)
+    {
+      IdeMakecacheTarget *target = g_ptr_array_index (indexed, i);
+
+      g_ptr_array_add (targets,
+                       ide_makecache_target_new (ide_makecache_target_get_subdir (target),
+                                                 ide_makecache_target_get_target (target)));
+    }
+
+#ifdef IDE_ENABLE_TRACE
+  {
+    GString *str;
+
+    str = g_string_new (NULL);
+
+    for (i = 0; i < targets->len; i++)
+      {
+        const gchar *target_subdir;
+        const gchar *target;
+        IdeMakecacheTarget *cur;
+
+        cur = g_ptr_array_index (targets, i);
+
+        target_subdir = ide_makecache_target_get_subdir (cur);
+        target = ide_makecache_target_get_target (cur);
+
+        if (target_subdir != NULL)
+          g_string_append_printf (str, " (%s of subdir %s)", target, target_subdir);
+        else
+          g_string_append_printf (str, " %s", target);
+      }
+
+    IDE_TRACE_MSG ("File \"%s\" found in targets: %s", path, str->str);
+    g_string_free (str, TRUE);
+  }
+#endif
+
+  IDE_RETURN (g_steal_pointer (&targets));
 }
 
 static gboolean
@@ -423,6 +635,9 @@ ide_makecache_new_worker (GTask        *task,
   g_autofree gchar *name_used = NULL;
   g_autofree gchar *name = NULL;
   g_autofree gchar *cache_path = NULL;
+  g_autofree gchar *index_path = NULL;
+  g_autofree gchar *checksum = NULL;
+  g_autoptr(GHashTable) index = NULL;
   g_autoptr(GFile) parent = NULL;
   g_autofree gchar *workdir = NULL;
   g_autoptr(GMappedFile) mapped = NULL;
@@ -474,6 +689,7 @@ ide_makecache_new_worker (GTask        *task,
                                  "makecache",
                                  name,
                                  NULL);
+  index_path = g_strdup_printf ("%s.index", cache_path);
 
  /*
   * NOTE:
@@ -494,6 +710,7 @@ ide_makecache_new_worker (GTask        *task,
   * 6) mmap() the cache file using g_mapped_file_new_from_fd().
   * 7) Close the fd. This does NOT cause the mmap() region to be unmapped.
   * 8) Validate the mmap() contents with g_utf8_validate().
+  * 9) Load or build the file targets index, persisting it next to the makecache.
   */
 
   /*
@@ -620,9 +837,26 @@ ide_makecache_new_worker (GTask        *task,
     }
 
   /*
-   * Step 9, save the mmap and runtime for future use.
+   * Step 9, load the file targets index if the makecache is unchanged since
+   * the last time we indexed it, otherwise rebuild and persist it.
+   */
+  checksum = ide_makecache_get_index_checksum (mapped);
+
+  if (!(index = ide_makecache_load_file_targets_index (index_path, checksum)))
+    {
+      g_autoptr(GError) save_error = NULL;
+
+      index = ide_makecache_build_file_targets_index (mapped);
+
+      if (!ide_makecache_save_file_targets_index (index, index_path, checksum, &save_error))
+        g_warning ("Failed to save makecache index: %s", save_error->message);
+    }
+
+  /*
+   * Step 10, save the mmap, index, and runtime for future use.
    */
   self->mapped = g_mapped_file_ref (mapped);
+  self->file_targets_index = g_steal_pointer (&index);
   self->runtime = g_object_ref (runtime);
 
   g_task_return_pointer (task, g_object_ref (self), g_object_unref);
@@ -1127,7 +1361,7 @@ ide_makecache_get_file_targets_worker (GTask        *task,
   g_assert (EGG_IS_TASK_CACHE (source_object));
   g_assert (G_IS_TASK (task));
   g_assert (lookup != NULL);
-  g_assert (lookup->mapped != NULL);
+  g_assert (lookup->index != NULL);
   g_assert (lookup->path != NULL);
 
   path = lookup->path;
@@ -1139,7 +1373,7 @@ ide_makecache_get_file_targets_worker (GTask        *task,
   base = g_path_get_basename (path);
 
   /* we use an empty GPtrArray to get negative cache hits. a bit heavy handed? sure. */
-  if (!(ret = ide_makecache_get_file_targets_searched (lookup->mapped, path)))
+  if (!(ret = ide_makecache_get_file_targets_searched (lookup->index, path)))
     ret = g_ptr_array_new ();
 
   /* If we had a vala file, we might need to translate the target */
@@ -1211,7 +1445,7 @@ ide_makecache_get_file_targets_dispatch (EggTaskCache  *cache,
   g_assert (G_IS_TASK (task));
 
   lookup = g_slice_new0 (FileTargetsLookup);
-  lookup->mapped = g_mapped_file_ref (self->mapped);
+  lookup->index = g_hash_table_ref (self->file_targets_index);
 
   if (!(lookup->path = ide_makecache_get_relative_path (self, file)) &&
       !(lookup->path = g_file_get_path (file)) &&
@@ -1338,6 +1572,7 @@ ide_makecache_finalize (GObject *object)
 
   g_clear_object (&self->makefile);
   g_clear_pointer (&self->mapped, g_mapped_file_unref);
+  g_clear_pointer (&self->file_targets_index, g_hash_table_unref);
   g_clear_object (&self->file_targets_cache);
   g_clear_object (&self->file_flags_cache);
   g_clear_object (&self->runtime);
@@ -22,23 +22,50 @@
 
 #include "gb-color-picker-document-monitor.h"
 
+/* Number of lines handed to the worker thread at once */
+#define SCAN_MAX_LINES 500
+
 struct _GbColorPickerDocumentMonitor
 {
   GObject       parent_instance;
 
   IdeBuffer    *buffer;
 
-  gulong        insert_handler_id;
+  /* Applied to every line already scanned for colors */
+  GtkTextTag   *scanned_tag;
+
+  /* The GtkTextView showing the buffer, used to scan the visible lines first */
+  GPtrArray    *views;
+
+  GCancellable *scan_cancellable;
+  guint         scan_source;
+
   gulong        insert_after_handler_id;
-  gulong        delete_handler_id;
   gulong        delete_after_handler_id;
   gulong        cursor_notify_handler_id;
 
-  gulong        remove_tag_handler_id;
-
   guint         is_in_user_action : 1;
+  guint         is_scanning : 1;
 };
 
+typedef struct
+{
+  gchar *text;
+  gsize  change_count;
+  gint   begin_offset;
+  gint   end_offset;
+  gint   begin_line;
+} ScanRequest;
+
+typedef struct
+{
+  GstyleColor *color;
+  gint         begin_line;
+  gint         begin_index;
+  gint         end_line;
+  gint         end_index;
+} ScanMatch;
+
 G_DEFINE_TYPE (GbColorPickerDocumentMonitor, gb_color_picker_document_monitor, G_TYPE_OBJECT)
 
 enum {
@@ -62,9 +89,7 @@ block_signals (GbColorPickerDocumentMonitor *self)
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
 
   g_signal_handler_block (self->buffer, self->cursor_notify_handler_id);
-  g_signal_handler_block (self->buffer, self->insert_handler_id);
   g_signal_handler_block (self->buffer, self->insert_after_handler_id);
-  g_signal_handler_block (self->buffer, self->delete_handler_id);
   g_signal_handler_block (self->buffer, self->delete_after_handler_id);
 }
 
@@ -74,9 +99,7 @@ unblock_signals (GbColorPickerDocumentMonitor *self)
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
 
   g_signal_handler_unblock (self->buffer, self->cursor_notify_handler_id);
-  g_signal_handler_unblock (self->buffer, self->insert_handler_id);
   g_signal_handler_unblock (self->buffer, self->insert_after_handler_id);
-  g_signal_handler_unblock (self->buffer, self->delete_handler_id);
   g_signal_handler_unblock (self->buffer, self->delete_after_handler_id);
 }
 
@@ -105,11 +128,28 @@ gb_color_picker_document_monitor_set_color_tag_at_cursor (GbColorPickerDocumentM
   unblock_signals (self);
 }
 
+static void
+scan_request_free (gpointer data)
+{
+  ScanRequest *request = data;
+
+  g_free (request->text);
+  g_slice_free (ScanRequest, request);
+}
+
+static void
+scan_match_clear (gpointer data)
+{
+  ScanMatch *match = data;
+
+  g_clear_object (&match->color);
+}
+
 static void
 remove_color_tag_foreach_cb (GtkTextTag *tag,
                              GPtrArray  *taglist)
 {
-  const gchar *name;
+  g_autofree gchar *name = NULL;
 
   g_assert (GTK_IS_TEXT_TAG (tag));
   g_assert (taglist != NULL);
@@ -119,21 +159,95 @@ remove_color_tag_foreach_cb (GtkTextTag *tag,
     g_ptr_array_add (taglist, tag);
 }
 
+static gboolean
+is_color_tag (GtkTextTag *tag)
+{
+  g_autofree gchar *name = NULL;
+
+  g_object_get (G_OBJECT (tag), "name", &name, NULL);
+
+  return (!ide_str_empty0 (name) && g_str_has_prefix (name, COLOR_TAG_PREFIX));
+}
+
+typedef struct
+{
+  GtkTextTag  *tag;
+  GtkTextIter  begin;
+  GtkTextIter  end;
+} TagSpan;
+
+/*
+ * Color tags are shared by all the occurrences of a color, so we only remove
+ * them from the range instead of removing them from the tag table.
+ * Removing tags while walking the toggles would move them under us,
+ * so we collect the spans first.
+ */
+static void
+remove_color_tags (GbColorPickerDocumentMonitor *self,
+                   const GtkTextIter            *begin,
+                   const GtkTextIter            *end)
+{
+  g_autoptr(GArray) spans = NULL;
+  GtkTextIter iter = *begin;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  spans = g_array_new (FALSE, FALSE, sizeof (TagSpan));
+
+  do
+    {
+      g_autoptr(GSList) tags = gtk_text_iter_get_tags (&iter);
+
+      for (const GSList *l = tags; l != NULL; l = l->next)
+        {
+          TagSpan span = { l->data, iter, iter };
+
+          if (!is_color_tag (span.tag))
+            continue;
+
+          gtk_text_iter_forward_to_tag_toggle (&span.end, span.tag);
+          if (gtk_text_iter_compare (&span.end, end) > 0)
+            span.end = *end;
+
+          g_array_append_val (spans, span);
+        }
+    }
+  while (gtk_text_iter_forward_to_tag_toggle (&iter, NULL) &&
+         gtk_text_iter_compare (&iter, end) < 0);
+
+  for (guint i = 0; i < spans->len; i++)
+    {
+      TagSpan *span = &g_array_index (spans, TagSpan, i);
+
+      gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self->buffer), span->tag, &span->begin, &span->end);
+    }
+}
+
+static void
+cancel_scan (GbColorPickerDocumentMonitor *self)
+{
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  ide_clear_source (&self->scan_source);
+
+  if (self->scan_cancellable != NULL)
+    {
+      g_cancellable_cancel (self->scan_cancellable);
+      g_clear_object (&self->scan_cancellable);
+    }
+
+  self->is_scanning = FALSE;
+}
+
 void
 gb_color_picker_document_monitor_uncolorize (GbColorPickerDocumentMonitor *self,
                                              GtkTextIter                  *begin,
                                              GtkTextIter                  *end)
 {
   g_autoptr (GPtrArray) taglist = NULL;
-  g_autofree gchar *name = NULL;
-  g_autoptr (GSList) tags = NULL;
   GtkTextTagTable *tag_table;
   GtkTextIter real_begin;
   GtkTextIter real_end;
-  GtkTextTag *color_tag;
-  GtkTextTag *tag;
-  GSList *l;
-  gint n;
 
   g_return_if_fail (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
   g_return_if_fail (self->buffer != NULL);
@@ -141,11 +255,16 @@ gb_color_picker_document_monitor_uncolorize (GbColorPickerDocumentMonitor *self,
   tag_table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (self->buffer));
   if (begin == NULL && end == NULL)
     {
+      cancel_scan (self);
+
       taglist = g_ptr_array_new ();
       gtk_text_tag_table_foreach (tag_table, (GtkTextTagTableForeach)remove_color_tag_foreach_cb, taglist);
-      for (n = 0; n < taglist->len; ++n)
+      for (guint n = 0; n < taglist->len; ++n)
         gtk_text_tag_table_remove (tag_table, g_ptr_array_index (taglist, n));
 
+      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self->buffer), &real_begin, &real_end);
+      gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self->buffer), self->scanned_tag, &real_begin, &real_end);
+
       return;
     }
 
@@ -159,53 +278,304 @@ gb_color_picker_document_monitor_uncolorize (GbColorPickerDocumentMonitor *self,
   else
     real_end = *end;
 
-  while (TRUE)
+  remove_color_tags (self, &real_begin, &real_end);
+}
+
+static void
+get_visible_area (GbColorPickerDocumentMonitor *self,
+                  GtkTextView                  *view,
+                  GtkTextIter                  *begin,
+                  GtkTextIter                  *end)
+{
+  GdkRectangle rect;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+  g_assert (GTK_IS_TEXT_VIEW (view));
+
+  /* Half a page above and below, so that scrolling rarely shows uncolored text */
+  gtk_text_view_get_visible_rect (view, &rect);
+  gtk_text_view_get_line_at_y (view, begin, rect.y - rect.height / 2, NULL);
+  gtk_text_view_get_line_at_y (view, end, rect.y + rect.height + rect.height / 2, NULL);
+
+  gtk_text_iter_set_line_offset (begin, 0);
+  if (!gtk_text_iter_forward_line (end))
+    gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self->buffer), end);
+}
+
+/*
+ * Finds the first lines not scanned yet between @area_begin and @area_end.
+ * Scanned ranges always start and end on line boundaries.
+ */
+static gboolean
+get_unscanned_range (GbColorPickerDocumentMonitor *self,
+                     const GtkTextIter            *area_begin,
+                     const GtkTextIter            *area_end,
+                     GtkTextIter                  *begin,
+                     GtkTextIter                  *end)
+{
+  GtkTextIter iter = *area_begin;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  if (gtk_text_iter_has_tag (&iter, self->scanned_tag) &&
+      !gtk_text_iter_forward_to_tag_toggle (&iter, self->scanned_tag))
+    return FALSE;
+
+  if (gtk_text_iter_compare (&iter, area_end) >= 0)
+    return FALSE;
+
+  *begin = iter;
+  gtk_text_iter_set_line_offset (begin, 0);
+
+  *end = iter;
+  gtk_text_iter_forward_to_tag_toggle (end, self->scanned_tag);
+  if (gtk_text_iter_compare (end, area_end) > 0)
+    *end = *area_end;
+
+  if (gtk_text_iter_get_line (end) - gtk_text_iter_get_line (begin) > SCAN_MAX_LINES)
+    gtk_text_iter_set_line (end, gtk_text_iter_get_line (begin) + SCAN_MAX_LINES);
+  else if (!gtk_text_iter_starts_line (end))
+    gtk_text_iter_forward_line (end);
+
+  return !gtk_text_iter_equal (begin, end);
+}
+
+static gboolean
+get_next_scan_range (GbColorPickerDocumentMonitor *self,
+                     GtkTextIter                  *begin,
+                     GtkTextIter                  *end)
+{
+  GtkTextIter area_begin;
+  GtkTextIter area_end;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  /* Without any view, we fallback on scanning the whole buffer by chunks */
+  if (self->views->len == 0)
     {
-      color_tag = NULL;
-      tags = gtk_text_iter_get_toggled_tags (&real_begin, TRUE);
-      for (l = tags; l != NULL; l = g_slist_next (l))
-        {
-          tag = l->data;
-          g_object_get (G_OBJECT (tag), "name", &name, NULL);
-          if (!ide_str_empty0 (name) && g_str_has_prefix (name, COLOR_TAG_PREFIX))
-            {
-              color_tag = tag;
-              break;
-            }
-        }
+      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self->buffer), &area_begin, &area_end);
+      return get_unscanned_range (self, &area_begin, &area_end, begin, end);
+    }
 
-      if (color_tag != NULL)
-        {
-          gtk_text_iter_forward_to_tag_toggle (&real_begin, color_tag);
-          gtk_text_tag_table_remove (tag_table, color_tag);
-        }
+  for (guint i = 0; i < self->views->len; i++)
+    {
+      GtkTextView *view = g_ptr_array_index (self->views, i);
+
+      if (!gtk_widget_get_mapped (GTK_WIDGET (view)))
+        continue;
+
+      get_visible_area (self, view, &area_begin, &area_end);
+      if (get_unscanned_range (self, &area_begin, &area_end, begin, end))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+scan_worker (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  ScanRequest *request = task_data;
+  g_autoptr(GPtrArray) items = NULL;
+  GArray *matches;
+  const gchar *text = request->text;
+  gint line = request->begin_line;
+  gint line_start = 0;
+  gint pos = 0;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (request != NULL);
+
+  matches = g_array_new (FALSE, FALSE, sizeof (ScanMatch));
+  g_array_set_clear_func (matches, scan_match_clear);
+
+  if (!ide_str_empty0 (text))
+    items = gstyle_color_parse (text);
+
+  /* Items are ordered, and their start and length are in bytes */
+  for (guint i = 0; items != NULL && i < items->len; i++)
+    {
+      GstyleColorItem *item = g_ptr_array_index (items, i);
+      gint start = gstyle_color_item_get_start (item);
+      gint len = gstyle_color_item_get_len (item);
+      ScanMatch match;
+
+      for (; pos < start; pos++)
+        if (text [pos] == '\n')
+          {
+            line++;
+            line_start = pos + 1;
+          }
+
+      match.color = g_object_ref ((GstyleColor *)gstyle_color_item_get_color (item));
+      match.begin_line = line;
+      match.begin_index = start - line_start;
+
+      for (; pos < start + len; pos++)
+        if (text [pos] == '\n')
+          {
+            line++;
+            line_start = pos + 1;
+          }
+
+      match.end_line = line;
+      match.end_index = start + len - line_start;
+
+      g_array_append_val (matches, match);
+    }
+
+  g_task_return_pointer (task, matches, (GDestroyNotify)g_array_unref);
+}
+
+static void queue_scan (GbColorPickerDocumentMonitor *self);
+
+static void
+scan_cb (GObject      *object,
+         GAsyncResult *result,
+         gpointer      user_data)
+{
+  GbColorPickerDocumentMonitor *self = (GbColorPickerDocumentMonitor *)object;
+  g_autoptr(GArray) matches = NULL;
+  GtkTextBuffer *buffer;
+  ScanRequest *request;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+  g_assert (G_IS_TASK (result));
+
+  matches = g_task_propagate_pointer (G_TASK (result), NULL);
+  if (matches == NULL || self->buffer == NULL)
+    return;
+
+  self->is_scanning = FALSE;
+  g_clear_object (&self->scan_cancellable);
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  request = g_task_get_task_data (G_TASK (result));
+
+  /* The buffer changed while scanning, the lines are still unscanned */
+  if (request->change_count != ide_buffer_get_change_count (self->buffer))
+    {
+      queue_scan (self);
+      return;
+    }
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &begin, request->begin_offset);
+  gtk_text_buffer_get_iter_at_offset (buffer, &end, request->end_offset);
+  remove_color_tags (self, &begin, &end);
 
-      if (!gtk_text_iter_forward_to_tag_toggle (&real_begin, NULL))
-        break;
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const ScanMatch *match = &g_array_index (matches, ScanMatch, i);
+      GtkTextIter tag_begin;
+      GtkTextIter tag_end;
+      GtkTextTag *tag;
+
+      gtk_text_buffer_get_iter_at_line_index (buffer, &tag_begin, match->begin_line, match->begin_index);
+      gtk_text_buffer_get_iter_at_line_index (buffer, &tag_end, match->end_line, match->end_index);
 
-      if (gtk_text_iter_compare (&real_begin, &real_end) != -1)
-        break;
+      tag = gb_color_picker_helper_get_color_tag (buffer, match->color);
+      gtk_text_buffer_apply_tag (buffer, tag, &tag_begin, &tag_end);
     }
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &begin, request->begin_offset);
+  gtk_text_buffer_get_iter_at_offset (buffer, &end, request->end_offset);
+  gtk_text_buffer_apply_tag (buffer, self->scanned_tag, &begin, &end);
+
+  queue_scan (self);
+}
+
+static gboolean
+scan_source_cb (gpointer user_data)
+{
+  GbColorPickerDocumentMonitor *self = user_data;
+  g_autoptr(GTask) task = NULL;
+  ScanRequest *request;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  self->scan_source = 0;
+
+  if (self->is_scanning || self->buffer == NULL)
+    return G_SOURCE_REMOVE;
+
+  if (!get_next_scan_range (self, &begin, &end))
+    return G_SOURCE_REMOVE;
+
+  request = g_slice_new0 (ScanRequest);
+  request->text = gtk_text_buffer_get_slice (GTK_TEXT_BUFFER (self->buffer), &begin, &end, TRUE);
+  request->change_count = ide_buffer_get_change_count (self->buffer);
+  request->begin_offset = gtk_text_iter_get_offset (&begin);
+  request->end_offset = gtk_text_iter_get_offset (&end);
+  request->begin_line = gtk_text_iter_get_line (&begin);
+
+  self->is_scanning = TRUE;
+  self->scan_cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, self->scan_cancellable, scan_cb, NULL);
+  g_task_set_source_tag (task, scan_source_cb);
+  g_task_set_task_data (task, request, scan_request_free);
+  g_task_set_return_on_cancel (task, TRUE);
+  g_task_run_in_thread (task, scan_worker);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_scan (GbColorPickerDocumentMonitor *self)
+{
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  if (self->scan_source == 0 && self->buffer != NULL)
+    self->scan_source = g_idle_add_full (G_PRIORITY_LOW, scan_source_cb, self, NULL);
+}
+
+/*
+ * Marks the lines between @begin and @end as needing a new scan.
+ */
+static void
+invalidate_lines (GbColorPickerDocumentMonitor *self,
+                  const GtkTextIter            *begin,
+                  const GtkTextIter            *end)
+{
+  GtkTextIter real_begin = *begin;
+  GtkTextIter real_end = *end;
+
+  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+
+  gtk_text_iter_set_line_offset (&real_begin, 0);
+  if (!gtk_text_iter_starts_line (&real_end) || gtk_text_iter_equal (&real_begin, &real_end))
+    gtk_text_iter_forward_line (&real_end);
+
+  remove_color_tags (self, &real_begin, &real_end);
+  gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self->buffer), self->scanned_tag, &real_begin, &real_end);
+
+  queue_scan (self);
 }
 
+/**
+ * gb_color_picker_document_monitor_colorize:
+ * @self: a #GbColorPickerDocumentMonitor
+ * @begin: (nullable): the beginning of the range, or %NULL for the buffer start
+ * @end: (nullable): the end of the range, or %NULL for the buffer end
+ *
+ * Queues the lines of the range for scanning. Scanning happens in a worker
+ * thread, visible lines of the added views first, further lines being
+ * scanned as they are scrolled into view.
+ */
 void
 gb_color_picker_document_monitor_colorize (GbColorPickerDocumentMonitor *self,
                                            GtkTextIter                  *begin,
                                            GtkTextIter                  *end)
 {
-  g_autofree gchar *text = NULL;
-  g_autoptr(GPtrArray) items = NULL;
-  GstyleColorItem *item;
-  GstyleColor *color;
-  GtkTextTag *tag;
   GtkTextIter real_begin;
   GtkTextIter real_end;
-  GtkTextIter tag_begin;
-  GtkTextIter tag_end;
-  gint offset;
-  gint len;
-  gint n;
-  gint pos;
 
   g_return_if_fail (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
   g_return_if_fail (self->buffer != NULL);
@@ -220,133 +590,110 @@ gb_color_picker_document_monitor_colorize (GbColorPickerDocumentMonitor *self,
   else
     real_end = *end;
 
-  if (gtk_text_iter_equal (&real_begin, &real_end))
-    return;
-
-  offset = gtk_text_iter_get_offset (&real_begin);
-  text = gtk_text_buffer_get_slice (GTK_TEXT_BUFFER (self->buffer), &real_begin, &real_end, TRUE);
-
-  items = gstyle_color_parse (text);
-  for (n = 0; n < items->len; ++n)
-    {
-      item = g_ptr_array_index (items, n);
-      pos = offset + gstyle_color_item_get_start (item);
-      gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (self->buffer), &tag_begin, pos);
-      len = gstyle_color_item_get_len (item);
-      gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (self->buffer), &tag_end, pos + len);
-      color = (GstyleColor *)gstyle_color_item_get_color (item);
-
-      tag = gb_color_picker_helper_create_color_tag (GTK_TEXT_BUFFER (self->buffer), color);
-      gtk_text_buffer_apply_tag (GTK_TEXT_BUFFER (self->buffer), tag, &tag_begin, &tag_end);
-      /* FIXME: is the tag added to the tag table or should we handle a hash table/tag table ourself ? */
-    }
+  invalidate_lines (self, &real_begin, &real_end);
 }
 
 static void
-text_inserted_cb (GbColorPickerDocumentMonitor *self,
-                  GtkTextIter                  *cursor,
-                  gchar                        *text,
-                  gint                          len,
-                  GtkTextBuffer                *buffer)
+view_scrolled_cb (GbColorPickerDocumentMonitor *self)
 {
-  GtkTextTag *tag;
-  GstyleColor *color;
-  GtkTextIter begin, end;
-
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
-  g_assert (GTK_IS_TEXT_BUFFER (buffer));
-  g_assert (cursor != NULL);
 
-  tag = gb_color_picker_helper_get_tag_at_iter (cursor, &color, &begin, &end);
-  if (tag != NULL )
-    {
-      gtk_text_iter_set_line_offset (&begin, 0);
-      if (!gtk_text_iter_ends_line (&end))
-        gtk_text_iter_forward_to_line_end (&end);
-
-      gb_color_picker_document_monitor_uncolorize (self, &begin, &end);
-    }
+  queue_scan (self);
 }
 
 static void
-text_inserted_after_cb (GbColorPickerDocumentMonitor *self,
-                        GtkTextIter                  *iter,
-                        gchar                        *text,
-                        gint                          len,
-                        GtkTextBuffer                *buffer)
+view_destroy_cb (GbColorPickerDocumentMonitor *self,
+                 GtkTextView                  *view)
 {
-  GtkTextIter begin, end;
-  gint offset;
-
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
-  g_assert (GTK_IS_TEXT_BUFFER (buffer));
-  g_assert (iter != NULL);
+  g_assert (GTK_IS_TEXT_VIEW (view));
 
-  begin = *iter;
-  offset = gtk_text_iter_get_offset (&begin);
-  gtk_text_iter_set_offset (&begin, offset - len);
-  gtk_text_iter_set_line_offset (&begin, 0);
+  gb_color_picker_document_monitor_remove_view (self, view);
+}
+
+/**
+ * gb_color_picker_document_monitor_add_view:
+ * @self: a #GbColorPickerDocumentMonitor
+ * @view: a #GtkTextView showing the monitored buffer
+ *
+ * Restricts scanning to the lines shown by the added views, expanding it
+ * as they are scrolled.
+ */
+void
+gb_color_picker_document_monitor_add_view (GbColorPickerDocumentMonitor *self,
+                                           GtkTextView                  *view)
+{
+  GtkAdjustment *vadj;
 
-  end = *iter;
-  if (!gtk_text_iter_ends_line (&end))
-    gtk_text_iter_forward_to_line_end (&end);
+  g_return_if_fail (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (view));
+
+  for (guint i = 0; i < self->views->len; i++)
+    if (g_ptr_array_index (self->views, i) == view)
+      return;
 
-  gb_color_picker_document_monitor_colorize (self, &begin, &end);
+  g_ptr_array_add (self->views, view);
+
+  vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view));
+  if (vadj != NULL)
+    g_signal_connect_object (vadj,
+                             "value-changed",
+                             G_CALLBACK (view_scrolled_cb),
+                             self,
+                             G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (view,
+                           "size-allocate",
+                           G_CALLBACK (view_scrolled_cb),
+                           self,
+                           G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+  g_signal_connect_object (view,
+                           "destroy",
+                           G_CALLBACK (view_destroy_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  queue_scan (self);
 }
 
-static void
-remove_tag_cb (GbColorPickerDocumentMonitor *self,
-               GtkTextTag                   *tag,
-               GtkTextIter                  *start,
-               GtkTextIter                  *end,
-               GtkTextBuffer                *buffer)
+void
+gb_color_picker_document_monitor_remove_view (GbColorPickerDocumentMonitor *self,
+                                              GtkTextView                  *view)
 {
-  GtkTextTagTable *tag_table;
-  g_autofree gchar *name = NULL;
+  GtkAdjustment *vadj;
 
-  g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
-  g_assert (GTK_IS_TEXT_BUFFER (buffer));
-  g_assert (GTK_IS_TEXT_TAG (tag));
+  g_return_if_fail (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (view));
 
-  tag_table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (self->buffer));
-  g_object_get (G_OBJECT (tag), "name", &name, NULL);
+  if (!g_ptr_array_remove (self->views, view))
+    return;
 
-  if (!ide_str_empty0 (name) &&
-      g_str_has_prefix (name, COLOR_TAG_PREFIX) &&
-      gtk_text_tag_table_lookup (tag_table, name))
-    {
-      gtk_text_tag_table_remove (tag_table, tag);
-    }
+  vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view));
+  if (vadj != NULL)
+    g_signal_handlers_disconnect_by_func (vadj, view_scrolled_cb, self);
+
+  g_signal_handlers_disconnect_by_func (view, view_scrolled_cb, self);
+  g_signal_handlers_disconnect_by_func (view, view_destroy_cb, self);
 }
 
 static void
-text_deleted_cb (GbColorPickerDocumentMonitor *self,
-                 GtkTextIter                  *begin,
-                 GtkTextIter                  *end,
-                 GtkTextBuffer                *buffer)
+text_inserted_after_cb (GbColorPickerDocumentMonitor *self,
+                        GtkTextIter                  *iter,
+                        gchar                        *text,
+                        gint                          len,
+                        GtkTextBuffer                *buffer)
 {
-  GtkTextIter recolor_begin;
-  GtkTextIter recolor_end;
+  GtkTextIter begin;
 
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
   g_assert (GTK_IS_TEXT_BUFFER (buffer));
+  g_assert (iter != NULL);
 
-  self->remove_tag_handler_id = g_signal_connect_object (GTK_TEXT_BUFFER (self->buffer),
-                                                         "remove-tag",
-                                                         G_CALLBACK (remove_tag_cb),
-                                                         self,
-                                                         G_CONNECT_SWAPPED | G_CONNECT_AFTER);
-
-  recolor_begin = *begin;
-  gtk_text_iter_set_line_offset (&recolor_begin, 0);
-
-  recolor_end = *end;
-  if (!gtk_text_iter_ends_line (&recolor_end))
-    gtk_text_iter_forward_to_line_end (&recolor_end);
+  /* @len is in bytes */
+  begin = *iter;
+  gtk_text_iter_backward_chars (&begin, g_utf8_strlen (text, len));
 
-  /* FIXME: we only need to remove color tag */
-  gtk_text_buffer_remove_all_tags (buffer, &recolor_begin, &recolor_end);
-  g_signal_handler_disconnect (GTK_TEXT_BUFFER (self->buffer), self->remove_tag_handler_id);
+  invalidate_lines (self, &begin, iter);
 }
 
 static void
@@ -355,22 +702,12 @@ text_deleted_after_cb (GbColorPickerDocumentMonitor *self,
                        GtkTextIter                  *end,
                        GtkTextBuffer                *buffer)
 {
-  GtkTextIter recolor_begin;
-  GtkTextIter recolor_end;
-
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
   g_assert (GTK_IS_TEXT_BUFFER (buffer));
   g_assert (begin != NULL);
   g_assert (end != NULL);
 
-  recolor_begin = *begin;
-  gtk_text_iter_set_line_offset (&recolor_begin, 0);
-
-  recolor_end = *end;
-  if (!gtk_text_iter_ends_line (&recolor_end))
-    gtk_text_iter_forward_to_line_end (&recolor_end);
-
-  gb_color_picker_document_monitor_colorize (self, &recolor_begin, &recolor_end);
+  invalidate_lines (self, begin, end);
 }
 
 static void
@@ -407,11 +744,7 @@ start_monitor (GbColorPickerDocumentMonitor *self)
 {
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
 
-  self->insert_handler_id = g_signal_connect_object (GTK_TEXT_BUFFER (self->buffer),
-                                                     "insert-text",
-                                                     G_CALLBACK (text_inserted_cb),
-                                                     self,
-                                                     G_CONNECT_SWAPPED);
+  self->scanned_tag = gtk_text_buffer_create_tag (GTK_TEXT_BUFFER (self->buffer), NULL, NULL);
 
   self->insert_after_handler_id = g_signal_connect_object (GTK_TEXT_BUFFER (self->buffer),
                                                            "insert-text",
@@ -419,12 +752,6 @@ start_monitor (GbColorPickerDocumentMonitor *self)
                                                            self,
                                                            G_CONNECT_SWAPPED | G_CONNECT_AFTER);
 
-  self->delete_handler_id = g_signal_connect_object (GTK_TEXT_BUFFER (self->buffer),
-                                                     "delete-range",
-                                                     G_CALLBACK (text_deleted_cb),
-                                                     self,
-                                                     G_CONNECT_SWAPPED);
-
   self->delete_after_handler_id = g_signal_connect_object (GTK_TEXT_BUFFER (self->buffer),
                                                            "delete-range",
                                                            G_CALLBACK (text_deleted_after_cb),
@@ -441,13 +768,25 @@ start_monitor (GbColorPickerDocumentMonitor *self)
 static void
 stop_monitor (GbColorPickerDocumentMonitor *self)
 {
+  GtkTextTagTable *tag_table;
+
   g_assert (GB_IS_COLOR_PICKER_DOCUMENT_MONITOR (self));
 
-  g_signal_handlers_disconnect_by_func (self->buffer, text_inserted_cb, self);
+  cancel_scan (self);
+
+  while (self->views->len > 0)
+    gb_color_picker_document_monitor_remove_view (self, g_ptr_array_index (self->views, 0));
+
   g_signal_handlers_disconnect_by_func (self->buffer, text_inserted_after_cb, self);
-  g_signal_handlers_disconnect_by_func (self->buffer, text_deleted_cb, self);
   g_signal_handlers_disconnect_by_func (self->buffer, text_deleted_after_cb, self);
   g_signal_handlers_disconnect_by_func (self->buffer, cursor_moved_cb, self);
+
+  if (self->scanned_tag != NULL)
+    {
+      tag_table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (self->buffer));
+      gtk_text_tag_table_remove (tag_table, self->scanned_tag);
+      self->scanned_tag = NULL;
+    }
 }
 
 void
@@ -459,13 +798,14 @@ gb_color_picker_document_monitor_set_buffer (GbColorPickerDocumentMonitor *self,
 
   if (self->buffer != buffer)
     {
-      self->buffer = buffer;
+      if (self->buffer != NULL)
+        stop_monitor (self);
+
+      ide_set_weak_pointer (&self->buffer, buffer);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUFFER]);
 
       if (buffer != NULL)
         start_monitor (self);
-      else
-        stop_monitor (self);
     }
 }
 
@@ -485,9 +825,32 @@ gb_color_picker_document_monitor_new (IdeBuffer *buffer)
                        NULL);
 }
 
+static void
+gb_color_picker_document_monitor_dispose (GObject *object)
+{
+  GbColorPickerDocumentMonitor *self = (GbColorPickerDocumentMonitor *)object;
+
+  cancel_scan (self);
+
+  if (self->buffer != NULL)
+    {
+      stop_monitor (self);
+      ide_clear_weak_pointer (&self->buffer);
+    }
+
+  while (self->views->len > 0)
+    gb_color_picker_document_monitor_remove_view (self, g_ptr_array_index (self->views, 0));
+
+  G_OBJECT_CLASS (gb_color_picker_document_monitor_parent_class)->dispose (object);
+}
+
 static void
 gb_color_picker_document_monitor_finalize (GObject *object)
 {
+  GbColorPickerDocumentMonitor *self = (GbColorPickerDocumentMonitor *)object;
+
+  g_clear_pointer (&self->views, g_ptr_array_unref);
+
   G_OBJECT_CLASS (gb_color_picker_document_monitor_parent_class)->finalize (object);
 }
 
@@ -545,6 +908,7 @@ gb_color_picker_document_monitor_class_init (GbColorPickerDocumentMonitorClass *
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->dispose = gb_color_picker_document_monitor_dispose;
   object_class->finalize = gb_color_picker_document_monitor_finalize;
   object_class->get_property = gb_color_picker_document_monitor_get_property;
   object_class->set_property = gb_color_picker_document_monitor_set_property;
@@ -572,4 +936,5 @@ gb_color_picker_document_monitor_class_init (GbColorPickerDocumentMonitorClass *
 static void
 gb_color_picker_document_monitor_init (GbColorPickerDocumentMonitor *self)
 {
+  self->views = g_ptr_array_new ();
 }
@@ -31,12 +31,16 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (GbColorPickerDocumentMonitor, gb_color_picker_document_monitor, GB, COLOR_PICKER_DOCUMENT_MONITOR, GObject)
 
 GbColorPickerDocumentMonitor *gb_color_picker_document_monitor_new                        (IdeBuffer *buffer);
+void                          gb_color_picker_document_monitor_add_view                   (GbColorPickerDocumentMonitor *self,
+                                                                                           GtkTextView                  *view);
 void                          gb_color_picker_document_monitor_colorize                   (GbColorPickerDocumentMonitor *self,
                                                                                            GtkTextIter                  *begin,
                                                                                            GtkTextIter                  *end);
 IdeBuffer                    *gb_color_picker_document_monitor_get_buffer                 (GbColorPickerDocumentMonitor *self);
 void                          gb_color_picker_document_monitor_set_buffer                 (GbColorPickerDocumentMonitor *self,
                                                                                            IdeBuffer                    *buffer);
+void                          gb_color_picker_document_monitor_remove_view                (GbColorPickerDocumentMonitor *self,
+                                                                                           GtkTextView                  *view);
 
 void                          gb_color_picker_document_monitor_set_color_tag_at_cursor    (GbColorPickerDocumentMonitor *self,
                                                                                            GstyleColor                  *color);
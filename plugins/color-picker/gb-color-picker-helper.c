@@ -24,8 +24,6 @@
 
 #include "gb-color-picker-helper.h"
 
-static guint tag_count = 0;
-
 /* We don't take the alpha part intop account because the
  * view background can be different depending of the used theme
  */
@@ -57,30 +55,6 @@ gb_color_picker_helper_get_matching_monochrome (GdkRGBA *src_rgba,
     }
 }
 
-static inline void
-int_to_str (gchar *str,
-            guint  value)
-{
-  guint i = 1000000000;
-
-  g_assert (str != NULL);
-
-  if (value == 0)
-    i = 1;
-  else
-    while (i > value)
-      i /= 10;
-
-  do
-    {
-      *str = '0' + (value - value % i) / i % 10;
-      ++str;
-      i /= 10;
-    } while (i);
-
-  *str = '\0';
-}
-
 const gchar *
 gb_color_picker_helper_get_color_picker_data_path (void)
 {
@@ -95,28 +69,36 @@ gb_color_picker_helper_get_color_picker_data_path (void)
   return datadir;
 }
 
+/* Colors only differing by their alpha value are displayed the same way,
+ * so we share one tag per rgb value, named after it. The tag table is used
+ * as our cache and every occurrence of a color refers to the same tag.
+ */
 GtkTextTag *
-gb_color_picker_helper_create_color_tag (GtkTextBuffer *buffer,
-                                         GstyleColor   *color)
+gb_color_picker_helper_get_color_tag (GtkTextBuffer *buffer,
+                                      GstyleColor   *color)
 {
-  gchar str [11];
+  GtkTextTagTable *tag_table;
   GtkTextTag *tag;
-  g_autofree gchar *name = NULL;
+  gchar name [sizeof COLOR_TAG_PREFIX + 6];
   GdkRGBA fg_rgba;
   GdkRGBA bg_rgba;
 
   g_assert (GTK_IS_TEXT_BUFFER (buffer));
   g_assert (GSTYLE_IS_COLOR (color));
 
-  int_to_str (str, tag_count);
-
   gstyle_color_fill_rgba (color, &bg_rgba);
   bg_rgba.alpha = 1.0;
 
-  gb_color_picker_helper_get_matching_monochrome (&bg_rgba, &fg_rgba);
-  name = g_strconcat (COLOR_TAG_PREFIX, str, NULL);
-  ++tag_count;
+  g_snprintf (name, sizeof name, COLOR_TAG_PREFIX "%02x%02x%02x",
+              (guint)(CLAMP (bg_rgba.red, 0.0, 1.0) * 255.0 + 0.5),
+              (guint)(CLAMP (bg_rgba.green, 0.0, 1.0) * 255.0 + 0.5),
+              (guint)(CLAMP (bg_rgba.blue, 0.0, 1.0) * 255.0 + 0.5));
 
+  tag_table = gtk_text_buffer_get_tag_table (buffer);
+  if (NULL != (tag = gtk_text_tag_table_lookup (tag_table, name)))
+    return tag;
+
+  gb_color_picker_helper_get_matching_monochrome (&bg_rgba, &fg_rgba);
   tag = gtk_text_buffer_create_tag (buffer, name,
                                     "foreground-rgba", &fg_rgba,
                                     "background-rgba", &bg_rgba,
@@ -223,14 +205,12 @@ gb_color_picker_helper_set_color_tag (GtkTextIter *begin,
       cursor_offset = gtk_text_iter_get_offset (&cursor);
     }
 
-  tag = gb_color_picker_helper_create_color_tag (buffer, color);
+  tag = gb_color_picker_helper_get_color_tag (buffer, color);
   tag_text = gstyle_color_to_string (color, GSTYLE_COLOR_KIND_ORIGINAL);
 
   gtk_text_buffer_delete (buffer, begin, end);
   gtk_text_buffer_insert_with_tags (buffer, begin, tag_text, -1, tag, NULL);
 
-  /* TODO: remove old tag name from table */
-
   if (preserve_cursor)
     {
       gtk_text_buffer_get_iter_at_offset (buffer, &cursor, cursor_offset);
@@ -269,10 +249,10 @@ gb_color_picker_helper_set_color_tag_at_iter (GtkTextIter *iter,
           dst_offset = MIN (cursor_offset, start_offset + strlen (new_text) - 1);
         }
 
-      gb_color_picker_helper_change_color_tag (tag, color);
-
-      /* TODO: keep tags in tagtable so no need for ref/unref */
-      g_object_ref (tag);
+      /* Tags are shared between all occurrences of a color, so we switch
+       * to the tag of the new color instead of changing the current one.
+       */
+      tag = gb_color_picker_helper_get_color_tag (buffer, color);
 
       gtk_text_buffer_delete (buffer, &begin, &end);
       gtk_text_buffer_insert_with_tags (buffer, &begin, new_text, -1, tag, NULL);
@@ -283,7 +263,6 @@ gb_color_picker_helper_set_color_tag_at_iter (GtkTextIter *iter,
           gtk_text_buffer_place_cursor (buffer, &begin);
         }
 
-      g_object_unref (tag);
       return tag;
     }
   else
@@ -30,7 +30,7 @@ G_BEGIN_DECLS
 
 void                      gb_color_picker_helper_change_color_tag                 (GtkTextTag       *tag,
                                                                                    GstyleColor      *color);
-GtkTextTag               *gb_color_picker_helper_create_color_tag                 (GtkTextBuffer    *buffer,
+GtkTextTag               *gb_color_picker_helper_get_color_tag                    (GtkTextBuffer    *buffer,
                                                                                    GstyleColor      *color);
 GtkTextTag               *gb_color_picker_helper_get_tag_at_iter                  (GtkTextIter      *cursor,
                                                                                    GstyleColor     **current_color,
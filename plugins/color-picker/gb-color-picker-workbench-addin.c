@@ -280,6 +280,9 @@ view_clear (GbColorPickerWorkbenchAddin *self,
   monitor = get_view_monitor (self, view);
   if (monitor != NULL)
     {
+      gb_color_picker_document_monitor_remove_view (monitor,
+                                                    GTK_TEXT_VIEW (ide_editor_view_get_active_source_view (view)));
+
       if (remove_color)
         gb_color_picker_document_monitor_uncolorize (monitor, NULL, NULL);
 
@@ -351,6 +354,9 @@ activate_color_picker_action_cb (GbColorPickerWorkbenchAddin *self,
       else
         g_object_ref (monitor);
 
+      gb_color_picker_document_monitor_add_view (monitor,
+                                                 GTK_TEXT_VIEW (ide_editor_view_get_active_source_view (view)));
+
       ide_workbench_focus (self->workbench, GTK_WIDGET (self->dock));
       gb_color_picker_document_monitor_colorize (monitor, NULL, NULL);
     }
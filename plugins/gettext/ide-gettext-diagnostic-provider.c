@@ -18,34 +18,71 @@
 
 #define G_LOG_DOMAIN "ide-gettext-diagnostic-provider"
 
-#include <egg-task-cache.h>
 #include <glib/gi18n.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ide-gettext-diagnostic-provider.h"
 
-struct _IdeGettextDiagnostics
-{
-  GObject         parent_instance;
-  IdeDiagnostics *diagnostics;
-  guint64         sequence;
-};
+/*
+ * Results are cached by a checksum of the file, its language and its
+ * contents, so unchanged contents are never checked again. Misses are
+ * collected for BATCH_DELAY_MSEC, and checked with a single xgettext per
+ * language whose output is split back per file. This shares the cost of
+ * spawning xgettext when many buffers change at once, like after switching
+ * branches.
+ *
+ * Warnings are attached to the file they mention whether or not xgettext
+ * failed, so the cached result for some contents does not depend on which
+ * other files shared its batch. Requests whose tasks have all been
+ * cancelled are dropped before xgettext is spawned for them.
+ *
+ * All the contents of a file are persisted to the same temporary file, so
+ * newer contents are held back until the xgettext reading the previous
+ * ones has exited.
+ */
+
+#define BATCH_DELAY_MSEC   50
+#define MAX_CACHED_RESULTS 100
 
 struct _IdeGettextDiagnosticProvider
 {
-  IdeObject     parent_instance;
-  EggTaskCache *diagnostics_cache;
+  IdeObject   parent_instance;
+
+  /* checksum -> IdeDiagnostics, oldest first in results_order */
+  GHashTable *results;
+  GQueue      results_order;
+
+  /* checksum -> Request, for requests waiting for a batch or in one */
+  GHashTable *requests;
+  GPtrArray  *pending;
+  guint       batch_source;
+
+  /* Temporary files being read by a running xgettext */
+  GHashTable *running;
 };
 
 typedef struct
 {
-  IdeFile *file;
+  gchar          *checksum;
+  IdeFile        *file;
   IdeUnsavedFile *unsaved_file;
-} TranslationUnit;
+  const gchar    *xgettext_lang;
+  GPtrArray      *tasks;
+  GPtrArray      *diagnostics;
+} Request;
+
+typedef struct
+{
+  IdeGettextDiagnosticProvider *self;
+  GPtrArray                    *requests;
+} Batch;
 
 static void diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface);
+static void ide_gettext_diagnostic_provider_queue_batch (IdeGettextDiagnosticProvider *self);
+static void ide_gettext_diagnostic_provider_run (IdeGettextDiagnosticProvider *self,
+                                                 GPtrArray                    *requests);
 
-G_DEFINE_TYPE (IdeGettextDiagnostics, ide_gettext_diagnostics, G_TYPE_OBJECT)
 G_DEFINE_TYPE_EXTENDED (IdeGettextDiagnosticProvider,
                         ide_gettext_diagnostic_provider,
                         IDE_TYPE_OBJECT,
@@ -53,90 +90,25 @@ G_DEFINE_TYPE_EXTENDED (IdeGettextDiagnosticProvider,
                         G_IMPLEMENT_INTERFACE (IDE_TYPE_DIAGNOSTIC_PROVIDER,
                                                diagnostic_provider_iface_init))
 
-enum {
-  PROP_0,
-  PROP_DIAGNOSTICS,
-  PROP_SEQUENCE,
-  N_PROPS
-};
-
-static GParamSpec *properties [N_PROPS];
-
 static void
-ide_gettext_diagnostics_set_property (GObject      *object,
-                                      guint         prop_id,
-                                      const GValue *value,
-                                      GParamSpec   *pspec)
+request_free (gpointer data)
 {
-  IdeGettextDiagnostics *self = IDE_GETTEXT_DIAGNOSTICS (object);
-
-  switch (prop_id)
-    {
-    case PROP_DIAGNOSTICS:
-      self->diagnostics = g_value_dup_boxed (value);
-      break;
-
-    case PROP_SEQUENCE:
-      self->sequence = g_value_get_uint64 (value);
-      break;
-
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-      break;
-    }
+  Request *request = data;
+
+  g_clear_pointer (&request->checksum, g_free);
+  g_clear_object (&request->file);
+  g_clear_pointer (&request->unsaved_file, ide_unsaved_file_unref);
+  g_clear_pointer (&request->tasks, g_ptr_array_unref);
+  g_clear_pointer (&request->diagnostics, g_ptr_array_unref);
+  g_slice_free (Request, request);
 }
 
 static void
-ide_gettext_diagnostics_finalize (GObject *object)
+batch_free (Batch *batch)
 {
-  IdeGettextDiagnostics *self = IDE_GETTEXT_DIAGNOSTICS (object);
-
-  g_clear_pointer (&self->diagnostics, ide_diagnostics_unref);
-
-  G_OBJECT_CLASS (ide_gettext_diagnostics_parent_class)->finalize (object);
-}
-
-static void
-ide_gettext_diagnostics_class_init (IdeGettextDiagnosticsClass *klass)
-{
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-
-  object_class->finalize = ide_gettext_diagnostics_finalize;
-  object_class->set_property = ide_gettext_diagnostics_set_property;
-
-  properties [PROP_DIAGNOSTICS] =
-    g_param_spec_boxed ("diagnostics",
-                        "Diagnostics",
-                        "Diagnostics",
-                        IDE_TYPE_DIAGNOSTICS,
-                        (G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
-
-  properties [PROP_SEQUENCE] =
-    g_param_spec_uint64 ("sequence",
-                         "Sequence",
-                         "The document sequence number",
-                         0,
-                         G_MAXUINT64,
-                         0,
-                         (G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
-
-  g_object_class_install_properties (object_class, N_PROPS, properties);
-}
-
-static void
-ide_gettext_diagnostics_init (IdeGettextDiagnostics *self)
-{
-}
-
-static void
-translation_unit_free (TranslationUnit *unit)
-{
-  if (unit != NULL)
-    {
-      g_clear_object (&unit->file);
-      g_clear_pointer (&unit->unsaved_file, ide_unsaved_file_unref);
-      g_slice_free (TranslationUnit, unit);
-    }
+  g_clear_object (&batch->self);
+  g_clear_pointer (&batch->requests, g_ptr_array_unref);
+  g_slice_free (Batch, batch);
 }
 
 static IdeUnsavedFile *
@@ -171,243 +143,463 @@ get_unsaved_file (IdeGettextDiagnosticProvider *self,
   return NULL;
 }
 
-static void
-get_diagnostics_cb (GObject      *source_object,
-                    GAsyncResult *res,
-                    gpointer      user_data)
+static const gchar *
+id_to_xgettext_language (const gchar *id)
+{
+  static const struct {
+    const gchar *id;
+    const gchar *lang;
+  } id_to_lang[] = {
+    { "awk", "awk" },
+    { "c", "C" },
+    { "chdr", "C" },
+    { "cpp", "C++" },
+    { "js", "JavaScript" },
+    { "lisp", "Lisp" },
+    { "objc", "ObjectiveC" },
+    { "perl", "Perl" },
+    { "php", "PHP" },
+    { "python", "Python" },
+    { "sh", "Shell" },
+    { "tcl", "Tcl" },
+    { "vala", "Vala" }
+  };
+  gsize i;
+
+  if (id != NULL)
+    {
+      for (i = 0; i < G_N_ELEMENTS (id_to_lang); i++)
+        if (strcmp (id, id_to_lang[i].id) == 0)
+          return id_to_lang[i].lang;
+    }
+
+  return NULL;
+}
+
+static gchar *
+compute_checksum (IdeFile        *file,
+                  const gchar    *xgettext_lang,
+                  IdeUnsavedFile *unsaved_file)
 {
-  EggTaskCache *cache = EGG_TASK_CACHE (source_object);
-  g_autoptr(GTask) task = user_data;
-  g_autoptr(IdeGettextDiagnostics) diags = NULL;
-  GError *error = NULL;
+  g_autoptr(GChecksum) checksum = NULL;
+  g_autofree gchar *uri = NULL;
+  GBytes *content;
 
-  g_assert (EGG_IS_TASK_CACHE (cache));
-  g_assert (G_IS_TASK (task));
+  uri = g_file_get_uri (ide_file_get_file (file));
+  content = ide_unsaved_file_get_content (unsaved_file);
 
-  diags = egg_task_cache_get_finish (cache, res, &error);
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  g_checksum_update (checksum, (const guchar *)uri, strlen (uri) + 1);
+  g_checksum_update (checksum, (const guchar *)xgettext_lang, strlen (xgettext_lang) + 1);
+  g_checksum_update (checksum,
+                     g_bytes_get_data (content, NULL),
+                     g_bytes_get_size (content));
 
-  if (diags == NULL)
-    g_task_return_error (task, error);
-  else
-    g_task_return_pointer (task, g_steal_pointer (&diags), g_object_unref);
+  return g_strdup (g_checksum_get_string (checksum));
 }
 
 static void
-ide_gettext_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
-                                                IdeFile               *file,
-                                                GCancellable          *cancellable,
-                                                GAsyncReadyCallback    callback,
-                                                gpointer               user_data)
+ide_gettext_diagnostic_provider_complete (IdeGettextDiagnosticProvider *self,
+                                          Request                      *request,
+                                          const GError                 *error)
 {
-  IdeGettextDiagnosticProvider *self = (IdeGettextDiagnosticProvider *)provider;
-  g_autoptr(IdeUnsavedFile) unsaved_file = NULL;
-  IdeGettextDiagnostics *cached;
-  g_autoptr(GTask) task = NULL;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
 
-  g_return_if_fail (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
-  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
-
-  task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_source_tag (task, ide_gettext_diagnostic_provider_diagnose_async);
+  g_assert (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
+  g_assert (request != NULL);
 
-  if (NULL != (cached = egg_task_cache_peek (self->diagnostics_cache, file)))
+  if (error == NULL)
     {
-      unsaved_file = get_unsaved_file (self, file);
+      diagnostics = ide_diagnostics_new (g_steal_pointer (&request->diagnostics));
+
+      g_hash_table_insert (self->results,
+                           g_strdup (request->checksum),
+                           ide_diagnostics_ref (diagnostics));
+      g_queue_push_tail (&self->results_order, g_strdup (request->checksum));
 
-      if (unsaved_file == NULL || (cached->sequence >= ide_unsaved_file_get_sequence (unsaved_file)))
+      while (self->results_order.length > MAX_CACHED_RESULTS)
         {
-          g_task_return_pointer (task, g_object_ref (cached), g_object_unref);
-          return;
+          g_autofree gchar *oldest = g_queue_pop_head (&self->results_order);
+
+          g_hash_table_remove (self->results, oldest);
         }
     }
 
-  egg_task_cache_get_async (self->diagnostics_cache,
-                            file,
-                            TRUE,
-                            cancellable,
-                            get_diagnostics_cb,
-                            g_steal_pointer (&task));
+  for (guint i = 0; i < request->tasks->len; i++)
+    {
+      GTask *task = g_ptr_array_index (request->tasks, i);
+
+      if (error != NULL)
+        g_task_return_error (task, g_error_copy (error));
+      else
+        g_task_return_pointer (task,
+                               ide_diagnostics_ref (diagnostics),
+                               (GDestroyNotify)ide_diagnostics_unref);
+    }
+
+  /* Frees @request */
+  g_hash_table_remove (self->requests, request->checksum);
 }
 
-static IdeDiagnostics *
-ide_gettext_diagnostic_provider_diagnose_finish (IdeDiagnosticProvider  *provider,
-                                                 GAsyncResult           *result,
-                                                 GError                **error)
+/*
+ * Completes the tasks of @request that were cancelled while it was waiting.
+ * Returns %TRUE if any task is still interested in the result.
+ */
+static gboolean
+request_prune_cancelled (Request *request)
 {
-  GTask *task = (GTask *)result;
-  g_autoptr(IdeGettextDiagnostics) object = NULL;
+  g_assert (request != NULL);
 
-  g_return_val_if_fail (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (provider), NULL);
-  g_return_val_if_fail (G_IS_TASK (task), NULL);
+  for (guint i = request->tasks->len; i > 0; i--)
+    {
+      GTask *task = g_ptr_array_index (request->tasks, i - 1);
 
-  if (NULL == (object = g_task_propagate_pointer (task, error)))
-    return NULL;
+      if (g_task_return_error_if_cancelled (task))
+        g_ptr_array_remove_index (request->tasks, i - 1);
+    }
 
-  return ide_diagnostics_ref (object->diagnostics);
+  return request->tasks->len > 0;
 }
 
 static void
-diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface)
+parse_stderr (GPtrArray   *requests,
+              const gchar *stderr_buf,
+              gint        *last_mentioned)
 {
-  iface->diagnose_async = ide_gettext_diagnostic_provider_diagnose_async;
-  iface->diagnose_finish = ide_gettext_diagnostic_provider_diagnose_finish;
-}
+  g_auto(GStrv) lines = NULL;
 
-static void
-ide_gettext_diagnostic_provider_finalize (GObject *object)
-{
-  IdeGettextDiagnosticProvider *self = IDE_GETTEXT_DIAGNOSTIC_PROVIDER (object);
+  *last_mentioned = -1;
 
-  g_clear_object (&self->diagnostics_cache);
+  if (stderr_buf == NULL)
+    return;
 
-  G_OBJECT_CLASS (ide_gettext_diagnostic_provider_parent_class)->finalize (object);
-}
+  lines = g_strsplit (stderr_buf, "\n", 0);
 
-static void
-ide_gettext_diagnostic_provider_class_init (IdeGettextDiagnosticProviderClass *klass)
-{
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  for (guint i = 0; lines [i] != NULL; i++)
+    {
+      for (guint j = 0; j < requests->len; j++)
+        {
+          Request *request = g_ptr_array_index (requests, j);
+          const gchar *temp_path = ide_unsaved_file_get_temp_path (request->unsaved_file);
+          gsize len = strlen (temp_path);
+          gchar *p = lines [i];
 
-  object_class->finalize = ide_gettext_diagnostic_provider_finalize;
+          if (strncmp (p, temp_path, len) != 0 || p [len] != ':')
+            continue;
+
+          *last_mentioned = MAX (*last_mentioned, (gint)j);
+          p += len + 1;
+
+          if (g_ascii_isdigit (*p))
+            {
+              gulong line_number = strtoul (p, &p, 10);
+              IdeSourceLocation *loc;
+              IdeDiagnostic *diag;
+
+              loc = ide_source_location_new (request->file,
+                                             line_number - 1,
+                                             0,
+                                             0);
+              diag = ide_diagnostic_new (IDE_DIAGNOSTIC_WARNING,
+                                         g_strstrip (p + 1),
+                                         loc);
+              g_ptr_array_add (request->diagnostics, diag);
+            }
+
+          break;
+        }
+    }
 }
 
 static void
-subprocess_wait_cb (GObject      *object,
-                    GAsyncResult *res,
-                    gpointer      user_data)
+communicate_cb (GObject      *object,
+                GAsyncResult *result,
+                gpointer      user_data)
 {
   GSubprocess *subprocess = (GSubprocess *)object;
-  g_autofree gchar *input_prefix = NULL;
-  g_autoptr(IdeDiagnostics) local_diags = NULL;
-  g_autoptr(GTask) task = user_data;
-  g_autoptr(GPtrArray) array = NULL;
-  g_autoptr(GDataInputStream) stderr_data_input = NULL;
-  GInputStream *stderr_input = NULL;
-  g_autoptr(IdeGettextDiagnostics) diags = NULL;
-  TranslationUnit *unit;
-  GError *error = NULL;
+  g_autofree gchar *stderr_buf = NULL;
+  g_autoptr(GError) error = NULL;
+  Batch *batch = user_data;
+  IdeGettextDiagnosticProvider *self = batch->self;
+  GPtrArray *requests = batch->requests;
+  gint last_mentioned = -1;
+  guint n_done;
 
   g_assert (G_IS_SUBPROCESS (subprocess));
-  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
 
-  unit = g_task_get_task_data (task);
+  /* Newer contents of these files may now be persisted */
+  for (guint i = 0; i < requests->len; i++)
+    {
+      Request *request = g_ptr_array_index (requests, i);
+
+      g_hash_table_remove (self->running, ide_unsaved_file_get_temp_path (request->unsaved_file));
+    }
 
-  g_assert (unit != NULL);
+  if (self->pending->len > 0)
+    ide_gettext_diagnostic_provider_queue_batch (self);
 
-  if (!g_subprocess_wait_finish (subprocess, res, &error))
+  if (!g_subprocess_communicate_utf8_finish (subprocess, result, NULL, &stderr_buf, &error))
     {
-      g_task_return_error (task, error);
+      for (guint i = 0; i < requests->len; i++)
+        ide_gettext_diagnostic_provider_complete (self, g_ptr_array_index (requests, i), error);
+      batch_free (batch);
       return;
     }
 
-  array = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_diagnostic_unref);
+  /* Warnings are reported whether or not xgettext failed */
+  parse_stderr (requests, stderr_buf, &last_mentioned);
+
   if (g_subprocess_get_exit_status (subprocess) == 0)
-    goto out;
+    {
+      for (guint i = 0; i < requests->len; i++)
+        ide_gettext_diagnostic_provider_complete (self, g_ptr_array_index (requests, i), NULL);
+      batch_free (batch);
+      return;
+    }
+
+  /*
+   * xgettext stops at the first fatal error, so the files after the last
+   * one it reported on are checked again, dropping what was parsed for
+   * them. Without any report, we can't tell which file failed, so each is
+   * checked on its own.
+   */
+  if (requests->len == 1)
+    n_done = 1;
+  else
+    n_done = last_mentioned + 1;
 
-  stderr_input = g_subprocess_get_stderr_pipe (subprocess);
-  stderr_data_input = g_data_input_stream_new (stderr_input);
-  input_prefix = g_strdup_printf ("%s:", ide_unsaved_file_get_temp_path (unit->unsaved_file));
+  for (guint i = 0; i < n_done; i++)
+    ide_gettext_diagnostic_provider_complete (self, g_ptr_array_index (requests, i), NULL);
 
-  for (;;)
+  if (n_done == 0)
     {
-      g_autofree gchar *line = NULL;
-      gsize length;
+      for (guint i = 0; i < requests->len; i++)
+        {
+          g_autoptr(GPtrArray) single = g_ptr_array_new ();
 
-      line = g_data_input_stream_read_line (stderr_data_input,
-                                            &length,
-                                            g_task_get_cancellable (task),
-                                            &error);
-      if (line == NULL)
-        break;
+          g_ptr_array_add (single, g_ptr_array_index (requests, i));
+          ide_gettext_diagnostic_provider_run (self, single);
+        }
+    }
+  else if (n_done < requests->len)
+    {
+      g_autoptr(GPtrArray) rest = g_ptr_array_new ();
 
-      if (g_str_has_prefix (line, input_prefix))
-        {
-          gchar *p = line + strlen (input_prefix);
+      for (guint i = n_done; i < requests->len; i++)
+        g_ptr_array_add (rest, g_ptr_array_index (requests, i));
 
-          if (g_ascii_isdigit (*p))
-            {
-              gulong line_number = strtoul (p, &p, 10);
-              IdeSourceLocation *loc;
-              IdeDiagnostic *diag;
+      ide_gettext_diagnostic_provider_run (self, rest);
+    }
 
-              loc = ide_source_location_new (unit->file,
-                                             line_number - 1,
-                                             0,
-                                             0);
-              diag = ide_diagnostic_new (IDE_DIAGNOSTIC_WARNING,
-                                         g_strstrip (p + 1),
-                                         loc);
-              g_ptr_array_add (array, diag);
-            }
+  batch_free (batch);
+}
+
+/*
+ * Checks @requests, which share the same language, with a single xgettext.
+ * Requests are owned by self->requests.
+ */
+static void
+ide_gettext_diagnostic_provider_run (IdeGettextDiagnosticProvider *self,
+                                     GPtrArray                    *requests)
+{
+  g_autoptr(GSubprocess) subprocess = NULL;
+  g_autoptr(GPtrArray) args = NULL;
+  g_autoptr(GPtrArray) persisted = NULL;
+  g_autoptr(GError) error = NULL;
+  Batch *batch;
+
+  g_assert (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
+  g_assert (requests != NULL);
+  g_assert (requests->len > 0);
+
+  persisted = g_ptr_array_new ();
+
+  for (guint i = 0; i < requests->len; i++)
+    {
+      Request *request = g_ptr_array_index (requests, i);
+      g_autoptr(GError) persist_error = NULL;
+
+      if (!request_prune_cancelled (request))
+        {
+          /* Frees @request */
+          g_hash_table_remove (self->requests, request->checksum);
+          continue;
         }
+
+      if (!ide_unsaved_file_persist (request->unsaved_file, NULL, &persist_error))
+        {
+          ide_gettext_diagnostic_provider_complete (self, request, persist_error);
+          continue;
+        }
+
+      g_clear_pointer (&request->diagnostics, g_ptr_array_unref);
+      request->diagnostics = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_diagnostic_unref);
+
+      g_ptr_array_add (persisted, request);
+    }
+
+  if (persisted->len == 0)
+    return;
+
+  args = g_ptr_array_new ();
+  g_ptr_array_add (args, "xgettext");
+  g_ptr_array_add (args, "--check=ellipsis-unicode");
+  g_ptr_array_add (args, "--check=quote-unicode");
+  g_ptr_array_add (args, "--check=space-ellipsis");
+  g_ptr_array_add (args, "-k_");
+  g_ptr_array_add (args, "-kN_");
+  g_ptr_array_add (args, "-L");
+  g_ptr_array_add (args, (gchar *)((Request *)g_ptr_array_index (persisted, 0))->xgettext_lang);
+  g_ptr_array_add (args, "-o");
+  g_ptr_array_add (args, "-");
+  for (guint i = 0; i < persisted->len; i++)
+    {
+      Request *request = g_ptr_array_index (persisted, i);
+
+      g_ptr_array_add (args, (gchar *)ide_unsaved_file_get_temp_path (request->unsaved_file));
+    }
+  g_ptr_array_add (args, NULL);
+
+#ifdef IDE_ENABLE_TRACE
+  {
+    g_autofree gchar *str = NULL;
+    str = g_strjoinv (" ", (gchar **)args->pdata);
+    IDE_TRACE_MSG ("Launching '%s'", str);
+  }
+#endif
+
+  subprocess = g_subprocess_newv ((const gchar * const *)args->pdata,
+                                  G_SUBPROCESS_FLAGS_STDIN_PIPE
+                                  | G_SUBPROCESS_FLAGS_STDOUT_SILENCE
+                                  | G_SUBPROCESS_FLAGS_STDERR_PIPE,
+                                  &error);
+
+  if (subprocess == NULL)
+    {
+      for (guint i = 0; i < persisted->len; i++)
+        ide_gettext_diagnostic_provider_complete (self, g_ptr_array_index (persisted, i), error);
+      return;
+    }
+
+  for (guint i = 0; i < persisted->len; i++)
+    {
+      Request *request = g_ptr_array_index (persisted, i);
+
+      g_hash_table_add (self->running, g_strdup (ide_unsaved_file_get_temp_path (request->unsaved_file)));
     }
 
- out:
-  local_diags = ide_diagnostics_new (g_steal_pointer (&array));
-  diags = g_object_new (IDE_TYPE_GETTEXT_DIAGNOSTICS,
-                        "diagnostics", local_diags,
-                        "sequence", ide_unsaved_file_get_sequence (unit->unsaved_file),
-                        NULL);
-  g_task_return_pointer (task, g_steal_pointer (&diags), g_object_unref);
+  batch = g_slice_new0 (Batch);
+  batch->self = g_object_ref (self);
+  batch->requests = g_steal_pointer (&persisted);
+
+  g_subprocess_communicate_utf8_async (subprocess, NULL, NULL, communicate_cb, batch);
 }
 
-static const gchar *
-id_to_xgettext_language (const gchar *id)
+static gboolean
+ide_gettext_diagnostic_provider_batch_cb (gpointer data)
 {
-  static const struct {
-    const gchar *id;
-    const gchar *lang;
-  } id_to_lang[] = {
-    { "awk", "awk" },
-    { "c", "C" },
-    { "chdr", "C" },
-    { "cpp", "C++" },
-    { "js", "JavaScript" },
-    { "lisp", "Lisp" },
-    { "objc", "ObjectiveC" },
-    { "perl", "Perl" },
-    { "php", "PHP" },
-    { "python", "Python" },
-    { "sh", "Shell" },
-    { "tcl", "Tcl" },
-    { "vala", "Vala" }
-  };
-  gsize i;
+  IdeGettextDiagnosticProvider *self = data;
+  g_autoptr(GPtrArray) pending = NULL;
+  g_autoptr(GHashTable) temp_paths = NULL;
+  g_autoptr(GHashTable) by_lang = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  gboolean retry = FALSE;
 
-  if (id != NULL)
+  g_assert (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
+
+  self->batch_source = 0;
+
+  pending = self->pending;
+  self->pending = g_ptr_array_new ();
+
+  temp_paths = g_hash_table_new (g_str_hash, g_str_equal);
+  by_lang = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
+
+  for (guint i = 0; i < pending->len; i++)
     {
-      for (i = 0; i < G_N_ELEMENTS (id_to_lang); i++)
-        if (strcmp (id, id_to_lang[i].id) == 0)
-          return id_to_lang[i].lang;
+      Request *request = g_ptr_array_index (pending, i);
+      const gchar *temp_path = ide_unsaved_file_get_temp_path (request->unsaved_file);
+      GPtrArray *group;
+
+      /*
+       * Contents of the same file share a temporary file, check them one at
+       * a time. Those held back for a running xgettext are queued again
+       * once it exits.
+       */
+      if (g_hash_table_contains (self->running, temp_path))
+        {
+          g_ptr_array_add (self->pending, request);
+          continue;
+        }
+
+      if (g_hash_table_contains (temp_paths, temp_path))
+        {
+          g_ptr_array_add (self->pending, request);
+          retry = TRUE;
+          continue;
+        }
+
+      g_hash_table_add (temp_paths, (gpointer)temp_path);
+
+      if (!(group = g_hash_table_lookup (by_lang, request->xgettext_lang)))
+        {
+          group = g_ptr_array_new ();
+          g_hash_table_insert (by_lang, (gpointer)request->xgettext_lang, group);
+        }
+
+      g_ptr_array_add (group, request);
     }
 
-  return NULL;
+  g_hash_table_iter_init (&iter, by_lang);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    ide_gettext_diagnostic_provider_run (self, value);
+
+  if (retry)
+    ide_gettext_diagnostic_provider_queue_batch (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_gettext_diagnostic_provider_queue_batch (IdeGettextDiagnosticProvider *self)
+{
+  g_assert (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
+
+  if (self->batch_source == 0)
+    self->batch_source = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                             BATCH_DELAY_MSEC,
+                                             ide_gettext_diagnostic_provider_batch_cb,
+                                             g_object_ref (self),
+                                             g_object_unref);
 }
 
 static void
-populate_cache (EggTaskCache  *cache,
-                gconstpointer  key,
-                GTask         *task,
-                gpointer       user_data)
+ide_gettext_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
+                                                IdeFile               *file,
+                                                GCancellable          *cancellable,
+                                                GAsyncReadyCallback    callback,
+                                                gpointer               user_data)
 {
-  IdeGettextDiagnosticProvider *self = user_data;
+  IdeGettextDiagnosticProvider *self = (IdeGettextDiagnosticProvider *)provider;
   g_autoptr(IdeUnsavedFile) unsaved_file = NULL;
-  g_autoptr(GSubprocess) subprocess = NULL;
+  g_autoptr(GTask) task = NULL;
+  g_autofree gchar *checksum = NULL;
   GtkSourceLanguage *language;
   const gchar *language_id;
   const gchar *xgettext_lang;
-  const gchar *temp_path;
-  TranslationUnit *unit;
-  IdeFile *file = (IdeFile *)key;
-  GCancellable *cancellable;
-  GError *error = NULL;
-  GPtrArray *args;
-
-  g_assert (EGG_IS_TASK_CACHE (cache));
-  g_assert (IDE_IS_FILE (file));
-  g_assert (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
+  IdeDiagnostics *cached;
+  Request *request;
 
-  cancellable = g_task_get_cancellable (task);
+  g_return_if_fail (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_gettext_diagnostic_provider_diagnose_async);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
 
   if (NULL == (unsaved_file = get_unsaved_file (self, file)))
     {
@@ -429,76 +621,87 @@ populate_cache (EggTaskCache  *cache,
       return;
     }
 
-  if (!ide_unsaved_file_persist (unsaved_file, cancellable, &error))
+  checksum = compute_checksum (file, xgettext_lang, unsaved_file);
+
+  if (NULL != (cached = g_hash_table_lookup (self->results, checksum)))
     {
-      g_task_return_error (task, error);
+      g_task_return_pointer (task,
+                             ide_diagnostics_ref (cached),
+                             (GDestroyNotify)ide_diagnostics_unref);
       return;
     }
 
-  temp_path = ide_unsaved_file_get_temp_path (unsaved_file);
+  /* The same contents may already be waiting for xgettext */
+  if (NULL == (request = g_hash_table_lookup (self->requests, checksum)))
+    {
+      request = g_slice_new0 (Request);
+      request->checksum = g_strdup (checksum);
+      request->file = g_object_ref (file);
+      request->unsaved_file = ide_unsaved_file_ref (unsaved_file);
+      request->xgettext_lang = xgettext_lang;
+      request->tasks = g_ptr_array_new_with_free_func (g_object_unref);
 
-  g_assert (temp_path != NULL);
+      g_hash_table_insert (self->requests, request->checksum, request);
+      g_ptr_array_add (self->pending, request);
 
-  args = g_ptr_array_new ();
-  g_ptr_array_add (args, "xgettext");
-  g_ptr_array_add (args, "--check=ellipsis-unicode");
-  g_ptr_array_add (args, "--check=quote-unicode");
-  g_ptr_array_add (args, "--check=space-ellipsis");
-  g_ptr_array_add (args, "-k_");
-  g_ptr_array_add (args, "-kN_");
-  g_ptr_array_add (args, "-L");
-  g_ptr_array_add (args, (gchar *)xgettext_lang);
-  g_ptr_array_add (args, "-o");
-  g_ptr_array_add (args, "-");
-  g_ptr_array_add (args, (gchar *)temp_path);
-  g_ptr_array_add (args, NULL);
+      ide_gettext_diagnostic_provider_queue_batch (self);
+    }
 
-#ifdef IDE_ENABLE_TRACE
-  {
-    g_autofree gchar *str = NULL;
-    str = g_strjoinv (" ", (gchar **)args->pdata);
-    IDE_TRACE_MSG ("Launching '%s'", str);
-  }
-#endif
+  g_ptr_array_add (request->tasks, g_steal_pointer (&task));
+}
 
-  subprocess = g_subprocess_newv ((const gchar * const *)args->pdata,
-                                  G_SUBPROCESS_FLAGS_STDIN_PIPE
-                                  | G_SUBPROCESS_FLAGS_STDOUT_PIPE
-                                  | G_SUBPROCESS_FLAGS_STDERR_PIPE,
-                                  &error);
+static IdeDiagnostics *
+ide_gettext_diagnostic_provider_diagnose_finish (IdeDiagnosticProvider  *provider,
+                                                 GAsyncResult           *result,
+                                                 GError                **error)
+{
+  g_return_val_if_fail (IDE_IS_GETTEXT_DIAGNOSTIC_PROVIDER (provider), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
 
-  g_ptr_array_free (args, TRUE);
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
 
-  if (subprocess == NULL)
-    {
-      g_task_return_error (task, error);
-      return;
-    }
+static void
+diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface)
+{
+  iface->diagnose_async = ide_gettext_diagnostic_provider_diagnose_async;
+  iface->diagnose_finish = ide_gettext_diagnostic_provider_diagnose_finish;
+}
+
+static void
+ide_gettext_diagnostic_provider_finalize (GObject *object)
+{
+  IdeGettextDiagnosticProvider *self = IDE_GETTEXT_DIAGNOSTIC_PROVIDER (object);
 
-  unit = g_slice_new0 (TranslationUnit);
-  unit->file = g_object_ref (file);
-  unit->unsaved_file = ide_unsaved_file_ref (unsaved_file);
-  g_task_set_task_data (task, unit, (GDestroyNotify)translation_unit_free);
+  g_assert (self->batch_source == 0);
 
-  g_subprocess_wait_async (subprocess,
-                           cancellable,
-                           subprocess_wait_cb,
-                           g_object_ref (task));
+  g_clear_pointer (&self->results, g_hash_table_unref);
+  g_queue_foreach (&self->results_order, (GFunc)g_free, NULL);
+  g_queue_clear (&self->results_order);
+  g_clear_pointer (&self->pending, g_ptr_array_unref);
+  g_clear_pointer (&self->requests, g_hash_table_unref);
+  g_clear_pointer (&self->running, g_hash_table_unref);
+
+  G_OBJECT_CLASS (ide_gettext_diagnostic_provider_parent_class)->finalize (object);
+}
+
+static void
+ide_gettext_diagnostic_provider_class_init (IdeGettextDiagnosticProviderClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_gettext_diagnostic_provider_finalize;
 }
 
 static void
 ide_gettext_diagnostic_provider_init (IdeGettextDiagnosticProvider *self)
 {
-  self->diagnostics_cache = egg_task_cache_new ((GHashFunc)ide_file_hash,
-                                                (GEqualFunc)ide_file_equal,
-                                                g_object_ref,
-                                                g_object_unref,
-                                                g_object_ref,
-                                                g_object_unref,
-                                                20 * 1000L,
-                                                populate_cache,
-                                                self,
-                                                NULL);
-
-  egg_task_cache_set_name (self->diagnostics_cache, "gettext diagnostic cache");
+  self->results = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify)ide_diagnostics_unref);
+  g_queue_init (&self->results_order);
+  self->requests = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, request_free);
+  self->pending = g_ptr_array_new ();
+  self->running = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
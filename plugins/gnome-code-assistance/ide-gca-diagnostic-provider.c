@@ -18,6 +18,7 @@
 
 #define G_LOG_DOMAIN "ide-gca-diagnostic-provider"
 
+#include <egg-counter.h>
 #include <gca-diagnostics.h>
 #include <glib/gi18n.h>
 
@@ -28,40 +29,183 @@
 
 #include "gca-structs.h"
 
+/*
+ * Diagnose requests are coalesced per document and sent to the service in
+ * batches per language. A document has at most one parse in flight, and
+ * newer revisions replace the one waiting to be parsed, so fast typing does
+ * not queue a parse per keystroke. When a batch has more than one document,
+ * it is parsed with ParseAll() from the Project interface if the backend
+ * implements it.
+ */
+
 struct _IdeGcaDiagnosticProvider
 {
   IdeObject   parent_instance;
-  GHashTable *document_cache;
+
+  /* path -> Document */
+  GHashTable *documents;
+
+  /* language id -> Language */
+  GHashTable *languages;
 };
 
 typedef struct
 {
-  GTask          *task; /* Integrity check backpointer */
-  IdeUnsavedFile *unsaved_file;
-  IdeFile        *file;
+  gchar          *path;
   gchar          *language_id;
-} DiagnoseState;
+  IdeFile        *file;
+
+  /* Newest revision and the tasks waiting for it */
+  IdeUnsavedFile *unsaved_file;
+  GPtrArray      *tasks;
+
+  /* Revision being parsed and the tasks waiting for it */
+  IdeUnsavedFile *in_flight_unsaved_file;
+  GPtrArray      *in_flight_tasks;
+  gchar          *document_path;
+
+  guint           queued : 1;
+  guint           in_flight : 1;
+} Document;
+
+typedef struct
+{
+  IdeGcaDiagnosticProvider *self;
+  gchar                    *language_id;
+  GQueue                    queue;
+  guint                     flush_source;
+  guint                     parse_all_unsupported : 1;
+} Language;
+
+typedef struct
+{
+  IdeGcaDiagnosticProvider *self;
+  Language                 *language;
+  GcaService               *proxy;
+  GPtrArray                *documents;
+  gint64                    begin;
+} Batch;
+
+typedef struct
+{
+  IdeGcaDiagnosticProvider *self;
+  GcaService               *proxy;
+  Document                 *document;
+  gint64                    begin;
+} Step;
 
 static void diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface);
+static void ide_gca_diagnostic_provider_enqueue (IdeGcaDiagnosticProvider *self,
+                                                 Document                 *document);
 
 G_DEFINE_TYPE_EXTENDED (IdeGcaDiagnosticProvider, ide_gca_diagnostic_provider, IDE_TYPE_OBJECT, 0,
                         G_IMPLEMENT_INTERFACE (IDE_TYPE_DIAGNOSTIC_PROVIDER,
                                                diagnostic_provider_iface_init))
 
+/*
+ * Latency of each stage, as a histogram of 10 msec, 100 msec and 1 sec
+ * buckets along with the total time spent in the stage.
+ */
+#define DEFINE_STAGE_COUNTERS(Stage, Name)                                        \
+  EGG_DEFINE_COUNTER (Stage##_10msec, "GnomeCodeAssistance", Name " < 10 msec",   \
+                      "Number of " Name " stages completing within 10 msec.")     \
+  EGG_DEFINE_COUNTER (Stage##_100msec, "GnomeCodeAssistance", Name " < 100 msec", \
+                      "Number of " Name " stages completing within 100 msec.")    \
+  EGG_DEFINE_COUNTER (Stage##_1sec, "GnomeCodeAssistance", Name " < 1 sec",       \
+                      "Number of " Name " stages completing within 1 sec.")       \
+  EGG_DEFINE_COUNTER (Stage##_slow, "GnomeCodeAssistance", Name " >= 1 sec",      \
+                      "Number of " Name " stages taking 1 sec or more.")          \
+  EGG_DEFINE_COUNTER (Stage##_usec, "GnomeCodeAssistance", Name " Total usec",    \
+                      "Total time spent in " Name " stages in microseconds.")
+
+#define RECORD_STAGE(Stage, begin)                                                \
+  G_STMT_START {                                                                  \
+    gint64 stage_usec = g_get_monotonic_time () - (begin);                        \
+    if (stage_usec < 10 * 1000)                                                   \
+      EGG_COUNTER_INC (Stage##_10msec);                                           \
+    else if (stage_usec < 100 * 1000)                                             \
+      EGG_COUNTER_INC (Stage##_100msec);                                          \
+    else if (stage_usec < G_USEC_PER_SEC)                                         \
+      EGG_COUNTER_INC (Stage##_1sec);                                             \
+    else                                                                          \
+      EGG_COUNTER_INC (Stage##_slow);                                             \
+    EGG_COUNTER_ADD (Stage##_usec, stage_usec);                                   \
+  } G_STMT_END
+
+DEFINE_STAGE_COUNTERS (queue, "Queue")
+DEFINE_STAGE_COUNTERS (persist, "Persist")
+DEFINE_STAGE_COUNTERS (parse, "Parse")
+DEFINE_STAGE_COUNTERS (diagnostics, "Diagnostics")
+
+EGG_DEFINE_COUNTER (superseded, "GnomeCodeAssistance", "Superseded Revisions",
+                    "Number of revisions dropped before being parsed.")
+EGG_DEFINE_COUNTER (batched, "GnomeCodeAssistance", "ParseAll Documents",
+                    "Number of documents parsed together with ParseAll().")
+
 static GSettings *gca_settings;
 
 static void
-diagnose_state_free (gpointer data)
+document_free (gpointer data)
 {
-  DiagnoseState *state = data;
+  Document *document = data;
+
+  g_assert (!document->queued);
+  g_assert (!document->in_flight);
+
+  g_free (document->path);
+  g_free (document->language_id);
+  g_free (document->document_path);
+  g_clear_object (&document->file);
+  g_clear_pointer (&document->unsaved_file, ide_unsaved_file_unref);
+  g_clear_pointer (&document->in_flight_unsaved_file, ide_unsaved_file_unref);
+  g_clear_pointer (&document->tasks, g_ptr_array_unref);
+  g_clear_pointer (&document->in_flight_tasks, g_ptr_array_unref);
+  g_slice_free (Document, document);
+}
 
-  if (state)
-    {
-      g_clear_object (&state->file);
-      g_free (state->language_id);
-      g_clear_pointer (&state->unsaved_file, ide_unsaved_file_unref);
-      g_slice_free (DiagnoseState, state);
-    }
+static void
+language_free (gpointer data)
+{
+  Language *language = data;
+
+  if (language->flush_source != 0)
+    g_source_remove (language->flush_source);
+  g_queue_clear (&language->queue);
+  g_free (language->language_id);
+  g_slice_free (Language, language);
+}
+
+static void
+batch_free (Batch *batch)
+{
+  g_clear_object (&batch->self);
+  g_clear_object (&batch->proxy);
+  g_clear_pointer (&batch->documents, g_ptr_array_unref);
+  g_slice_free (Batch, batch);
+}
+
+static Step *
+step_new (IdeGcaDiagnosticProvider *self,
+          GcaService               *proxy,
+          Document                 *document)
+{
+  Step *step;
+
+  step = g_slice_new0 (Step);
+  step->self = g_object_ref (self);
+  step->proxy = g_object_ref (proxy);
+  step->document = document;
+  step->begin = g_get_monotonic_time ();
+
+  return step;
+}
+
+static void
+step_free (Step *step)
+{
+  g_clear_object (&step->self);
+  g_clear_object (&step->proxy);
+  g_slice_free (Step, step);
 }
 
 static IdeDiagnosticSeverity
@@ -92,7 +236,7 @@ get_severity (guint val)
 }
 
 static IdeDiagnostics *
-variant_to_diagnostics (DiagnoseState *state,
+variant_to_diagnostics (IdeFile  *file,
                         GVariant *variant)
 {
 
@@ -149,7 +293,6 @@ variant_to_diagnostics (DiagnoseState *state,
           IdeSourceRange *range;
           IdeSourceLocation *begin;
           IdeSourceLocation *end;
-          IdeFile *file = NULL;
 
           /*
            * FIXME:
@@ -157,8 +300,6 @@ variant_to_diagnostics (DiagnoseState *state,
            * Not always true, but we can cheat for now and claim it is within
            * the file we just parsed.
            */
-          file = state->file;
-
           begin = ide_source_location_new (file, x2 - 1, x3 - 1, 0);
           end = ide_source_location_new (file, x4 - 1, x5 - 1, 0);
 
@@ -175,37 +316,69 @@ variant_to_diagnostics (DiagnoseState *state,
   return ide_diagnostics_new (ar);
 }
 
+static void
+ide_gca_diagnostic_provider_complete (IdeGcaDiagnosticProvider *self,
+                                      Document                 *document,
+                                      IdeDiagnostics           *diagnostics,
+                                      const GError             *error)
+{
+  g_autoptr(GPtrArray) tasks = NULL;
+
+  g_assert (IDE_IS_GCA_DIAGNOSTIC_PROVIDER (self));
+  g_assert (document != NULL);
+  g_assert (document->in_flight);
+  g_assert (diagnostics != NULL || error != NULL);
+
+  tasks = g_steal_pointer (&document->in_flight_tasks);
+  g_clear_pointer (&document->in_flight_unsaved_file, ide_unsaved_file_unref);
+  g_clear_pointer (&document->document_path, g_free);
+  document->in_flight = FALSE;
+
+  for (guint i = 0; i < tasks->len; i++)
+    {
+      GTask *task = g_ptr_array_index (tasks, i);
+
+      if (error != NULL)
+        g_task_return_error (task, g_error_copy (error));
+      else
+        g_task_return_pointer (task,
+                               ide_diagnostics_ref (diagnostics),
+                               (GDestroyNotify)ide_diagnostics_unref);
+    }
+
+  /* A newer revision arrived while this one was being parsed */
+  if (document->tasks->len > 0)
+    ide_gca_diagnostic_provider_enqueue (self, document);
+  else
+    g_hash_table_remove (self->documents, document->path);
+}
+
 static void
 diagnostics_cb (GObject      *object,
                 GAsyncResult *result,
                 gpointer      user_data)
 {
   GcaDiagnostics *proxy = (GcaDiagnostics *)object;
-  g_autoptr(GTask) task = user_data;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
   g_autoptr(GVariant) var = NULL;
-  GError *error = NULL;
-  IdeDiagnostics *diagnostics;
-  DiagnoseState *state;
+  g_autoptr(GError) error = NULL;
+  Step *step = user_data;
 
   IDE_ENTRY;
 
-  g_assert (G_IS_TASK (task));
+  g_assert (GCA_IS_DIAGNOSTICS (proxy));
   g_assert (G_IS_ASYNC_RESULT (result));
 
-  if (!gca_diagnostics_call_diagnostics_finish (proxy, &var, result, &error))
-    {
-      IDE_TRACE_MSG ("%s", error->message);
-      g_task_return_error (task, error);
-      IDE_EXIT;
-    }
+  RECORD_STAGE (diagnostics, step->begin);
 
-  state = g_task_get_task_data (task);
-  g_assert (state->task == task);
+  if (!gca_diagnostics_call_diagnostics_finish (proxy, &var, result, &error))
+    IDE_TRACE_MSG ("%s", error->message);
+  else
+    diagnostics = variant_to_diagnostics (step->document->file, var);
 
-  diagnostics = variant_to_diagnostics (state, var);
+  ide_gca_diagnostic_provider_complete (step->self, step->document, diagnostics, error);
 
-  g_task_return_pointer (task, diagnostics,
-                         (GDestroyNotify)ide_diagnostics_unref);
+  step_free (step);
 
   IDE_EXIT;
 }
@@ -215,114 +388,263 @@ get_diag_proxy_cb (GObject      *object,
                    GAsyncResult *result,
                    gpointer      user_data)
 {
-  g_autoptr(GTask) task = user_data;
-  IdeGcaDiagnosticProvider *self;
-  GcaDiagnostics *proxy;
-  GError *error = NULL;
-  const gchar *path;
+  IdeGcaService *service = (IdeGcaService *)object;
+  g_autoptr(GcaDiagnostics) proxy = NULL;
+  g_autoptr(GError) error = NULL;
+  Step *step = user_data;
 
   IDE_ENTRY;
 
-  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_GCA_SERVICE (service));
   g_assert (G_IS_ASYNC_RESULT (result));
 
-  self = g_task_get_source_object (task);
-
-  proxy = gca_diagnostics_proxy_new_finish (result, &error);
+  proxy = ide_gca_service_get_diagnostics_proxy_finish (service, result, &error);
 
   if (!proxy)
     {
-      g_task_return_error (task, error);
+      ide_gca_diagnostic_provider_complete (step->self, step->document, NULL, error);
+      step_free (step);
       IDE_EXIT;
     }
 
-  path = g_dbus_proxy_get_object_path (G_DBUS_PROXY (proxy));
-  g_hash_table_replace (self->document_cache, g_strdup (path), proxy);
-
-  gca_diagnostics_call_diagnostics (proxy,
-                                    g_task_get_cancellable (task),
-                                    diagnostics_cb,
-                                    g_object_ref (task));
+  gca_diagnostics_call_diagnostics (proxy, NULL, diagnostics_cb, step);
 
   IDE_EXIT;
 }
 
+static void
+fetch_diagnostics (IdeGcaDiagnosticProvider *self,
+                   GcaService               *proxy,
+                   Document                 *document)
+{
+  IdeGcaService *service;
+  IdeContext *context;
+
+  g_assert (IDE_IS_GCA_DIAGNOSTIC_PROVIDER (self));
+  g_assert (GCA_IS_SERVICE (proxy));
+  g_assert (document->document_path != NULL);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  service = ide_context_get_service_typed (context, IDE_TYPE_GCA_SERVICE);
+
+  ide_gca_service_get_diagnostics_proxy_async (service,
+                                               proxy,
+                                               document->document_path,
+                                               NULL,
+                                               get_diag_proxy_cb,
+                                               step_new (self, proxy, document));
+}
+
+static const gchar *
+get_data_path (Document *document)
+{
+  if (document->in_flight_unsaved_file != NULL)
+    return ide_unsaved_file_get_temp_path (document->in_flight_unsaved_file);
+  return document->path;
+}
+
+static GVariant *
+get_parse_options (void)
+{
+  if (G_UNLIKELY (gca_settings == NULL))
+    gca_settings = g_settings_new ("org.gnome.builder.gnome-code-assistance");
+
+  if (g_settings_get_boolean (gca_settings, "enable-pylint"))
+    {
+      GVariantBuilder builder;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
+      g_variant_builder_add (&builder, "{sv}", "pylint", g_variant_new_boolean (TRUE));
+      return g_variant_builder_end (&builder);
+    }
+
+  return g_variant_new ("a{sv}", 0);
+}
+
 static void
 parse_cb (GObject      *object,
           GAsyncResult *result,
           gpointer      user_data)
 {
   GcaService *proxy = (GcaService *)object;
-  IdeGcaDiagnosticProvider *self;
-  DiagnoseState *state;
-  g_autoptr(GTask) task = user_data;
-  GcaDiagnostics *doc_proxy;
-  gboolean ret;
-  GError *error = NULL;
   g_autofree gchar *document_path = NULL;
+  g_autoptr(GError) error = NULL;
+  Step *step = user_data;
 
   IDE_ENTRY;
 
   g_assert (GCA_IS_SERVICE (proxy));
-  g_assert (G_IS_TASK (task));
 
-  self = g_task_get_source_object (task);
-  state = g_task_get_task_data (task);
+  RECORD_STAGE (parse, step->begin);
 
-  ret = gca_service_call_parse_finish (proxy, &document_path, result, &error);
-
-  if (!ret)
+  if (!gca_service_call_parse_finish (proxy, &document_path, result, &error))
     {
       IDE_TRACE_MSG ("%s", error->message);
-      g_task_return_error (task, error);
+      ide_gca_diagnostic_provider_complete (step->self, step->document, NULL, error);
+      step_free (step);
       IDE_EXIT;
     }
 
-  doc_proxy = g_hash_table_lookup (self->document_cache, document_path);
+  step->document->document_path = g_steal_pointer (&document_path);
+  fetch_diagnostics (step->self, proxy, step->document);
+
+  step_free (step);
+
+  IDE_EXIT;
+}
+
+static void
+parse_document (IdeGcaDiagnosticProvider *self,
+                GcaService               *proxy,
+                Document                 *document)
+{
+  GVariant *cursor;
+
+  g_assert (IDE_IS_GCA_DIAGNOSTIC_PROVIDER (self));
+  g_assert (GCA_IS_SERVICE (proxy));
+  g_assert (document != NULL);
+
+  /* TODO: Plumb support for cursors down to this level? */
+  cursor = g_variant_new ("(xx)", (gint64)0, (gint64)0);
+
+  gca_service_call_parse (proxy,
+                          document->path,
+                          get_data_path (document),
+                          cursor,
+                          get_parse_options (),
+                          NULL,
+                          parse_cb,
+                          step_new (self, proxy, document));
+}
+
+static void
+parse_all_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  GDBusConnection *bus = (GDBusConnection *)object;
+  g_autoptr(GVariant) reply = NULL;
+  g_autoptr(GVariantIter) iter = NULL;
+  g_autoptr(GError) error = NULL;
+  Batch *batch = user_data;
+  const gchar *path;
+  const gchar *document_path;
 
-  if (!doc_proxy)
+  IDE_ENTRY;
+
+  g_assert (G_IS_DBUS_CONNECTION (bus));
+
+  reply = g_dbus_connection_call_finish (bus, result, &error);
+
+  if (reply == NULL)
     {
-      g_autofree gchar *well_known_name = NULL;
-      GDBusConnection *conn;
-
-      well_known_name = g_strdup_printf ("org.gnome.CodeAssist.v1.%s",
-                                         state->language_id);
-      conn = g_dbus_proxy_get_connection (G_DBUS_PROXY (proxy));
-
-      gca_diagnostics_proxy_new (conn,
-                                 G_DBUS_PROXY_FLAGS_NONE,
-                                 well_known_name,
-                                 document_path,
-                                 g_task_get_cancellable (task),
-                                 get_diag_proxy_cb,
-                                 g_object_ref (task));
+      IDE_TRACE_MSG ("%s", error->message);
+
+      if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD) ||
+          g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_INTERFACE) ||
+          g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT))
+        {
+          batch->language->parse_all_unsupported = TRUE;
+
+          for (guint i = 0; i < batch->documents->len; i++)
+            parse_document (batch->self, batch->proxy, g_ptr_array_index (batch->documents, i));
+        }
+      else
+        {
+          for (guint i = 0; i < batch->documents->len; i++)
+            ide_gca_diagnostic_provider_complete (batch->self,
+                                                  g_ptr_array_index (batch->documents, i),
+                                                  NULL,
+                                                  error);
+        }
+
+      batch_free (batch);
       IDE_EXIT;
     }
 
-  gca_diagnostics_call_diagnostics (doc_proxy,
-                                    g_task_get_cancellable (task),
-                                    diagnostics_cb,
-                                    g_object_ref (task));
+  RECORD_STAGE (parse, batch->begin);
+  EGG_COUNTER_ADD (batched, batch->documents->len);
+
+  g_variant_get (reply, "(a(so))", &iter);
+
+  while (g_variant_iter_next (iter, "(&s&o)", &path, &document_path))
+    {
+      for (guint i = 0; i < batch->documents->len; i++)
+        {
+          Document *document = g_ptr_array_index (batch->documents, i);
+
+          if (document->document_path == NULL && g_strcmp0 (document->path, path) == 0)
+            {
+              document->document_path = g_strdup (document_path);
+              break;
+            }
+        }
+    }
+
+  for (guint i = 0; i < batch->documents->len; i++)
+    {
+      Document *document = g_ptr_array_index (batch->documents, i);
+
+      if (document->document_path != NULL)
+        fetch_diagnostics (batch->self, batch->proxy, document);
+      else
+        parse_document (batch->self, batch->proxy, document);
+    }
+
+  batch_free (batch);
 
   IDE_EXIT;
 }
 
-static GVariant *
-get_parse_options (void)
+static gboolean
+parse_all (Batch *batch)
 {
-  if (G_UNLIKELY (gca_settings == NULL))
-    gca_settings = g_settings_new ("org.gnome.builder.gnome-code-assistance");
+  g_autofree gchar *project_path = NULL;
+  GVariantBuilder builder;
+  IdeContext *context;
+  IdeVcs *vcs;
 
-  if (g_settings_get_boolean (gca_settings, "enable-pylint"))
+  g_assert (batch != NULL);
+
+  if (batch->language->parse_all_unsupported || batch->documents->len < 2)
+    return FALSE;
+
+  context = ide_object_get_context (IDE_OBJECT (batch->self));
+  vcs = ide_context_get_vcs (context);
+  project_path = g_file_get_path (ide_vcs_get_working_directory (vcs));
+
+  if (project_path == NULL)
+    return FALSE;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss)"));
+
+  for (guint i = 0; i < batch->documents->len; i++)
     {
-      GVariantBuilder builder;
+      Document *document = g_ptr_array_index (batch->documents, i);
 
-      g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-      g_variant_builder_add (&builder, "{sv}", "pylint", g_variant_new_boolean (TRUE));
-      return g_variant_builder_end (&builder);
+      g_variant_builder_add (&builder, "(ss)", document->path, get_data_path (document));
     }
 
-  return g_variant_new ("a{sv}", 0);
+  batch->begin = g_get_monotonic_time ();
+
+  g_dbus_connection_call (g_dbus_proxy_get_connection (G_DBUS_PROXY (batch->proxy)),
+                          g_dbus_proxy_get_name (G_DBUS_PROXY (batch->proxy)),
+                          g_dbus_proxy_get_object_path (G_DBUS_PROXY (batch->proxy)),
+                          "org.gnome.CodeAssist.v1.Project",
+                          "ParseAll",
+                          g_variant_new ("(sa(ss)(xx)@a{sv})",
+                                         project_path,
+                                         &builder,
+                                         (gint64)0, (gint64)0,
+                                         get_parse_options ()),
+                          G_VARIANT_TYPE ("(a(so))"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          parse_all_cb,
+                          batch);
+
+  return TRUE;
 }
 
 static void
@@ -330,75 +652,138 @@ get_proxy_cb (GObject      *object,
               GAsyncResult *result,
               gpointer      user_data)
 {
-  g_autoptr(GTask) task = user_data;
-  g_autoptr(GVariant) options = NULL;
   IdeGcaService *service = (IdeGcaService *)object;
-  DiagnoseState *state;
-  GcaService *proxy;
-  const gchar *temp_path;
-  GError *error = NULL;
-  GFile *gfile;
-  g_autofree gchar *path = NULL;
-  GVariant *cursor = NULL;
+  g_autoptr(GError) error = NULL;
+  Batch *batch = user_data;
+  GPtrArray *documents;
 
   IDE_ENTRY;
 
-  g_assert (G_IS_TASK (task));
   g_assert (IDE_IS_GCA_SERVICE (service));
 
-  state = g_task_get_task_data (task);
-  g_assert (state->task == task);
+  batch->proxy = ide_gca_service_get_proxy_finish (service, result, &error);
+
+  if (!batch->proxy)
+    {
+      for (guint i = 0; i < batch->documents->len; i++)
+        ide_gca_diagnostic_provider_complete (batch->self,
+                                              g_ptr_array_index (batch->documents, i),
+                                              NULL,
+                                              error);
+      batch_free (batch);
+      IDE_EXIT;
+    }
 
-  proxy = ide_gca_service_get_proxy_finish (service, result, &error);
+  documents = g_ptr_array_sized_new (batch->documents->len);
 
-  if (!proxy)
+  for (guint i = 0; i < batch->documents->len; i++)
     {
-      g_task_return_error (task, error);
-      IDE_GOTO (cleanup);
+      Document *document = g_ptr_array_index (batch->documents, i);
+      g_autoptr(GError) persist_error = NULL;
+      gint64 begin;
+
+      if (document->in_flight_unsaved_file != NULL)
+        {
+          begin = g_get_monotonic_time ();
+
+          if (!ide_unsaved_file_persist (document->in_flight_unsaved_file, NULL, &persist_error))
+            {
+              ide_gca_diagnostic_provider_complete (batch->self, document, NULL, persist_error);
+              continue;
+            }
+
+          RECORD_STAGE (persist, begin);
+        }
+
+      g_ptr_array_add (documents, document);
     }
 
-  gfile = ide_file_get_file (state->file);
-  temp_path = path = g_file_get_path (gfile);
+  g_ptr_array_unref (batch->documents);
+  batch->documents = documents;
 
-  if (!path)
+  if (!parse_all (batch))
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_NOT_SUPPORTED,
-                               _("Code assistance requires a local file."));
-      IDE_GOTO (cleanup);
+      for (guint i = 0; i < batch->documents->len; i++)
+        parse_document (batch->self, batch->proxy, g_ptr_array_index (batch->documents, i));
+      batch_free (batch);
     }
 
-  if (state->unsaved_file)
+  IDE_EXIT;
+}
+
+static gboolean
+ide_gca_diagnostic_provider_flush (gpointer data)
+{
+  Language *language = data;
+  IdeGcaDiagnosticProvider *self = language->self;
+  IdeGcaService *service;
+  IdeContext *context;
+  Document *document;
+  Batch *batch;
+
+  g_assert (IDE_IS_GCA_DIAGNOSTIC_PROVIDER (self));
+
+  language->flush_source = 0;
+
+  batch = g_slice_new0 (Batch);
+  batch->self = g_object_ref (self);
+  batch->language = language;
+  batch->documents = g_ptr_array_new ();
+
+  while ((document = g_queue_pop_head (&language->queue)))
     {
-      if (!ide_unsaved_file_persist (state->unsaved_file,
-                                     g_task_get_cancellable (task),
-                                     &error))
+      g_assert (document->queued);
+      g_assert (!document->in_flight);
+
+      document->queued = FALSE;
+      document->in_flight = TRUE;
+      document->in_flight_tasks = document->tasks;
+      document->in_flight_unsaved_file = g_steal_pointer (&document->unsaved_file);
+      document->tasks = g_ptr_array_new_with_free_func (g_object_unref);
+
+      for (guint i = 0; i < document->in_flight_tasks->len; i++)
         {
-          g_task_return_error (task, error);
-          IDE_GOTO (cleanup);
+          GTask *task = g_ptr_array_index (document->in_flight_tasks, i);
+          gint64 *queued_at = g_task_get_task_data (task);
+
+          RECORD_STAGE (queue, *queued_at);
         }
 
-      temp_path = ide_unsaved_file_get_temp_path (state->unsaved_file);
+      g_ptr_array_add (batch->documents, document);
     }
 
-  /* TODO: Plumb support for cursors down to this level? */
-  cursor = g_variant_new ("(xx)", (gint64)0, (gint64)0);
-  options = g_variant_ref_sink (get_parse_options ());
+  context = ide_object_get_context (IDE_OBJECT (self));
+  service = ide_context_get_service_typed (context, IDE_TYPE_GCA_SERVICE);
 
-  gca_service_call_parse (proxy,
-                          path,
-                          temp_path,
-                          cursor,
-                          options,
-                          g_task_get_cancellable (task),
-                          parse_cb,
-                          g_object_ref (task));
+  ide_gca_service_get_proxy_async (service, language->language_id, NULL, get_proxy_cb, batch);
 
-cleanup:
-  g_clear_object (&proxy);
+  return G_SOURCE_REMOVE;
+}
 
-  IDE_EXIT;
+static void
+ide_gca_diagnostic_provider_enqueue (IdeGcaDiagnosticProvider *self,
+                                     Document                 *document)
+{
+  Language *language;
+
+  g_assert (IDE_IS_GCA_DIAGNOSTIC_PROVIDER (self));
+  g_assert (!document->queued);
+  g_assert (!document->in_flight);
+
+  if (!(language = g_hash_table_lookup (self->languages, document->language_id)))
+    {
+      language = g_slice_new0 (Language);
+      language->self = self;
+      language->language_id = g_strdup (document->language_id);
+      g_queue_init (&language->queue);
+      g_hash_table_insert (self->languages, language->language_id, language);
+    }
+
+  document->queued = TRUE;
+  g_queue_push_tail (&language->queue, document);
+
+  if (language->flush_source == 0)
+    language->flush_source = g_idle_add (ide_gca_diagnostic_provider_flush, language);
 }
 
 static void
@@ -410,12 +795,13 @@ ide_gca_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
 {
   IdeGcaDiagnosticProvider *self = (IdeGcaDiagnosticProvider *)provider;
   g_autoptr(GTask) task = NULL;
-  IdeGcaService *service;
-  DiagnoseState *state;
+  g_autofree gchar *path = NULL;
   GtkSourceLanguage *language;
   IdeContext *context;
   IdeUnsavedFiles *files;
   const gchar *language_id = NULL;
+  Document *document;
+  gint64 *queued_at;
   GFile *gfile;
 
   IDE_ENTRY;
@@ -438,21 +824,51 @@ ide_gca_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
       IDE_EXIT;
     }
 
+  gfile = ide_file_get_file (file);
+  path = g_file_get_path (gfile);
+
+  if (!path)
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_SUPPORTED,
+                               _("Code assistance requires a local file."));
+      IDE_EXIT;
+    }
+
   context = ide_object_get_context (IDE_OBJECT (provider));
-  service = ide_context_get_service_typed (context, IDE_TYPE_GCA_SERVICE);
   files = ide_context_get_unsaved_files (context);
-  gfile = ide_file_get_file (file);
 
-  state = g_slice_new0 (DiagnoseState);
-  state->task = task;
-  state->language_id = g_strdup (language_id);
-  state->file = g_object_ref (file);
-  state->unsaved_file = ide_unsaved_files_get_unsaved_file (files, gfile);
+  if (!(document = g_hash_table_lookup (self->documents, path)))
+    {
+      document = g_slice_new0 (Document);
+      document->path = g_strdup (path);
+      document->tasks = g_ptr_array_new_with_free_func (g_object_unref);
+      g_hash_table_insert (self->documents, document->path, document);
+    }
+
+  if (!document->queued)
+    {
+      g_free (document->language_id);
+      document->language_id = g_strdup (language_id);
+    }
+
+  g_set_object (&document->file, file);
+
+  /* Only the newest revision is parsed */
+  if (document->unsaved_file != NULL)
+    EGG_COUNTER_INC (superseded);
+  g_clear_pointer (&document->unsaved_file, ide_unsaved_file_unref);
+  document->unsaved_file = ide_unsaved_files_get_unsaved_file (files, gfile);
+
+  queued_at = g_new (gint64, 1);
+  *queued_at = g_get_monotonic_time ();
+  g_task_set_task_data (task, queued_at, g_free);
 
-  g_task_set_task_data (task, state, diagnose_state_free);
+  g_ptr_array_add (document->tasks, g_steal_pointer (&task));
 
-  ide_gca_service_get_proxy_async (service, language_id, cancellable,
-                                   get_proxy_cb, g_object_ref (task));
+  if (!document->queued && !document->in_flight)
+    ide_gca_diagnostic_provider_enqueue (self, document);
 
   IDE_EXIT;
 }
@@ -480,7 +896,8 @@ ide_gca_diagnostic_provider_finalize (GObject *object)
 {
   IdeGcaDiagnosticProvider *self = (IdeGcaDiagnosticProvider *)object;
 
-  g_clear_pointer (&self->document_cache, g_hash_table_unref);
+  g_clear_pointer (&self->languages, g_hash_table_unref);
+  g_clear_pointer (&self->documents, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_gca_diagnostic_provider_parent_class)->finalize (object);
 }
@@ -503,6 +920,6 @@ ide_gca_diagnostic_provider_class_init (IdeGcaDiagnosticProviderClass *klass)
 static void
 ide_gca_diagnostic_provider_init (IdeGcaDiagnosticProvider *self)
 {
-  self->document_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                g_free, g_object_unref);
+  self->documents = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, document_free);
+  self->languages = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, language_free);
 }
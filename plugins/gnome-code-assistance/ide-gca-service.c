@@ -18,6 +18,7 @@
 
 #define G_LOG_DOMAIN "ide-gca-service"
 
+#include <gca-diagnostics.h>
 #include <gca-service.h>
 #include <glib/gi18n.h>
 
@@ -30,6 +31,7 @@ struct _IdeGcaService
 
   GDBusConnection *bus;
   GHashTable      *proxy_cache;
+  GHashTable      *diagnostics_cache;
 
   gulong           bus_closed_handler;
 };
@@ -53,6 +55,7 @@ on_bus_closed (GDBusConnection *bus,
 
   g_clear_object (&self->bus);
   g_hash_table_remove_all (self->proxy_cache);
+  g_hash_table_remove_all (self->diagnostics_cache);
 }
 
 static GDBusConnection *
@@ -231,6 +234,99 @@ ide_gca_service_get_proxy_finish (IdeGcaService  *self,
   return g_task_propagate_pointer (task, error);
 }
 
+static void
+diagnostics_proxy_new_cb (GObject      *object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  IdeGcaService *self;
+  g_autoptr(GTask) task = user_data;
+  GcaDiagnostics *proxy;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (G_IS_ASYNC_RESULT (result));
+
+  self = g_task_get_source_object (task);
+
+  proxy = gca_diagnostics_proxy_new_finish (result, &error);
+
+  if (!proxy)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* Don't cache proxies for a connection that has since closed */
+  if (self->bus == g_dbus_proxy_get_connection (G_DBUS_PROXY (proxy)))
+    g_hash_table_replace (self->diagnostics_cache,
+                          g_strdup (g_dbus_proxy_get_object_path (G_DBUS_PROXY (proxy))),
+                          g_object_ref (proxy));
+
+  g_task_return_pointer (task, proxy, g_object_unref);
+}
+
+/**
+ * ide_gca_service_get_diagnostics_proxy_async:
+ * @service_proxy: the #GcaService that parsed the document.
+ * @document_path: the object path returned from parsing the document.
+ *
+ * Asynchronously loads a proxy for the diagnostics of a parsed document.
+ * Proxies are cached until the bus connection is closed.
+ */
+void
+ide_gca_service_get_diagnostics_proxy_async (IdeGcaService       *self,
+                                             GcaService          *service_proxy,
+                                             const gchar         *document_path,
+                                             GCancellable        *cancellable,
+                                             GAsyncReadyCallback  callback,
+                                             gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  GcaDiagnostics *proxy;
+
+  g_return_if_fail (IDE_IS_GCA_SERVICE (self));
+  g_return_if_fail (GCA_IS_SERVICE (service_proxy));
+  g_return_if_fail (document_path != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+
+  if ((proxy = g_hash_table_lookup (self->diagnostics_cache, document_path)))
+    {
+      g_task_return_pointer (task, g_object_ref (proxy), g_object_unref);
+      return;
+    }
+
+  gca_diagnostics_proxy_new (g_dbus_proxy_get_connection (G_DBUS_PROXY (service_proxy)),
+                             G_DBUS_PROXY_FLAGS_NONE,
+                             g_dbus_proxy_get_name (G_DBUS_PROXY (service_proxy)),
+                             document_path,
+                             cancellable,
+                             diagnostics_proxy_new_cb,
+                             g_object_ref (task));
+}
+
+/**
+ * ide_gca_service_get_diagnostics_proxy_finish:
+ *
+ * Completes an asynchronous request to load a document diagnostics proxy.
+ *
+ * Returns: (transfer full): A #GcaDiagnostics or %NULL upon failure.
+ */
+GcaDiagnostics *
+ide_gca_service_get_diagnostics_proxy_finish (IdeGcaService  *self,
+                                              GAsyncResult   *result,
+                                              GError        **error)
+{
+  GTask *task = (GTask *)result;
+
+  g_return_val_if_fail (IDE_IS_GCA_SERVICE (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (task), NULL);
+
+  return g_task_propagate_pointer (task, error);
+}
+
 static void
 ide_gca_service_finalize (GObject *object)
 {
@@ -243,6 +339,7 @@ ide_gca_service_finalize (GObject *object)
     }
 
   g_clear_pointer (&self->proxy_cache, g_hash_table_unref);
+  g_clear_pointer (&self->diagnostics_cache, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_gca_service_parent_class)->finalize (object);
 }
@@ -260,4 +357,6 @@ ide_gca_service_init (IdeGcaService *self)
 {
   self->proxy_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
                                              g_free, g_object_unref);
+  self->diagnostics_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, g_object_unref);
 }
@@ -19,6 +19,7 @@
 #ifndef IDE_GCA_SERVICE_H
 #define IDE_GCA_SERVICE_H
 
+#include <gca-diagnostics.h>
 #include <gca-service.h>
 
 #include "ide-service.h"
@@ -29,14 +30,23 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (IdeGcaService, ide_gca_service, IDE, GCA_SERVICE, IdeObject)
 
-void        ide_gca_service_get_proxy_async  (IdeGcaService        *self,
-                                              const gchar          *language_id,
-                                              GCancellable         *cancellable,
-                                              GAsyncReadyCallback   callback,
-                                              gpointer              user_data);
-GcaService *ide_gca_service_get_proxy_finish (IdeGcaService        *self,
-                                              GAsyncResult         *result,
-                                              GError              **error);
+void            ide_gca_service_get_proxy_async              (IdeGcaService        *self,
+                                                              const gchar          *language_id,
+                                                              GCancellable         *cancellable,
+                                                              GAsyncReadyCallback   callback,
+                                                              gpointer              user_data);
+GcaService     *ide_gca_service_get_proxy_finish             (IdeGcaService        *self,
+                                                              GAsyncResult         *result,
+                                                              GError              **error);
+void            ide_gca_service_get_diagnostics_proxy_async  (IdeGcaService        *self,
+                                                              GcaService           *service_proxy,
+                                                              const gchar          *document_path,
+                                                              GCancellable         *cancellable,
+                                                              GAsyncReadyCallback   callback,
+                                                              gpointer              user_data);
+GcaDiagnostics *ide_gca_service_get_diagnostics_proxy_finish (IdeGcaService        *self,
+                                                              GAsyncResult         *result,
+                                                              GError              **error);
 
 G_END_DECLS
 
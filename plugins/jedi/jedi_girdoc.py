@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+
+#
+# jedi_girdoc.py
+#
+# Copyright (C) 2015 Elad Alfassa <elad@fedoraproject.org>
+# Copyright (C) 2015 Christian Hergert <chris@dronelabs.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Builds the sqlite database of GObject Introspection documentation used by
+the Jedi completion provider.
+
+This module intentionally has no dependency on gi so that it can also be
+run at build time to generate a prebuilt database which is installed next
+to the plugin and copied into the user cache on first run:
+
+    python3 jedi_girdoc.py girdoc.db /usr/share/gir-1.0
+"""
+
+import os
+import os.path
+import sqlite3
+import sys
+
+from concurrent.futures import ThreadPoolExecutor
+
+# lxml is faster than the Python standard library xml, and can ignore invalid
+# characters (which occur in some .gir files). It also releases the GIL while
+# parsing, which lets us parse several files concurrently with threads.
+try:
+    import lxml.etree
+    HAS_LXML = True
+except ImportError:
+    HAS_LXML = False
+
+_NS = {'core': 'http://www.gtk.org/introspection/core/1.0',
+       'c': 'http://www.gtk.org/introspection/c/1.0'}
+
+_GLIB_TYPE_NAME = '{http://www.gtk.org/introspection/glib/1.0}type-name'
+_C_IDENTIFIER = '{http://www.gtk.org/introspection/c/1.0}identifier'
+
+# Number of parsed files to insert per transaction. Committing periodically
+# means progress is kept if we are interrupted, without paying for a
+# transaction per symbol.
+_FILES_PER_TRANSACTION = 32
+
+
+def create_tables(cursor):
+    "Create the tables (and indexes used by lookups) if they don't exist"
+    cursor.execute('CREATE TABLE IF NOT EXISTS doc (symbol text, library_version text, doc text, gir_file text)')
+    cursor.execute('CREATE TABLE IF NOT EXISTS girfiles (file text, last_modified integer)')
+    cursor.execute('CREATE INDEX IF NOT EXISTS doc_symbol_idx ON doc (symbol, library_version)')
+    cursor.execute('CREATE INDEX IF NOT EXISTS doc_gir_file_idx ON doc (gir_file)')
+    cursor.execute('CREATE UNIQUE INDEX IF NOT EXISTS girfiles_file_idx ON girfiles (file)')
+
+
+def find_changed_gir_files(cursor, gir_path_list):
+    """
+    Returns a list of (filename, mtime) for gir files which are new or have
+    been modified since they were last indexed. The known mtimes are loaded
+    with a single query rather than one per file.
+    """
+    known = dict(cursor.execute('SELECT file, last_modified FROM girfiles'))
+    processed = set()
+    changed = []
+
+    for gir_path in gir_path_list:
+        try:
+            entries = os.listdir(gir_path)
+        except OSError:
+            continue
+        for gir_file in entries:
+            if gir_file in processed or not gir_file.endswith('.gir'):
+                continue
+            processed.add(gir_file)
+            filename = os.path.join(gir_path, gir_file)
+            try:
+                mtime = os.stat(filename).st_mtime
+            except OSError:
+                continue
+            last_modified = known.get(filename)
+            if last_modified is None or last_modified < mtime:
+                changed.append((filename, mtime))
+
+    return changed
+
+
+def parse_gir_file(filename):
+    "Parse a single gir file, returning a list of (symbol, version, doc, file) rows"
+    rows = []
+    parser = lxml.etree.XMLParser(recover=True)
+    tree = lxml.etree.parse(filename, parser=parser)
+    namespace = tree.find('core:namespace', namespaces=_NS)
+    if namespace is None:
+        return rows
+    library_version = namespace.attrib.get('version')
+
+    for node in namespace.findall('core:class', namespaces=_NS):
+        doc = node.find('core:doc', namespaces=_NS)
+        if doc is not None and _GLIB_TYPE_NAME in node.attrib:
+            rows.append((node.attrib[_GLIB_TYPE_NAME], library_version, doc.text, filename))
+
+    for method in namespace.findall('core:method', namespaces=_NS) + \
+                  namespace.findall('core:constructor', namespaces=_NS) + \
+                  namespace.findall('core:function', namespaces=_NS):
+        doc = method.find('core:doc', namespaces=_NS)
+        if doc is not None and _C_IDENTIFIER in method.attrib:
+            rows.append((method.attrib[_C_IDENTIFIER], library_version, doc.text, filename))
+
+    return rows
+
+
+def _parse_gir_file_safe(filename):
+    try:
+        return parse_gir_file(filename)
+    except Exception as ex:
+        print('Failed to parse {}: {}'.format(filename, ex))
+        return []
+
+
+def update(db, gir_path_list, max_workers=None):
+    """
+    Bring the documentation database @db (a sqlite3 connection) up to date
+    with the gir files found in @gir_path_list. Changed files are parsed
+    concurrently and their symbols written in batched transactions.
+    """
+    if not HAS_LXML:
+        return  # Can't process the gir files without lxml
+
+    cursor = db.cursor()
+    try:
+        create_tables(cursor)
+        db.commit()
+
+        changed = find_changed_gir_files(cursor, gir_path_list)
+        if not changed:
+            return
+
+        mtimes = dict(changed)
+        pending = []
+
+        def flush():
+            cursor.execute('BEGIN')
+            filenames = [(filename,) for filename, rows in pending]
+            cursor.executemany('DELETE FROM doc WHERE gir_file=?', filenames)
+            cursor.executemany('DELETE FROM girfiles WHERE file=?', filenames)
+            for filename, rows in pending:
+                cursor.executemany('INSERT INTO doc VALUES (?, ?, ?, ?)', rows)
+            cursor.executemany('INSERT INTO girfiles VALUES (?, ?)',
+                               [(filename, mtimes[filename]) for filename, rows in pending])
+            cursor.execute('COMMIT')
+            pending.clear()
+
+        if max_workers is None:
+            max_workers = os.cpu_count() or 1
+
+        with ThreadPoolExecutor(max_workers=max_workers) as executor:
+            filenames = [filename for filename, mtime in changed]
+            for filename, rows in zip(filenames, executor.map(_parse_gir_file_safe, filenames)):
+                pending.append((filename, rows))
+                if len(pending) >= _FILES_PER_TRANSACTION:
+                    flush()
+
+        if pending:
+            flush()
+    finally:
+        cursor.close()
+
+
+def connect(path):
+    "Open the database at @path, configured for fast batched writes"
+    # We manage transactions explicitly
+    db = sqlite3.connect(path, isolation_level=None)
+    db.execute('PRAGMA journal_mode=WAL')
+    db.execute('PRAGMA synchronous=NORMAL')
+    return db
+
+
+def main(argv):
+    if len(argv) < 3:
+        print('usage: {} OUTPUT GIR_DIR...'.format(argv[0]), file=sys.stderr)
+        return 1
+    if not HAS_LXML:
+        print('python3-lxml is required to build the documentation database', file=sys.stderr)
+        return 1
+    db = connect(argv[1])
+    update(db, argv[2:])
+    # Prebuilt databases are copied, so fold the WAL back into the main file
+    db.execute('PRAGMA journal_mode=DELETE')
+    db.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
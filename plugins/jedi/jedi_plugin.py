@@ -21,20 +21,17 @@
 #
 
 import gi
-# lxml is faster than the Python standard library xml, and can ignore invalid
-# characters (which occur in some .gir files).
-# gnome-code-assistance also needs lxml, so I think it's okay to use it here.
-try:
-    import lxml.etree
-    HAS_LXML = True
-except ImportError:
-    HAS_LXML = False
-    print('Warning: python3-lxml is not installed, no documentation will be available in Python auto-completion')
 import os
 import os.path
-import sqlite3
+import shutil
 import threading
 
+import jedi_girdoc
+
+# gnome-code-assistance also needs lxml, so I think it's okay to use it here.
+if not jedi_girdoc.HAS_LXML:
+    print('Warning: python3-lxml is not installed, no documentation will be available in Python auto-completion')
+
 gi.require_version('GIRepository', '2.0')
 gi.require_version('Gtk', '3.0')
 gi.require_version('GtkSource', '3.0')
@@ -231,9 +228,13 @@ def init_gir_path_list():
 init_gir_path_list()
 
 class DocumentationDB(object):
+    # Upper bound on the number of memoized symbol lookups
+    QUERY_CACHE_SIZE = 4096
+
     def __init__(self):
         self.db = None
         self.cursor = None
+        self.query_cache = OrderedDict()
 
     def close(self):
         "Close the DB if open"
@@ -251,70 +252,41 @@ class DocumentationDB(object):
                 os.makedirs(os.path.dirname(doc_db_path))
             except:
                 pass
-            self.db = sqlite3.connect(doc_db_path)
+            # On first run, start from the prebuilt database shipped with the
+            # plugin (if any) so that only files which differ from the build
+            # machine need to be parsed.
+            prebuilt_path = os.path.join(os.path.dirname(__file__), 'girdoc.db')
+            if not os.path.exists(doc_db_path) and os.path.exists(prebuilt_path):
+                try:
+                    shutil.copyfile(prebuilt_path, doc_db_path)
+                except OSError:
+                    pass
+            self.db = jedi_girdoc.connect(doc_db_path)
             self.cursor = self.db.cursor()
             # Create the tables if they don't exist to prevent exceptions later on
-            self.cursor.execute('CREATE TABLE IF NOT EXISTS doc (symbol text, library_version text, doc text, gir_file text)')
-            self.cursor.execute('CREATE TABLE IF NOT EXISTS girfiles (file text, last_modified integer)')
+            jedi_girdoc.create_tables(self.cursor)
 
     def query(self, symbol, version):
-        "Query the documentation DB"
+        "Query the documentation DB, caching the most recently used results"
+        key = (symbol, version)
+        if key in self.query_cache:
+            self.query_cache.move_to_end(key)
+            return self.query_cache[key]
         self.open()
         self.cursor.execute('SELECT doc FROM doc WHERE symbol=? AND library_version=?', (symbol, version))
         result = self.cursor.fetchone()
         if result is not None:
-            return result[0]
-        else:
-            return None
+            result = result[0]
+        self.query_cache[key] = result
+        if len(self.query_cache) > self.QUERY_CACHE_SIZE:
+            self.query_cache.popitem(last=False)
+        return result
 
     def update(self, close_when_done=False):
         "Build the documentation DB and ensure it's up to date"
-        if not HAS_LXML:
-            return  # Can't process the gir files without lxml
-        ns = {'core': 'http://www.gtk.org/introspection/core/1.0',
-              'c': 'http://www.gtk.org/introspection/c/1.0'}
         self.open()
-        cursor = self.cursor
-        processed_gir_files = {}
-
-        # I would use scandir for better performance, but it requires newer Python
-        for gir_path in GIR_PATH_LIST:
-            for gir_file in os.listdir(gir_path):
-                if gir_file in processed_gir_files:
-                    continue
-                processed_gir_files[gir_file] = None
-                filename = os.path.join(gir_path, gir_file)
-                mtime = os.stat(filename).st_mtime
-                cursor.execute('SELECT * from girfiles WHERE file=?', (filename,))
-                result = cursor.fetchone()
-                if result is None:
-                    cursor.execute('INSERT INTO girfiles VALUES (?, ?)', (filename, mtime))
-                else:
-                    if result[1] >= mtime:
-                        continue
-                    else:
-                        # updated
-                        cursor.execute('DELETE FROM doc WHERE gir_file=?', (filename,))
-                        cursor.execute('UPDATE girfiles SET last_modified=? WHERE file=?', (mtime, filename))
-                parser = lxml.etree.XMLParser(recover=True)
-                tree = lxml.etree.parse(filename, parser=parser)
-                namespace = tree.find('core:namespace', namespaces=ns)
-                library_version = namespace.attrib['version']
-                for node in namespace.findall('core:class', namespaces=ns):
-                    doc = node.find('core:doc', namespaces=ns)
-                    if doc is not None:
-                        symbol = node.attrib['{http://www.gtk.org/introspection/glib/1.0}type-name']
-                        cursor.execute("INSERT INTO doc VALUES (?, ?, ?, ?)",
-                                       (symbol, library_version, doc.text, filename))
-                for method in namespace.findall('core:method', namespaces=ns) + \
-                              namespace.findall('core:constructor', namespaces=ns) + \
-                              namespace.findall('core:function', namespaces=ns):
-                    doc = method.find('core:doc', namespaces=ns)
-                    if doc is not None:
-                        symbol = method.attrib['{http://www.gtk.org/introspection/c/1.0}identifier']
-                        cursor.execute("INSERT INTO doc VALUES (?, ?, ?, ?)",
-                                       (symbol, library_version, doc.text, filename))
-        self.db.commit()
+        jedi_girdoc.update(self.db, GIR_PATH_LIST)
+        self.query_cache.clear()
         if close_when_done:
             self.close()
 
@@ -326,6 +298,113 @@ def update_doc_db_on_startup():
 update_doc_db_on_startup()
 
 
+class JediDocument:
+    """
+    Tracks the edits made to a buffer since they were last sent to the
+    worker, so that we only need to ship the full buffer contents when
+    the worker does not yet know about the document.
+    """
+    # If we accumulate more than this many edits, it is cheaper to just
+    # send the whole buffer again.
+    MAX_PENDING_EDITS = 1000
+
+    # Versions are unique across documents, so that two providers tracking
+    # the same file can never be mistaken for each other by the worker.
+    next_version = 0
+
+    def __init__(self, buffer):
+        self.buffer = buffer
+        self.version = 0
+        self.proxy = None
+        self.filename = None
+        self.edits = []
+        self.needs_open = True
+        self.handlers = [buffer.connect('insert-text', self.on_insert_text),
+                         buffer.connect('delete-range', self.on_delete_range)]
+
+    def disconnect(self):
+        for handler in self.handlers:
+            self.buffer.disconnect(handler)
+        self.handlers = []
+
+    def close(self):
+        """
+        Stops tracking the buffer and releases the worker's copy of it.
+        """
+        self.disconnect()
+        self.release()
+
+    def release(self):
+        if self.proxy is not None and self.filename is not None and not self.needs_open:
+            self.proxy.call('CloseDocument',
+                            GLib.Variant('(s)', (self.filename,)),
+                            0, -1, None, None, None)
+        self.invalidate()
+
+    @classmethod
+    def new_version(cls):
+        cls.next_version += 1
+        return cls.next_version
+
+    def push_edit(self, edit):
+        if self.needs_open:
+            return
+        if len(self.edits) >= self.MAX_PENDING_EDITS:
+            self.edits = []
+            self.needs_open = True
+            return
+        self.edits.append(edit)
+
+    def on_insert_text(self, buffer, location, text, length):
+        # Runs before the default handler, so location is pre-insertion
+        line = location.get_line()
+        column = location.get_line_offset()
+        self.push_edit((line, column, line, column, text))
+
+    def on_delete_range(self, buffer, begin, end):
+        self.push_edit((begin.get_line(), begin.get_line_offset(),
+                        end.get_line(), end.get_line_offset(), ''))
+
+    def invalidate(self):
+        self.edits = []
+        self.needs_open = True
+
+    def sync(self, proxy, filename):
+        """
+        Sends whatever is necessary for the worker to have an up to date
+        copy of the buffer and returns the version the worker will have.
+        Messages on the connection are ordered, so the completion request
+        that follows will observe these changes.
+        """
+        if proxy is not self.proxy:
+            # The worker was (re)spawned, it knows nothing about us
+            self.proxy = proxy
+            self.invalidate()
+        elif filename != self.filename:
+            # The buffer was saved under a new name
+            self.release()
+
+        self.filename = filename
+
+        if self.needs_open:
+            begin, end = self.buffer.get_bounds()
+            text = self.buffer.get_text(begin, end, True)
+            self.version = self.new_version()
+            self.edits = []
+            self.needs_open = False
+            proxy.call('OpenDocument',
+                       GLib.Variant('(sus)', (filename, self.version, text)),
+                       0, -1, None, None, None)
+        elif self.edits:
+            edits, self.edits = self.edits, []
+            base_version, self.version = self.version, self.new_version()
+            proxy.call('ApplyEdits',
+                       GLib.Variant('(suua(iiiis))', (filename, base_version, self.version, edits)),
+                       0, -1, None, None, None)
+
+        return self.version
+
+
 class JediCompletionProvider(Ide.Object, GtkSource.CompletionProvider, Ide.CompletionProvider):
     context = None
     current_word = None
@@ -335,6 +414,8 @@ class JediCompletionProvider(Ide.Object, GtkSource.CompletionProvider, Ide.Compl
     line = -1
     line_offset = -1
     loading_proxy = False
+    documents = None
+    unloaded_handler = None
 
     proxy = None
 
@@ -380,15 +461,13 @@ class JediCompletionProvider(Ide.Object, GtkSource.CompletionProvider, Ide.Compl
 
         buffer = iter.get_buffer()
 
-        begin, end = buffer.get_bounds()
         filename = (iter.get_buffer()
                         .get_file()
                         .get_file()
                         .get_path())
 
-        text = buffer.get_text(begin, end, True)
-        line = iter.get_line() + 1
-        column = iter.get_line_offset()
+        document = self.get_document(buffer)
+        version = document.sync(self.proxy, filename)
 
         self.line = iter.get_line()
         self.line_offset = iter.get_line_offset()
@@ -399,7 +478,7 @@ class JediCompletionProvider(Ide.Object, GtkSource.CompletionProvider, Ide.Compl
         context.connect('cancelled', lambda *_: cancellable.cancel())
 
         def async_handler(proxy, result, user_data):
-            (self, results, context) = user_data
+            (self, results, context, retry) = user_data
 
             try:
                 variant = proxy.call_finish(result)
@@ -413,12 +492,44 @@ class JediCompletionProvider(Ide.Object, GtkSource.CompletionProvider, Ide.Compl
                 if isinstance(ex, GLib.Error) and \
                    ex.matches(Gio.io_error_quark(), Gio.IOErrorEnum.CANCELLED):
                     return
+                if retry and isinstance(ex, GLib.Error) and \
+                   ex.matches(Gio.io_error_quark(), Gio.IOErrorEnum.NOT_FOUND):
+                    # The worker lost track of our document (or the versions
+                    # diverged), so send the whole buffer and try again.
+                    document.invalidate()
+                    version = document.sync(proxy, filename)
+                    proxy.call('CodeCompleteDocument',
+                               GLib.Variant('(suii)', (filename, version, self.line, self.line_offset)),
+                               0, 10000, cancellable, async_handler, (self, results, context, False))
+                    return
                 print(repr(ex))
                 context.add_proposals(self, [], True)
 
-        self.proxy.call('CodeComplete',
-                        GLib.Variant('(siis)', (filename, self.line, self.line_offset, text)),
-                        0, 10000, cancellable, async_handler, (self, results, context))
+        self.proxy.call('CodeCompleteDocument',
+                        GLib.Variant('(suii)', (filename, version, self.line, self.line_offset)),
+                        0, 10000, cancellable, async_handler, (self, results, context, True))
+
+    def get_document(self, buffer):
+        """
+        Returns the JediDocument tracking @buffer. Documents are kept until
+        the buffer is unloaded, so switching between buffers only sends the
+        edits made since, rather than the whole buffer again.
+        """
+        if self.documents is None:
+            self.documents = {}
+            buffer_manager = self.get_context().get_buffer_manager()
+            self.unloaded_handler = buffer_manager.connect('buffer-unloaded', self.on_buffer_unloaded)
+
+        document = self.documents.get(buffer)
+        if document is None:
+            document = JediDocument(buffer)
+            self.documents[buffer] = document
+        return document
+
+    def on_buffer_unloaded(self, buffer_manager, buffer):
+        document = self.documents.pop(buffer, None)
+        if document is not None:
+            document.close()
 
     def do_match(self, context):
         if not HAS_JEDI:
@@ -568,7 +679,7 @@ class JediCompletionRequest:
     did_run = False
     cancelled = False
 
-    def __init__(self, invocation, filename, line, column, content):
+    def __init__(self, invocation, filename, line, column, content, documentation_db, cache_key=None, cache=None):
         assert(type(line) == int)
         assert(type(column) == int)
 
@@ -577,6 +688,9 @@ class JediCompletionRequest:
         self.line = line
         self.column = column
         self.content = content
+        self.documentation_db = documentation_db
+        self.cache_key = cache_key
+        self.cache = cache
 
     def run(self):
         try:
@@ -588,12 +702,18 @@ class JediCompletionRequest:
     def _run(self):
         self.did_run = True
 
+        if self.cache is not None and self.cache_key in self.cache:
+            self.invocation.return_value(self.cache[self.cache_key])
+            return
+
         results = []
 
         # Jedi uses 1-based line indexes, we use 0 throughout Builder.
+        # Passing the filename allows jedi to reuse its parser cache for
+        # the module across requests.
         script = jedi.Script(self.content, self.line + 1, self.column, self.filename)
 
-        db = DocumentationDB()
+        db = self.documentation_db
         for info in script.completions():
             if self.cancelled:
                 return
@@ -650,15 +770,42 @@ class JediCompletionRequest:
 
             results.append((_TYPES.get(info.real_type, 0), info.name, info.complete, params, doc))
 
-        db.close()
+        variant = GLib.Variant('(a(issass))', (results,))
+
+        if self.cache is not None:
+            self.cache.clear()
+            self.cache[self.cache_key] = variant
 
-        self.invocation.return_value(GLib.Variant('(a(issass))', (results,)))
+        self.invocation.return_value(variant)
 
     def cancel(self):
         if not self.cancelled and not self.did_run:
             self.cancelled = True
             self.invocation.return_error_literal(Gio.io_error_quark(), Gio.IOErrorEnum.CANCELLED, "Operation was cancelled")
 
+class JediServiceDocument:
+    """
+    The worker side copy of a buffer, kept up to date by applying the
+    incremental edits sent by the UI process.
+    """
+    def __init__(self, version, content):
+        self.version = version
+        self.lines = content.split('\n')
+        self._text = content
+
+    def apply_edit(self, begin_line, begin_column, end_line, end_column, text):
+        prefix = self.lines[begin_line][:begin_column]
+        suffix = self.lines[end_line][end_column:]
+        self.lines[begin_line:end_line + 1] = (prefix + text + suffix).split('\n')
+        self._text = None
+
+    @property
+    def text(self):
+        if self._text is None:
+            self._text = '\n'.join(self.lines)
+        return self._text
+
+
 class JediService(Ide.DBusService):
     queue = None
     handler_id = None
@@ -667,16 +814,62 @@ class JediService(Ide.DBusService):
         super().__init__()
         self.queue = {}
         self.handler_id = 0
+        self.documents = {}
+        self.results_cache = {}
+        # Kept open for the life of the worker so lookups are cached
+        self.documentation_db = DocumentationDB()
 
-    @Ide.DBusMethod('org.gnome.builder.plugins.jedi', in_signature='siis', out_signature='a(issass)', async=True)
-    def CodeComplete(self, invocation, filename, line, column, content):
+    def queue_request(self, filename, request):
         if filename in self.queue:
-            request = self.queue.pop(filename)
-            request.cancel()
-        self.queue[filename] = JediCompletionRequest(invocation, filename, line, column, content)
+            old = self.queue.pop(filename)
+            old.cancel()
+        self.queue[filename] = request
         if not self.handler_id:
             self.handler_id = GLib.timeout_add(5, self.process)
 
+    @Ide.DBusMethod('org.gnome.builder.plugins.jedi', in_signature='siis', out_signature='a(issass)', async=True)
+    def CodeComplete(self, invocation, filename, line, column, content):
+        self.queue_request(filename, JediCompletionRequest(invocation, filename, line, column, content,
+                                                           self.documentation_db))
+
+    @Ide.DBusMethod('org.gnome.builder.plugins.jedi', in_signature='sus', out_signature='b')
+    def OpenDocument(self, filename, version, content):
+        self.documents[filename] = JediServiceDocument(version, content)
+        return True
+
+    @Ide.DBusMethod('org.gnome.builder.plugins.jedi', in_signature='suua(iiiis)', out_signature='b')
+    def ApplyEdits(self, filename, base_version, version, edits):
+        document = self.documents.get(filename)
+        if document is None or document.version != base_version:
+            # We missed something, the next completion will request a resync
+            self.documents.pop(filename, None)
+            return False
+        try:
+            for edit in edits:
+                document.apply_edit(*edit)
+            document.version = version
+        except IndexError:
+            self.documents.pop(filename, None)
+            return False
+        return True
+
+    @Ide.DBusMethod('org.gnome.builder.plugins.jedi', in_signature='s', out_signature='b')
+    def CloseDocument(self, filename):
+        return self.documents.pop(filename, None) is not None
+
+    @Ide.DBusMethod('org.gnome.builder.plugins.jedi', in_signature='suii', out_signature='a(issass)', async=True)
+    def CodeCompleteDocument(self, invocation, filename, version, line, column):
+        document = self.documents.get(filename)
+        if document is None or document.version != version:
+            invocation.return_error_literal(Gio.io_error_quark(), Gio.IOErrorEnum.NOT_FOUND,
+                                            "Document is not up to date")
+            return
+        request = JediCompletionRequest(invocation, filename, line, column, document.text,
+                                        self.documentation_db,
+                                        cache_key=(filename, version, line, column),
+                                        cache=self.results_cache)
+        self.queue_request(filename, request)
+
     def process(self):
         self.handler_id = 0
         while self.queue:
@@ -43,6 +43,9 @@ class MesonBuildSystem(Ide.Object, Ide.BuildSystem, Gio.AsyncInitable):
         task = Gio.Task.new(self, cancel, callback)
         task.set_priority(priority)
 
+        # Build directory → Ide.CompileCommands, shared between builders
+        self._compile_commands = {}
+
         # TODO: Be async here also
         project_file = self.get_context().get_project_file()
         if project_file.get_basename() == 'meson.build':
@@ -57,6 +60,18 @@ class MesonBuildSystem(Ide.Object, Ide.BuildSystem, Gio.AsyncInitable):
     def do_init_finish(self, result):
         return result.propagate_boolean()
 
+    def get_compile_commands(self, build_dir: Gio.File):
+        """
+        Returns an Ide.CompileCommands for @build_dir so compile_commands.json
+        is only parsed once for all builders of the project.
+        """
+        key = build_dir.get_path()
+        commands = self._compile_commands.get(key)
+        if commands is None:
+            commands = Ide.CompileCommands.new()
+            self._compile_commands[key] = commands
+        return commands
+
     def do_get_priority(self):
         return -200 # Lower priority than Autotools for now
 
@@ -165,45 +180,32 @@ class MesonBuilder(Ide.Builder):
         task = Gio.Task.new(self, cancellable, callback)
         task.build_flags = []
 
-        def extract_flags(command: str):
-            flags = GLib.shell_parse_argv(command)[1] # Raises on failure
-            build_dir = self._get_build_dir().get_path()
-            wanted_flags = []
-            for flag in flags:
-                if flag.startswith('-I'):
-                    # All paths are relative to build
-                    abspath = path.normpath(path.join(build_dir, flag[2:]))
-                    wanted_flags.append('-I' + abspath)
-                elif flag.startswith(('-isystem', '-W', '-D')):
-                    wanted_flags.append(flag)
-            return wanted_flags
-
-        def build_flags_thread():
-            commands_file = path.join(self._get_build_dir().get_path(), 'compile_commands.json')
-            try:
-                with open(commands_file) as f:
-                    commands = json.loads(f.read(), encoding='utf-8')
-            except (json.JSONDecodeError, FileNotFoundError, UnicodeDecodeError) as e:
-                task.return_error(GLib.Error('Failed to decode meson json: {}'.format(e)))
-                return
+        build_system = self.get_context().get_build_system()
+        commands = build_system.get_compile_commands(self._get_build_dir())
 
-            infile = ifile.get_path()
-            for c in commands:
-                filepath = path.normpath(path.join(c['directory'], c['file']))
-                if filepath == infile:
-                    try:
-                        task.build_flags = extract_flags(c['command'])
-                    except GLib.Error as e:
-                        task.return_error(e)
-                        return
-                    break
-            else:
+        def lookup_flags():
+            try:
+                task.build_flags = commands.lookup(ifile.get_file())[0]
+            except GLib.Error as e:
+                if not e.matches(Gio.io_error_quark(), Gio.IOErrorEnum.NOT_FOUND):
+                    task.return_error(e)
+                    return
                 print('Meson: Warning: No flags found')
-
             task.return_boolean(True)
 
-        thread = threading.Thread(target=build_flags_thread)
-        thread.start()
+        def load_finish(commands, result):
+            try:
+                commands.load_finish(result)
+            except GLib.Error as e:
+                task.return_error(GLib.Error('Failed to decode meson json: {}'.format(e)))
+                return
+            lookup_flags()
+
+        if commands.get_loaded():
+            lookup_flags()
+        else:
+            commands_file = self._get_build_dir().get_child('compile_commands.json')
+            commands.load_async(commands_file, cancellable, load_finish)
 
     def do_get_build_flags_finish(self, result):
         if result.propagate_boolean():
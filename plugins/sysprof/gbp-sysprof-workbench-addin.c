@@ -16,8 +16,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
+
 #include <glib/gi18n.h>
 #include <sysprof.h>
+#include <unistd.h>
 
 #include "gbp-sysprof-perspective.h"
 #include "gbp-sysprof-workbench-addin.h"
@@ -55,6 +58,110 @@ gbp_sysprof_workbench_addin_update_controls (GbpSysprofWorkbenchAddin *self)
   gtk_widget_set_visible (GTK_WIDGET (self->zoom_controls), visible);
 }
 
+#if defined(IDE_ENABLE_TRACE_RING) && defined(HAVE_SP_CAPTURE_WRITER_ADD_MARK)
+typedef struct
+{
+  SpCaptureWriter *writer;
+  GPid             pid;
+  GArray          *stack;
+} TraceFlush;
+
+static void
+trace_ring_discard_cb (const IdeTraceRecord *records,
+                       guint                 n_records,
+                       gpointer              user_data)
+{
+}
+
+static void
+trace_ring_flush_cb (const IdeTraceRecord *records,
+                     guint                 n_records,
+                     gpointer              user_data)
+{
+  TraceFlush *flush = user_data;
+
+  /* Records arrive one thread at a time, so entries can be paired by stack */
+  g_array_set_size (flush->stack, 0);
+
+  for (guint i = 0; i < n_records; i++)
+    {
+      const IdeTraceRecord *record = &records[i];
+      const gchar *name = ide_trace_ring_get_function_name (record->function_id);
+      g_autofree gchar *message = NULL;
+
+      switch ((IdeTraceEvent)record->event)
+        {
+        case IDE_TRACE_EVENT_ENTRY:
+          g_array_append_val (flush->stack, *record);
+          break;
+
+        case IDE_TRACE_EVENT_EXIT:
+          /*
+           * Unwind to the matching entry. Frames without an exit (such as
+           * those left with IDE_GOTO) are dropped along the way. Exits
+           * whose entry was overwritten in the ring have nothing to match.
+           */
+          for (guint j = flush->stack->len; j > 0; j--)
+            {
+              const IdeTraceRecord *entry = &g_array_index (flush->stack, IdeTraceRecord, j - 1);
+
+              if (entry->function_id == record->function_id)
+                {
+                  message = g_strdup_printf ("thread %u", record->thread_id);
+                  sp_capture_writer_add_mark (flush->writer,
+                                              entry->time,
+                                              -1,
+                                              flush->pid,
+                                              record->time - entry->time,
+                                              "Builder",
+                                              name,
+                                              message);
+                  g_array_set_size (flush->stack, j - 1);
+                  break;
+                }
+            }
+          break;
+
+        case IDE_TRACE_EVENT_PROBE:
+          message = g_strdup_printf ("thread %u, line %u", record->thread_id, record->line);
+          sp_capture_writer_add_mark (flush->writer,
+                                      record->time,
+                                      -1,
+                                      flush->pid,
+                                      0,
+                                      "Builder",
+                                      name,
+                                      message);
+          break;
+
+        default:
+          break;
+        }
+    }
+}
+
+/*
+ * Converts the IDE_ENTRY/IDE_EXIT/IDE_PROBE records gathered while the
+ * profiler was running into marks, so they show up next to the samples.
+ */
+static void
+gbp_sysprof_workbench_addin_flush_trace (SpCaptureWriter *writer)
+{
+  TraceFlush flush;
+
+  g_assert (writer != NULL);
+
+  flush.writer = writer;
+  flush.pid = getpid ();
+  flush.stack = g_array_new (FALSE, FALSE, sizeof (IdeTraceRecord));
+
+  ide_trace_ring_foreach (trace_ring_flush_cb, &flush);
+  sp_capture_writer_flush (writer);
+
+  g_array_unref (flush.stack);
+}
+#endif
+
 static void
 profiler_stopped (GbpSysprofWorkbenchAddin *self,
                   SpProfiler               *profiler)
@@ -75,6 +182,11 @@ profiler_stopped (GbpSysprofWorkbenchAddin *self,
     IDE_EXIT;
 
   writer = sp_profiler_get_writer (profiler);
+
+#if defined(IDE_ENABLE_TRACE_RING) && defined(HAVE_SP_CAPTURE_WRITER_ADD_MARK)
+  gbp_sysprof_workbench_addin_flush_trace (writer);
+#endif
+
   reader = sp_capture_writer_create_reader (writer, &error);
 
   if (reader == NULL)
@@ -120,6 +232,12 @@ profiler_child_spawned (GbpSysprofWorkbenchAddin *self,
   IDE_TRACE_MSG ("Adding pid %s to profiler", identifier);
 
   sp_profiler_add_pid (self->profiler, pid);
+
+#if defined(IDE_ENABLE_TRACE_RING) && defined(HAVE_SP_CAPTURE_WRITER_ADD_MARK)
+  /* Only keep what is traced while the profiler is running */
+  ide_trace_ring_foreach (trace_ring_discard_cb, NULL);
+#endif
+
   sp_profiler_start (self->profiler);
 }
 
@@ -586,7 +586,6 @@ gb_terminal_set_split_view (IdeLayoutView   *view,
 
       self->terminal_bottom = g_object_new (GB_TYPE_TERMINAL,
                                             "audible-bell", FALSE,
-                                            "scrollback-lines", G_MAXUINT,
                                             "expand", TRUE,
                                             "visible", TRUE,
                                             NULL);
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <egg-counter.h>
 #include <glib/gi18n.h>
 #include <ide.h>
 
@@ -25,6 +26,15 @@
 
 #define BUILDER_PCRE2_MULTILINE           0x00000400u
 
+/*
+ * VTE does not tell us how large its scrollback is, so we estimate it from
+ * the number of cells. This is an upper bound for the text and attributes
+ * of a cell, VTE compresses the rows it moves into the scrollback.
+ */
+#define SCROLLBACK_BYTES_PER_CELL 4
+#define MIN_SCROLLBACK_LINES      100
+#define MIN_SCROLLBACK_COLUMNS    80
+
 typedef struct
 {
   GbTerminal *terminal;
@@ -38,6 +48,14 @@ struct _GbTerminal
   GtkWidget   *popup_menu;
 
   gchar       *url;
+
+  GSettings   *settings;
+
+  /* Byte budget for the scrollback, 0 for unlimited */
+  guint        scrollback_limit;
+
+  /* Estimated bytes of scrollback held by this terminal */
+  gint64       scrollback_bytes;
 };
 
 struct _GbTerminalClass
@@ -54,6 +72,16 @@ struct _GbTerminalClass
 
 G_DEFINE_TYPE (GbTerminal, gb_terminal, VTE_TYPE_TERMINAL)
 
+EGG_DEFINE_COUNTER (scrollback_bytes, "Terminal", "Scrollback Bytes",
+                    "Estimated bytes of scrollback kept by all terminals.")
+
+enum {
+  PROP_0,
+  PROP_SCROLLBACK_BYTES,
+  PROP_SCROLLBACK_LIMIT,
+  LAST_PROP
+};
+
 enum {
   COPY_LINK_ADDRESS,
   OPEN_LINK,
@@ -66,6 +94,7 @@ enum {
 #define DINGUS1 "(((gopher|news|telnet|nntp|file|http|ftp|https)://)|(www|ftp)[-A-Za-z0-9]*\\.)[-A-Za-z0-9\\.]+(:[0-9]*)?"
 #define DINGUS2 DINGUS1 "/[-A-Za-z0-9_\\$\\.\\+\\!\\*\\(\\),;:@&=\\?/~\\#\\%]*[^]'\\.}>\\) ,\\\"]"
 
+static GParamSpec *properties [LAST_PROP];
 static guint signals [LAST_SIGNAL];
 static const gchar *url_regexes[] = {
   DINGUS1,
@@ -232,14 +261,157 @@ gb_terminal_open_link (GbTerminal *self)
                        NULL);
 }
 
+static void
+gb_terminal_update_scrollback_bytes (GbTerminal *self)
+{
+  GtkAdjustment *vadj;
+  gint64 rows;
+  gint64 bytes;
+
+  g_assert (GB_IS_TERMINAL (self));
+
+  vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
+
+  if (vadj != NULL)
+    rows = gtk_adjustment_get_upper (vadj) - gtk_adjustment_get_page_size (vadj);
+  else
+    rows = 0;
+
+  bytes = MAX (0, rows) * vte_terminal_get_column_count (VTE_TERMINAL (self)) * SCROLLBACK_BYTES_PER_CELL;
+
+  if (bytes != self->scrollback_bytes)
+    {
+      /* The counter is the sum of the estimates of all terminals */
+      EGG_COUNTER_ADD (scrollback_bytes, bytes - self->scrollback_bytes);
+      self->scrollback_bytes = bytes;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_SCROLLBACK_BYTES]);
+    }
+}
+
+/*
+ * Converts the byte budget into a number of scrollback lines for the
+ * current width. Narrow terminals are treated as MIN_SCROLLBACK_COLUMNS
+ * wide, so that a transiently tiny allocation cannot raise the limit to
+ * millions of lines.
+ */
+static void
+gb_terminal_update_scrollback_lines (GbTerminal *self)
+{
+  glong columns;
+  glong lines;
+
+  g_assert (GB_IS_TERMINAL (self));
+
+  columns = MAX (MIN_SCROLLBACK_COLUMNS, vte_terminal_get_column_count (VTE_TERMINAL (self)));
+
+  if (self->scrollback_limit == 0)
+    lines = -1;
+  else
+    lines = MAX (MIN_SCROLLBACK_LINES,
+                 self->scrollback_limit / (columns * SCROLLBACK_BYTES_PER_CELL));
+
+  if (lines != vte_terminal_get_scrollback_lines (VTE_TERMINAL (self)))
+    vte_terminal_set_scrollback_lines (VTE_TERMINAL (self), lines);
+}
+
+static void
+gb_terminal_size_allocate (GtkWidget     *widget,
+                           GtkAllocation *allocation)
+{
+  GbTerminal *self = (GbTerminal *)widget;
+
+  g_assert (GB_IS_TERMINAL (self));
+
+  GTK_WIDGET_CLASS (gb_terminal_parent_class)->size_allocate (widget, allocation);
+
+  /* The number of lines fitting the budget depends on the columns */
+  gb_terminal_update_scrollback_lines (self);
+  gb_terminal_update_scrollback_bytes (self);
+}
+
+static void
+gb_terminal_set_scrollback_limit (GbTerminal *self,
+                                  guint       scrollback_limit)
+{
+  g_assert (GB_IS_TERMINAL (self));
+
+  if (scrollback_limit != self->scrollback_limit)
+    {
+      self->scrollback_limit = scrollback_limit;
+      gb_terminal_update_scrollback_lines (self);
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_SCROLLBACK_LIMIT]);
+    }
+}
+
+static void
+gb_terminal_finalize (GObject *object)
+{
+  GbTerminal *self = (GbTerminal *)object;
+
+  EGG_COUNTER_SUB (scrollback_bytes, self->scrollback_bytes);
+
+  g_clear_object (&self->settings);
+  g_clear_pointer (&self->url, g_free);
+
+  G_OBJECT_CLASS (gb_terminal_parent_class)->finalize (object);
+}
+
+static void
+gb_terminal_get_property (GObject    *object,
+                          guint       prop_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  GbTerminal *self = GB_TERMINAL (object);
+
+  switch (prop_id)
+    {
+    case PROP_SCROLLBACK_BYTES:
+      g_value_set_int64 (value, self->scrollback_bytes);
+      break;
+
+    case PROP_SCROLLBACK_LIMIT:
+      g_value_set_uint (value, self->scrollback_limit);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gb_terminal_set_property (GObject      *object,
+                          guint         prop_id,
+                          const GValue *value,
+                          GParamSpec   *pspec)
+{
+  GbTerminal *self = GB_TERMINAL (object);
+
+  switch (prop_id)
+    {
+    case PROP_SCROLLBACK_LIMIT:
+      gb_terminal_set_scrollback_limit (self, g_value_get_uint (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 gb_terminal_class_init (GbTerminalClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
   GtkBindingSet *binding_set;
 
+  object_class->finalize = gb_terminal_finalize;
+  object_class->get_property = gb_terminal_get_property;
+  object_class->set_property = gb_terminal_set_property;
+
   widget_class->button_press_event = gb_terminal_button_press_event;
   widget_class->popup_menu = gb_terminal_popup_menu;
+  widget_class->size_allocate = gb_terminal_size_allocate;
 
   klass->copy_link_address = gb_terminal_copy_link_address;
   klass->open_link = gb_terminal_open_link;
@@ -283,6 +455,40 @@ gb_terminal_class_init (GbTerminalClass *klass)
                   1,
                   G_TYPE_BOOLEAN);
 
+  /**
+   * GbTerminal:scrollback-bytes:
+   *
+   * The estimated number of bytes of scrollback held by this terminal.
+   * This is updated as output arrives and when the terminal is resized.
+   */
+  properties [PROP_SCROLLBACK_BYTES] =
+    g_param_spec_int64 ("scrollback-bytes",
+                        "Scrollback Bytes",
+                        "The estimated number of bytes of scrollback",
+                        0,
+                        G_MAXINT64,
+                        0,
+                        (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GbTerminal:scrollback-limit:
+   *
+   * The approximate number of bytes of scrollback to keep, or 0 to keep all
+   * of it. This is converted to a number of scrollback lines based on the
+   * width of the terminal. Resizing the terminal may raise the number of
+   * lines, but never lowers it, so no history is lost on resize.
+   */
+  properties [PROP_SCROLLBACK_LIMIT] =
+    g_param_spec_uint ("scrollback-limit",
+                       "Scrollback Limit",
+                       "The approximate number of bytes of scrollback to keep",
+                       0,
+                       G_MAXUINT,
+                       0,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, LAST_PROP, properties);
+
   binding_set = gtk_binding_set_by_class (klass);
 
   gtk_binding_entry_add_signal (binding_set,
@@ -301,8 +507,27 @@ gb_terminal_class_init (GbTerminalClass *klass)
 static void
 gb_terminal_init (GbTerminal *self)
 {
+  GtkAdjustment *vadj;
+
   egg_widget_action_group_attach (self, "terminal");
 
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (self), -1);
+
+  self->settings = g_settings_new ("org.gnome.builder.terminal");
+  g_settings_bind (self->settings, "scrollback-limit", self, "scrollback-limit", G_SETTINGS_BIND_GET);
+
+  g_signal_connect (self,
+                    "contents-changed",
+                    G_CALLBACK (gb_terminal_update_scrollback_bytes),
+                    NULL);
+
+  if ((vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self))))
+    g_signal_connect_object (vadj,
+                             "changed",
+                             G_CALLBACK (gb_terminal_update_scrollback_bytes),
+                             self,
+                             G_CONNECT_SWAPPED);
+
   for (guint i = 0; url_regexes[i]; i++)
     {
       const gchar *pattern = url_regexes[i];
@@ -0,0 +1,123 @@
+/* gb-todo-item.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "gb-todo-item.h"
+
+struct _GbTodoItem
+{
+  GObject  parent_instance;
+
+  GFile   *file;
+  gchar   *message;
+  guint    line;
+};
+
+G_DEFINE_TYPE (GbTodoItem, gb_todo_item, G_TYPE_OBJECT)
+
+static void
+gb_todo_item_finalize (GObject *object)
+{
+  GbTodoItem *self = (GbTodoItem *)object;
+
+  g_clear_object (&self->file);
+  g_clear_pointer (&self->message, g_free);
+
+  G_OBJECT_CLASS (gb_todo_item_parent_class)->finalize (object);
+}
+
+static void
+gb_todo_item_class_init (GbTodoItemClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gb_todo_item_finalize;
+}
+
+static void
+gb_todo_item_init (GbTodoItem *self)
+{
+}
+
+/**
+ * gb_todo_item_new:
+ * @file: the file containing the item
+ * @line: the line of the item, starting from 1
+ * @message: the line of the item followed by its context lines
+ */
+GbTodoItem *
+gb_todo_item_new (GFile       *file,
+                  guint        line,
+                  const gchar *message)
+{
+  GbTodoItem *self;
+
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (message != NULL, NULL);
+
+  self = g_object_new (GB_TYPE_TODO_ITEM, NULL);
+  self->file = g_object_ref (file);
+  self->line = line;
+  self->message = g_strdup (message);
+
+  return self;
+}
+
+GFile *
+gb_todo_item_get_file (GbTodoItem *self)
+{
+  g_return_val_if_fail (GB_IS_TODO_ITEM (self), NULL);
+
+  return self->file;
+}
+
+guint
+gb_todo_item_get_line (GbTodoItem *self)
+{
+  g_return_val_if_fail (GB_IS_TODO_ITEM (self), 0);
+
+  return self->line;
+}
+
+const gchar *
+gb_todo_item_get_message (GbTodoItem *self)
+{
+  g_return_val_if_fail (GB_IS_TODO_ITEM (self), NULL);
+
+  return self->message;
+}
+
+/**
+ * gb_todo_item_get_shortdesc:
+ *
+ * Returns: (transfer full): the first line of the message, stripped.
+ */
+gchar *
+gb_todo_item_get_shortdesc (GbTodoItem *self)
+{
+  const gchar *endptr;
+
+  g_return_val_if_fail (GB_IS_TODO_ITEM (self), NULL);
+
+  endptr = strchr (self->message, '\n');
+  if (endptr == NULL)
+    endptr = self->message + strlen (self->message);
+
+  return g_strstrip (g_strndup (self->message, endptr - self->message));
+}
@@ -0,0 +1,40 @@
+/* gb-todo-item.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GB_TODO_ITEM_H
+#define GB_TODO_ITEM_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GB_TYPE_TODO_ITEM (gb_todo_item_get_type())
+
+G_DECLARE_FINAL_TYPE (GbTodoItem, gb_todo_item, GB, TODO_ITEM, GObject)
+
+GbTodoItem  *gb_todo_item_new           (GFile       *file,
+                                         guint        line,
+                                         const gchar *message);
+GFile       *gb_todo_item_get_file      (GbTodoItem  *self);
+guint        gb_todo_item_get_line      (GbTodoItem  *self);
+const gchar *gb_todo_item_get_message   (GbTodoItem  *self);
+gchar       *gb_todo_item_get_shortdesc (GbTodoItem  *self);
+
+G_END_DECLS
+
+#endif /* GB_TODO_ITEM_H */
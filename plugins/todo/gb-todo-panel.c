@@ -0,0 +1,300 @@
+/* gb-todo-panel.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <glib/gi18n.h>
+
+#include "gb-todo-item.h"
+#include "gb-todo-panel.h"
+
+struct _GbTodoPanel
+{
+  PnlDockWidget  parent_instance;
+
+  GFile         *workdir;
+  GtkListStore  *model;
+  GtkTreeView   *tree_view;
+};
+
+G_DEFINE_TYPE (GbTodoPanel, gb_todo_panel, PNL_TYPE_DOCK_WIDGET)
+
+static void
+gb_todo_panel_file_data_func (GtkCellLayout   *cell_layout,
+                              GtkCellRenderer *cell,
+                              GtkTreeModel    *model,
+                              GtkTreeIter     *iter,
+                              gpointer         user_data)
+{
+  GbTodoPanel *self = user_data;
+  g_autoptr(GbTodoItem) item = NULL;
+  g_autofree gchar *relative = NULL;
+  g_autofree gchar *text = NULL;
+  GFile *file;
+
+  gtk_tree_model_get (model, iter, 0, &item, -1);
+  file = gb_todo_item_get_file (item);
+
+  if (NULL == (relative = g_file_get_relative_path (self->workdir, file)))
+    relative = g_file_get_path (file);
+
+  text = g_strdup_printf ("%s:%u", relative, gb_todo_item_get_line (item));
+  g_object_set (cell, "text", text, NULL);
+}
+
+static void
+gb_todo_panel_message_data_func (GtkCellLayout   *cell_layout,
+                                 GtkCellRenderer *cell,
+                                 GtkTreeModel    *model,
+                                 GtkTreeIter     *iter,
+                                 gpointer         user_data)
+{
+  g_autoptr(GbTodoItem) item = NULL;
+  g_autofree gchar *shortdesc = NULL;
+
+  gtk_tree_model_get (model, iter, 0, &item, -1);
+  shortdesc = gb_todo_item_get_shortdesc (item);
+  g_object_set (cell, "text", shortdesc, NULL);
+}
+
+static gboolean
+gb_todo_panel_query_tooltip (GbTodoPanel *self,
+                             gint         x,
+                             gint         y,
+                             gboolean     keyboard_mode,
+                             GtkTooltip  *tooltip,
+                             GtkTreeView *tree_view)
+{
+  g_autoptr(GbTodoItem) item = NULL;
+  g_autofree gchar *escaped = NULL;
+  g_autofree gchar *markup = NULL;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+
+  g_assert (GB_IS_TODO_PANEL (self));
+  g_assert (GTK_IS_TREE_VIEW (tree_view));
+
+  if (!gtk_tree_view_get_tooltip_context (tree_view, &x, &y, keyboard_mode, &model, NULL, &iter))
+    return FALSE;
+
+  gtk_tree_model_get (model, &iter, 0, &item, -1);
+  escaped = g_markup_escape_text (gb_todo_item_get_message (item), -1);
+  markup = g_strdup_printf ("<tt>%s</tt>", escaped);
+  gtk_tooltip_set_markup (tooltip, markup);
+
+  return TRUE;
+}
+
+static void
+gb_todo_panel_row_activated (GbTodoPanel       *self,
+                             GtkTreePath       *path,
+                             GtkTreeViewColumn *column,
+                             GtkTreeView       *tree_view)
+{
+  g_autoptr(GbTodoItem) item = NULL;
+  g_autoptr(IdeUri) uri = NULL;
+  g_autofree gchar *fragment = NULL;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  GtkWidget *workbench;
+
+  g_assert (GB_IS_TODO_PANEL (self));
+  g_assert (path != NULL);
+  g_assert (GTK_IS_TREE_VIEW (tree_view));
+
+  model = gtk_tree_view_get_model (tree_view);
+  if (!gtk_tree_model_get_iter (model, &iter, path))
+    return;
+
+  gtk_tree_model_get (model, &iter, 0, &item, -1);
+
+  uri = ide_uri_new_from_file (gb_todo_item_get_file (item));
+  fragment = g_strdup_printf ("L%u", MAX (2, gb_todo_item_get_line (item)) - 1);
+  ide_uri_set_fragment (uri, fragment);
+
+  workbench = gtk_widget_get_ancestor (GTK_WIDGET (self), IDE_TYPE_WORKBENCH);
+  if (workbench != NULL)
+    ide_workbench_open_uri_async (IDE_WORKBENCH (workbench),
+                                  uri,
+                                  "editor",
+                                  IDE_WORKBENCH_OPEN_FLAGS_NONE,
+                                  NULL,
+                                  NULL,
+                                  NULL);
+}
+
+/**
+ * gb_todo_panel_add_items:
+ * @items: (element-type GbTodoItem): the items to add
+ * @prepend: if the items should be placed at the top
+ *
+ * Adds @items to the panel. Prepended items are selected so that they can
+ * be navigated to quickly.
+ */
+void
+gb_todo_panel_add_items (GbTodoPanel *self,
+                         GPtrArray   *items,
+                         gboolean     prepend)
+{
+  GtkTreeIter iter;
+
+  g_return_if_fail (GB_IS_TODO_PANEL (self));
+  g_return_if_fail (items != NULL);
+
+  if (items->len == 0)
+    return;
+
+  for (guint i = 0; i < items->len; i++)
+    {
+      GbTodoItem *item = g_ptr_array_index (items, i);
+
+      if (prepend)
+        gtk_list_store_insert_with_values (self->model, &iter, i, 0, item, -1);
+      else
+        gtk_list_store_insert_with_values (self->model, &iter, -1, 0, item, -1);
+    }
+
+  if (prepend && gtk_tree_model_get_iter_first (GTK_TREE_MODEL (self->model), &iter))
+    {
+      g_autoptr(GtkTreePath) path = NULL;
+
+      gtk_tree_selection_select_iter (gtk_tree_view_get_selection (self->tree_view), &iter);
+      path = gtk_tree_model_get_path (GTK_TREE_MODEL (self->model), &iter);
+      gtk_tree_view_scroll_to_cell (self->tree_view, path, NULL, TRUE, 0.0, 0.0);
+    }
+}
+
+void
+gb_todo_panel_clear_file (GbTodoPanel *self,
+                          GFile       *file)
+{
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  gboolean valid;
+
+  g_return_if_fail (GB_IS_TODO_PANEL (self));
+  g_return_if_fail (G_IS_FILE (file));
+
+  model = GTK_TREE_MODEL (self->model);
+  valid = gtk_tree_model_get_iter_first (model, &iter);
+
+  while (valid)
+    {
+      g_autoptr(GbTodoItem) item = NULL;
+
+      gtk_tree_model_get (model, &iter, 0, &item, -1);
+
+      /* gtk_list_store_remove() advances the iter for us */
+      if (g_file_equal (gb_todo_item_get_file (item), file))
+        valid = gtk_list_store_remove (self->model, &iter);
+      else
+        valid = gtk_tree_model_iter_next (model, &iter);
+    }
+}
+
+static void
+gb_todo_panel_finalize (GObject *object)
+{
+  GbTodoPanel *self = (GbTodoPanel *)object;
+
+  g_clear_object (&self->workdir);
+  g_clear_object (&self->model);
+
+  G_OBJECT_CLASS (gb_todo_panel_parent_class)->finalize (object);
+}
+
+static void
+gb_todo_panel_class_init (GbTodoPanelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gb_todo_panel_finalize;
+}
+
+static void
+gb_todo_panel_init (GbTodoPanel *self)
+{
+  GtkTreeViewColumn *column;
+  GtkCellRenderer *cell;
+  GtkWidget *scroller;
+
+  self->model = gtk_list_store_new (1, GB_TYPE_TODO_ITEM);
+
+  g_object_set (self, "title", _("Todo"), NULL);
+
+  scroller = g_object_new (GTK_TYPE_SCROLLED_WINDOW,
+                           "visible", TRUE,
+                           NULL);
+  gtk_container_add (GTK_CONTAINER (self), scroller);
+
+  self->tree_view = g_object_new (GTK_TYPE_TREE_VIEW,
+                                  "has-tooltip", TRUE,
+                                  "model", self->model,
+                                  "visible", TRUE,
+                                  NULL);
+  g_signal_connect_object (self->tree_view,
+                           "query-tooltip",
+                           G_CALLBACK (gb_todo_panel_query_tooltip),
+                           self,
+                           G_CONNECT_SWAPPED);
+  g_signal_connect_object (self->tree_view,
+                           "row-activated",
+                           G_CALLBACK (gb_todo_panel_row_activated),
+                           self,
+                           G_CONNECT_SWAPPED);
+  gtk_container_add (GTK_CONTAINER (scroller), GTK_WIDGET (self->tree_view));
+
+  column = g_object_new (GTK_TYPE_TREE_VIEW_COLUMN,
+                         "title", _("File"),
+                         NULL);
+  cell = g_object_new (GTK_TYPE_CELL_RENDERER_TEXT,
+                       "xalign", 0.0f,
+                       NULL);
+  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (column), cell, TRUE);
+  gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (column), cell,
+                                      gb_todo_panel_file_data_func,
+                                      self, NULL);
+  gtk_tree_view_append_column (self->tree_view, column);
+
+  column = g_object_new (GTK_TYPE_TREE_VIEW_COLUMN,
+                         "title", _("Message"),
+                         NULL);
+  cell = g_object_new (GTK_TYPE_CELL_RENDERER_TEXT,
+                       "xalign", 0.0f,
+                       NULL);
+  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (column), cell, TRUE);
+  gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (column), cell,
+                                      gb_todo_panel_message_data_func,
+                                      NULL, NULL);
+  gtk_tree_view_append_column (self->tree_view, column);
+}
+
+GtkWidget *
+gb_todo_panel_new (GFile *workdir)
+{
+  GbTodoPanel *self;
+
+  g_return_val_if_fail (G_IS_FILE (workdir), NULL);
+
+  self = g_object_new (GB_TYPE_TODO_PANEL,
+                       "expand", TRUE,
+                       "visible", TRUE,
+                       NULL);
+  self->workdir = g_object_ref (workdir);
+
+  return GTK_WIDGET (self);
+}
@@ -0,0 +1,40 @@
+/* gb-todo-panel.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GB_TODO_PANEL_H
+#define GB_TODO_PANEL_H
+
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+#define GB_TYPE_TODO_PANEL (gb_todo_panel_get_type())
+
+G_DECLARE_FINAL_TYPE (GbTodoPanel, gb_todo_panel, GB, TODO_PANEL, PnlDockWidget)
+
+GtkWidget *gb_todo_panel_new        (GFile       *workdir);
+void       gb_todo_panel_add_items  (GbTodoPanel *self,
+                                     GPtrArray   *items,
+                                     gboolean     prepend);
+void       gb_todo_panel_clear_file (GbTodoPanel *self,
+                                     GFile       *file);
+
+G_END_DECLS
+
+#endif /* GB_TODO_PANEL_H */
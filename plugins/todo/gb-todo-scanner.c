@@ -0,0 +1,845 @@
+/* gb-todo-scanner.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "gb-todo-scanner"
+
+#include <string.h>
+
+#include "gb-todo-item.h"
+#include "gb-todo-scanner.h"
+
+/*
+ * GbTodoScanner finds the TODO:, FIXME: and XXX: markers of a project.
+ *
+ * Directories are walked by a few threads sharing a queue, and VCS ignored
+ * files and directories are skipped before being opened. Files are mapped
+ * and searched for colons with memchr(), only checking for a keyword in
+ * front of each colon.
+ *
+ * The matches of each file are kept in an index, along with the file
+ * modification time, size and a hash of its contents. The index is saved
+ * in the user cache directory, so that mining again, even in a new
+ * session, only rescans the files that changed.
+ */
+
+#define INDEX_VERSION        1
+#define INDEX_TYPE_STRING    "(ua{s(ttta(us))})"
+#define MAX_LINE_LENGTH      1024
+#define CONTEXT_LINES        5
+#define BINARY_PROBE_SIZE    8192
+#define MAX_WORKERS          8
+#define QUERY_ATTRIBUTES     G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+                             G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+                             G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK "," \
+                             G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+struct _GbTodoScanner
+{
+  GObject     parent_instance;
+
+  IdeVcs     *vcs;
+  GFile      *workdir;
+  gchar      *index_path;
+
+  /* The VCS is not guaranteed to be thread-safe */
+  GMutex      vcs_mutex;
+
+  /* Protects the fields below */
+  GMutex      index_mutex;
+  GHashTable *index;
+  guint       generation;
+  guint       index_loaded : 1;
+  guint       index_dirty : 1;
+};
+
+typedef struct
+{
+  guint  line;
+  gchar *message;
+} TodoMatch;
+
+/* The matches array of an entry is never modified once in the index */
+typedef struct
+{
+  guint64  mtime;
+  guint64  size;
+  guint64  hash;
+  guint    generation;
+  GArray  *matches;
+} FileEntry;
+
+typedef struct
+{
+  GbTodoScanner *self;
+  GCancellable  *cancellable;
+  guint          generation;
+
+  GMutex         mutex;
+  GCond          cond;
+  GQueue         directories;
+  guint          busy;
+  GPtrArray     *items;
+} Mine;
+
+static const struct {
+  const gchar *keyword;
+  gsize        len;
+} keywords[] = {
+  { "FIXME", 5 },
+  { "TODO", 4 },
+  { "XXX", 3 },
+};
+
+static const gchar *skip_directories[] = { ".bzr", ".git", ".hg", ".svn", NULL };
+
+G_DEFINE_TYPE (GbTodoScanner, gb_todo_scanner, G_TYPE_OBJECT)
+
+static void
+todo_match_clear (gpointer data)
+{
+  TodoMatch *match = data;
+
+  g_clear_pointer (&match->message, g_free);
+}
+
+static GArray *
+todo_match_array_new (void)
+{
+  GArray *matches;
+
+  matches = g_array_new (FALSE, FALSE, sizeof (TodoMatch));
+  g_array_set_clear_func (matches, todo_match_clear);
+
+  return matches;
+}
+
+static void
+file_entry_free (gpointer data)
+{
+  FileEntry *entry = data;
+
+  g_clear_pointer (&entry->matches, g_array_unref);
+  g_slice_free (FileEntry, entry);
+}
+
+static guint64
+hash_contents (const gchar *data,
+               gsize        len)
+{
+  guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+
+  /* FNV-1a */
+  for (gsize i = 0; i < len; i++)
+    {
+      hash ^= (guchar)data [i];
+      hash *= G_GUINT64_CONSTANT (1099511628211);
+    }
+
+  return hash;
+}
+
+static inline gboolean
+is_keyword_colon (const gchar *begin,
+                  const gchar *colon)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (keywords); i++)
+    {
+      if ((gsize)(colon - begin) >= keywords [i].len &&
+          memcmp (colon - keywords [i].len, keywords [i].keyword, keywords [i].len) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+line_has_keyword (const gchar *line,
+                  const gchar *line_end)
+{
+  const gchar *colon;
+
+  for (const gchar *p = line; NULL != (colon = memchr (p, ':', line_end - p)); p = colon + 1)
+    {
+      if (is_keyword_colon (line, colon))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Every keyword is followed by a colon, so we let memchr() find the colons
+ * and only then check for a keyword in front of them. Each match is
+ * reported with up to CONTEXT_LINES following lines, stopping at the next
+ * match. Like grep -I, files with a NUL byte in their first block are
+ * considered binary and skipped.
+ */
+static void
+scan_contents (const gchar *data,
+               gsize        len,
+               GArray      *matches)
+{
+  const gchar *end = data + len;
+  const gchar *counted = data;
+  const gchar *colon;
+  const gchar *p = data;
+  guint line = 1;
+
+  if (memchr (data, '\0', MIN (len, BINARY_PROBE_SIZE)) != NULL)
+    return;
+
+  while (p < end && NULL != (colon = memchr (p, ':', end - p)))
+    {
+      const gchar *line_start;
+      const gchar *line_end;
+      const gchar *nl;
+      GString *message;
+      TodoMatch match;
+      guint context_lines = 0;
+
+      if (!is_keyword_colon (data, colon))
+        {
+          p = colon + 1;
+          continue;
+        }
+
+      for (line_start = colon; line_start > data && line_start [-1] != '\n'; line_start--)
+        { /* Do nothing */ }
+
+      if (NULL == (line_end = memchr (colon, '\n', end - colon)))
+        line_end = end;
+
+      p = (line_end < end) ? line_end + 1 : end;
+
+      /* Skip long lines, like from SVG files */
+      if (line_end - line_start > MAX_LINE_LENGTH)
+        continue;
+
+      for (; NULL != (nl = memchr (counted, '\n', line_start - counted)); counted = nl + 1)
+        line++;
+
+      message = g_string_new_len (line_start, line_end - line_start);
+
+      for (const gchar *context = p; context < end && context_lines < CONTEXT_LINES; context_lines++)
+        {
+          const gchar *context_end;
+
+          if (NULL == (context_end = memchr (context, '\n', end - context)))
+            context_end = end;
+
+          if (line_has_keyword (context, context_end))
+            break;
+
+          if (context_end - context <= MAX_LINE_LENGTH)
+            {
+              g_string_append_c (message, '\n');
+              g_string_append_len (message, context, context_end - context);
+            }
+
+          context = (context_end < end) ? context_end + 1 : end;
+        }
+
+      if (!g_utf8_validate (message->str, message->len, NULL))
+        {
+          g_string_free (message, TRUE);
+          continue;
+        }
+
+      match.line = line;
+      match.message = g_strchomp (g_string_free (message, FALSE));
+      g_array_append_val (matches, match);
+    }
+}
+
+static void
+gb_todo_scanner_load_index (GbTodoScanner *self)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GVariantIter) iter = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  GVariant *matchesv;
+  const gchar *key;
+  guint64 mtime;
+  guint64 size;
+  guint64 hash;
+  guint version = 0;
+
+  g_assert (GB_IS_TODO_SCANNER (self));
+
+  self->index_loaded = TRUE;
+
+  if (NULL == (mapped = g_mapped_file_new (self->index_path, FALSE, NULL)))
+    return;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (INDEX_TYPE_STRING), bytes, FALSE));
+
+  g_variant_get (variant, INDEX_TYPE_STRING, &version, &iter);
+  if (version != INDEX_VERSION)
+    return;
+
+  while (g_variant_iter_next (iter, "{&s(ttt@a(us))}", &key, &mtime, &size, &hash, &matchesv))
+    {
+      FileEntry *entry;
+      GVariantIter matches_iter;
+      const gchar *message;
+      guint line;
+
+      entry = g_slice_new0 (FileEntry);
+      entry->mtime = mtime;
+      entry->size = size;
+      entry->hash = hash;
+      entry->matches = todo_match_array_new ();
+
+      g_variant_iter_init (&matches_iter, matchesv);
+      while (g_variant_iter_next (&matches_iter, "(u&s)", &line, &message))
+        {
+          TodoMatch match = { line, g_strdup (message) };
+
+          g_array_append_val (entry->matches, match);
+        }
+
+      g_hash_table_insert (self->index, g_strdup (key), entry);
+      g_variant_unref (matchesv);
+    }
+}
+
+static void
+gb_todo_scanner_save_index (GbTodoScanner *self)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *directory = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_assert (GB_IS_TODO_SCANNER (self));
+
+  g_mutex_lock (&self->index_mutex);
+
+  if (!self->index_dirty)
+    {
+      g_mutex_unlock (&self->index_mutex);
+      return;
+    }
+
+  self->index_dirty = FALSE;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(ttta(us))}"));
+
+  g_hash_table_iter_init (&iter, self->index);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      FileEntry *entry = value;
+      GVariantBuilder matches;
+
+      g_variant_builder_init (&matches, G_VARIANT_TYPE ("a(us)"));
+
+      for (guint i = 0; i < entry->matches->len; i++)
+        {
+          const TodoMatch *match = &g_array_index (entry->matches, TodoMatch, i);
+
+          g_variant_builder_add (&matches, "(us)", match->line, match->message);
+        }
+
+      g_variant_builder_add (&builder, "{s(ttta(us))}",
+                             key, entry->mtime, entry->size, entry->hash, &matches);
+    }
+
+  variant = g_variant_ref_sink (g_variant_new ("(u@a{s(ttta(us))})",
+                                               INDEX_VERSION,
+                                               g_variant_builder_end (&builder)));
+
+  g_mutex_unlock (&self->index_mutex);
+
+  directory = g_path_get_dirname (self->index_path);
+  g_mkdir_with_parents (directory, 0750);
+
+  if (!g_file_set_contents (self->index_path,
+                            g_variant_get_data (variant),
+                            g_variant_get_size (variant),
+                            &error))
+    g_warning ("Failed to save todo index: %s", error->message);
+}
+
+static gboolean
+gb_todo_scanner_is_ignored (GbTodoScanner *self,
+                            GFile         *file)
+{
+  gboolean ret;
+
+  g_assert (GB_IS_TODO_SCANNER (self));
+  g_assert (G_IS_FILE (file));
+
+  g_mutex_lock (&self->vcs_mutex);
+  ret = ide_vcs_is_ignored (self->vcs, file, NULL);
+  g_mutex_unlock (&self->vcs_mutex);
+
+  return ret;
+}
+
+static GArray *
+gb_todo_scanner_lookup (GbTodoScanner *self,
+                        const gchar   *key,
+                        guint64        mtime,
+                        guint64        size,
+                        const guint64 *hash,
+                        guint          generation)
+{
+  GArray *matches = NULL;
+  FileEntry *entry;
+
+  g_assert (GB_IS_TODO_SCANNER (self));
+  g_assert (key != NULL);
+
+  g_mutex_lock (&self->index_mutex);
+
+  entry = g_hash_table_lookup (self->index, key);
+
+  if (entry != NULL && entry->size == size &&
+      (hash != NULL ? entry->hash == *hash : entry->mtime == mtime))
+    {
+      if (entry->mtime != mtime)
+        {
+          entry->mtime = mtime;
+          self->index_dirty = TRUE;
+        }
+
+      entry->generation = MAX (entry->generation, generation);
+      matches = g_array_ref (entry->matches);
+    }
+
+  g_mutex_unlock (&self->index_mutex);
+
+  return matches;
+}
+
+static void
+gb_todo_scanner_scan_file (Mine      *mine,
+                           GFile     *file,
+                           GFileInfo *info,
+                           GPtrArray *items)
+{
+  GbTodoScanner *self = mine->self;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GArray) matches = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *key = NULL;
+  const gchar *name;
+  guint64 mtime;
+  guint64 size;
+
+  g_assert (mine != NULL);
+  g_assert (G_IS_FILE (file));
+  g_assert (G_IS_FILE_INFO (info));
+
+  name = g_file_info_get_name (info);
+  if (g_str_has_suffix (name, ".m4") || g_str_has_suffix (name, ".po"))
+    return;
+
+  if (NULL == (path = g_file_get_path (file)))
+    return;
+
+  if (NULL == (key = g_file_get_relative_path (self->workdir, file)))
+    key = g_strdup (path);
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+          g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  size = g_file_info_get_size (info);
+
+  matches = gb_todo_scanner_lookup (self, key, mtime, size, NULL, mine->generation);
+
+  if (matches == NULL)
+    {
+      const gchar *data;
+      gsize len;
+      guint64 hash;
+
+      if (NULL == (mapped = g_mapped_file_new (path, FALSE, NULL)))
+        return;
+
+      data = g_mapped_file_get_contents (mapped);
+      len = g_mapped_file_get_length (mapped);
+      hash = hash_contents (data, len);
+
+      /* Only the modification time changed */
+      matches = gb_todo_scanner_lookup (self, key, mtime, len, &hash, mine->generation);
+
+      if (matches == NULL)
+        {
+          FileEntry *entry;
+
+          matches = todo_match_array_new ();
+          if (len > 0)
+            scan_contents (data, len, matches);
+
+          entry = g_slice_new0 (FileEntry);
+          entry->mtime = mtime;
+          entry->size = len;
+          entry->hash = hash;
+          entry->generation = mine->generation;
+          entry->matches = g_array_ref (matches);
+
+          g_mutex_lock (&self->index_mutex);
+          g_hash_table_insert (self->index, g_steal_pointer (&key), entry);
+          self->index_dirty = TRUE;
+          g_mutex_unlock (&self->index_mutex);
+        }
+    }
+
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const TodoMatch *match = &g_array_index (matches, TodoMatch, i);
+
+      g_ptr_array_add (items, gb_todo_item_new (file, match->line, match->message));
+    }
+}
+
+static void
+gb_todo_scanner_scan_directory (Mine      *mine,
+                                GFile     *directory,
+                                GPtrArray *items)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+
+  g_assert (mine != NULL);
+  g_assert (G_IS_FILE (directory));
+
+  enumerator = g_file_enumerate_children (directory,
+                                          QUERY_ATTRIBUTES,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          mine->cancellable,
+                                          NULL);
+  if (enumerator == NULL)
+    return;
+
+  for (;;)
+    {
+      g_autoptr(GFileInfo) info = NULL;
+      g_autoptr(GFile) child = NULL;
+      const gchar *name;
+      GFileType file_type;
+
+      if (NULL == (info = g_file_enumerator_next_file (enumerator, mine->cancellable, NULL)))
+        break;
+
+      name = g_file_info_get_name (info);
+      file_type = g_file_info_get_file_type (info);
+
+      if (g_file_info_get_is_symlink (info))
+        continue;
+
+      if (file_type == G_FILE_TYPE_DIRECTORY)
+        {
+          if (g_strv_contains (skip_directories, name))
+            continue;
+        }
+      else if (file_type != G_FILE_TYPE_REGULAR)
+        continue;
+
+      child = g_file_get_child (directory, name);
+
+      /* Checked up front, so ignored directories are never walked */
+      if (gb_todo_scanner_is_ignored (mine->self, child))
+        continue;
+
+      if (file_type == G_FILE_TYPE_DIRECTORY)
+        {
+          g_mutex_lock (&mine->mutex);
+          g_queue_push_tail (&mine->directories, g_steal_pointer (&child));
+          g_cond_signal (&mine->cond);
+          g_mutex_unlock (&mine->mutex);
+        }
+      else
+        {
+          gb_todo_scanner_scan_file (mine, child, info, items);
+        }
+    }
+}
+
+static gpointer
+mine_worker (gpointer data)
+{
+  Mine *mine = data;
+  g_autoptr(GPtrArray) items = NULL;
+
+  g_assert (mine != NULL);
+
+  items = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (;;)
+    {
+      g_autoptr(GFile) directory = NULL;
+
+      g_mutex_lock (&mine->mutex);
+      while (mine->directories.length == 0 && mine->busy > 0)
+        g_cond_wait (&mine->cond, &mine->mutex);
+      if (NULL != (directory = g_queue_pop_head (&mine->directories)))
+        mine->busy++;
+      g_mutex_unlock (&mine->mutex);
+
+      /* Nothing queued and nobody left to queue anything */
+      if (directory == NULL)
+        break;
+
+      if (!g_cancellable_is_cancelled (mine->cancellable))
+        gb_todo_scanner_scan_directory (mine, directory, items);
+
+      g_mutex_lock (&mine->mutex);
+      if (--mine->busy == 0 && mine->directories.length == 0)
+        g_cond_broadcast (&mine->cond);
+      g_mutex_unlock (&mine->mutex);
+    }
+
+  g_mutex_lock (&mine->mutex);
+  for (guint i = 0; i < items->len; i++)
+    g_ptr_array_add (mine->items, g_object_ref (g_ptr_array_index (items, i)));
+  g_mutex_unlock (&mine->mutex);
+
+  return NULL;
+}
+
+/*
+ * Drops the index entries of files below @directory that were not seen
+ * by this mine, nor by any mine started after it.
+ */
+static void
+gb_todo_scanner_prune (GbTodoScanner *self,
+                       GFile         *directory,
+                       guint          generation)
+{
+  g_autofree gchar *prefix = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_assert (GB_IS_TODO_SCANNER (self));
+  g_assert (G_IS_FILE (directory));
+
+  if (!g_file_equal (directory, self->workdir))
+    {
+      g_autofree gchar *relative = g_file_get_relative_path (self->workdir, directory);
+
+      if (relative == NULL)
+        return;
+
+      prefix = g_strconcat (relative, G_DIR_SEPARATOR_S, NULL);
+    }
+
+  g_mutex_lock (&self->index_mutex);
+
+  g_hash_table_iter_init (&iter, self->index);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      FileEntry *entry = value;
+
+      if (entry->generation >= generation)
+        continue;
+
+      if (prefix != NULL ? g_str_has_prefix (key, prefix) : !g_path_is_absolute (key))
+        {
+          g_hash_table_iter_remove (&iter);
+          self->index_dirty = TRUE;
+        }
+    }
+
+  g_mutex_unlock (&self->index_mutex);
+}
+
+static void
+gb_todo_scanner_mine_worker (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  GbTodoScanner *self = source_object;
+  GFile *file = task_data;
+  g_autoptr(GFileInfo) info = NULL;
+  g_autoptr(GPtrArray) items = NULL;
+  GError *error = NULL;
+  Mine mine = { 0 };
+
+  g_assert (G_IS_TASK (task));
+  g_assert (GB_IS_TODO_SCANNER (self));
+  g_assert (G_IS_FILE (file));
+
+  info = g_file_query_info (file,
+                            QUERY_ATTRIBUTES,
+                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                            cancellable,
+                            &error);
+
+  if (info == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  items = g_ptr_array_new_with_free_func (g_object_unref);
+
+  mine.self = self;
+  mine.cancellable = cancellable;
+  mine.items = items;
+  g_mutex_init (&mine.mutex);
+  g_cond_init (&mine.cond);
+  g_queue_init (&mine.directories);
+
+  g_mutex_lock (&self->index_mutex);
+  if (!self->index_loaded)
+    gb_todo_scanner_load_index (self);
+  mine.generation = ++self->generation;
+  g_mutex_unlock (&self->index_mutex);
+
+  if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+    {
+      g_autoptr(GPtrArray) threads = g_ptr_array_new ();
+      guint n_workers = CLAMP (g_get_num_processors (), 1, MAX_WORKERS);
+
+      g_queue_push_tail (&mine.directories, g_object_ref (file));
+
+      for (guint i = 1; i < n_workers; i++)
+        g_ptr_array_add (threads, g_thread_new ("[todo] scanner", mine_worker, &mine));
+
+      mine_worker (&mine);
+
+      for (guint i = 0; i < threads->len; i++)
+        g_thread_join (g_ptr_array_index (threads, i));
+
+      if (!g_cancellable_is_cancelled (cancellable))
+        gb_todo_scanner_prune (self, file, mine.generation);
+    }
+  else if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+           !gb_todo_scanner_is_ignored (self, file))
+    {
+      gb_todo_scanner_scan_file (&mine, file, info, items);
+    }
+
+  g_cond_clear (&mine.cond);
+  g_mutex_clear (&mine.mutex);
+
+  gb_todo_scanner_save_index (self);
+
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_pointer (task, g_steal_pointer (&items), (GDestroyNotify)g_ptr_array_unref);
+}
+
+/**
+ * gb_todo_scanner_mine_async:
+ * @self: a #GbTodoScanner
+ * @file: a file or a directory to mine
+ *
+ * Finds the todo items of @file, or of the files below it if it is a
+ * directory. Files unchanged since they were last mined are not read.
+ */
+void
+gb_todo_scanner_mine_async (GbTodoScanner       *self,
+                            GFile               *file,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+
+  g_return_if_fail (GB_IS_TODO_SCANNER (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gb_todo_scanner_mine_async);
+  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
+  g_task_run_in_thread (task, gb_todo_scanner_mine_worker);
+}
+
+/**
+ * gb_todo_scanner_mine_finish:
+ *
+ * Returns: (transfer container) (element-type GbTodoItem): the todo items.
+ */
+GPtrArray *
+gb_todo_scanner_mine_finish (GbTodoScanner  *self,
+                             GAsyncResult   *result,
+                             GError        **error)
+{
+  g_return_val_if_fail (GB_IS_TODO_SCANNER (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+gb_todo_scanner_finalize (GObject *object)
+{
+  GbTodoScanner *self = (GbTodoScanner *)object;
+
+  g_clear_object (&self->vcs);
+  g_clear_object (&self->workdir);
+  g_clear_pointer (&self->index_path, g_free);
+  g_clear_pointer (&self->index, g_hash_table_unref);
+  g_mutex_clear (&self->vcs_mutex);
+  g_mutex_clear (&self->index_mutex);
+
+  G_OBJECT_CLASS (gb_todo_scanner_parent_class)->finalize (object);
+}
+
+static void
+gb_todo_scanner_class_init (GbTodoScannerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gb_todo_scanner_finalize;
+}
+
+static void
+gb_todo_scanner_init (GbTodoScanner *self)
+{
+  g_mutex_init (&self->vcs_mutex);
+  g_mutex_init (&self->index_mutex);
+  self->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, file_entry_free);
+}
+
+GbTodoScanner *
+gb_todo_scanner_new (IdeVcs *vcs)
+{
+  GbTodoScanner *self;
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *name = NULL;
+
+  g_return_val_if_fail (IDE_IS_VCS (vcs), NULL);
+
+  self = g_object_new (GB_TYPE_TODO_SCANNER, NULL);
+  self->vcs = g_object_ref (vcs);
+  self->workdir = g_object_ref (ide_vcs_get_working_directory (vcs));
+
+  /* One index per project directory */
+  path = g_file_get_uri (self->workdir);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, path, -1);
+  name = g_strdup_printf ("%s.index", checksum);
+  self->index_path = g_build_filename (g_get_user_cache_dir (),
+                                       ide_get_program_name (),
+                                       "todo",
+                                       name,
+                                       NULL);
+
+  return self;
+}
@@ -0,0 +1,42 @@
+/* gb-todo-scanner.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GB_TODO_SCANNER_H
+#define GB_TODO_SCANNER_H
+
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+#define GB_TYPE_TODO_SCANNER (gb_todo_scanner_get_type())
+
+G_DECLARE_FINAL_TYPE (GbTodoScanner, gb_todo_scanner, GB, TODO_SCANNER, GObject)
+
+GbTodoScanner *gb_todo_scanner_new         (IdeVcs               *vcs);
+void           gb_todo_scanner_mine_async  (GbTodoScanner        *self,
+                                            GFile                *file,
+                                            GCancellable         *cancellable,
+                                            GAsyncReadyCallback   callback,
+                                            gpointer              user_data);
+GPtrArray     *gb_todo_scanner_mine_finish (GbTodoScanner        *self,
+                                            GAsyncResult         *result,
+                                            GError              **error);
+
+G_END_DECLS
+
+#endif /* GB_TODO_SCANNER_H */
@@ -0,0 +1,221 @@
+/* gb-todo-workbench-addin.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define G_LOG_DOMAIN "gb-todo-workbench-addin"
+
+#include <libpeas/peas.h>
+#include <ide.h>
+
+#include "gb-todo-panel.h"
+#include "gb-todo-scanner.h"
+#include "gb-todo-workbench-addin.h"
+
+struct _GbTodoWorkbenchAddin
+{
+  GObject           parent_instance;
+
+  GtkWidget        *panel;
+  GbTodoScanner    *scanner;
+  GCancellable     *cancellable;
+  IdeBufferManager *buffer_manager;
+  gulong            buffer_saved_handler;
+};
+
+static void workbench_addin_iface_init (IdeWorkbenchAddinInterface *iface);
+
+G_DEFINE_DYNAMIC_TYPE_EXTENDED (GbTodoWorkbenchAddin, gb_todo_workbench_addin, G_TYPE_OBJECT, 0,
+                                G_IMPLEMENT_INTERFACE_DYNAMIC (IDE_TYPE_WORKBENCH_ADDIN,
+                                                               workbench_addin_iface_init))
+
+static void
+gb_todo_workbench_addin_post (GbTodoWorkbenchAddin *self,
+                              GAsyncResult         *result,
+                              gboolean              prepend)
+{
+  g_autoptr(GPtrArray) items = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (GB_IS_TODO_WORKBENCH_ADDIN (self));
+  g_assert (G_IS_ASYNC_RESULT (result));
+
+  if (self->scanner == NULL)
+    return;
+
+  if (NULL == (items = gb_todo_scanner_mine_finish (self->scanner, result, &error)))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s", error->message);
+      return;
+    }
+
+  if (self->panel != NULL)
+    gb_todo_panel_add_items (GB_TODO_PANEL (self->panel), items, prepend);
+}
+
+static void
+gb_todo_workbench_addin_mine_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  g_autoptr(GbTodoWorkbenchAddin) self = user_data;
+
+  gb_todo_workbench_addin_post (self, result, FALSE);
+}
+
+static void
+gb_todo_workbench_addin_mine_file_cb (GObject      *object,
+                                      GAsyncResult *result,
+                                      gpointer      user_data)
+{
+  g_autoptr(GbTodoWorkbenchAddin) self = user_data;
+
+  gb_todo_workbench_addin_post (self, result, TRUE);
+}
+
+static void
+gb_todo_workbench_addin_buffer_saved (GbTodoWorkbenchAddin *self,
+                                      IdeBuffer            *buffer,
+                                      IdeBufferManager     *buffer_manager)
+{
+  GFile *file;
+
+  g_assert (GB_IS_TODO_WORKBENCH_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
+
+  file = ide_file_get_file (ide_buffer_get_file (buffer));
+
+  if (self->panel != NULL)
+    gb_todo_panel_clear_file (GB_TODO_PANEL (self->panel), file);
+
+  /*
+   * Just updated files are placed at the top so that they can be navigated
+   * to quickly. Only this file is read again, the rest of the index stays.
+   */
+  gb_todo_scanner_mine_async (self->scanner,
+                              file,
+                              self->cancellable,
+                              gb_todo_workbench_addin_mine_file_cb,
+                              g_object_ref (self));
+}
+
+static void
+gb_todo_workbench_addin_load (IdeWorkbenchAddin *addin,
+                              IdeWorkbench      *workbench)
+{
+  GbTodoWorkbenchAddin *self = (GbTodoWorkbenchAddin *)addin;
+  IdePerspective *editor;
+  IdeContext *context;
+  IdeVcs *vcs;
+  GtkWidget *pane;
+  GtkWidget *panel;
+  GFile *workdir;
+
+  g_assert (GB_IS_TODO_WORKBENCH_ADDIN (self));
+  g_assert (IDE_IS_WORKBENCH (workbench));
+
+  context = ide_workbench_get_context (workbench);
+  vcs = ide_context_get_vcs (context);
+  workdir = ide_vcs_get_working_directory (vcs);
+
+  editor = ide_workbench_get_perspective_by_name (workbench, "editor");
+
+  g_assert (editor != NULL);
+  g_assert (IDE_IS_LAYOUT (editor));
+
+  pane = pnl_dock_bin_get_bottom_edge (PNL_DOCK_BIN (editor));
+  panel = gb_todo_panel_new (workdir);
+  ide_set_weak_pointer (&self->panel, panel);
+  gtk_container_add (GTK_CONTAINER (pane), panel);
+
+  self->cancellable = g_cancellable_new ();
+  self->scanner = gb_todo_scanner_new (vcs);
+
+  ide_set_weak_pointer (&self->buffer_manager, ide_context_get_buffer_manager (context));
+  self->buffer_saved_handler =
+    g_signal_connect_object (self->buffer_manager,
+                             "buffer-saved",
+                             G_CALLBACK (gb_todo_workbench_addin_buffer_saved),
+                             self,
+                             G_CONNECT_SWAPPED);
+
+  gb_todo_scanner_mine_async (self->scanner,
+                              workdir,
+                              self->cancellable,
+                              gb_todo_workbench_addin_mine_cb,
+                              g_object_ref (self));
+}
+
+static void
+gb_todo_workbench_addin_unload (IdeWorkbenchAddin *addin,
+                                IdeWorkbench      *workbench)
+{
+  GbTodoWorkbenchAddin *self = (GbTodoWorkbenchAddin *)addin;
+
+  g_assert (GB_IS_TODO_WORKBENCH_ADDIN (self));
+  g_assert (IDE_IS_WORKBENCH (workbench));
+
+  if (self->buffer_manager != NULL)
+    {
+      ide_clear_signal_handler (self->buffer_manager, &self->buffer_saved_handler);
+      ide_clear_weak_pointer (&self->buffer_manager);
+    }
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+  g_clear_object (&self->scanner);
+
+  if (self->panel != NULL)
+    {
+      gtk_widget_destroy (self->panel);
+      ide_clear_weak_pointer (&self->panel);
+    }
+}
+
+static void
+workbench_addin_iface_init (IdeWorkbenchAddinInterface *iface)
+{
+  iface->load = gb_todo_workbench_addin_load;
+  iface->unload = gb_todo_workbench_addin_unload;
+}
+
+static void
+gb_todo_workbench_addin_class_init (GbTodoWorkbenchAddinClass *klass)
+{
+}
+
+static void
+gb_todo_workbench_addin_class_finalize (GbTodoWorkbenchAddinClass *klass)
+{
+}
+
+static void
+gb_todo_workbench_addin_init (GbTodoWorkbenchAddin *self)
+{
+}
+
+void
+peas_register_types (PeasObjectModule *module)
+{
+  gb_todo_workbench_addin_register_type (G_TYPE_MODULE (module));
+
+  peas_object_module_register_extension_type (module,
+                                              IDE_TYPE_WORKBENCH_ADDIN,
+                                              GB_TYPE_TODO_WORKBENCH_ADDIN);
+}
@@ -38,6 +38,11 @@ namespace Ide
 		Vala.Parser parser;
 		HashMap<GLib.File,Ide.ValaSourceFile> source_files;
 		Ide.ValaDiagnostics report;
+		bool needs_analyze;
+		bool needs_flow_analysis;
+		/* Held by parse_file() for its long analysis sections */
+		GLib.Mutex analysis_lock = GLib.Mutex ();
+		Ide.ValaCompletionCache? last_completion;
 
 		public ValaIndex (Ide.Context context)
 		{
@@ -302,6 +307,7 @@ namespace Ide
 
 			Ide.ThreadPool.push (Ide.ThreadPoolKind.COMPILER, () => {
 				if ((cancellable == null) || !cancellable.is_cancelled ()) {
+					this.analysis_lock.lock ();
 					lock (this.code_context) {
 						Vala.CodeContext.push (this.code_context);
 
@@ -312,19 +318,26 @@ namespace Ide
 						var source_file = this.source_files[file];
 						source_file.get_mapped_contents ();
 
-						this.apply_unsaved_files (unsaved_files_copy);
-						this.report.clear ();
-						this.reparse ();
-						if (this.report.get_errors () == 0 &&
-						        (cancellable == null || !cancellable.is_cancelled ())) {
-						    this.code_context.check ();
-						}
+						this.update_locked (unsaved_files_copy);
+						this.analyze_locked (cancellable);
 
-						GLib.Idle.add(this.parse_file.callback);
+						Vala.CodeContext.pop ();
+					}
 
+					/*
+					 * Flow analysis covers the whole project, so drop the
+					 * code_context lock first to let the quick requests, such
+					 * as diagnostics and the symbol tree, run in between.
+					 */
+					lock (this.code_context) {
+						Vala.CodeContext.push (this.code_context);
+						this.flow_analyze_locked (cancellable);
 						Vala.CodeContext.pop ();
 					}
+					this.analysis_lock.unlock ();
 				}
+
+				GLib.Idle.add(this.parse_file.callback);
 			});
 
 			yield;
@@ -332,46 +345,73 @@ namespace Ide
 			return true;
 		}
 
-		public Ide.CompletionResults code_complete (GLib.File file,
-		                                            int line,
-		                                            int column,
-		                                            string? line_text,
-		                                            Ide.UnsavedFiles? unsaved_files,
-		                                            Ide.ValaCompletionProvider provider,
-		                                            GLib.Cancellable? cancellable,
-		                                            out int result_line,
-		                                            out int result_column)
+		/*
+		 * Completion never waits for parse_file(). If it is busy analyzing,
+		 * the proposals of the last completion are reused when the cursor is
+		 * still within the same word, and no proposals are returned otherwise.
+		 *
+		 * Else only the files that changed (and their dependents) are reparsed
+		 * and analyzed, and while the file being edited does not parse,
+		 * completion is performed against its last good version. The
+		 * whole-project flow analysis is left to parse_file().
+		 */
+		public async Ide.CompletionResults code_complete (GLib.File file,
+		                                                  int line,
+		                                                  int column,
+		                                                  string? line_text,
+		                                                  Ide.UnsavedFiles? unsaved_files,
+		                                                  Ide.ValaCompletionProvider provider,
+		                                                  GLib.Cancellable? cancellable,
+		                                                  out int result_line,
+		                                                  out int result_column)
 		{
-			var unsaved_files_copy = unsaved_files.to_array ();
+			GLib.GenericArray<UnsavedFile>? unsaved_files_copy = null;
 			var result = new Ide.CompletionResults (provider.query);
+			var res_line = line;
+			var res_column = column;
 
-			if ((cancellable == null) || !cancellable.is_cancelled ()) {
-				lock (this.code_context) {
-					Vala.CodeContext.push (this.code_context);
+			if (unsaved_files != null) {
+				unsaved_files_copy = unsaved_files.to_array ();
+			}
 
-					this.apply_unsaved_files (unsaved_files_copy);
-					this.report.clear ();
-					this.reparse ();
-					if (this.report.get_errors () == 0 &&
-					        (cancellable == null || !cancellable.is_cancelled ())) {
-					    this.code_context.check ();
-					}
+			Ide.ThreadPool.push (Ide.ThreadPoolKind.COMPILER, () => {
+				if ((cancellable == null) || !cancellable.is_cancelled ()) {
+					if (!this.analysis_lock.trylock ()) {
+						if (!this.complete_from_cache (file, line, column, line_text, result, provider, ref res_line, ref res_column)) {
+							res_line = -1;
+							res_column = -1;
+						}
+					} else {
+						lock (this.code_context) {
+							Vala.CodeContext.push (this.code_context);
 
-					if (this.source_files.contains (file)) {
-						var source_file = this.source_files [file];
-						string? text = (line_text == null) ? source_file.get_source_line (line) : line_text;
-						var locator = new Ide.ValaLocator ();
-						var nearest = locator.locate (source_file, line, column);
+							this.update_locked (unsaved_files_copy);
+							this.analyze_locked (cancellable);
 
-						this.add_completions (source_file, ref line, ref column, text, nearest, result, provider);
-					}
+							if (this.source_files.contains (file) &&
+							    (cancellable == null || !cancellable.is_cancelled ())) {
+								var source_file = this.source_files [file];
+								string? text = (line_text == null) ? source_file.get_source_line (line) : line_text;
+								var locator = new Ide.ValaLocator ();
+								var nearest = locator.locate (source_file, line, column);
 
-					Vala.CodeContext.pop ();
+								var symbols = this.add_completions (source_file, ref res_line, ref res_column, text, nearest, result, provider);
+								this.cache_completion (file, res_line, res_column, text, (owned)symbols);
+							}
+
+							Vala.CodeContext.pop ();
+						}
+						this.analysis_lock.unlock ();
+					}
 				}
-			}
 
-			result_line = line;
-			result_column = column;
+				GLib.Idle.add (this.code_complete.callback);
+			});
+
+			yield;
+
+			result_line = res_line;
+			result_column = res_column;
 
 			return result;
 		}
@@ -399,37 +439,166 @@ namespace Ide
 			return diagnostics;
 		}
 
-		void apply_unsaved_files (GLib.GenericArray<Ide.UnsavedFile> unsaved_files)
+		/*
+		 * Brings the code context up to date with @unsaved_files. Only files
+		 * whose contents changed are reparsed, followed by any file which
+		 * mentions a symbol they used to, or now, declare. That repeats until
+		 * no more files are invalidated, since reparsing a dependent replaces
+		 * its symbols too. Each file is reparsed at most once per update.
+		 *
+		 * Content that does not parse is never swapped into the context. The
+		 * last good version of that file is kept instead, and the syntax errors
+		 * are reported as its diagnostics.
+		 *
+		 * Caller is expected to hold code_context lock.
+		 */
+		void update_locked (GLib.GenericArray<Ide.UnsavedFile>? unsaved_files)
 		{
-			foreach (var source_file in this.code_context.get_source_files ()) {
-				if ((source_file.file_type == Vala.SourceFileType.SOURCE) &&
-				    (source_file is Ide.ValaSourceFile)) {
-					(source_file as Ide.ValaSourceFile).sync (unsaved_files);
+			var changed = new HashSet<string> (GLib.str_hash, GLib.str_equal);
+
+			if (unsaved_files != null) {
+				foreach (var source_file in this.source_files.values) {
+					if (source_file.file_type != Vala.SourceFileType.SOURCE)
+						continue;
+
+					var content = source_file.get_changed_content (unsaved_files);
+					if (content == null || !this.parses_cleanly (source_file, content))
+						continue;
+
+					foreach (var name in source_file.provides)
+						changed.add (name);
+
+					source_file.replace_content (content);
+				}
+			}
+
+			this.report.clear ();
+
+			var reparsed = this.reparse ();
+			var visited = new HashSet<Ide.ValaSourceFile> ();
+
+			while (reparsed.size > 0) {
+				foreach (var source_file in reparsed) {
+					visited.add (source_file);
+					foreach (var name in source_file.provides)
+						changed.add (name);
+				}
+
+				foreach (var source_file in this.source_files.values) {
+					if (source_file.file_type == Vala.SourceFileType.SOURCE &&
+					    !visited.contains (source_file) &&
+					    source_file.mentions_any (changed)) {
+						source_file.reset ();
+					}
 				}
+
+				changed.clear ();
+				reparsed = this.reparse ();
 			}
 		}
 
-		void reparse ()
+		/*
+		 * Resolves and analyzes the files reparsed since the last call. The
+		 * symbol resolver skips types that are already resolved, and every
+		 * symbol which was already checked returns early from the semantic
+		 * analyzer, so the work is limited to the changed files and their
+		 * dependents. This is all completion needs.
+		 *
+		 * Caller is expected to hold code_context lock.
+		 */
+		void analyze_locked (GLib.Cancellable? cancellable)
 		{
-			this.report.clear ();
+			if (!this.needs_analyze || this.report.get_errors () > 0)
+				return;
+
+			if (cancellable != null && cancellable.is_cancelled ())
+				return;
+
+			this.code_context.resolver.resolve (this.code_context);
+			this.code_context.analyzer.analyze (this.code_context);
+			this.needs_analyze = false;
+			this.needs_flow_analysis = true;
+		}
+
+		/*
+		 * Flow analysis revisits every method body in the project and only
+		 * produces diagnostics, so it is only run when diagnosing.
+		 *
+		 * Caller is expected to hold code_context lock.
+		 */
+		void flow_analyze_locked (GLib.Cancellable? cancellable)
+		{
+			this.analyze_locked (cancellable);
+
+			if (!this.needs_flow_analysis || this.needs_analyze || this.report.get_errors () > 0)
+				return;
+
+			if (cancellable != null && cancellable.is_cancelled ())
+				return;
+
+			this.code_context.flow_analyzer.analyze (this.code_context);
+			this.needs_flow_analysis = false;
+		}
+
+		/*
+		 * Parses @content into a throwaway context to find out whether it is
+		 * worth replacing the last good version of @source_file.
+		 */
+		bool parses_cleanly (Ide.ValaSourceFile source_file,
+		                     string content)
+		{
+			var scratch_context = new Vala.CodeContext ();
+			var scratch_report = new Ide.ValaDiagnostics ();
+			scratch_context.report = scratch_report;
+
+			Vala.CodeContext.push (scratch_context);
+
+			var scratch_file = new Ide.ValaSourceFile (scratch_context,
+			                                           Vala.SourceFileType.SOURCE,
+			                                           source_file.filename,
+			                                           content,
+			                                           false);
+			scratch_context.add_source_file (scratch_file);
+			new Vala.Parser ().parse (scratch_context);
+
+			Vala.CodeContext.pop ();
+
+			if (scratch_report.get_errors () > 0) {
+				source_file.take_diagnostics (scratch_file);
+				return false;
+			}
+
+			return true;
+		}
+
+		/* Parses every file which has no nodes, returning those it parsed */
+		ArrayList<Ide.ValaSourceFile> reparse ()
+		{
+			var reparsed = new ArrayList<Ide.ValaSourceFile> ();
 
 			foreach (var source_file in this.code_context.get_source_files ()) {
 				if (source_file.get_nodes ().size == 0) {
 					this.parser.visit_source_file (source_file);
+					this.needs_analyze = true;
 					if (source_file is Ide.ValaSourceFile) {
-						(source_file as Ide.ValaSourceFile).dirty = false;
+						var ide_source_file = source_file as Ide.ValaSourceFile;
+						ide_source_file.dirty = false;
+						ide_source_file.update_symbols ();
+						reparsed.add (ide_source_file);
 					}
 				}
 			}
+
+			return reparsed;
 		}
 
-		void add_completions (Ide.ValaSourceFile source_file,
-		                      ref int line,
-		                      ref int column,
-		                      string line_text,
-		                      Vala.Symbol? nearest,
-		                      Ide.CompletionResults results,
-		                      Ide.ValaCompletionProvider provider)
+		GLib.List<Vala.Symbol>? add_completions (Ide.ValaSourceFile source_file,
+		                                         ref int line,
+		                                         ref int column,
+		                                         string line_text,
+		                                         Vala.Symbol? nearest,
+		                                         Ide.CompletionResults results,
+		                                         Ide.ValaCompletionProvider provider)
 		{
 			var block = nearest as Vala.Block;
 			Vala.SourceLocation cursor = Vala.SourceLocation (null, line, column);
@@ -448,6 +617,74 @@ namespace Ide
 
 			line = cursor.line;
 			column = cursor.column;
+
+			return list;
+		}
+
+		void cache_completion (GLib.File file,
+		                       int line,
+		                       int column,
+		                       string? line_text,
+		                       owned GLib.List<Vala.Symbol>? symbols)
+		{
+			Ide.ValaCompletionCache? cache = null;
+
+			if (line_text != null && column > 0 && column - 1 <= line_text.char_count ()) {
+				cache = new Ide.ValaCompletionCache ();
+				cache.file = file;
+				cache.line = line;
+				cache.column = column;
+				cache.prefix = line_text.substring (0, line_text.index_of_nth_char (column - 1));
+				cache.symbols = (owned)symbols;
+			}
+
+			lock (this.last_completion) {
+				this.last_completion = cache;
+			}
+		}
+
+		/*
+		 * Replays the proposals of the last completion if @line_text only
+		 * differs from it by more of the word being completed. This does not
+		 * touch the code context, so it is safe while parse_file() holds it.
+		 */
+		bool complete_from_cache (GLib.File file,
+		                          int line,
+		                          int column,
+		                          string? line_text,
+		                          Ide.CompletionResults results,
+		                          Ide.ValaCompletionProvider provider,
+		                          ref int result_line,
+		                          ref int result_column)
+		{
+			Ide.ValaCompletionCache? cache;
+
+			lock (this.last_completion) {
+				cache = this.last_completion;
+			}
+
+			if (cache == null || line_text == null ||
+			    cache.line != line || column < cache.column ||
+			    !cache.file.equal (file) ||
+			    !line_text.has_prefix (cache.prefix))
+				return false;
+
+			unichar ch;
+			int index = cache.prefix.length;
+			while (line_text.get_next_char (ref index, out ch)) {
+				if (!ch.isalnum () && ch != '_')
+					return false;
+			}
+
+			foreach (var symbol in cache.symbols) {
+				if (symbol.name != null && symbol.name[0] != '\0')
+					results.take_proposal (new Ide.ValaCompletionItem (symbol, provider));
+			}
+
+			result_line = cache.line;
+			result_column = cache.column;
+
+			return true;
 		}
 
 		public async Vala.Symbol? find_symbol_at (GLib.File file, int line, int column)
@@ -551,5 +788,15 @@ namespace Ide
 			return null;
 		}
 	}
+
+	/* The proposals of the last completion, never modified once cached */
+	class ValaCompletionCache: GLib.Object
+	{
+		public GLib.File file;
+		public int line;
+		public int column;
+		public string prefix;
+		public GLib.List<Vala.Symbol> symbols;
+	}
 }
 
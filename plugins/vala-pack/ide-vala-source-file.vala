@@ -47,6 +47,17 @@ namespace Ide
 		ArrayList<Ide.Diagnostic> diagnostics;
 		internal Ide.File file;
 
+		/*
+		 * The names declared by this file and every identifier it mentions.
+		 * Ide.ValaIndex uses these to find which files need to be reparsed
+		 * when the declarations of another file change.
+		 */
+		internal HashSet<string> provides;
+		HashSet<string> identifiers;
+
+		/* The last unsaved content we were handed, parsed or not */
+		string? last_content;
+
 		public ValaSourceFile (Vala.CodeContext context,
 		                       Vala.SourceFileType type,
 		                       string filename,
@@ -57,6 +68,8 @@ namespace Ide
 
 			this.file = new Ide.File (null, GLib.File.new_for_path (filename));
 			this.diagnostics = new ArrayList<Ide.Diagnostic> ();
+			this.provides = new HashSet<string> (GLib.str_hash, GLib.str_equal);
+			this.identifiers = new HashSet<string> (GLib.str_hash, GLib.str_equal);
 
 			this.add_default_namespace ();
 			this.dirty = true;
@@ -99,20 +112,83 @@ namespace Ide
 			this.dirty = true;
 		}
 
-		public void sync (GenericArray<Ide.UnsavedFile> unsaved_files)
+		/*
+		 * Returns the contents of the unsaved buffer for this file if they
+		 * changed since the last call, otherwise null.
+		 */
+		public string? get_changed_content (GenericArray<Ide.UnsavedFile> unsaved_files)
 		{
 			var gfile = this.file.file;
-			unsaved_files.foreach((unsaved_file) => {
+
+			for (var i = 0; i < unsaved_files.length; i++) {
+				var unsaved_file = unsaved_files[i];
+
 				if (unsaved_file.get_file ().equal (gfile)) {
-					var bytes = unsaved_file.get_content ();
+					var content = (string)unsaved_file.get_content ().get_data ();
 
-					if (bytes.get_data () != (uint8[]) this.content) {
-						this.content = (string)bytes.get_data ();
-						this.reset ();
-						return;
-					}
+					if (content == this.last_content)
+						return null;
+
+					this.last_content = content;
+
+					return (content != this.content) ? content : null;
 				}
-			});
+			}
+
+			return null;
+		}
+
+		public void replace_content (string content)
+		{
+			this.content = content;
+			this.reset ();
+		}
+
+		/*
+		 * Replaces our diagnostics with those of @other. This is used to
+		 * surface syntax errors from a scratch parse of content which did
+		 * not make it into the code context.
+		 */
+		public void take_diagnostics (Ide.ValaSourceFile other)
+		{
+			this.diagnostics = other.diagnostics;
+			other.diagnostics = new ArrayList<Ide.Diagnostic> ();
+		}
+
+		/* Must be called after the file has been parsed */
+		public void update_symbols ()
+		{
+			this.provides.clear ();
+			this.accept_children (new DeclarationCollector (this, this.provides));
+
+			this.identifiers.clear ();
+
+			char *data = this.get_mapped_contents ();
+			size_t len = this.get_mapped_length ();
+			ssize_t begin = -1;
+
+			for (size_t i = 0; i <= len; i++) {
+				char ch = (i < len) ? data[i] : '\0';
+
+				if (ch.isalnum () || ch == '_') {
+					if (begin < 0)
+						begin = (ssize_t)i;
+				} else if (begin >= 0) {
+					if (!data[begin].isdigit ())
+						this.identifiers.add (((string)(data + begin)).ndup (i - begin));
+					begin = -1;
+				}
+			}
+		}
+
+		public bool mentions_any (Vala.Set<string> names)
+		{
+			foreach (var name in names) {
+				if (this.identifiers.contains (name))
+					return true;
+			}
+
+			return false;
 		}
 
 		public void report (Vala.SourceReference source_reference,
@@ -142,6 +218,42 @@ namespace Ide
 			return new Ide.Diagnostics (ar);
 		}
 
+		class DeclarationCollector: Vala.CodeVisitor
+		{
+			unowned Vala.SourceFile file;
+			unowned HashSet<string> names;
+
+			public DeclarationCollector (Vala.SourceFile file, HashSet<string> names)
+			{
+				this.file = file;
+				this.names = names;
+			}
+
+			void add (Vala.Symbol symbol)
+			{
+				if (symbol.name != null &&
+				    symbol.source_reference != null &&
+				    symbol.source_reference.file == this.file)
+					this.names.add (symbol.name);
+			}
+
+			public override void visit_namespace (Vala.Namespace ns) { ns.accept_children (this); }
+			public override void visit_class (Vala.Class cl) { add (cl); cl.accept_children (this); }
+			public override void visit_interface (Vala.Interface iface) { add (iface); iface.accept_children (this); }
+			public override void visit_struct (Vala.Struct st) { add (st); st.accept_children (this); }
+			public override void visit_enum (Vala.Enum en) { add (en); en.accept_children (this); }
+			public override void visit_enum_value (Vala.EnumValue ev) { add (ev); }
+			public override void visit_error_domain (Vala.ErrorDomain edomain) { add (edomain); edomain.accept_children (this); }
+			public override void visit_error_code (Vala.ErrorCode ecode) { add (ecode); }
+			public override void visit_delegate (Vala.Delegate d) { add (d); }
+			public override void visit_constant (Vala.Constant c) { add (c); }
+			public override void visit_field (Vala.Field f) { add (f); }
+			public override void visit_method (Vala.Method m) { add (m); }
+			public override void visit_creation_method (Vala.CreationMethod m) { add (m); }
+			public override void visit_property (Vala.Property prop) { add (prop); }
+			public override void visit_signal (Vala.Signal sig) { add (sig); }
+		}
+
 		void add_default_namespace ()
 		{
 			this.current_using_directives = new ArrayList<Vala.UsingDirective> ();
@@ -0,0 +1,503 @@
+/* ide-xml-element-index.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-xml-element-index"
+
+#include <string.h>
+
+#include "ide-xml-element-index.h"
+
+/*
+ * The index keeps the elements of a buffer, from a '<' to the next '>' as
+ * ide_xml_find_next_element() finds them, sorted by offset. Since text
+ * between two elements never contains a '<', an edit only changes the
+ * elements around it: edits shift the offsets of the following elements
+ * and extend a dirty range, which is tokenized again from an idle callback
+ * or before the next lookup.
+ *
+ * Matching elements are then found with one pass in each direction, using
+ * the same rules as ide_xml_find_closing_element() and
+ * ide_xml_find_opening_element(), so lookups are a binary search.
+ */
+
+typedef struct
+{
+  guint                begin;
+  guint                end;
+  GQuark               name;
+  gint                 match;
+  IdeXmlElementTagType type;
+} Element;
+
+struct _IdeXmlElementIndex
+{
+  GtkTextBuffer *buffer;
+  GArray        *elements;
+  guint          dirty_begin;
+  guint          dirty_end;
+  guint          update_source;
+  guint          dirty : 1;
+  guint          needs_match : 1;
+};
+
+#define ELEMENT(self, i) (&g_array_index ((self)->elements, Element, (i)))
+
+/* Index of the first element ending at or after @offset */
+static guint
+find_by_end (IdeXmlElementIndex *self,
+             guint               offset)
+{
+  guint lo = 0;
+  guint hi = self->elements->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (ELEMENT (self, mid)->end < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* Index of the first element beginning after @offset */
+static guint
+find_by_begin (IdeXmlElementIndex *self,
+               guint               offset)
+{
+  guint lo = 0;
+  guint hi = self->elements->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (ELEMENT (self, mid)->begin <= offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static gboolean
+ide_xml_element_index_update_cb (gpointer data)
+{
+  IdeXmlElementIndex *self = data;
+
+  self->update_source = 0;
+  ide_xml_element_index_update (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_xml_element_index_mark_dirty (IdeXmlElementIndex *self,
+                                  guint               begin,
+                                  guint               end)
+{
+  if (self->dirty)
+    {
+      self->dirty_begin = MIN (self->dirty_begin, begin);
+      self->dirty_end = MAX (self->dirty_end, end);
+    }
+  else
+    {
+      self->dirty_begin = begin;
+      self->dirty_end = end;
+      self->dirty = TRUE;
+    }
+
+  if (self->update_source == 0)
+    self->update_source = g_idle_add_full (G_PRIORITY_LOW,
+                                           ide_xml_element_index_update_cb,
+                                           self,
+                                           NULL);
+}
+
+IdeXmlElementIndex *
+ide_xml_element_index_new (GtkTextBuffer *buffer)
+{
+  IdeXmlElementIndex *self;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+  self = g_slice_new0 (IdeXmlElementIndex);
+  self->buffer = buffer;
+  g_object_add_weak_pointer (G_OBJECT (buffer), (gpointer *)&self->buffer);
+  self->elements = g_array_new (FALSE, FALSE, sizeof (Element));
+
+  ide_xml_element_index_mark_dirty (self, 0, gtk_text_buffer_get_char_count (buffer));
+
+  return self;
+}
+
+void
+ide_xml_element_index_free (IdeXmlElementIndex *self)
+{
+  if (self == NULL)
+    return;
+
+  if (self->update_source != 0)
+    g_source_remove (self->update_source);
+
+  if (self->buffer != NULL)
+    g_object_remove_weak_pointer (G_OBJECT (self->buffer), (gpointer *)&self->buffer);
+
+  g_array_unref (self->elements);
+  g_slice_free (IdeXmlElementIndex, self);
+}
+
+/**
+ * ide_xml_element_index_insert:
+ *
+ * Must be called before @n_chars characters are inserted at @offset.
+ */
+void
+ide_xml_element_index_insert (IdeXmlElementIndex *self,
+                              guint               offset,
+                              guint               n_chars)
+{
+  g_return_if_fail (self != NULL);
+
+  if (n_chars == 0)
+    return;
+
+  for (guint i = find_by_end (self, offset); i < self->elements->len; i++)
+    {
+      Element *element = ELEMENT (self, i);
+
+      if (element->begin >= offset)
+        element->begin += n_chars;
+      element->end += n_chars;
+    }
+
+  if (self->dirty)
+    {
+      if (self->dirty_begin >= offset)
+        self->dirty_begin += n_chars;
+      if (self->dirty_end >= offset)
+        self->dirty_end += n_chars;
+    }
+
+  ide_xml_element_index_mark_dirty (self, offset, offset + n_chars);
+}
+
+static inline guint
+map_deleted (guint offset,
+             guint begin,
+             guint end)
+{
+  if (offset < begin)
+    return offset;
+  else if (offset >= end)
+    return offset - (end - begin);
+  else
+    return begin;
+}
+
+/**
+ * ide_xml_element_index_delete:
+ *
+ * Must be called before the characters between @begin and @end are deleted.
+ */
+void
+ide_xml_element_index_delete (IdeXmlElementIndex *self,
+                              guint               begin,
+                              guint               end)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (begin <= end);
+
+  if (begin == end)
+    return;
+
+  for (guint i = find_by_end (self, begin); i < self->elements->len; i++)
+    {
+      Element *element = ELEMENT (self, i);
+
+      element->begin = map_deleted (element->begin, begin, end);
+      element->end = map_deleted (element->end, begin, end);
+    }
+
+  if (self->dirty)
+    {
+      self->dirty_begin = map_deleted (self->dirty_begin, begin, end);
+      self->dirty_end = map_deleted (self->dirty_end, begin, end);
+    }
+
+  ide_xml_element_index_mark_dirty (self, begin, begin);
+}
+
+/* Same as ide_xml_get_element_tag_type() and ide_xml_get_element_name() */
+static void
+parse_element (const gchar *lt,
+               const gchar *gt,
+               Element     *element)
+{
+  g_autofree gchar *str = NULL;
+  const gchar *name;
+  const gchar *name_end;
+  gchar start_ch = lt[1];
+  gchar end_ch = gt[-1];
+
+  if (end_ch == '/' ||
+      (end_ch == '?' && start_ch == '?') ||
+      (end_ch == '-' && start_ch == '!'))
+    element->type = IDE_XML_ELEMENT_TAG_START_END;
+  else if (start_ch == '/')
+    element->type = IDE_XML_ELEMENT_TAG_END;
+  else
+    element->type = IDE_XML_ELEMENT_TAG_START;
+
+  name = lt;
+  while (*name == '<' || *name == '/')
+    name++;
+
+  /* Comments and elements starting with ? do not have a name */
+  if (name >= gt || *name == '!' || *name == '?')
+    return;
+
+  for (name_end = g_utf8_next_char (name); name_end < gt; name_end = g_utf8_next_char (name_end))
+    {
+      if (g_unichar_isspace (g_utf8_get_char (name_end)) || *name_end == '/')
+        break;
+    }
+
+  str = g_strndup (name, name_end - name);
+  element->name = g_quark_from_string (str);
+}
+
+static void
+tokenize (const gchar *text,
+          guint        offset,
+          GArray      *elements)
+{
+  const gchar *iter = text;
+  const gchar *lt;
+  const gchar *gt;
+
+  while ((lt = strchr (iter, '<')) && (gt = strchr (lt, '>')))
+    {
+      Element element = { 0 };
+
+      element.begin = offset + g_utf8_strlen (iter, lt - iter);
+      element.end = element.begin + g_utf8_strlen (lt, gt - lt);
+      element.match = -1;
+      parse_element (lt, gt, &element);
+
+      g_array_append_val (elements, element);
+
+      iter = gt + 1;
+      offset = element.end + 1;
+    }
+}
+
+static void
+ide_xml_element_index_rescan (IdeXmlElementIndex *self)
+{
+  g_autoptr(GArray) elements = NULL;
+  g_autofree gchar *text = NULL;
+  GtkTextIter begin;
+  GtkTextIter end;
+  guint n_chars;
+  guint lo;
+  guint hi;
+  guint p;
+  guint stop;
+
+  self->dirty = FALSE;
+  self->needs_match = TRUE;
+
+  if (self->buffer == NULL)
+    {
+      g_array_set_size (self->elements, 0);
+      return;
+    }
+
+  n_chars = gtk_text_buffer_get_char_count (self->buffer);
+
+  /*
+   * Tokenize from the end of the last element before the dirty range up to
+   * the end of the first element after it. Whatever the edits, tokens are
+   * aligned again after that element since it ends with the first '>'
+   * following its '<'.
+   */
+  lo = find_by_end (self, self->dirty_begin);
+  hi = find_by_begin (self, self->dirty_end);
+
+  p = lo > 0 ? ELEMENT (self, lo - 1)->end + 1 : 0;
+
+  if (hi < self->elements->len)
+    stop = ELEMENT (self, hi++)->end + 1;
+  else
+    stop = n_chars;
+
+  stop = MIN (stop, n_chars);
+  p = MIN (p, stop);
+
+  gtk_text_buffer_get_iter_at_offset (self->buffer, &begin, p);
+  gtk_text_buffer_get_iter_at_offset (self->buffer, &end, stop);
+  text = gtk_text_iter_get_slice (&begin, &end);
+
+  elements = g_array_new (FALSE, FALSE, sizeof (Element));
+  tokenize (text, p, elements);
+
+  g_array_remove_range (self->elements, lo, hi - lo);
+  g_array_insert_vals (self->elements, lo, elements->data, elements->len);
+}
+
+static void
+ide_xml_element_index_match (IdeXmlElementIndex *self)
+{
+  g_autoptr(GArray) stack = NULL;
+  guint len = self->elements->len;
+
+  self->needs_match = FALSE;
+
+  stack = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (guint i = 0; i < len; i++)
+    ELEMENT (self, i)->match = -1;
+
+  /*
+   * Start elements, like ide_xml_find_closing_element(). An unbalanced end
+   * element stops the search of every element still open.
+   */
+  for (guint i = 0; i < len; i++)
+    {
+      Element *element = ELEMENT (self, i);
+
+      if (element->name == 0)
+        continue;
+
+      if (element->type == IDE_XML_ELEMENT_TAG_START)
+        {
+          g_array_append_val (stack, i);
+        }
+      else if (element->type == IDE_XML_ELEMENT_TAG_END && stack->len > 0)
+        {
+          Element *open = ELEMENT (self, g_array_index (stack, guint, stack->len - 1));
+
+          if (open->name == element->name)
+            {
+              open->match = i;
+              g_array_set_size (stack, stack->len - 1);
+            }
+          else
+            g_array_set_size (stack, 0);
+        }
+    }
+
+  g_array_set_size (stack, 0);
+
+  /* End elements, like ide_xml_find_opening_element() */
+  for (guint i = len; i > 0; i--)
+    {
+      Element *element = ELEMENT (self, i - 1);
+
+      if (element->name == 0)
+        continue;
+
+      if (element->type == IDE_XML_ELEMENT_TAG_END)
+        {
+          guint pos = i - 1;
+
+          g_array_append_val (stack, pos);
+        }
+      else if (element->type == IDE_XML_ELEMENT_TAG_START && stack->len > 0)
+        {
+          Element *close = ELEMENT (self, g_array_index (stack, guint, stack->len - 1));
+
+          if (close->name == element->name)
+            {
+              close->match = i - 1;
+              g_array_set_size (stack, stack->len - 1);
+            }
+          else
+            g_array_set_size (stack, 0);
+        }
+    }
+}
+
+/**
+ * ide_xml_element_index_update:
+ *
+ * Brings the index up to date with the buffer. This happens on its own
+ * from an idle callback after edits, and before lookups.
+ */
+void
+ide_xml_element_index_update (IdeXmlElementIndex *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->dirty)
+    ide_xml_element_index_rescan (self);
+
+  if (self->needs_match)
+    ide_xml_element_index_match (self);
+}
+
+/**
+ * ide_xml_element_index_lookup:
+ * @begin: (out): the offset of the '<' of the element
+ * @end: (out): the offset of the '>' of the element
+ * @match_begin: (out): the offset of the '<' of the matching element, or -1
+ * @match_end: (out): the offset of the '>' of the matching element, or -1
+ *
+ * Finds the element containing @offset, and the element it matches.
+ *
+ * Returns: the type of the element, or %IDE_XML_ELEMENT_TAG_UNKNOWN if
+ *   @offset is not within an element.
+ */
+IdeXmlElementTagType
+ide_xml_element_index_lookup (IdeXmlElementIndex *self,
+                              guint               offset,
+                              guint              *begin,
+                              guint              *end,
+                              gint               *match_begin,
+                              gint               *match_end)
+{
+  const Element *element;
+  guint pos;
+
+  g_return_val_if_fail (self != NULL, IDE_XML_ELEMENT_TAG_UNKNOWN);
+  g_return_val_if_fail (begin != NULL, IDE_XML_ELEMENT_TAG_UNKNOWN);
+  g_return_val_if_fail (end != NULL, IDE_XML_ELEMENT_TAG_UNKNOWN);
+  g_return_val_if_fail (match_begin != NULL, IDE_XML_ELEMENT_TAG_UNKNOWN);
+  g_return_val_if_fail (match_end != NULL, IDE_XML_ELEMENT_TAG_UNKNOWN);
+
+  ide_xml_element_index_update (self);
+
+  pos = find_by_begin (self, offset);
+  if (pos == 0 || ELEMENT (self, pos - 1)->end < offset)
+    return IDE_XML_ELEMENT_TAG_UNKNOWN;
+
+  element = ELEMENT (self, pos - 1);
+
+  *begin = element->begin;
+  *end = element->end;
+  *match_begin = element->match >= 0 ? (gint)ELEMENT (self, element->match)->begin : -1;
+  *match_end = element->match >= 0 ? (gint)ELEMENT (self, element->match)->end : -1;
+
+  return element->type;
+}
@@ -0,0 +1,48 @@
+/* ide-xml-element-index.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_XML_ELEMENT_INDEX_H
+#define IDE_XML_ELEMENT_INDEX_H
+
+#include <gtk/gtk.h>
+
+#include "ide-xml.h"
+
+G_BEGIN_DECLS
+
+typedef struct _IdeXmlElementIndex IdeXmlElementIndex;
+
+IdeXmlElementIndex   *ide_xml_element_index_new    (GtkTextBuffer      *buffer);
+void                  ide_xml_element_index_free   (IdeXmlElementIndex *self);
+void                  ide_xml_element_index_insert (IdeXmlElementIndex *self,
+                                                    guint               offset,
+                                                    guint               n_chars);
+void                  ide_xml_element_index_delete (IdeXmlElementIndex *self,
+                                                    guint               begin,
+                                                    guint               end);
+void                  ide_xml_element_index_update (IdeXmlElementIndex *self);
+IdeXmlElementTagType  ide_xml_element_index_lookup (IdeXmlElementIndex *self,
+                                                    guint               offset,
+                                                    guint              *begin,
+                                                    guint              *end,
+                                                    gint               *match_begin,
+                                                    gint               *match_end);
+
+G_END_DECLS
+
+#endif /* IDE_XML_ELEMENT_INDEX_H */
@@ -19,6 +19,7 @@
 #include <egg-signal-group.h>
 #include <glib/gi18n.h>
 
+#include "ide-xml-element-index.h"
 #include "ide-xml-highlighter.h"
 #include "ide-xml.h"
 
@@ -33,6 +34,10 @@ struct _IdeXmlHighlighter
   GtkTextMark        *iter_mark;
   IdeHighlightEngine *engine;
   GtkTextBuffer      *buffer;
+  IdeXmlElementIndex *index;
+
+  /* Bounds of the tagged elements, so that only they are cleared */
+  GtkTextMark        *tag_marks[4];
   guint               highlight_timeout;
   guint               has_tags : 1;
 };
@@ -46,14 +51,39 @@ G_DEFINE_DYNAMIC_TYPE_EXTENDED (IdeXmlHighlighter,
                                 G_IMPLEMENT_INTERFACE (IDE_TYPE_HIGHLIGHTER,
                                                        highlighter_iface_init))
 
+static void
+ide_xml_highlighter_tag_element (IdeXmlHighlighter *self,
+                                 GtkTextTag        *tag,
+                                 guint              n,
+                                 guint              begin,
+                                 guint              end)
+{
+  GtkTextIter start_iter;
+  GtkTextIter end_iter;
+
+  /*
+   * Offsets point to the < char and the > char. In our case we want to
+   * highlight everything that is between those two chars.
+   */
+  gtk_text_buffer_get_iter_at_offset (self->buffer, &start_iter, begin + 1);
+  gtk_text_buffer_get_iter_at_offset (self->buffer, &end_iter, end);
+  gtk_text_buffer_apply_tag (self->buffer, tag, &start_iter, &end_iter);
+
+  gtk_text_buffer_move_mark (self->buffer, self->tag_marks [n * 2], &start_iter);
+  gtk_text_buffer_move_mark (self->buffer, self->tag_marks [n * 2 + 1], &end_iter);
+}
+
 static gboolean
 ide_xml_highlighter_highlight_timeout_handler (gpointer data)
 {
   IdeXmlHighlighter *self = data;
+  IdeXmlElementTagType tag_type;
   GtkTextTag *tag;
   GtkTextIter iter;
-  GtkTextIter start;
-  GtkTextIter end;
+  guint begin;
+  guint end;
+  gint match_begin;
+  gint match_end;
 
   g_assert (IDE_IS_XML_HIGHLIGHTER (self));
   g_assert (self->buffer != NULL);
@@ -64,62 +94,39 @@ ide_xml_highlighter_highlight_timeout_handler (gpointer data)
 
   tag = ide_highlight_engine_get_style (self->engine, XML_TAG_MATCH_STYLE_NAME);
 
-  /*
-   * Clear previous tags. We could save the previous
-   * iters and clear only those locations but for
-   * now this should be ok.
-   */
+  /* Clear previous tags */
   if (self->has_tags)
     {
-      gtk_text_buffer_get_bounds (self->buffer, &start, &end);
-      gtk_text_buffer_remove_tag (self->buffer, tag, &start, &end);
+      for (guint i = 0; i < G_N_ELEMENTS (self->tag_marks); i += 2)
+        {
+          GtkTextIter start;
+          GtkTextIter stop;
+
+          gtk_text_buffer_get_iter_at_mark (self->buffer, &start, self->tag_marks [i]);
+          gtk_text_buffer_get_iter_at_mark (self->buffer, &stop, self->tag_marks [i + 1]);
+          gtk_text_buffer_remove_tag (self->buffer, tag, &start, &stop);
+        }
 
       self->has_tags = FALSE;
     }
 
-
   gtk_text_buffer_get_iter_at_mark (self->buffer, &iter, self->iter_mark);
-  if (ide_xml_in_element (&iter) && ide_xml_get_current_element (&iter,
-                                                                 &start,
-                                                                 &end))
-    {
-      GtkTextIter next_start;
-      GtkTextIter next_end;
-      IdeXmlElementTagType tag_type = ide_xml_get_element_tag_type (&start,
-                                                                    &end);
-
-      if ((tag_type == IDE_XML_ELEMENT_TAG_START &&
-          ide_xml_find_closing_element (&start,&end,
-                                      &next_start,&next_end)) ||
-          (tag_type == IDE_XML_ELEMENT_TAG_END &&
-          ide_xml_find_opening_element (&start,&end,
-                                      &next_start,&next_end)) ||
-          tag_type == IDE_XML_ELEMENT_TAG_START_END)
-        {
+  tag_type = ide_xml_element_index_lookup (self->index,
+                                           gtk_text_iter_get_offset (&iter),
+                                           &begin, &end,
+                                           &match_begin, &match_end);
 
-          /*
-           * All iters point to the begining of < char and the
-           * beginning of > char.In our case we want to highlight everything that is
-           * between those two chars.This is the reason we move one char forward
-           * from the start iter
-           */
-          gtk_text_iter_forward_char (&start);
-          gtk_text_buffer_apply_tag (GTK_TEXT_BUFFER (self->buffer),
-                                     tag,
-                                     &start,
-                                     &end);
-
-          if (tag_type != IDE_XML_ELEMENT_TAG_START_END)
-            {
-              gtk_text_iter_forward_char (&next_start);
-              gtk_text_buffer_apply_tag (GTK_TEXT_BUFFER (self->buffer),
-                                         tag,
-                                         &next_start,
-                                         &next_end);
-            }
-
-          self->has_tags = TRUE;
-        }
+  if (tag_type == IDE_XML_ELEMENT_TAG_START_END)
+    {
+      ide_xml_highlighter_tag_element (self, tag, 0, begin, end);
+      self->has_tags = TRUE;
+    }
+  else if ((tag_type == IDE_XML_ELEMENT_TAG_START || tag_type == IDE_XML_ELEMENT_TAG_END) &&
+           match_begin >= 0)
+    {
+      ide_xml_highlighter_tag_element (self, tag, 0, begin, end);
+      ide_xml_highlighter_tag_element (self, tag, 1, match_begin, match_end);
+      self->has_tags = TRUE;
     }
 
 cleanup:
@@ -128,6 +135,37 @@ cleanup:
   return G_SOURCE_REMOVE;
 }
 
+static void
+ide_xml_highlighter_insert_text_cb (IdeXmlHighlighter *self,
+                                    GtkTextIter       *location,
+                                    const gchar       *text,
+                                    gint               len,
+                                    GtkTextBuffer     *buffer)
+{
+  g_assert (IDE_IS_XML_HIGHLIGHTER (self));
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+
+  if (self->index != NULL)
+    ide_xml_element_index_insert (self->index,
+                                  gtk_text_iter_get_offset (location),
+                                  g_utf8_strlen (text, len));
+}
+
+static void
+ide_xml_highlighter_delete_range_cb (IdeXmlHighlighter *self,
+                                     GtkTextIter       *begin,
+                                     GtkTextIter       *end,
+                                     GtkTextBuffer     *buffer)
+{
+  g_assert (IDE_IS_XML_HIGHLIGHTER (self));
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+
+  if (self->index != NULL)
+    ide_xml_element_index_delete (self->index,
+                                  gtk_text_iter_get_offset (begin),
+                                  gtk_text_iter_get_offset (end));
+}
+
 static void
 ide_xml_highlighter_bind_buffer_cb (IdeXmlHighlighter  *self,
                                     IdeBuffer          *buffer,
@@ -143,6 +181,11 @@ ide_xml_highlighter_bind_buffer_cb (IdeXmlHighlighter  *self,
 
   gtk_text_buffer_get_start_iter (self->buffer, &begin);
   self->iter_mark = gtk_text_buffer_create_mark (self->buffer, NULL, &begin, TRUE);
+
+  for (guint i = 0; i < G_N_ELEMENTS (self->tag_marks); i++)
+    self->tag_marks [i] = gtk_text_buffer_create_mark (self->buffer, NULL, &begin, (i % 2) == 0);
+
+  self->index = ide_xml_element_index_new (self->buffer);
 }
 
 static void
@@ -162,6 +205,16 @@ ide_xml_highlighter_unbind_buffer_cb (IdeXmlHighlighter  *self,
   gtk_text_buffer_delete_mark (self->buffer, self->iter_mark);
   self->iter_mark = NULL;
 
+  for (guint i = 0; i < G_N_ELEMENTS (self->tag_marks); i++)
+    {
+      gtk_text_buffer_delete_mark (self->buffer, self->tag_marks [i]);
+      self->tag_marks [i] = NULL;
+    }
+
+  g_clear_pointer (&self->index, ide_xml_element_index_free);
+
+  self->has_tags = FALSE;
+
   ide_clear_weak_pointer (&self->buffer);
 }
 
@@ -276,6 +329,16 @@ ide_xml_highlighter_init (IdeXmlHighlighter *self)
                                    G_CALLBACK (ide_xml_highlighter_cursor_moved_cb),
                                    self,
                                    0);
+  egg_signal_group_connect_object (self->signal_group,
+                                   "insert-text",
+                                   G_CALLBACK (ide_xml_highlighter_insert_text_cb),
+                                   self,
+                                   G_CONNECT_SWAPPED);
+  egg_signal_group_connect_object (self->signal_group,
+                                   "delete-range",
+                                   G_CALLBACK (ide_xml_highlighter_delete_range_cb),
+                                   self,
+                                   G_CONNECT_SWAPPED);
 
   g_signal_connect_object (self->signal_group,
                            "bind",
@@ -90,6 +90,7 @@ main (int   argc,
   int ret;
 
   ide_log_init (TRUE, NULL);
+  ide_log_set_async (TRUE);
 
   early_verbose_check (&argc, &argv);
 
@@ -0,0 +1,243 @@
+/* test-editorconfig-cache.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that EditorconfigGlibCache gives the same settings as
+ * editorconfig_parse(), including after an .editorconfig changes.
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "editorconfig-glib.h"
+
+static const struct {
+  const gchar *path;
+  const gchar *contents;
+} files[] = {
+  { ".editorconfig",
+    "root = true\n"
+    "[*]\n"
+    "Indent_Style = SPACE\n"
+    "indent_size = 4\n"
+    "Charset = UTF-8\n"
+    "[*.{c,h}]\n"
+    "indent_size = 2\n"
+    "trim_trailing_whitespace = TRUE\n"
+    "[Makefile]\n"
+    "indent_style = Tab\n"
+    "[file{1..3}.txt]\n"
+    "max_line_length = 80\n"
+    "[[abc].md]\n"
+    "end_of_line = CRLF\n"
+    "[*.c]\n"
+    "insert_final_newline = true\n" },
+  { "src/.editorconfig",
+    "[lib/**.c]\n"
+    "indent_size = 8\n"
+    "tab_width = 8\n"
+    "[/main.c]\n"
+    "indent_style = tab\n"
+    "[**/deep/*]\n"
+    "Custom_Key = Some Value\n" },
+  { "src/lib/.editorconfig",
+    "[*.h]\n"
+    "indent_size = tab\n" },
+  { "other/.editorconfig",
+    "root = true\n"
+    "[*.c]\n"
+    "indent_style = tab\n" },
+  { "other/nested/.editorconfig",
+    "[*]\n"
+    "max_line_length = 100\n" },
+};
+
+static const gchar *paths[] = {
+  "foo.c",
+  "foo.h",
+  "foo.py",
+  "Makefile",
+  "file1.txt",
+  "file3.txt",
+  "file4.txt",
+  "a.md",
+  "d.md",
+  "src/main.c",
+  "src/main.h",
+  "src/Makefile",
+  "src/lib/util.c",
+  "src/lib/util.h",
+  "src/lib/sub/util.c",
+  "src/deep/x.txt",
+  "src/a/deep/y.txt",
+  "other/foo.c",
+  "other/foo.h",
+  "other/nested/foo.c",
+  "other/nested/deep/bar.py",
+  "missing/dir/foo.c",
+};
+
+static void
+write_file (const gchar *root,
+            const gchar *path,
+            const gchar *contents)
+{
+  g_autofree gchar *filename = g_build_filename (root, path, NULL);
+  g_autofree gchar *dir = g_path_get_dirname (filename);
+  g_autoptr(GError) error = NULL;
+
+  g_mkdir_with_parents (dir, 0750);
+  g_file_set_contents (filename, contents, -1, &error);
+  g_assert_no_error (error);
+}
+
+static gboolean
+tables_equal (GHashTable *a,
+              GHashTable *b)
+{
+  GHashTableIter iter;
+  gpointer k, v;
+
+  if (g_hash_table_size (a) != g_hash_table_size (b))
+    return FALSE;
+
+  g_hash_table_iter_init (&iter, a);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      const GValue *va = v;
+      const GValue *vb = g_hash_table_lookup (b, k);
+
+      if (vb == NULL || G_VALUE_TYPE (va) != G_VALUE_TYPE (vb))
+        return FALSE;
+
+      if (G_VALUE_HOLDS_INT (va) && g_value_get_int (va) != g_value_get_int (vb))
+        return FALSE;
+
+      if (G_VALUE_HOLDS_BOOLEAN (va) && g_value_get_boolean (va) != g_value_get_boolean (vb))
+        return FALSE;
+
+      if (G_VALUE_HOLDS_STRING (va) && g_strcmp0 (g_value_get_string (va), g_value_get_string (vb)) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+check_paths (EditorconfigGlibCache *cache,
+             const gchar           *root)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (paths); i++)
+    {
+      g_autofree gchar *filename = g_build_filename (root, paths [i], NULL);
+      g_autoptr(GFile) file = g_file_new_for_path (filename);
+      g_autoptr(GHashTable) expected = NULL;
+      g_autoptr(GHashTable) cached = NULL;
+      g_autoptr(GError) error = NULL;
+
+      expected = editorconfig_glib_read (file, NULL, &error);
+      g_assert_no_error (error);
+      g_assert (expected != NULL);
+
+      cached = editorconfig_glib_cache_read (cache, file, NULL, &error);
+      g_assert_no_error (error);
+      g_assert (cached != NULL);
+
+      if (!tables_equal (expected, cached))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  gboolean *timed_out = user_data;
+
+  *timed_out = TRUE;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+remove_tree (const gchar *root)
+{
+  for (guint i = G_N_ELEMENTS (files); i > 0; i--)
+    {
+      g_autofree gchar *filename = g_build_filename (root, files [i - 1].path, NULL);
+      g_autofree gchar *dir = g_path_get_dirname (filename);
+
+      g_unlink (filename);
+
+      while (g_strcmp0 (dir, root) != 0 && g_rmdir (dir) == 0)
+        {
+          gchar *parent = g_path_get_dirname (dir);
+
+          g_free (dir);
+          dir = parent;
+        }
+    }
+
+  g_rmdir (root);
+}
+
+static void
+test_editorconfig_cache (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *root = NULL;
+  EditorconfigGlibCache *cache;
+  gboolean timed_out = FALSE;
+  guint timeout_id;
+
+  root = g_dir_make_tmp ("test-editorconfig-cache-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  for (guint i = 0; i < G_N_ELEMENTS (files); i++)
+    write_file (root, files [i].path, files [i].contents);
+
+  cache = editorconfig_glib_cache_new ();
+
+  /* The second round is answered from the cache */
+  g_assert_true (check_paths (cache, root));
+  g_assert_true (check_paths (cache, root));
+
+  /* Drop the root of the subtree, the settings above must now apply */
+  write_file (root, "other/.editorconfig", "[*.c]\nindent_size = 3\n");
+
+  timeout_id = g_timeout_add_seconds (10, timeout_cb, &timed_out);
+  while (!timed_out && !check_paths (cache, root))
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_false (timed_out);
+  g_source_remove (timeout_id);
+
+  editorconfig_glib_cache_unref (cache);
+
+  remove_tree (root);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Editorconfig/Cache/equivalence", test_editorconfig_cache);
+  return g_test_run ();
+}
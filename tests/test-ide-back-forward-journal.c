@@ -0,0 +1,195 @@
+/* test-ide-back-forward-journal.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "history/ide-back-forward-journal.h"
+
+static const gchar *legacy_contents =
+  "file:///home/christian/Projects/foo/foo.c#L30_1\n"
+  "12 4 file:///home/christian/Projects/foo/foo.h\n"
+  "file:///home/christian/Projects/%20spaces/foo#L120_43\n"
+  "file:///home/christian/Projects/foo/foo.c#L2000_0\n"
+  "file:///home/christian/Projects/foo/README\n";
+
+/* The legacy file is newest first, the journal is oldest first */
+static const gchar *legacy_entries[] = {
+  "file:///home/christian/Projects/foo/README",
+  "file:///home/christian/Projects/foo/foo.c#L2000_0",
+  "file:///home/christian/Projects/%20spaces/foo#L120_43",
+  "file:///home/christian/Projects/foo/foo.h#L12_4",
+  "file:///home/christian/Projects/foo/foo.c#L30_1",
+};
+
+static const gchar *appended_entries[] = {
+  "file:///home/christian/Projects/foo/foo.c#L31_7",
+  "file:///home/christian/Projects/foo/bar.c#custom",
+  "file:///home/christian/Projects/foo/foo.c#L1_0",
+};
+
+static void
+assert_entries (IdeBackForwardJournal *journal,
+                const gchar          **first,
+                guint                  n_first,
+                const gchar          **second,
+                guint                  n_second)
+{
+  GPtrArray *entries = _ide_back_forward_journal_get_entries (journal);
+  guint i;
+
+  g_assert_cmpint (entries->len, ==, n_first + n_second);
+
+  for (i = 0; i < n_first; i++)
+    g_assert_cmpstr (g_ptr_array_index (entries, i), ==, first [i]);
+
+  for (i = 0; i < n_second; i++)
+    g_assert_cmpstr (g_ptr_array_index (entries, n_first + i), ==, second [i]);
+}
+
+static GPtrArray *
+make_uris (const gchar **first,
+           guint         n_first,
+           const gchar **second,
+           guint         n_second)
+{
+  GPtrArray *ret = g_ptr_array_new_with_free_func (g_free);
+  guint i;
+
+  for (i = 0; i < n_first; i++)
+    g_ptr_array_add (ret, g_strdup (first [i]));
+
+  for (i = 0; i < n_second; i++)
+    g_ptr_array_add (ret, g_strdup (second [i]));
+
+  return ret;
+}
+
+static IdeBackForwardJournal *
+load (GFile *file)
+{
+  IdeBackForwardJournal *journal = _ide_back_forward_journal_new ();
+  g_autoptr(GError) error = NULL;
+
+  _ide_back_forward_journal_load (journal, file, &error);
+  g_assert_no_error (error);
+
+  return journal;
+}
+
+static void
+test_journal (void)
+{
+  g_autoptr(IdeBackForwardJournal) journal = NULL;
+  g_autoptr(GPtrArray) uris = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autofree gchar *dir = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *contents = NULL;
+  gsize length = 0;
+  gsize appended_length = 0;
+
+  dir = g_dir_make_tmp ("test-ide-back-forward-journal-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  path = g_build_filename (dir, "project.back-forward-list", NULL);
+  file = g_file_new_for_path (path);
+
+  /* A missing journal is reported as such */
+  journal = _ide_back_forward_journal_new ();
+  g_assert (!_ide_back_forward_journal_load (journal, file, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_clear_error (&error);
+  g_clear_pointer (&journal, _ide_back_forward_journal_unref);
+
+  /* The text format is still readable */
+  g_file_set_contents (path, legacy_contents, -1, &error);
+  g_assert_no_error (error);
+
+  journal = load (file);
+  g_assert (_ide_back_forward_journal_is_legacy (journal));
+  assert_entries (journal, legacy_entries, G_N_ELEMENTS (legacy_entries), NULL, 0);
+  g_clear_pointer (&journal, _ide_back_forward_journal_unref);
+
+  /* And converts to the same items */
+  g_assert (_ide_back_forward_journal_convert (file, NULL, &error));
+  g_assert_no_error (error);
+
+  journal = load (file);
+  g_assert (!_ide_back_forward_journal_is_legacy (journal));
+  assert_entries (journal, legacy_entries, G_N_ELEMENTS (legacy_entries), NULL, 0);
+
+  g_file_get_contents (path, &contents, &length, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (length, <, strlen (legacy_contents));
+  g_clear_pointer (&contents, g_free);
+
+  /* Saving again only appends the new items */
+  uris = make_uris (legacy_entries, G_N_ELEMENTS (legacy_entries),
+                    appended_entries, G_N_ELEMENTS (appended_entries));
+  g_assert (_ide_back_forward_journal_save (journal, file, uris, G_N_ELEMENTS (legacy_entries), NULL, &error));
+  g_assert_no_error (error);
+
+  g_file_get_contents (path, &contents, &appended_length, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (appended_length, >, length);
+  g_clear_pointer (&contents, g_free);
+  g_clear_pointer (&journal, _ide_back_forward_journal_unref);
+
+  journal = load (file);
+  assert_entries (journal,
+                  legacy_entries, G_N_ELEMENTS (legacy_entries),
+                  appended_entries, G_N_ELEMENTS (appended_entries));
+  g_clear_pointer (&journal, _ide_back_forward_journal_unref);
+
+  /* A torn record at the end is ignored */
+  g_file_get_contents (path, &contents, &length, &error);
+  g_assert_no_error (error);
+  g_file_set_contents (path, contents, length - 1, &error);
+  g_assert_no_error (error);
+  g_clear_pointer (&contents, g_free);
+
+  journal = load (file);
+  assert_entries (journal,
+                  legacy_entries, G_N_ELEMENTS (legacy_entries),
+                  appended_entries, G_N_ELEMENTS (appended_entries) - 1);
+
+  /* And the next save rewrites the journal with exactly what we have */
+  g_assert (_ide_back_forward_journal_save (journal, file, uris, uris->len - 1, NULL, &error));
+  g_assert_no_error (error);
+  g_clear_pointer (&journal, _ide_back_forward_journal_unref);
+
+  journal = load (file);
+  assert_entries (journal,
+                  legacy_entries, G_N_ELEMENTS (legacy_entries),
+                  appended_entries, G_N_ELEMENTS (appended_entries));
+
+  g_unlink (path);
+  g_rmdir (dir);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/BackForwardJournal/basic", test_journal);
+  return g_test_run ();
+}
@@ -0,0 +1,785 @@
+/* test-ide-benchmark.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Opens an IdeContext on a project and times the hot paths that are
+ * exercised when a project is first loaded:
+ *
+ *   - context initialization
+ *   - listing the files of the project
+ *   - search queries (p50/p99)
+ *   - build flags lookups for every source file
+ *   - loading a ctags index
+ *
+ * Without --project, a synthetic project is generated in a temporary
+ * directory. Its size is controlled with --files and --dirs. The results
+ * are printed (or written with --json) as JSON so they can be compared
+ * between runs. When --baseline is given, the test fails if a phase got
+ * slower than the baseline by more than --tolerance.
+ *
+ * This runs headless, so it is part of `make check`. There, the baseline
+ * comes from IDE_BENCHMARK_BASELINE, which points to data/benchmark-baseline.json.
+ * It holds generous ceilings for the default synthetic project rather than
+ * measured results, so that only gross regressions fail on slow machines.
+ */
+
+#include <ide.h>
+#include <json-glib/json-glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "application/ide-application-tests.h"
+
+#define SEARCH_TIMEOUT_MSEC 5000
+#define DEFAULT_N_FILES     200
+#define DEFAULT_N_DIRS      10
+#define DEFAULT_N_QUERIES   50
+
+static gchar    *project_path;
+static gchar    *json_path;
+static gchar    *baseline_path;
+static gdouble   tolerance = 2.0;
+static gint      n_files = DEFAULT_N_FILES;
+static gint      n_dirs = DEFAULT_N_DIRS;
+static gint      n_queries = DEFAULT_N_QUERIES;
+static gboolean  keep;
+static gchar    *synthetic_path;
+
+typedef struct
+{
+  GTask           *task;
+  IdeContext      *context;
+  GFile           *project_file;
+  GPtrArray       *files;
+  JsonBuilder     *builder;
+
+  /* Used by the search and build flags phases */
+  GArray          *samples;
+  guint            index;
+  guint            n_failed;
+  gint64           begin;
+  gint64           phase_begin;
+  guint            timeout_id;
+  IdeSearchContext *search;
+} Benchmark;
+
+static void benchmark_search_next      (Benchmark *bench);
+static void benchmark_build_flags_next (Benchmark *bench);
+static void benchmark_ctags            (Benchmark *bench);
+
+static void
+benchmark_free (gpointer data)
+{
+  Benchmark *bench = data;
+
+  g_clear_object (&bench->context);
+  g_clear_object (&bench->project_file);
+  g_clear_object (&bench->builder);
+  g_clear_object (&bench->search);
+  g_clear_pointer (&bench->files, g_ptr_array_unref);
+  g_clear_pointer (&bench->samples, g_array_unref);
+  g_slice_free (Benchmark, bench);
+}
+
+static gint
+compare_gint64 (gconstpointer a,
+                gconstpointer b)
+{
+  const gint64 *ia = a;
+  const gint64 *ib = b;
+
+  return (*ia > *ib) - (*ia < *ib);
+}
+
+static gint64
+percentile (GArray  *samples,
+            gdouble  pct)
+{
+  if (samples->len == 0)
+    return 0;
+
+  return g_array_index (samples, gint64, MIN (samples->len - 1, (guint)(samples->len * pct)));
+}
+
+static void
+add_samples (JsonBuilder *builder,
+             GArray      *samples)
+{
+  gint64 total = 0;
+
+  g_array_sort (samples, compare_gint64);
+
+  for (guint i = 0; i < samples->len; i++)
+    total += g_array_index (samples, gint64, i);
+
+  json_builder_set_member_name (builder, "total_usec");
+  json_builder_add_int_value (builder, total);
+  json_builder_set_member_name (builder, "p50_usec");
+  json_builder_add_int_value (builder, percentile (samples, .50));
+  json_builder_set_member_name (builder, "p99_usec");
+  json_builder_add_int_value (builder, percentile (samples, .99));
+  json_builder_set_member_name (builder, "max_usec");
+  json_builder_add_int_value (builder, percentile (samples, 1.0));
+}
+
+/*
+ * Synthetic project generation
+ */
+
+static void
+write_file (GFile       *dir,
+            const gchar *name,
+            const gchar *contents)
+{
+  g_autoptr(GFile) file = g_file_get_child (dir, name);
+  g_autofree gchar *path = g_file_get_path (file);
+  g_autoptr(GError) error = NULL;
+
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+}
+
+static gint
+compare_lines (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+static GFile *
+generate_project (void)
+{
+  g_autoptr(GPtrArray) tags = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(GString) commands = g_string_new ("[\n");
+  g_autoptr(GString) tags_file = g_string_new (NULL);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *root_path = NULL;
+  GFile *root;
+
+  root_path = g_dir_make_tmp ("builder-benchmark-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  root = g_file_new_for_path (root_path);
+  synthetic_path = g_strdup (root_path);
+
+  write_file (root, "README", "A synthetic project generated by test-ide-benchmark.\n");
+
+  for (gint d = 0; d < n_dirs; d++)
+    {
+      g_autofree gchar *dir_name = g_strdup_printf ("module%03d", d);
+      g_autoptr(GFile) dir = g_file_get_child (root, dir_name);
+
+      g_file_make_directory (dir, NULL, &error);
+      g_assert_no_error (error);
+
+      for (gint f = d; f < n_files; f += n_dirs)
+        {
+          g_autofree gchar *c_name = g_strdup_printf ("source%05d.c", f);
+          g_autofree gchar *h_name = g_strdup_printf ("source%05d.h", f);
+          g_autofree gchar *c_path = g_build_filename (root_path, dir_name, c_name, NULL);
+          g_autofree gchar *contents = NULL;
+          g_autofree gchar *header = NULL;
+
+          header = g_strdup_printf ("int module%03d_function%05d (int value);\n", d, f);
+          contents = g_strdup_printf ("#include \"%s\"\n"
+                                      "\n"
+                                      "int\n"
+                                      "module%03d_function%05d (int value)\n"
+                                      "{\n"
+                                      "  return value * %d;\n"
+                                      "}\n",
+                                      h_name, d, f, f);
+
+          write_file (dir, h_name, header);
+          write_file (dir, c_name, contents);
+
+          g_string_append_printf (commands,
+                                  "%s  { \"directory\": \"%s\", \"file\": \"%s\", "
+                                  "\"command\": \"cc -I%s/%s -DMODULE=%d -c %s\" }",
+                                  commands->len > 2 ? ",\n" : "",
+                                  root_path, c_path, root_path, dir_name, d, c_path);
+
+          g_ptr_array_add (tags,
+                           g_strdup_printf ("module%03d_function%05d\t%s/%s\t"
+                                            "/^module%03d_function%05d (int value)$/;\"\tf\n",
+                                            d, f, dir_name, c_name, d, f));
+        }
+    }
+
+  g_string_append (commands, "\n]\n");
+  write_file (root, "compile_commands.json", commands->str);
+
+  g_ptr_array_sort (tags, compare_lines);
+  g_string_append (tags_file, "!_TAG_FILE_FORMAT\t2\t/extended format/\n");
+  g_string_append (tags_file, "!_TAG_FILE_SORTED\t1\t/0=unsorted, 1=sorted, 2=foldcase/\n");
+  for (guint i = 0; i < tags->len; i++)
+    g_string_append (tags_file, g_ptr_array_index (tags, i));
+  write_file (root, "tags", tags_file->str);
+
+  return root;
+}
+
+static void
+remove_recursive (GFile *file)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  GFileInfo *info;
+
+  enumerator = g_file_enumerate_children (file,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          NULL, NULL);
+
+  while (enumerator != NULL &&
+         NULL != (info = g_file_enumerator_next_file (enumerator, NULL, NULL)))
+    {
+      g_autoptr(GFile) child = g_file_get_child (file, g_file_info_get_name (info));
+
+      remove_recursive (child);
+      g_object_unref (info);
+    }
+
+  g_file_delete (file, NULL, NULL);
+}
+
+/*
+ * Phases
+ */
+
+static void
+benchmark_begin_phase (Benchmark   *bench,
+                       const gchar *name)
+{
+  json_builder_set_member_name (bench->builder, name);
+  json_builder_begin_object (bench->builder);
+  bench->phase_begin = g_get_monotonic_time ();
+}
+
+static void
+benchmark_end_phase (Benchmark *bench)
+{
+  json_builder_set_member_name (bench->builder, "usec");
+  json_builder_add_int_value (bench->builder, g_get_monotonic_time () - bench->phase_begin);
+  json_builder_end_object (bench->builder);
+}
+
+static void
+benchmark_complete (Benchmark *bench)
+{
+  g_autoptr(JsonGenerator) generator = NULL;
+  g_autoptr(JsonNode) root = NULL;
+  g_autofree gchar *json = NULL;
+
+  json_builder_end_object (bench->builder);
+  json_builder_end_object (bench->builder);
+
+  root = json_builder_get_root (bench->builder);
+  generator = json_generator_new ();
+  json_generator_set_pretty (generator, TRUE);
+  json_generator_set_root (generator, root);
+  json = json_generator_to_data (generator, NULL);
+
+  if (json_path != NULL)
+    {
+      g_autoptr(GError) error = NULL;
+
+      g_file_set_contents (json_path, json, -1, &error);
+      g_assert_no_error (error);
+    }
+  else
+    {
+      g_printerr ("%s\n", json);
+    }
+
+  if (baseline_path != NULL)
+    {
+      g_autoptr(JsonParser) parser = json_parser_new ();
+      g_autoptr(GError) error = NULL;
+      JsonObject *base_phases;
+      JsonObject *phases;
+      GList *members;
+
+      json_parser_load_from_file (parser, baseline_path, &error);
+      g_assert_no_error (error);
+
+      base_phases = json_object_get_object_member (json_node_get_object (json_parser_get_root (parser)), "phases");
+      phases = json_object_get_object_member (json_node_get_object (root), "phases");
+      g_assert (base_phases != NULL);
+
+      members = json_object_get_members (phases);
+
+      for (const GList *iter = members; iter; iter = iter->next)
+        {
+          const gchar *phase = iter->data;
+          const gchar *metric = "usec";
+          JsonObject *base;
+          JsonObject *cur;
+          gint64 base_value;
+          gint64 cur_value;
+
+          if (!json_object_has_member (base_phases, phase))
+            continue;
+
+          base = json_object_get_object_member (base_phases, phase);
+          cur = json_object_get_object_member (phases, phase);
+
+          if (json_object_has_member (cur, "p99_usec"))
+            metric = "p99_usec";
+
+          if (!json_object_has_member (base, metric))
+            continue;
+
+          base_value = json_object_get_int_member (base, metric);
+          cur_value = json_object_get_int_member (cur, metric);
+
+          if (base_value > 0 && cur_value > base_value * tolerance)
+            {
+              g_printerr ("%s regressed: %s is %"G_GINT64_FORMAT", baseline %"G_GINT64_FORMAT"\n",
+                          phase, metric, cur_value, base_value);
+              g_test_fail ();
+            }
+        }
+
+      g_list_free (members);
+    }
+
+  /* Releasing the task frees @bench */
+  g_task_return_boolean (bench->task, TRUE);
+  g_object_unref (bench->task);
+}
+
+static void
+benchmark_ctags_cb (GObject      *object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  Benchmark *bench = user_data;
+  g_autoptr(GObject) index = NULL;
+  g_autoptr(GError) error = NULL;
+
+  index = g_async_initable_new_finish (G_ASYNC_INITABLE (object), result, &error);
+
+  json_builder_set_member_name (bench->builder, "loaded");
+  json_builder_add_boolean_value (bench->builder, index != NULL);
+  if (error != NULL)
+    {
+      json_builder_set_member_name (bench->builder, "error");
+      json_builder_add_string_value (bench->builder, error->message);
+    }
+  benchmark_end_phase (bench);
+
+  benchmark_complete (bench);
+}
+
+static void
+benchmark_ctags (Benchmark *bench)
+{
+  g_autoptr(GFile) tags = NULL;
+  g_autofree gchar *path_root = NULL;
+  GFile *workdir;
+  GType type;
+
+  workdir = ide_vcs_get_working_directory (ide_context_get_vcs (bench->context));
+  tags = g_file_get_child (workdir, "tags");
+  path_root = g_file_get_path (workdir);
+
+  /* The ctags plugin is loaded dynamically, so look the type up by name */
+  type = g_type_from_name ("IdeCtagsIndex");
+
+  benchmark_begin_phase (bench, "ctags_load");
+
+  if (type == G_TYPE_INVALID || !g_file_query_exists (tags, NULL))
+    {
+      json_builder_set_member_name (bench->builder, "skipped");
+      json_builder_add_boolean_value (bench->builder, TRUE);
+      benchmark_end_phase (bench);
+      benchmark_complete (bench);
+      return;
+    }
+
+  g_async_initable_new_async (type,
+                              G_PRIORITY_DEFAULT,
+                              g_task_get_cancellable (bench->task),
+                              benchmark_ctags_cb,
+                              bench,
+                              "file", tags,
+                              "path-root", path_root,
+                              "mtime", (guint64)0,
+                              NULL);
+}
+
+static void
+benchmark_build_flags_cb (GObject      *object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  IdeBuildSystem *build_system = (IdeBuildSystem *)object;
+  Benchmark *bench = user_data;
+  g_auto(GStrv) flags = NULL;
+  gint64 elapsed;
+
+  flags = ide_build_system_get_build_flags_finish (build_system, result, NULL);
+  elapsed = g_get_monotonic_time () - bench->begin;
+  g_array_append_val (bench->samples, elapsed);
+
+  if (flags == NULL)
+    bench->n_failed++;
+
+  bench->index++;
+
+  benchmark_build_flags_next (bench);
+}
+
+static void
+benchmark_build_flags_next (Benchmark *bench)
+{
+  IdeBuildSystem *build_system;
+  g_autoptr(IdeFile) file = NULL;
+
+  /* Look every file up twice, the first pass warms any caches */
+  if (bench->index == bench->files->len || bench->index == bench->files->len * 2)
+    {
+      json_builder_set_member_name (bench->builder, "lookups");
+      json_builder_add_int_value (bench->builder, bench->samples->len);
+      json_builder_set_member_name (bench->builder, "failed");
+      json_builder_add_int_value (bench->builder, bench->n_failed);
+      add_samples (bench->builder, bench->samples);
+      benchmark_end_phase (bench);
+
+      g_array_set_size (bench->samples, 0);
+      bench->n_failed = 0;
+
+      if (bench->index == bench->files->len * 2 || bench->files->len == 0)
+        {
+          benchmark_ctags (bench);
+          return;
+        }
+
+      benchmark_begin_phase (bench, "build_flags_warm");
+    }
+
+  build_system = ide_context_get_build_system (bench->context);
+  file = ide_file_new (bench->context, g_ptr_array_index (bench->files, bench->index % bench->files->len));
+
+  bench->begin = g_get_monotonic_time ();
+
+  ide_build_system_get_build_flags_async (build_system,
+                                          file,
+                                          g_task_get_cancellable (bench->task),
+                                          benchmark_build_flags_cb,
+                                          bench);
+}
+
+static void
+benchmark_build_flags (Benchmark *bench)
+{
+  g_array_set_size (bench->samples, 0);
+  bench->index = 0;
+  bench->n_failed = 0;
+
+  benchmark_begin_phase (bench, "build_flags_cold");
+  benchmark_build_flags_next (bench);
+}
+
+static void
+benchmark_search_finish (Benchmark *bench)
+{
+  gint64 elapsed = g_get_monotonic_time () - bench->begin;
+
+  g_array_append_val (bench->samples, elapsed);
+
+  if (bench->timeout_id != 0)
+    {
+      g_source_remove (bench->timeout_id);
+      bench->timeout_id = 0;
+    }
+
+  g_signal_handlers_disconnect_by_data (bench->search, bench);
+  g_clear_object (&bench->search);
+
+  bench->index++;
+
+  benchmark_search_next (bench);
+}
+
+static gboolean
+benchmark_search_timeout (gpointer data)
+{
+  Benchmark *bench = data;
+
+  bench->timeout_id = 0;
+  bench->n_failed++;
+  g_signal_handlers_disconnect_by_data (bench->search, bench);
+  ide_search_context_cancel (bench->search);
+  benchmark_search_finish (bench);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+benchmark_search_finish_idle (gpointer data)
+{
+  benchmark_search_finish (data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+benchmark_search_completed (IdeSearchContext *search,
+                            Benchmark        *bench)
+{
+  g_signal_handlers_disconnect_by_data (search, bench);
+
+  /* Don't let the timeout finish this search a second time */
+  if (bench->timeout_id != 0)
+    {
+      g_source_remove (bench->timeout_id);
+      bench->timeout_id = 0;
+    }
+
+  /* Let the search context finish emitting before we drop it */
+  g_idle_add_full (G_PRIORITY_HIGH, benchmark_search_finish_idle, bench, NULL);
+}
+
+static void
+benchmark_search_next (Benchmark *bench)
+{
+  IdeSearchEngine *engine;
+  g_autofree gchar *query = NULL;
+  g_autofree gchar *basename = NULL;
+  GFile *file;
+
+  if (bench->index == (guint)n_queries || bench->files->len == 0)
+    {
+      json_builder_set_member_name (bench->builder, "queries");
+      json_builder_add_int_value (bench->builder, bench->samples->len);
+      json_builder_set_member_name (bench->builder, "timed_out");
+      json_builder_add_int_value (bench->builder, bench->n_failed);
+      add_samples (bench->builder, bench->samples);
+      benchmark_end_phase (bench);
+
+      benchmark_build_flags (bench);
+      return;
+    }
+
+  /* Alternate between fuzzy prefixes and full names of project files */
+  file = g_ptr_array_index (bench->files, (bench->index * 7919) % bench->files->len);
+  basename = g_file_get_basename (file);
+  if (bench->index % 2 == 0 && strlen (basename) > 3)
+    query = g_strndup (basename, 3 + bench->index % (strlen (basename) - 3));
+  else
+    query = g_steal_pointer (&basename);
+
+  engine = ide_context_get_search_engine (bench->context);
+  bench->search = ide_search_engine_search (engine, query);
+
+  if (bench->search == NULL)
+    {
+      bench->index = n_queries;
+      benchmark_search_next (bench);
+      return;
+    }
+
+  g_signal_connect (bench->search,
+                    "completed",
+                    G_CALLBACK (benchmark_search_completed),
+                    bench);
+
+  bench->timeout_id = g_timeout_add (SEARCH_TIMEOUT_MSEC, benchmark_search_timeout, bench);
+  bench->begin = g_get_monotonic_time ();
+
+  ide_search_context_execute (bench->search, query, 100);
+}
+
+static void
+benchmark_search (Benchmark *bench)
+{
+  g_array_set_size (bench->samples, 0);
+  bench->index = 0;
+  bench->n_failed = 0;
+
+  benchmark_begin_phase (bench, "search");
+  benchmark_search_next (bench);
+}
+
+static void
+list_files (Benchmark *bench,
+            IdeVcs    *vcs,
+            GFile     *dir)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  GFileInfo *info;
+
+  enumerator = g_file_enumerate_children (dir,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          NULL, NULL);
+
+  while (enumerator != NULL &&
+         NULL != (info = g_file_enumerator_next_file (enumerator, NULL, NULL)))
+    {
+      g_autoptr(GFile) child = g_file_get_child (dir, g_file_info_get_name (info));
+
+      if (!ide_vcs_is_ignored (vcs, child, NULL))
+        {
+          if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+            list_files (bench, vcs, child);
+          else if (g_str_has_suffix (g_file_info_get_name (info), ".c"))
+            g_ptr_array_add (bench->files, g_steal_pointer (&child));
+        }
+
+      g_object_unref (info);
+    }
+}
+
+static void
+benchmark_list_files (Benchmark *bench)
+{
+  IdeVcs *vcs = ide_context_get_vcs (bench->context);
+
+  benchmark_begin_phase (bench, "file_listing");
+  list_files (bench, vcs, ide_vcs_get_working_directory (vcs));
+  json_builder_set_member_name (bench->builder, "files");
+  json_builder_add_int_value (bench->builder, bench->files->len);
+  benchmark_end_phase (bench);
+
+  benchmark_search (bench);
+}
+
+static void
+benchmark_context_cb (GObject      *object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  Benchmark *bench = user_data;
+  g_autoptr(GError) error = NULL;
+
+  bench->context = ide_context_new_finish (result, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_CONTEXT (bench->context));
+
+  json_builder_set_member_name (bench->builder, "build_system");
+  json_builder_add_string_value (bench->builder, G_OBJECT_TYPE_NAME (ide_context_get_build_system (bench->context)));
+  json_builder_set_member_name (bench->builder, "vcs");
+  json_builder_add_string_value (bench->builder, G_OBJECT_TYPE_NAME (ide_context_get_vcs (bench->context)));
+  benchmark_end_phase (bench);
+
+  benchmark_list_files (bench);
+}
+
+static void
+test_benchmark (GCancellable        *cancellable,
+                GAsyncReadyCallback  callback,
+                gpointer             user_data)
+{
+  g_autofree gchar *path = NULL;
+  Benchmark *bench;
+
+  bench = g_slice_new0 (Benchmark);
+  bench->task = g_task_new (NULL, cancellable, callback, user_data);
+  bench->files = g_ptr_array_new_with_free_func (g_object_unref);
+  bench->samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  bench->builder = json_builder_new ();
+
+  g_object_set_data_full (G_OBJECT (bench->task), "BENCHMARK", bench, benchmark_free);
+
+  if (project_path != NULL)
+    bench->project_file = g_file_new_for_commandline_arg (project_path);
+  else
+    bench->project_file = generate_project ();
+
+  path = g_file_get_path (bench->project_file);
+
+  json_builder_begin_object (bench->builder);
+  json_builder_set_member_name (bench->builder, "project");
+  json_builder_add_string_value (bench->builder, path);
+  json_builder_set_member_name (bench->builder, "synthetic");
+  json_builder_add_boolean_value (bench->builder, project_path == NULL);
+  json_builder_set_member_name (bench->builder, "phases");
+  json_builder_begin_object (bench->builder);
+
+  benchmark_begin_phase (bench, "context_init");
+
+  ide_context_new_async (bench->project_file,
+                         cancellable,
+                         benchmark_context_cb,
+                         bench);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFile) synthetic = NULL;
+  IdeApplication *app;
+  gint ret;
+  const GOptionEntry entries[] = {
+    { "project", 'p', 0, G_OPTION_ARG_FILENAME, &project_path, "Benchmark an existing project instead of a synthetic one", "PATH" },
+    { "files", 'f', 0, G_OPTION_ARG_INT, &n_files, "Number of source files in the synthetic project", "200" },
+    { "dirs", 'd', 0, G_OPTION_ARG_INT, &n_dirs, "Number of directories in the synthetic project", "10" },
+    { "queries", 'q', 0, G_OPTION_ARG_INT, &n_queries, "Number of search queries to run", "50" },
+    { "json", 'j', 0, G_OPTION_ARG_FILENAME, &json_path, "Write the results to FILE", "FILE" },
+    { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline_path, "Fail if slower than the results in FILE", "FILE" },
+    { "tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &tolerance, "Allowed slowdown relative to the baseline", "2.0" },
+    { "keep", 0, 0, G_OPTION_ARG_NONE, &keep, "Do not remove the synthetic project" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark loading a project");
+  g_option_context_add_main_entries (context, entries, NULL);
+  /* Leave the GTest options for g_test_init() */
+  g_option_context_set_ignore_unknown_options (context, TRUE);
+  g_option_context_set_help_enabled (context, FALSE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  /* The checked in baseline only describes the default synthetic project */
+  if (baseline_path == NULL && project_path == NULL &&
+      n_files == DEFAULT_N_FILES &&
+      n_dirs == DEFAULT_N_DIRS &&
+      n_queries == DEFAULT_N_QUERIES)
+    baseline_path = g_strdup (g_getenv ("IDE_BENCHMARK_BASELINE"));
+
+  n_files = MAX (1, n_files);
+  n_dirs = CLAMP (n_dirs, 1, n_files);
+  n_queries = MAX (0, n_queries);
+
+  g_test_init (&argc, &argv, NULL);
+
+  ide_log_init (TRUE, NULL);
+
+  app = ide_application_new ();
+  ide_application_add_test (app, "/Ide/Benchmark/project", test_benchmark, NULL);
+  ret = g_application_run (G_APPLICATION (app), argc, argv);
+  g_object_unref (app);
+
+  if (synthetic_path != NULL && !keep)
+    {
+      synthetic = g_file_new_for_path (synthetic_path);
+      remove_recursive (synthetic);
+    }
+
+  return ret;
+}
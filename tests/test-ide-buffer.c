@@ -23,6 +23,7 @@
 #include <ide.h>
 
 #include "application/ide-application-tests.h"
+#include "ide-internal.h"
 
 static void
 test_buffer_basic_cb2 (GObject      *object,
@@ -100,6 +101,146 @@ test_buffer_basic (GCancellable        *cancellable,
   IDE_EXIT;
 }
 
+static IdeDiagnostic *
+create_diagnostic (IdeBuffer             *buffer,
+                   IdeDiagnosticSeverity  severity,
+                   guint                  line)
+{
+  g_autoptr(IdeSourceLocation) location = NULL;
+
+  location = ide_source_location_new (ide_buffer_get_file (buffer), line, 0, 0);
+
+  return ide_diagnostic_new (severity, "test diagnostic", location);
+}
+
+static void
+test_buffer_line_flags_snapshot_cb2 (GObject      *object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data)
+{
+  IdeBufferManager *manager = (IdeBufferManager *)object;
+  static const IdeBufferLineFlags expected[] = {
+    0,
+    IDE_BUFFER_LINE_FLAGS_ERROR,
+    IDE_BUFFER_LINE_FLAGS_ERROR,
+    0,
+    IDE_BUFFER_LINE_FLAGS_WARNING,
+    0,
+    0,
+  };
+  const IdeBufferLineFlags mask = IDE_BUFFER_LINE_FLAGS_ERROR | IDE_BUFFER_LINE_FLAGS_WARNING;
+  g_autoptr(IdeBuffer) ret = NULL;
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(IdeBufferLineFlagsSnapshot) snapshot = NULL;
+  g_autoptr(IdeBufferLineFlagsSnapshot) shifted = NULL;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
+  GPtrArray *ar;
+  GError *error = NULL;
+  guint line_count;
+  guint i;
+
+  IDE_ENTRY;
+
+  ret = ide_buffer_manager_load_file_finish (manager, result, &error);
+  g_assert_no_error (error);
+  g_assert (ret);
+  g_assert (IDE_IS_BUFFER (ret));
+
+  gtk_text_buffer_set_text (GTK_TEXT_BUFFER (ret), "a\nb\nc\nd\ne\nf\n", -1);
+  line_count = gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (ret));
+  g_assert_cmpint (line_count, ==, G_N_ELEMENTS (expected));
+
+  ar = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_diagnostic_unref);
+  g_ptr_array_add (ar, create_diagnostic (ret, IDE_DIAGNOSTIC_ERROR, 1));
+  g_ptr_array_add (ar, create_diagnostic (ret, IDE_DIAGNOSTIC_ERROR, 2));
+  g_ptr_array_add (ar, create_diagnostic (ret, IDE_DIAGNOSTIC_WARNING, 4));
+  diagnostics = ide_diagnostics_new (ar);
+  _ide_buffer_set_diagnostics (ret, diagnostics);
+
+  snapshot = ide_buffer_get_line_flags_snapshot (ret, 0, line_count - 1);
+
+  /* Each run boundary must match the diagnostics and the per-line lookup */
+  for (i = 0; i < line_count; i++)
+    {
+      IdeBufferLineFlags flags = ide_buffer_line_flags_snapshot_get (snapshot, i);
+
+      g_assert_cmpint (flags, ==, ide_buffer_get_line_flags (ret, i));
+      g_assert_cmpint (flags & mask, ==, expected [i]);
+    }
+
+  /* Lines past the end of the buffer and past the snapshot have no flags */
+  g_assert_cmpint (ide_buffer_line_flags_snapshot_get (snapshot, line_count), ==, 0);
+  g_assert_cmpint (ide_buffer_line_flags_snapshot_get (snapshot, line_count + 1000), ==, 0);
+  g_assert_cmpint (ide_buffer_line_flags_snapshot_get (snapshot, G_MAXUINT), ==, 0);
+
+  /* Lines before the start of the snapshot have no flags either */
+  shifted = ide_buffer_get_line_flags_snapshot (ret, 1000, 1100);
+  g_assert (shifted != snapshot);
+  for (i = 0; i < line_count; i++)
+    g_assert_cmpint (ide_buffer_line_flags_snapshot_get (shifted, i), ==, 0);
+
+  /* The earlier snapshot is immutable */
+  g_assert_cmpint (ide_buffer_line_flags_snapshot_get (snapshot, 1) & mask, ==, IDE_BUFFER_LINE_FLAGS_ERROR);
+
+  g_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+static void
+test_buffer_line_flags_snapshot_cb1 (GObject      *object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(IdeFile) file = NULL;
+  g_autoptr(IdeContext) context = NULL;
+  IdeBufferManager *manager;
+  IdeProject *project;
+  GError *error = NULL;
+
+  IDE_ENTRY;
+
+  context = ide_context_new_finish (result, &error);
+  g_assert_no_error (error);
+  g_assert (context != NULL);
+  g_assert (IDE_IS_CONTEXT (context));
+
+  manager = ide_context_get_buffer_manager (context);
+  project = ide_context_get_project (context);
+  file = ide_project_get_file_for_path (project, "test-ide-buffer-snapshot.tmp");
+
+  ide_buffer_manager_load_file_async (manager,
+                                      file,
+                                      FALSE,
+                                      IDE_WORKBENCH_OPEN_FLAGS_NONE,
+                                      NULL,
+                                      g_task_get_cancellable (task),
+                                      test_buffer_line_flags_snapshot_cb2,
+                                      g_object_ref (task));
+
+  IDE_EXIT;
+}
+
+static void
+test_buffer_line_flags_snapshot (GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_autoptr(GFile) project_file = NULL;
+  g_autofree gchar *path = NULL;
+  GTask *task;
+
+  IDE_ENTRY;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  path = g_build_filename (TEST_DATA_DIR, "project1", "configure.ac", NULL);
+  project_file = g_file_new_for_path (path);
+  ide_context_new_async (project_file, cancellable, test_buffer_line_flags_snapshot_cb1, task);
+
+  IDE_EXIT;
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
@@ -114,6 +255,7 @@ main (gint   argc,
 
   app = ide_application_new ();
   ide_application_add_test (app, "/Ide/Buffer/basic", test_buffer_basic, NULL);
+  ide_application_add_test (app, "/Ide/Buffer/line-flags-snapshot", test_buffer_line_flags_snapshot, NULL);
   ret = g_application_run (G_APPLICATION (app), argc, argv);
   g_object_unref (app);
 
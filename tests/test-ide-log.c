@@ -0,0 +1,138 @@
+/* test-ide-log.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures how long the calling thread spends inside g_message() with the
+ * synchronous and asynchronous ide_log_handler() modes, optionally with
+ * other threads logging at the same time.
+ */
+
+#include <ide.h>
+#include <stdlib.h>
+
+static guint    n_messages = 100000;
+static guint    n_threads;
+static gboolean repeat;
+
+static gint
+compare_gint64 (gconstpointer a,
+                gconstpointer b)
+{
+  const gint64 *ia = a;
+  const gint64 *ib = b;
+
+  return (*ia > *ib) - (*ia < *ib);
+}
+
+static gpointer
+noise_worker (gpointer data)
+{
+  volatile gint *running = data;
+  guint i = 0;
+
+  while (g_atomic_int_get (running))
+    g_message ("background message %u", i++);
+
+  return NULL;
+}
+
+static void
+run (const gchar *name,
+     gboolean     async_)
+{
+  g_autofree gint64 *samples = g_new (gint64, n_messages);
+  g_autoptr(GPtrArray) threads = g_ptr_array_new ();
+  volatile gint running = TRUE;
+  gint64 total = 0;
+  gint64 begin;
+
+  ide_log_set_async (async_);
+
+  for (guint i = 0; i < n_threads; i++)
+    g_ptr_array_add (threads, g_thread_new ("noise", noise_worker, (gpointer)&running));
+
+  for (guint i = 0; i < n_messages; i++)
+    {
+      begin = g_get_monotonic_time ();
+      if (repeat)
+        g_message ("the same message, over and over");
+      else
+        g_message ("message number %u from the main thread", i);
+      samples[i] = g_get_monotonic_time () - begin;
+      total += samples[i];
+    }
+
+  g_atomic_int_set (&running, FALSE);
+  for (guint i = 0; i < threads->len; i++)
+    g_thread_join (g_ptr_array_index (threads, i));
+
+  /* Include draining the queue, so nothing is left for the next run */
+  begin = g_get_monotonic_time ();
+  ide_log_set_async (FALSE);
+
+  qsort (samples, n_messages, sizeof (gint64), compare_gint64);
+
+  g_printerr ("%-6s: %u messages, mean %.2lf usec, p50 %"G_GINT64_FORMAT" usec, "
+              "p99 %"G_GINT64_FORMAT" usec, max %"G_GINT64_FORMAT" usec, "
+              "drain %"G_GINT64_FORMAT" usec\n",
+              name,
+              n_messages,
+              total / (gdouble)n_messages,
+              samples[n_messages / 2],
+              samples[(gsize)(n_messages * .99)],
+              samples[n_messages - 1],
+              g_get_monotonic_time () - begin);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *output = NULL;
+  const GOptionEntry entries[] = {
+    { "messages", 'n', 0, G_OPTION_ARG_INT, &n_messages, "Number of messages to log", "100000" },
+    { "threads", 't', 0, G_OPTION_ARG_INT, &n_threads, "Number of threads logging concurrently", "0" },
+    { "repeat", 'r', 0, G_OPTION_ARG_NONE, &repeat, "Log the same message every time" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "File to log to", "/dev/null" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark ide_log_handler()");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (n_messages == 0)
+    n_messages = 1;
+
+  ide_log_init (FALSE, output ? output : "/dev/null");
+  ide_log_set_verbosity (1);
+
+  run ("sync", FALSE);
+  run ("async", TRUE);
+
+  ide_log_shutdown ();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+/* test-ide-search-reducer.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares IdeSearchReducer with the GSequence based reducer it replaced,
+ * feeding both the same candidates, in random order and in ascending score
+ * order (where every candidate is accepted).
+ */
+
+#include <ide.h>
+#include <stdlib.h>
+
+static gint max_results = 100;
+static gint n_rounds = 5;
+
+static guint n_added;
+static guint n_removed;
+
+#define TEST_TYPE_PROVIDER (test_provider_get_type())
+G_DECLARE_FINAL_TYPE (TestProvider, test_provider, TEST, PROVIDER, IdeObject)
+
+struct _TestProvider
+{
+  IdeObject parent_instance;
+};
+
+static void search_provider_iface_init (IdeSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestProvider, test_provider, IDE_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_SEARCH_PROVIDER, search_provider_iface_init))
+
+static void search_provider_iface_init (IdeSearchProviderInterface *iface) { }
+static void test_provider_class_init (TestProviderClass *klass) { }
+static void test_provider_init (TestProvider *self) { }
+
+/* The reducer as it was before using a heap */
+typedef struct
+{
+  IdeSearchContext  *context;
+  IdeSearchProvider *provider;
+  GSequence         *sequence;
+  gsize              max_results;
+} SequenceReducer;
+
+static gboolean
+sequence_reducer_accepts (SequenceReducer *reducer,
+                          gfloat           score)
+{
+  GSequenceIter *iter;
+
+  if (g_sequence_get_length (reducer->sequence) < reducer->max_results)
+    return TRUE;
+
+  iter = g_sequence_get_begin_iter (reducer->sequence);
+
+  return score > ide_search_result_get_score (g_sequence_get (iter));
+}
+
+static void
+sequence_reducer_push (SequenceReducer *reducer,
+                       IdeSearchResult *result)
+{
+  if (reducer->max_results <= g_sequence_get_length (reducer->sequence))
+    {
+      GSequenceIter *iter;
+
+      iter = g_sequence_get_begin_iter (reducer->sequence);
+      ide_search_context_remove_result (reducer->context, reducer->provider, g_sequence_get (iter));
+      g_sequence_remove (iter);
+    }
+
+  g_sequence_insert_sorted (reducer->sequence,
+                            g_object_ref (result),
+                            (GCompareDataFunc)ide_search_result_compare,
+                            NULL);
+  ide_search_context_add_result (reducer->context, reducer->provider, result);
+}
+
+static void
+result_added_cb (void)
+{
+  n_added++;
+}
+
+static void
+result_removed_cb (void)
+{
+  n_removed++;
+}
+
+static gint64
+run_sequence (IdeSearchContext  *context,
+              IdeSearchProvider *provider,
+              GPtrArray         *results)
+{
+  SequenceReducer reducer = { context, provider, g_sequence_new (g_object_unref), max_results };
+  gint64 begin = g_get_monotonic_time ();
+  gint64 end;
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      IdeSearchResult *result = g_ptr_array_index (results, i);
+
+      if (sequence_reducer_accepts (&reducer, ide_search_result_get_score (result)))
+        sequence_reducer_push (&reducer, result);
+    }
+
+  end = g_get_monotonic_time ();
+  g_sequence_free (reducer.sequence);
+
+  return end - begin;
+}
+
+static gint64
+run_heap (IdeSearchContext  *context,
+          IdeSearchProvider *provider,
+          GPtrArray         *results)
+{
+  IdeSearchReducer reducer;
+  gint64 begin = g_get_monotonic_time ();
+  gint64 end;
+
+  ide_search_reducer_init (&reducer, context, provider, max_results);
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      IdeSearchResult *result = g_ptr_array_index (results, i);
+
+      if (ide_search_reducer_accepts (&reducer, ide_search_result_get_score (result)))
+        ide_search_reducer_push (&reducer, result);
+    }
+
+  ide_search_reducer_flush (&reducer);
+
+  end = g_get_monotonic_time ();
+  ide_search_reducer_destroy (&reducer);
+
+  return end - begin;
+}
+
+static gint
+compare_score (gconstpointer a,
+               gconstpointer b)
+{
+  return ide_search_result_compare (*(IdeSearchResult **)a, *(IdeSearchResult **)b);
+}
+
+static void
+run (IdeSearchContext  *context,
+     IdeSearchProvider *provider,
+     GPtrArray         *results,
+     const gchar       *order)
+{
+  gint64 sequence_usec = G_MAXINT64;
+  gint64 heap_usec = G_MAXINT64;
+  guint sequence_signals = 0;
+  guint heap_signals = 0;
+
+  for (gint round = 0; round < n_rounds; round++)
+    {
+      n_added = n_removed = 0;
+      sequence_usec = MIN (sequence_usec, run_sequence (context, provider, results));
+      sequence_signals = n_added + n_removed;
+
+      n_added = n_removed = 0;
+      heap_usec = MIN (heap_usec, run_heap (context, provider, results));
+      heap_signals = n_added + n_removed;
+    }
+
+  g_print ("%8u %-9s gsequence %8.2lf msec %7u signals   heap %8.2lf msec %7u signals   %5.1lfx\n",
+           results->len, order,
+           sequence_usec / 1000.0, sequence_signals,
+           heap_usec / 1000.0, heap_signals,
+           heap_usec > 0 ? sequence_usec / (gdouble)heap_usec : 0.0);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(IdeSearchContext) search_context = NULL;
+  g_autoptr(TestProvider) provider = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GRand) rand = NULL;
+  gint max_count = 1000000;
+  const GOptionEntry entries[] = {
+    { "max-results", 'm', 0, G_OPTION_ARG_INT, &max_results, "Number of results kept by the reducer", "100" },
+    { "count", 'c', 0, G_OPTION_ARG_INT, &max_count, "Largest number of candidates", "1000000" },
+    { "rounds", 'r', 0, G_OPTION_ARG_INT, &n_rounds, "Number of rounds, the best is reported", "5" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark search result reducers");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  max_results = MAX (1, max_results);
+  n_rounds = MAX (1, n_rounds);
+
+  /* Registers the main thread used by IDE_IS_MAIN_THREAD() */
+  g_type_class_unref (g_type_class_ref (IDE_TYPE_APPLICATION));
+
+  provider = g_object_new (TEST_TYPE_PROVIDER, NULL);
+  search_context = g_object_new (IDE_TYPE_SEARCH_CONTEXT, NULL);
+  g_signal_connect (search_context, "result-added", G_CALLBACK (result_added_cb), NULL);
+  g_signal_connect (search_context, "result-removed", G_CALLBACK (result_removed_cb), NULL);
+
+  rand = g_rand_new_with_seed (42);
+
+  g_print ("keeping %d results, best of %d rounds\n", max_results, n_rounds);
+
+  for (gint count = 1000; count <= max_count; count *= 10)
+    {
+      g_autoptr(GPtrArray) results = g_ptr_array_new_with_free_func (g_object_unref);
+
+      for (gint i = 0; i < count; i++)
+        g_ptr_array_add (results,
+                         ide_search_result_new (IDE_SEARCH_PROVIDER (provider),
+                                                NULL, NULL,
+                                                g_rand_double (rand)));
+
+      run (search_context, IDE_SEARCH_PROVIDER (provider), results, "random");
+
+      g_ptr_array_sort (results, compare_score);
+      run (search_context, IDE_SEARCH_PROVIDER (provider), results, "ascending");
+    }
+
+  return EXIT_SUCCESS;
+}
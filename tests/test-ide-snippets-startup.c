@@ -0,0 +1,227 @@
+/* test-ide-snippets-startup.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the startup cost of IdeSourceSnippetsManager.
+ *
+ * Bundled snippets are compared between parsing every resource up front,
+ * as done before lazy loading, and indexing them. User snippets are
+ * compared between parsing the text files and mapping the compiled cache.
+ * Synthetic user snippets are generated in a temporary configuration
+ * directory, controlled with --files and --snippets.
+ */
+
+#include <glib/gstdio.h>
+#include <ide.h>
+#include <stdlib.h>
+
+#include "snippets/ide-source-snippet-parser.h"
+
+#define SNIPPETS_DIRECTORY "/org/gnome/builder/snippets/"
+
+static gint n_files = 20;
+static gint n_snippets = 100;
+static gint n_rounds = 5;
+
+static gchar *user_path;
+static gchar *cache_path;
+
+/* What the manager constructor did before lazy loading */
+static void
+parse_all_bundled (void)
+{
+  g_auto(GStrv) names = NULL;
+
+  names = g_resources_enumerate_children (SNIPPETS_DIRECTORY, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  if (names == NULL)
+    return;
+
+  for (guint i = 0; names[i]; i++)
+    {
+      g_autoptr(IdeSourceSnippetParser) parser = ide_source_snippet_parser_new ();
+      g_autofree gchar *uri = NULL;
+      g_autoptr(GFile) file = NULL;
+
+      uri = g_strdup_printf ("resource://"SNIPPETS_DIRECTORY"%s", names[i]);
+      file = g_file_new_for_uri (uri);
+      ide_source_snippet_parser_load_from_file (parser, file, NULL);
+    }
+}
+
+static void
+generate_user_snippets (void)
+{
+  for (gint i = 0; i < n_files; i++)
+    {
+      g_autoptr(GString) str = g_string_new (NULL);
+      g_autofree gchar *name = g_strdup_printf ("bench%d.snippets", i);
+      g_autofree gchar *path = g_build_filename (user_path, name, NULL);
+
+      for (gint j = 0; j < n_snippets; j++)
+        g_string_append_printf (str,
+                                "snippet bench%d_%d\n"
+                                "- scope c, chdr\n"
+                                "- desc Benchmark snippet %d\n"
+                                "\tstatic ${1:void}\n"
+                                "\t${2:name}_%d (${3:void})\n"
+                                "\t{\n"
+                                "\t\t$0\n"
+                                "\t}\n",
+                                i, j, j, j);
+
+      g_file_set_contents (path, str->str, str->len, NULL);
+    }
+}
+
+static void
+clear_compiled (void)
+{
+  g_autoptr(GDir) dir = g_dir_open (cache_path, 0, NULL);
+  const gchar *name;
+
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      g_autofree gchar *path = g_build_filename (cache_path, name, NULL);
+
+      g_unlink (path);
+    }
+}
+
+static void
+load_cb (GObject      *object,
+         GAsyncResult *result,
+         gpointer      user_data)
+{
+  GMainLoop *main_loop = user_data;
+
+  ide_source_snippets_manager_load_finish (IDE_SOURCE_SNIPPETS_MANAGER (object), result, NULL);
+  g_main_loop_quit (main_loop);
+}
+
+static gint64
+load_user (void)
+{
+  g_autoptr(IdeSourceSnippetsManager) manager = NULL;
+  g_autoptr(GMainLoop) main_loop = g_main_loop_new (NULL, FALSE);
+  gint64 begin;
+
+  manager = g_object_new (IDE_TYPE_SOURCE_SNIPPETS_MANAGER, NULL);
+
+  begin = g_get_monotonic_time ();
+  ide_source_snippets_manager_load_async (manager, NULL, load_cb, main_loop);
+  g_main_loop_run (main_loop);
+
+  return g_get_monotonic_time () - begin;
+}
+
+static void
+report (const gchar *name,
+        gint64       before,
+        gint64       after)
+{
+  g_print ("%-10s before %8.2lf msec   after %8.2lf msec   saved %8.2lf msec\n",
+           name,
+           before / 1000.0,
+           after / 1000.0,
+           (before - after) / 1000.0);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *config_dir = NULL;
+  g_autofree gchar *cache_dir = NULL;
+  gint64 eager = G_MAXINT64;
+  gint64 lazy = G_MAXINT64;
+  gint64 first_language = G_MAXINT64;
+  gint64 text = G_MAXINT64;
+  gint64 compiled = G_MAXINT64;
+  const GOptionEntry entries[] = {
+    { "files", 'f', 0, G_OPTION_ARG_INT, &n_files, "Number of user snippets files", "20" },
+    { "snippets", 's', 0, G_OPTION_ARG_INT, &n_snippets, "Number of snippets per file", "100" },
+    { "rounds", 'r', 0, G_OPTION_ARG_INT, &n_rounds, "Number of rounds, the best is reported", "5" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark snippets loading at startup");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  n_rounds = MAX (1, n_rounds);
+
+  /* Must happen before GLib caches the user directories */
+  if (!(tmpdir = g_dir_make_tmp ("test-ide-snippets-XXXXXX", &error)))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  config_dir = g_build_filename (tmpdir, "config", NULL);
+  cache_dir = g_build_filename (tmpdir, "cache", NULL);
+  g_setenv ("XDG_CONFIG_HOME", config_dir, TRUE);
+  g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+  user_path = g_build_filename (config_dir, ide_get_program_name (), "snippets", NULL);
+  cache_path = g_build_filename (cache_dir, ide_get_program_name (), "snippets", NULL);
+  g_mkdir_with_parents (user_path, 0700);
+  generate_user_snippets ();
+
+  for (gint round = 0; round < n_rounds; round++)
+    {
+      g_autoptr(IdeSourceSnippetsManager) manager = NULL;
+      gint64 begin;
+
+      begin = g_get_monotonic_time ();
+      parse_all_bundled ();
+      eager = MIN (eager, g_get_monotonic_time () - begin);
+
+      begin = g_get_monotonic_time ();
+      manager = g_object_new (IDE_TYPE_SOURCE_SNIPPETS_MANAGER, NULL);
+      lazy = MIN (lazy, g_get_monotonic_time () - begin);
+
+      begin = g_get_monotonic_time ();
+      ide_source_snippets_manager_get_for_language_id (manager, "c");
+      first_language = MIN (first_language, g_get_monotonic_time () - begin);
+
+      clear_compiled ();
+      text = MIN (text, load_user ());
+      compiled = MIN (compiled, load_user ());
+    }
+
+  g_print ("best of %d rounds, %d user files with %d snippets each\n",
+           n_rounds, n_files, n_snippets);
+  report ("bundled", eager, lazy);
+  g_print ("%-10s first request for C snippets %8.2lf msec\n", "", first_language / 1000.0);
+  report ("user", text, compiled);
+
+  clear_compiled ();
+
+  return EXIT_SUCCESS;
+}
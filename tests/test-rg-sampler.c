@@ -0,0 +1,156 @@
+/* test-rg-sampler.c
+ *
+ * Copyright (C) 2016 Christian Hergert <christian@hergert.me>
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the CPU time spent per RgSampler tick as the number of metrics
+ * grows. Each round subscribes twice as many tables as the previous one,
+ * alternating between the CPU and memory sources, and runs --ticks ticks.
+ * The CPU time includes the sampling thread, so it covers the pread(), the
+ * scanner and the batched push into the tables.
+ */
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "rg-sampler.h"
+
+static gint n_ticks = 100;
+static gint max_tables = 256;
+static gint interval_msec = 5;
+
+static gint64
+get_cpu_time (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void
+sampled_cb (RgSampler *sampler,
+            GMainLoop *main_loop)
+{
+  static gint count;
+
+  if (++count >= n_ticks)
+    {
+      count = 0;
+      g_main_loop_quit (main_loop);
+    }
+}
+
+static RgTable *
+create_table (RgSampler       *sampler,
+              RgSamplerSource  source)
+{
+  RgTable *table;
+  guint n_values;
+  guint i;
+
+  table = g_object_new (RG_TYPE_TABLE,
+                        "max-samples", 120,
+                        "timespan", (GTimeSpan)(60 * G_USEC_PER_SEC),
+                        NULL);
+
+  n_values = rg_sampler_get_n_values (sampler, source);
+
+  for (i = 0; i < n_values; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("Value %u", i);
+      RgColumn *column = rg_column_new (name, G_TYPE_DOUBLE);
+
+      rg_table_add_column (table, column);
+      g_object_unref (column);
+    }
+
+  rg_sampler_add_table (sampler, table, source, interval_msec);
+
+  return table;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  const GOptionEntry entries[] = {
+    { "ticks", 't', 0, G_OPTION_ARG_INT, &n_ticks, "Number of ticks per round", "100" },
+    { "max-tables", 'm', 0, G_OPTION_ARG_INT, &max_tables, "Number of tables in the last round", "256" },
+    { "interval", 'i', 0, G_OPTION_ARG_INT, &interval_msec, "Tick interval in milliseconds", "5" },
+    { NULL }
+  };
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GMainLoop) main_loop = NULL;
+  g_autoptr(GPtrArray) tables = NULL;
+  g_autoptr(GError) error = NULL;
+  RgSampler *sampler;
+  gint n_tables;
+
+  context = g_option_context_new ("- benchmark the shared /proc sampler");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (n_ticks <= 0 || max_tables <= 0 || interval_msec <= 0)
+    {
+      g_printerr ("--ticks, --max-tables and --interval must be positive\n");
+      return EXIT_FAILURE;
+    }
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+  sampler = rg_sampler_get_default ();
+  tables = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_signal_connect (sampler, "sampled", G_CALLBACK (sampled_cb), main_loop);
+
+  g_print ("%8s %8s %14s\n", "tables", "metrics", "cpu usec/tick");
+
+  for (n_tables = 1; n_tables <= max_tables; n_tables *= 2)
+    {
+      guint n_metrics = 0;
+      gint64 cpu_begin;
+      guint i;
+
+      while (tables->len < (guint)n_tables)
+        {
+          RgSamplerSource source = (tables->len % 2) ? RG_SAMPLER_MEMORY : RG_SAMPLER_CPU;
+
+          g_ptr_array_add (tables, create_table (sampler, source));
+        }
+
+      for (i = 0; i < tables->len; i++)
+        n_metrics += rg_sampler_get_n_values (sampler, (i % 2) ? RG_SAMPLER_MEMORY : RG_SAMPLER_CPU);
+
+      cpu_begin = get_cpu_time ();
+
+      g_main_loop_run (main_loop);
+
+      g_print ("%8d %8u %14.1f\n",
+               n_tables,
+               n_metrics,
+               (get_cpu_time () - cpu_begin) / (gdouble)n_ticks);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/* ide-convert-back-forward-list.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Converts back/forward lists written in the previous text format to the
+ * binary journal. Builder converts a project's history the next time it is
+ * closed, this converts every file up front. Without arguments, all of the
+ * histories in the user's cache directory are converted.
+ */
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "history/ide-back-forward-journal.h"
+
+static gboolean dump;
+
+static GOptionEntry entries[] = {
+  { "dump", 'd', 0, G_OPTION_ARG_NONE, &dump,
+    "Print the items of each file instead of converting it" },
+  { NULL }
+};
+
+static gboolean
+dump_file (const gchar *path)
+{
+  g_autoptr(IdeBackForwardJournal) journal = _ide_back_forward_journal_new ();
+  g_autoptr(GFile) file = g_file_new_for_path (path);
+  g_autoptr(GError) error = NULL;
+  GPtrArray *items;
+  guint i;
+
+  if (!_ide_back_forward_journal_load (journal, file, &error))
+    {
+      fprintf (stderr, "%s: %s\n", path, error->message);
+      return FALSE;
+    }
+
+  items = _ide_back_forward_journal_get_entries (journal);
+
+  printf ("%s (%s, %u items)\n",
+          path,
+          _ide_back_forward_journal_is_legacy (journal) ? "text" : "journal",
+          items->len);
+
+  for (i = 0; i < items->len; i++)
+    printf ("  %s\n", (const gchar *)g_ptr_array_index (items, i));
+
+  return TRUE;
+}
+
+static gboolean
+convert_file (const gchar *path)
+{
+  g_autoptr(GFile) file = g_file_new_for_path (path);
+  g_autoptr(GError) error = NULL;
+
+  if (!_ide_back_forward_journal_convert (file, NULL, &error))
+    {
+      fprintf (stderr, "%s: %s\n", path, error->message);
+      return FALSE;
+    }
+
+  printf ("%s\n", path);
+
+  return TRUE;
+}
+
+static GPtrArray *
+find_histories (void)
+{
+  g_autofree gchar *path = NULL;
+  GPtrArray *ret;
+  const gchar *name;
+  GDir *dir;
+
+  ret = g_ptr_array_new_with_free_func (g_free);
+
+  path = g_build_filename (g_get_user_cache_dir (), "gnome-builder", "history", NULL);
+
+  if (NULL == (dir = g_dir_open (path, 0, NULL)))
+    return ret;
+
+  while (NULL != (name = g_dir_read_name (dir)))
+    {
+      if (g_str_has_suffix (name, ".back-forward-list"))
+        g_ptr_array_add (ret, g_build_filename (path, name, NULL));
+    }
+
+  g_dir_close (dir);
+
+  return ret;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GError) error = NULL;
+  gint ret = EXIT_SUCCESS;
+  guint i;
+
+  context = g_option_context_new ("[FILE...] - convert back/forward lists to journals");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (argc > 1)
+    {
+      files = g_ptr_array_new_with_free_func (g_free);
+      for (i = 1; i < (guint)argc; i++)
+        g_ptr_array_add (files, g_strdup (argv [i]));
+    }
+  else
+    {
+      files = find_histories ();
+    }
+
+  for (i = 0; i < files->len; i++)
+    {
+      const gchar *path = g_ptr_array_index (files, i);
+
+      if (!(dump ? dump_file (path) : convert_file (path)))
+        ret = EXIT_FAILURE;
+    }
+
+  return ret;
+}
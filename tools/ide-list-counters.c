@@ -17,11 +17,42 @@
  */
 
 #include "egg-counter.h"
+#include "egg-counter-sampler.h"
 
 #include <errno.h>
+#include <glib-unix.h>
+#include <signal.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef HAVE_SYSPROF
+# include <sysprof.h>
+#endif
+
+static gboolean  watch;
+static gchar    *record;
+static gint      interval = 1000;
+static gint      duration;
+
+static GOptionEntry entries[] = {
+  { "watch", 'w', 0, G_OPTION_ARG_NONE, &watch,
+    "Print the counters which changed, and their rate, at every interval" },
+  { "record", 'r', 0, G_OPTION_ARG_FILENAME, &record,
+    "Sample the counters until interrupted and save them to FILE. "
+    "FILE is written as CSV, or as a sysprof capture if it ends in .syscap", "FILE" },
+  { "interval", 'i', 0, G_OPTION_ARG_INT, &interval,
+    "Milliseconds between samples (default 1000)", "MSEC" },
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+    "Stop sampling after SEC seconds", "SEC" },
+  { NULL }
+};
+
+typedef struct
+{
+  GMainLoop         *main_loop;
+  EggCounterSampler *sampler;
+  gint64             begin_time;
+} Sampling;
 
 static void
 foreach_cb (EggCounter *counter,
@@ -62,17 +93,232 @@ int_parse_with_range (gint        *value,
   return TRUE;
 }
 
+static gboolean
+watch_cb (gpointer data)
+{
+  Sampling *sampling = data;
+  EggCounterSampler *sampler = sampling->sampler;
+  guint n_counters = egg_counter_sampler_get_n_counters (sampler);
+  guint sample;
+
+  egg_counter_sampler_sample (sampler);
+
+  sample = egg_counter_sampler_get_n_samples (sampler) - 1;
+
+  if (sample == 0)
+    return G_SOURCE_CONTINUE;
+
+  g_print ("%.3lf seconds\n",
+           (egg_counter_sampler_get_time (sampler, sample) - sampling->begin_time) / (gdouble)G_USEC_PER_SEC);
+
+  for (guint i = 0; i < n_counters; i++)
+    {
+      EggCounter *counter = egg_counter_sampler_get_counter (sampler, i);
+      gint64 delta = egg_counter_sampler_get_delta (sampler, i, sample);
+
+      if (delta == 0)
+        continue;
+
+      g_print ("  %-20s : %-32s : %20"G_GINT64_FORMAT" : %+12"G_GINT64_FORMAT" : %12.1lf/s\n",
+               counter->category,
+               counter->name,
+               egg_counter_sampler_get_value (sampler, i, sample),
+               delta,
+               egg_counter_sampler_get_rate (sampler, i, sample));
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+quit_cb (gpointer data)
+{
+  Sampling *sampling = data;
+
+  g_main_loop_quit (sampling->main_loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+#ifdef HAVE_SYSPROF
+/*
+ * Writes every sample as a counter frame. Each EggCounter becomes two
+ * sysprof counters: its value, and its rate per second.
+ */
+static gboolean
+write_capture (EggCounterSampler  *sampler,
+               const gchar        *filename,
+               GPid                pid,
+               GError            **error)
+{
+  SpCaptureWriter *writer;
+  SpCaptureCounter *counters;
+  SpCaptureCounterValue *values;
+  guint *ids;
+  guint n_counters = egg_counter_sampler_get_n_counters (sampler);
+  guint n_samples = egg_counter_sampler_get_n_samples (sampler);
+  guint base;
+
+  if (NULL == (writer = sp_capture_writer_new (filename, 0)))
+    {
+      int errsv = errno;
+
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   g_file_error_from_errno (errsv),
+                   "%s", g_strerror (errsv));
+      return FALSE;
+    }
+
+  base = sp_capture_writer_request_counter (writer, n_counters * 2);
+
+  counters = g_new0 (SpCaptureCounter, n_counters * 2);
+  ids = g_new0 (guint, n_counters * 2);
+  values = g_new0 (SpCaptureCounterValue, n_counters * 2);
+
+  for (guint i = 0; i < n_counters; i++)
+    {
+      EggCounter *counter = egg_counter_sampler_get_counter (sampler, i);
+      SpCaptureCounter *value = &counters[i];
+      SpCaptureCounter *rate = &counters[n_counters + i];
+
+      g_strlcpy (value->category, counter->category, sizeof value->category);
+      g_strlcpy (value->name, counter->name, sizeof value->name);
+      g_strlcpy (value->description, counter->description, sizeof value->description);
+      value->id = ids[i] = base + i;
+      value->type = SP_CAPTURE_COUNTER_INT64;
+
+      g_strlcpy (rate->category, counter->category, sizeof rate->category);
+      g_snprintf (rate->name, sizeof rate->name, "%s/s", counter->name);
+      g_strlcpy (rate->description, counter->description, sizeof rate->description);
+      rate->id = ids[n_counters + i] = base + n_counters + i;
+      rate->type = SP_CAPTURE_COUNTER_DOUBLE;
+    }
+
+  if (n_samples > 0)
+    {
+      gint64 time = egg_counter_sampler_get_time (sampler, 0) * 1000;
+
+      for (guint i = 0; i < n_counters; i++)
+        counters[i].value.v64 = egg_counter_sampler_get_value (sampler, i, 0);
+
+      sp_capture_writer_define_counters (writer, time, -1, pid, counters, n_counters * 2);
+    }
+
+  for (guint sample = 1; sample < n_samples; sample++)
+    {
+      gint64 time = egg_counter_sampler_get_time (sampler, sample) * 1000;
+
+      for (guint i = 0; i < n_counters; i++)
+        {
+          values[i].v64 = egg_counter_sampler_get_value (sampler, i, sample);
+          values[n_counters + i].vdbl = egg_counter_sampler_get_rate (sampler, i, sample);
+        }
+
+      sp_capture_writer_set_counters (writer, time, -1, pid, ids, values, n_counters * 2);
+    }
+
+  sp_capture_writer_flush (writer);
+  sp_capture_writer_unref (writer);
+
+  g_free (counters);
+  g_free (ids);
+  g_free (values);
+
+  return TRUE;
+}
+#endif
+
+static gint
+run_sampling (EggCounterArena *arena,
+              GPid             pid)
+{
+  g_autoptr(GError) error = NULL;
+  Sampling sampling = { 0 };
+  guint max_samples = 3600;
+  gint ret = EXIT_SUCCESS;
+
+  if (duration > 0)
+    max_samples = MAX (2, (guint)((gint64)duration * 1000 / interval) + 1);
+
+  sampling.main_loop = g_main_loop_new (NULL, FALSE);
+  sampling.sampler = egg_counter_sampler_new (arena, max_samples);
+  sampling.begin_time = g_get_monotonic_time ();
+
+  if (watch)
+    {
+      egg_counter_sampler_sample (sampling.sampler);
+      g_timeout_add (interval, watch_cb, &sampling);
+    }
+  else
+    {
+      egg_counter_sampler_start (sampling.sampler, interval);
+    }
+
+  if (duration > 0)
+    g_timeout_add_seconds (duration, quit_cb, &sampling);
+
+  g_unix_signal_add (SIGINT, quit_cb, &sampling);
+  g_unix_signal_add (SIGTERM, quit_cb, &sampling);
+
+  g_main_loop_run (sampling.main_loop);
+
+  egg_counter_sampler_stop (sampling.sampler);
+
+  if (record != NULL)
+    {
+#ifdef HAVE_SYSPROF
+      if (g_str_has_suffix (record, ".syscap"))
+        {
+          if (!write_capture (sampling.sampler, record, pid, &error))
+            ret = EXIT_FAILURE;
+        }
+      else
+#endif
+        {
+          g_autofree gchar *csv = egg_counter_sampler_to_csv (sampling.sampler);
+
+          if (!g_file_set_contents (record, csv, -1, &error))
+            ret = EXIT_FAILURE;
+        }
+
+      if (error != NULL)
+        fprintf (stderr, "Failed to write %s: %s\n", record, error->message);
+      else
+        g_print ("Wrote %u samples of %u counters to %s\n",
+                 egg_counter_sampler_get_n_samples (sampling.sampler),
+                 egg_counter_sampler_get_n_counters (sampling.sampler),
+                 record);
+    }
+
+  egg_counter_sampler_unref (sampling.sampler);
+  g_main_loop_unref (sampling.main_loop);
+
+  return ret;
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
 {
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
   EggCounterArena *arena;
   guint n_counters = 0;
   gint pid;
 
-  if (argc != 2)
+  context = g_option_context_new ("<pid> - list the counters of a Builder process");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
     {
-      fprintf (stderr, "usage: %s <pid>\n", argv [0]);
+      fprintf (stderr, "%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (argc != 2 || interval <= 0)
+    {
+      fprintf (stderr, "usage: %s [--watch] [--record=FILE] <pid>\n", argv [0]);
       return EXIT_FAILURE;
     }
 
@@ -93,6 +339,9 @@ main (gint   argc,
       return EXIT_FAILURE;
     }
 
+  if (watch || record != NULL)
+    return run_sampling (arena, pid);
+
   g_print ("%-20s : %-32s : %20s : %-72s\n",
            "      Category",
            "             Name", "Value", "Description");